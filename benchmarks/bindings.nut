@@ -0,0 +1,66 @@
+// Measures the cost of a call to a native function, by timing a loop
+// of calls minus the same loop without them.
+//
+// Run with: engine -data benchmarks -main bindings
+//
+// Run it on builds before and after a change to the bindings to
+// compare them.
+
+const NUM_CALLS = 1000000
+const NUM_RUNS  = 5
+
+function loop_empty(image, a, b) {
+    for (local i = 0; i < NUM_CALLS; ++i) {
+    }
+}
+
+function loop_vec2_add(image, a, b) {
+    for (local i = 0; i < NUM_CALLS; ++i) {
+        a + b
+    }
+}
+
+function loop_draw_image(image, a, b) {
+    for (local i = 0; i < NUM_CALLS; ++i) {
+        DrawImage(image, 0, 0)
+    }
+}
+
+function loop_draw_image_mask(image, a, b) {
+    local mask = CreateColor(255, 255, 255)
+    for (local i = 0; i < NUM_CALLS; ++i) {
+        DrawImage(image, 0, 0, mask)
+    }
+}
+
+function measure(loop, image, a, b) {
+    local best = null
+    for (local i = 0; i < NUM_RUNS; ++i) {
+        local start = GetTicks()
+        loop(image, a, b)
+        local time = GetTicks() - start
+        if (best == null || time < best) {
+            best = time
+        }
+    }
+    return best
+}
+
+function main(...) {
+    local image = Texture(1, 1)
+    local a = Vec2(1, 2)
+    local b = Vec2(3, 4)
+
+    local base = measure(loop_empty, image, a, b)
+    local loops = [
+        ["Vec2._add",              loop_vec2_add],
+        ["DrawImage",              loop_draw_image],
+        ["DrawImage with mask",    loop_draw_image_mask]
+    ]
+    foreach (entry in loops) {
+        local time = measure(entry[1], image, a, b)
+
+        // milliseconds per million calls are nanoseconds per call
+        print(entry[0] + ": " + ((time - base) * 1000000 / NUM_CALLS) + " ns per call\n")
+    }
+}
@@ -0,0 +1,62 @@
+// Measures how long it takes to compile the scripts in common/scripts,
+// read from files through CompileStream.
+//
+// Run with: engine -data benchmarks -main compile
+//
+// Run it on builds before and after a change to the compiler or the
+// source feed to compare them.
+
+const SCRIPT_DIR  = "/common/scripts/"
+const NUM_REPEATS = 20
+const NUM_RUNS    = 5
+
+function get_scripts() {
+    local scripts = []
+    foreach (name in EnumerateFiles(SCRIPT_DIR)) {
+        if (name.len() > 4 && name.slice(-4) == ".nut") {
+            scripts.append(SCRIPT_DIR + name)
+        }
+    }
+    return scripts
+}
+
+function compile_all(scripts, withCount) {
+    foreach (path in scripts) {
+        local file = File.Open(path)
+        if (withCount) {
+            CompileStream(file, path, GetFileSize(path))
+        } else {
+            CompileStream(file, path)
+        }
+        file.close()
+    }
+}
+
+function measure(scripts, withCount) {
+    local best = null
+    for (local i = 0; i < NUM_RUNS; ++i) {
+        local start = GetTicks()
+        for (local j = 0; j < NUM_REPEATS; ++j) {
+            compile_all(scripts, withCount)
+        }
+        local time = GetTicks() - start
+        if (best == null || time < best) {
+            best = time
+        }
+    }
+    return best
+}
+
+function main(...) {
+    local scripts = get_scripts()
+    local size = 0
+    foreach (path in scripts) {
+        size += GetFileSize(path)
+    }
+    print(scripts.len() + " scripts, " + size + " bytes\n")
+
+    foreach (name, withCount in {["whole stream"] = false, ["with count"] = true}) {
+        local time = measure(scripts, withCount)
+        print(name + ": " + time + " ms for " + NUM_REPEATS + " compiles of all scripts\n")
+    }
+}
@@ -0,0 +1,76 @@
+// Measures JSONStringify and JSONParse on a generated table of a few
+// megabytes, through strings and through a file.
+//
+// Run with: engine -data benchmarks -main json
+//
+// Run it on builds before and after a change to the JSON functions to
+// compare them. Builds that cannot stringify into or parse from a
+// stream only get the string part measured.
+
+const NUM_ITEMS = 20000
+const NUM_RUNS  = 5
+const JSON_FILE = "/data/json_benchmark.json"
+
+function generate() {
+    local items = []
+    for (local i = 0; i < NUM_ITEMS; ++i) {
+        items.append({
+            id          = i,
+            name        = "item" + i,
+            description = "An \"item\" with a\tlong description,\nspread over two lines",
+            position    = [i % 640, i % 480, i * 0.25],
+            active      = (i % 2 == 0),
+            owner       = null,
+            stats       = {strength = i % 100, defense = i % 50, speed = 1.5}
+        })
+    }
+    return {version = 1, items = items}
+}
+
+function measure(func, arg) {
+    local best = null
+    local result = null
+    for (local i = 0; i < NUM_RUNS; ++i) {
+        local start = GetTicks()
+        result = func(arg)
+        local time = GetTicks() - start
+        if (best == null || time < best) {
+            best = time
+        }
+    }
+    return [best, result]
+}
+
+function stringify_to_file(data) {
+    local file = File.Open(JSON_FILE, File.OUT)
+    JSONStringify(data, file)
+    file.close()
+}
+
+function parse_from_file(unused) {
+    local file = File.Open(JSON_FILE)
+    local data = JSONParse(file)
+    file.close()
+    return data
+}
+
+function main(...) {
+    local data = generate()
+
+    local stringify = measure(JSONStringify, data)
+    local json = stringify[1]
+    print("JSONStringify: " + stringify[0] + " ms for " + json.len() + " bytes\n")
+
+    local parse = measure(JSONParse, json)
+    print("JSONParse: " + parse[0] + " ms, " + parse[1].items.len() + " items\n")
+
+    try {
+        print("JSONStringify into a file: " + measure(stringify_to_file, data)[0] + " ms\n")
+        print("JSONParse from a file: " + measure(parse_from_file, null)[0] + " ms\n")
+    } catch (e) {
+        print("Streams not supported: " + e + "\n")
+    }
+    if (FileExists(JSON_FILE)) {
+        RemoveFile(JSON_FILE)
+    }
+}
@@ -0,0 +1,51 @@
+// Measures the overhead of the script profiler.
+//
+// Run with: engine -data benchmarks -main profiler
+//
+// Set ProfileNatives=true in the [Script] section of engine.cfg to
+// measure it with native functions timed too.
+
+const NUM_RUNS = 5
+
+function fib(n) {
+    return n < 2 ? n : fib(n - 1) + fib(n - 2)
+}
+
+function workload() {
+    // script calls
+    fib(24)
+
+    // native calls
+    local v = Vec2(1, 2)
+    for (local i = 0; i < 100000; ++i) {
+        v = v + Vec2(1, 1)
+    }
+}
+
+function measure(mode) {
+    local best = null
+    for (local i = 0; i < NUM_RUNS; ++i) {
+        if (mode) {
+            StartProfiler(mode, 1000)
+        }
+        local start = GetTicks()
+        workload()
+        local time = GetTicks() - start
+        if (mode) {
+            StopProfiler()
+        }
+        if (best == null || time < best) {
+            best = time
+        }
+    }
+    return best
+}
+
+function main(...) {
+    local base = measure(null)
+    print("no profiler: " + base + " ms\n")
+    foreach (name, mode in {sampling = PROFILER_SAMPLING, calls = PROFILER_CALLS}) {
+        local time = measure(mode)
+        print(name + ": " + time + " ms (" + (base > 0 ? ((time - base) * 100 / base) : 0) + "% overhead)\n")
+    }
+}
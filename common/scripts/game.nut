@@ -129,6 +129,43 @@ Game <- {
         }
     }
 
+    // in scale mode the frame is drawn into a render target first,
+    // without render targets it is captured from the window instead
+    function _beginScaledFrame() {
+        if (!_scaleTargetSupported) {
+            return
+        }
+        if (!_scaleTarget || _scaleTarget.width != _width || _scaleTarget.height != _height) {
+            _scaleTarget = null
+            try {
+                _scaleTarget = CreateRenderTarget(_width, _height)
+            } catch (e) {
+                _scaleTargetSupported = false
+                return
+            }
+        }
+        SetRenderTarget(_scaleTarget)
+        local bm = GetBlendMode()
+        SetBlendMode(BM_REPLACE)
+        DrawRect(0, 0, _width, _height, BLACK)
+        SetBlendMode(bm)
+    }
+
+    function _endScaledFrame() {
+        local w = _width
+        local h = _height
+        local bm = GetBlendMode()
+        SetBlendMode(BM_REPLACE)
+        if (_scaleTarget) {
+            SetRenderTarget(null)
+            DrawImageQuad(_scaleTarget, 0, 0, w*2, 0, w*2, h*2, 0, h*2)
+        } else {
+            CaptureFrame(0, 0, w, h)
+            DrawCaptureQuad(0, 0, w, h, 0, 0, w*2, 0, w*2, h*2, 0, h*2)
+        }
+        SetBlendMode(bm)
+    }
+
     // private variables
     _isRunning = false
     _shouldQuit = false
@@ -137,6 +174,8 @@ Game <- {
     _height = 0
     _fullScreen = false
     _scale = false
+    _scaleTarget = null
+    _scaleTargetSupported = true
     _showFPS = false
 
     _frameRate = 0
@@ -172,6 +211,10 @@ function main(...) {
     while (!Game._shouldQuit) {
         UpdateSystem()
 
+        if (Game._scale) {
+            Game._beginScaledFrame()
+        }
+
         // dispatch window events
         while (PeekWindowEvent()) {
             local event = GetWindowEvent()
@@ -264,13 +307,7 @@ function main(...) {
 
         // scale frame
         if (Game._scale) {
-            local w = Game._width
-            local h = Game._height
-            local bm = GetBlendMode()
-            SetBlendMode(BM_REPLACE)
-            CaptureFrame(0, 0, w, h)
-            DrawCaptureQuad(0, 0, w, h, 0, 0, w*2, 0, w*2, h*2, 0, h*2)
-            SetBlendMode(bm)
+            Game._endScaledFrame()
         }
 
         // show the effects of drawing in the window
@@ -11,6 +11,10 @@ class WindowStyle {
     cornerColors   = null; // upper left, upper right, lower left, lower right
     edgeOffsets    = null; // left, top, right, bottom
     images         = null; // upper-left, top, upper-right, right, lower-right, bottom, lower-left, left, background
+
+    _drawList       = null; // recorded window, see drawWindow
+    _drawListWidth  = 0;
+    _drawListHeight = 0;
 }
 
 function WindowStyle::FromFile(filename) {
@@ -67,23 +71,37 @@ function WindowStyle::FromFile(filename) {
 }
 
 function WindowStyle::drawWindow(x, y, width, height) {
+    // the window is recorded once per size and replayed at the position
+    if (!_drawList || _drawListWidth != width || _drawListHeight != height) {
+        _drawList = _recordWindow(width, height);
+        _drawListWidth  = width;
+        _drawListHeight = height;
+    }
+    _drawList.draw(x, y);
+}
+
+function WindowStyle::_recordWindow(width, height) {
+    local list = DrawList();
+
     // draw background
-    _drawBackground(x, y, width, height);
+    _drawBackground(list, 0, 0, width, height);
 
     // draw edges
-    _drawVerticalEdge(  1, x,                   y - images[1].height, width, height);
-    _drawVerticalEdge(  5, x,                   y + height,           width, height);
-    _drawHorizontalEdge(7, x - images[7].width, y,                    width, height);
-    _drawHorizontalEdge(3, x + width,           y,                    width, height);
+    _drawVerticalEdge(  list, 1, 0,                 -images[1].height, width, height);
+    _drawVerticalEdge(  list, 5, 0,                 height,            width, height);
+    _drawHorizontalEdge(list, 7, -images[7].width,  0,                 width, height);
+    _drawHorizontalEdge(list, 3, width,             0,                 width, height);
 
     // draw corners
-    DrawImage(images[0], x - images[0].width, y - images[0].height);
-    DrawImage(images[2], x + width,           y - images[2].height);
-    DrawImage(images[4], x + width,           y + height          );
-    DrawImage(images[6], x - images[6].width, y + height          );
+    list.drawImage(images[0], -images[0].width, -images[0].height);
+    list.drawImage(images[2], width,            -images[2].height);
+    list.drawImage(images[4], width,            height           );
+    list.drawImage(images[6], -images[6].width, height           );
+
+    return list;
 }
 
-function WindowStyle::_drawBackground(x, y, width, height) {
+function WindowStyle::_drawBackground(list, x, y, width, height) {
     local background = images[8];
 
     x -= edgeOffsets[0];
@@ -92,43 +110,40 @@ function WindowStyle::_drawBackground(x, y, width, height) {
     height += edgeOffsets[1] + edgeOffsets[3];
 
     if (backgroundMode == 0 || backgroundMode == 3) {
-        local orig_scissor = GetFrameScissor();
-        SetFrameScissor(Rect(x, y, width, height));
+        list.setScissor(Rect(x, y, width, height));
         for (local ix = 0; ix < width / background.width + 1; ix++) {
             for (local iy = 0; iy < height / background.height + 1; iy++) {
-                DrawImage(background, x + ix * background.width, y + iy * background.height);
+                list.drawImage(background, x + ix * background.width, y + iy * background.height);
             }
         }
-        SetFrameScissor(orig_scissor);
+        list.resetScissor();
     } else if (backgroundMode == 1 || backgroundMode == 4) {
-        DrawImageQuad(background, x, y, x + width, y, x + width, y + height, x, y + height);
+        list.drawImageQuad(background, x, y, x + width, y, x + width, y + height, x, y + height);
     }
 
-    if (backgroundMode >= 2 || backgroundMode <= 4) {
-        DrawRect(Rect(x, y, width, height), cornerColors[0], cornerColors[1], cornerColors[3], cornerColors[2]);
+    if (backgroundMode >= 2 && backgroundMode <= 4) {
+        list.drawRect(x, y, width, height, cornerColors[0], cornerColors[1], cornerColors[3], cornerColors[2]);
     }
 }
 
-function WindowStyle::_drawHorizontalEdge(index, x, y, width, height) {
+function WindowStyle::_drawHorizontalEdge(list, index, x, y, width, height) {
     local edge = images[index];
     local edge_w = edge.width;
     local edge_h = edge.height;
-    local orig_scissor = GetFrameScissor();
-    SetFrameScissor(Rect(x, y, edge_w, height));
+    list.setScissor(Rect(x, y, edge_w, height));
     for (local i = 0; i < height / edge_h + 1; i++) {
-        DrawImage(edge, x, y + i * edge_h);
+        list.drawImage(edge, x, y + i * edge_h);
     }
-    SetFrameScissor(orig_scissor);
+    list.resetScissor();
 }
 
-function WindowStyle::_drawVerticalEdge(index, x, y, width, height) {
+function WindowStyle::_drawVerticalEdge(list, index, x, y, width, height) {
     local edge = images[index];
     local edge_w = edge.width;
     local edge_h = edge.height;
-    local orig_scissor = GetFrameScissor();
-    SetFrameScissor(Rect(x, y, width, edge_h));
+    list.setScissor(Rect(x, y, width, edge_h));
     for (local i = 0; i < width / edge_w + 1; i++) {
-        DrawImage(edge, x + i * edge_w, y);
+        list.drawImage(edge, x + i * edge_w, y);
     }
-    SetFrameScissor(orig_scissor);
+    list.resetScissor();
 }
@@ -13,13 +13,33 @@ namespace sphere {
         std::string CommonPath;
         std::string DataPath;
         std::string MainScript;
+        std::string VideoDriver;
+        int         TextureMemoryBudget; // in megabytes, 0 means no budget
+        std::string FrameExport;         // shared memory name, empty means no export
+        int         FrameExportSlots;
+        std::string ScriptCachePath;     // empty means no cache
+        int         ScriptCacheSize;     // in megabytes
+        std::string Profiler;            // "calls" or "sampling", empty means no profiler
+        int         ProfilerInterval;    // in microseconds
+        std::string ProfilerOutput;      // collapsed stacks are written here at exit
+        bool        ProfileNatives;      // also time native functions when started by a script
         std::vector<std::string> GameArgs;
 
         explicit Config(const std::string& filename) {
             IniFile ini(filename);
-            CommonPath = ini.readString("Engine", "CommonPath", "common");
-            DataPath   = ini.readString("Engine", "DataPath",   "data");
-            MainScript = ini.readString("Engine", "MainScript", "game");
+            CommonPath  = ini.readString("Engine", "CommonPath", "common");
+            DataPath    = ini.readString("Engine", "DataPath",   "data");
+            MainScript  = ini.readString("Engine", "MainScript", "game");
+            VideoDriver = ini.readString("Video",  "Driver",     "opengl");
+            TextureMemoryBudget = ini.readInteger("Video", "TextureMemoryBudget", 0);
+            FrameExport = ini.readString("Video", "FrameExport", "");
+            FrameExportSlots = ini.readInteger("Video", "FrameExportSlots", 3);
+            ScriptCachePath = ini.readString("Script", "CachePath", "/engine/cache");
+            ScriptCacheSize = ini.readInteger("Script", "CacheSize", 16);
+            Profiler = ini.readString("Script", "Profiler", "");
+            ProfilerInterval = ini.readInteger("Script", "ProfilerInterval", 1000);
+            ProfilerOutput = ini.readString("Script", "ProfilerOutput", "/engine/profile.txt");
+            ProfileNatives = ini.readBoolean("Script", "ProfileNatives", false);
         }
 
     };
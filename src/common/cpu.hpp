@@ -0,0 +1,120 @@
+#ifndef SPHERE_CPU_HPP
+#define SPHERE_CPU_HPP
+
+#if defined(_M_IX86)    || \
+    defined(_M_X64)     || \
+    defined(_M_AMD64)   || \
+    defined(__i386__)   || \
+    defined(__x86_64__) || \
+    defined(__amd64__)
+#  define SPHERE_X86
+#endif
+
+/* SSE2 intrinsics are available with every x86 compiler we support,
+   AVX2 intrinsics need at least VS2012 or GCC 4.9 (function level targets) */
+#if defined(SPHERE_X86)
+#  define SPHERE_SSE2
+#  if defined(_MSC_VER)
+#    if _MSC_VER >= 1700
+#      define SPHERE_AVX2
+#    endif
+#  elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#    define SPHERE_AVX2
+#  endif
+#endif
+
+/* lets GCC compile a single function for an instruction set
+   without enabling it for the whole translation unit */
+#if defined(__GNUC__)
+#  define SPHERE_TARGET(isa) __attribute__((target(isa)))
+#else
+#  define SPHERE_TARGET(isa)
+#endif
+
+#if defined(SPHERE_X86)
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#endif
+
+
+namespace sphere {
+
+#if defined(SPHERE_X86)
+    namespace internal {
+
+        inline void cpuid(int leaf, int subleaf, unsigned int regs[4])
+        {
+#  if defined(_MSC_VER)
+            int r[4];
+            __cpuidex(r, leaf, subleaf);
+            regs[0] = r[0];
+            regs[1] = r[1];
+            regs[2] = r[2];
+            regs[3] = r[3];
+#  else
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#  endif
+        }
+
+        inline unsigned int xgetbv0()
+        {
+#  if defined(_MSC_VER)
+#    if _MSC_VER >= 1600
+            return (unsigned int)_xgetbv(0);
+#    else
+            return 0;
+#    endif
+#  else
+            unsigned int eax, edx;
+            __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+            return eax;
+#  endif
+        }
+
+    } // namespace internal
+#endif
+
+    //-----------------------------------------------------------------
+    inline bool HasSSE2()
+    {
+#if defined(SPHERE_SSE2)
+        unsigned int regs[4];
+        internal::cpuid(1, 0, regs);
+        return (regs[3] & (1 << 26)) != 0;
+#else
+        return false;
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    inline bool HasAVX2()
+    {
+#if defined(SPHERE_AVX2)
+        unsigned int regs[4];
+        internal::cpuid(0, 0, regs);
+        if (regs[0] < 7) {
+            return false;
+        }
+        internal::cpuid(1, 0, regs);
+        if ((regs[2] & (1 << 27)) == 0 || // OSXSAVE
+            (regs[2] & (1 << 28)) == 0) { // AVX
+            return false;
+        }
+        // the os must save the ymm registers on context switches
+        if ((internal::xgetbv0() & 0x6) != 0x6) {
+            return false;
+        }
+        internal::cpuid(7, 0, regs);
+        return (regs[1] & (1 << 5)) != 0;
+#else
+        return false;
+#endif
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -1,40 +1,210 @@
+#include <cmath>
 #include <cstring>
 #include <algorithm>
+#include <vector>
+#include "../system/system.hpp"
 #include "Canvas.hpp"
+#include "blend.hpp"
 
 
 namespace sphere {
 
+    //-----------------------------------------------------------------
+    // premultiplied canvases use different formulas for these blend modes
+    enum {
+        BM_ALPHA_PM = Canvas::BM_MULTIPLY + 1,
+        BM_ADD_PM,
+        BM_MULTIPLY_PM,
+    };
+
+    static inline int get_blend_func(int blendMode, bool premultiplied)
+    {
+        if (premultiplied) {
+            switch (blendMode) {
+                case Canvas::BM_ALPHA:    return BM_ALPHA_PM;
+                case Canvas::BM_ADD:      return BM_ADD_PM;
+                case Canvas::BM_MULTIPLY: return BM_MULTIPLY_PM;
+                default: break;
+            }
+        }
+        return blendMode;
+    }
+
+    //-----------------------------------------------------------------
+    static inline RGBA* premultiply_colors(const RGBA* col, RGBA* out, int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            out[i] = col[i];
+            rgba_premultiply(&out[i]);
+        }
+        return out;
+    }
+
+    //-----------------------------------------------------------------
+    // Parallel canvases split their operations into horizontal bands,
+    // which are processed by the system worker threads. Since bands
+    // consist of whole rows, the result is the same as with one band.
+    // Operations touching fewer pixels than the threshold always run
+    // on the calling thread, waking up the workers would cost more.
+    static const int PARALLEL_THRESHOLD = 256 * 256;
+    static const int MIN_BAND_HEIGHT    = 8;
+
+    typedef void (*BANDFUNC_T)(Canvas& canvas, const Recti& band, const void* args);
+
+    struct BandJob {
+        BANDFUNC_T  func;
+        Canvas*     canvas;
+        const void* args;
+        Recti       rect;
+        int         count;
+    };
+
+    //-----------------------------------------------------------------
+    static inline Recti get_band(const Recti& rect, int index, int count)
+    {
+        int y1 = rect.ul.y + (rect.getHeight() *  index)      / count;
+        int y2 = rect.ul.y + (rect.getHeight() * (index + 1)) / count - 1;
+        return Recti(rect.ul.x, y1, rect.lr.x, y2);
+    }
+
+    //-----------------------------------------------------------------
+    static inline Recti get_band_clip(const Canvas& canvas, const Recti& band)
+    {
+        // the scissor restricted to the rows of the band
+        const Recti& scissor = canvas.getScissor();
+        return Recti(scissor.ul.x, std::max(scissor.ul.y, band.ul.y),
+                     scissor.lr.x, std::min(scissor.lr.y, band.lr.y));
+    }
+
+    //-----------------------------------------------------------------
+    static void run_band(void* data, int index)
+    {
+        BandJob* job = (BandJob*)data;
+        job->func(*job->canvas, get_band(job->rect, index, job->count), job->args);
+    }
+
+    //-----------------------------------------------------------------
+    static void for_each_band(Canvas& canvas, const Recti& rect, BANDFUNC_T func, const void* args)
+    {
+        int count = 1;
+        if (canvas.isParallel() && rect.getWidth() * rect.getHeight() >= PARALLEL_THRESHOLD) {
+            int num_cpus = system::GetNumProcessors();
+            if (num_cpus > 1) {
+                // more bands than processors even out the load
+                count = std::min(num_cpus * 4, rect.getHeight() / MIN_BAND_HEIGHT);
+            }
+        }
+        if (count <= 1) {
+            func(canvas, rect, args);
+            return;
+        }
+        BandJob job;
+        job.func   = func;
+        job.canvas = &canvas;
+        job.args   = args;
+        job.rect   = rect;
+        job.count  = count;
+        system::RunParallel(run_band, &job, count);
+    }
+
     //-----------------------------------------------------------------
     Canvas*
-    Canvas::Create(int width, int height, const RGBA* pixels)
+    Canvas::Create(int width, int height, const RGBA* pixels, bool premultiplied)
     {
         assert(width > 0);
         assert(height > 0);
         CanvasPtr canvas = new Canvas(width, height);
+        canvas->_premultiplied = premultiplied;
         if (pixels) {
-            memcpy(canvas->getPixels(), pixels, canvas->getNumPixels() * GetNumBytesPerPixel());
+            // the rows of the canvas may be padded
+            for (int iy = 0; iy < height; ++iy) {
+                memcpy(canvas->getPixels() + iy * canvas->getStride(), pixels + iy * width, width * sizeof(RGBA));
+            }
         }
         return canvas.release();
     }
 
+    //-----------------------------------------------------------------
+    Canvas::PixelBuffer::PixelBuffer(int numPixels)
+        : memory(0)
+        , pixels(0)
+        , version(1)
+        , numCanvases(1)
+    {
+        memory = new u8[numPixels * sizeof(RGBA) + ROW_ALIGNMENT - 1];
+        pixels = (RGBA*)(((size_t)memory + ROW_ALIGNMENT - 1) & ~(size_t)(ROW_ALIGNMENT - 1));
+    }
+
+    //-----------------------------------------------------------------
+    Canvas::PixelBuffer::~PixelBuffer()
+    {
+        delete[] memory;
+    }
+
     //-----------------------------------------------------------------
     Canvas::Canvas(int width, int height)
-        : _width(width)
-        , _height(height)
+        : _width(0)
+        , _height(0)
+        , _stride(0)
         , _pixels(0)
         , _blendMode(BM_ALPHA)
+        , _premultiplied(false)
+        , _parallel(false)
+        , _antialias(false)
+        , _runsVersion(0)
     {
         assert(width > 0);
         assert(height > 0);
-        _pixels = new RGBA[width * height];
+        allocate(width, height);
         _scissor = Recti(0, 0, width - 1, height - 1);
     }
 
+    //-----------------------------------------------------------------
+    Canvas::Canvas(Canvas& parent, const Recti& section)
+        : _width(section.getWidth())
+        , _height(section.getHeight())
+        , _stride(parent._stride)
+        , _pixels(parent._pixels + section.ul.y * parent._stride + section.ul.x)
+        , _buffer(parent._buffer)
+        , _offset(section.ul)
+        , _blendMode(parent._blendMode)
+        , _premultiplied(parent._premultiplied)
+        , _parallel(parent._parallel)
+        , _antialias(parent._antialias)
+        , _runsVersion(0)
+    {
+        parent.grab();
+        _parent  = &parent;
+        _buffer->numCanvases++;
+        _scissor = Recti(0, 0, _width - 1, _height - 1);
+    }
+
     //-----------------------------------------------------------------
     Canvas::~Canvas()
     {
-        delete[] _pixels;
+        if (_buffer) {
+            _buffer->numCanvases--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // Replaces the pixels with a new, uninitialized buffer. If this is
+    // a view, it becomes a canvas of its own.
+    void
+    Canvas::allocate(int width, int height)
+    {
+        int align = ROW_ALIGNMENT / sizeof(RGBA);
+        _width   = width;
+        _height  = height;
+        _stride  = (width + align - 1) / align * align;
+        if (_buffer) {
+            _buffer->numCanvases--;
+        }
+        _buffer  = new PixelBuffer(_stride * height);
+        _pixels  = _buffer->pixels;
+        _parent  = 0;
+        _offset  = Vec2i(0, 0);
+        _runsVersion = 0;
     }
 
     //-----------------------------------------------------------------
@@ -44,22 +214,38 @@ namespace sphere {
         if (!rect.isValid() || !rect.isInside(0, 0, _width - 1, _height - 1)) {
             return 0;
         }
-        CanvasPtr section = Create(rect.getWidth(), rect.getHeight());
+        CanvasPtr section = Create(rect.getWidth(), rect.getHeight(), 0, _premultiplied);
         for (int iy = 0; iy < rect.getHeight(); ++iy) {
-            memcpy(section->getPixels() + (iy * section->getWidth()),
-                   _pixels + ((rect.ul.y + iy) * _width) + rect.ul.x,
+            memcpy(section->getPixels() + (iy * section->getStride()),
+                   _pixels + ((rect.ul.y + iy) * _stride) + rect.ul.x,
                    rect.getWidth() * sizeof(RGBA));
         }
         return section.release();
     }
 
+    //-----------------------------------------------------------------
+    // A view is a canvas that shares the pixels of a section of this
+    // canvas instead of copying them. It has its own scissor and blend
+    // mode and drawing onto it marks the section dirty in this canvas.
+    // Resizing a view, or rotating or transposing one that is not square,
+    // gives it pixels of its own. Shared pixels keep their alpha format.
+    Canvas*
+    Canvas::createView(const Recti& rect)
+    {
+        if (!rect.isValid() || !rect.isInside(0, 0, _width - 1, _height - 1)) {
+            return 0;
+        }
+        CanvasPtr view = new Canvas(*this, rect);
+        return view.release();
+    }
+
     //-----------------------------------------------------------------
     const RGBA&
     Canvas::getPixel(int x, int y) const
     {
         assert(x >= 0 && x < _width);
         assert(y >= 0 && y < _height);
-        return _pixels[_width * y + x];
+        return _pixels[_stride * y + x];
     }
 
     //-----------------------------------------------------------------
@@ -68,7 +254,8 @@ namespace sphere {
     {
         assert(x >= 0 && x < _width);
         assert(y >= 0 && y < _height);
-        _pixels[_width * y + x] = color;
+        _pixels[_stride * y + x] = color;
+        modified(Recti(x, y, x, y));
     }
 
     //-----------------------------------------------------------------
@@ -76,7 +263,7 @@ namespace sphere {
     Canvas::getPixelByIndex(int index) const
     {
         assert(index >= 0 && index < _width * _height);
-        return _pixels[index];
+        return _pixels[(index / _width) * _stride + (index % _width)];
     }
 
     //-----------------------------------------------------------------
@@ -84,7 +271,196 @@ namespace sphere {
     Canvas::setPixelByIndex(int index, const RGBA& color)
     {
         assert(index >= 0 && index < _width * _height);
-        _pixels[index] = color;
+        int x = index % _width;
+        int y = index / _width;
+        _pixels[y * _stride + x] = color;
+        modified(Recti(x, y, x, y));
+    }
+
+    //-----------------------------------------------------------------
+    // Copies rows of stride pixels into rect as they are, without
+    // blending or converting the alpha format.
+    void
+    Canvas::copyPixels(const RGBA* pixels, int stride, const Recti& rect)
+    {
+        assert(pixels);
+        assert(rect.isValid() && rect.isInside(0, 0, _width - 1, _height - 1));
+        for (int iy = 0; iy < rect.getHeight(); ++iy) {
+            memcpy(_pixels + ((rect.ul.y + iy) * _stride) + rect.ul.x,
+                   pixels + (iy * stride),
+                   rect.getWidth() * sizeof(RGBA));
+        }
+        modified(rect);
+    }
+
+    //-----------------------------------------------------------------
+    // The alpha format of pixels shared with a view or a parent
+    // cannot change, as the other canvases would still report the old
+    // one. Returns false in that case.
+    bool
+    Canvas::premultiply()
+    {
+        if (!_premultiplied) {
+            if (_buffer->numCanvases > 1) {
+                return false;
+            }
+            for (int iy = 0; iy < _height; ++iy) {
+                PremultiplySpan(_pixels + iy * _stride, _width);
+            }
+            _premultiplied = true;
+            modified();
+        }
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    Canvas::unpremultiply()
+    {
+        if (_premultiplied) {
+            if (_buffer->numCanvases > 1) {
+                return false;
+            }
+            for (int iy = 0; iy < _height; ++iy) {
+                UnpremultiplySpan(_pixels + iy * _stride, _width);
+            }
+            _premultiplied = false;
+            modified();
+        }
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    static inline int get_run_type(const RGBA& c, bool premultiplied)
+    {
+        if (c.alpha == 255) {
+            return Canvas::RUN_OPAQUE;
+        }
+        // premultiplied pixels with zero alpha may still add color
+        if (premultiplied ? (*(const u32*)&c == 0) : (c.alpha == 0)) {
+            return Canvas::RUN_TRANSPARENT;
+        }
+        return Canvas::RUN_TRANSLUCENT;
+    }
+
+    //-----------------------------------------------------------------
+    const Canvas::Run*
+    Canvas::getRuns(int y, int& numRuns) const
+    {
+        assert(y >= 0 && y < _height);
+        updateRuns();
+        numRuns = _rowRuns[y + 1] - _rowRuns[y];
+        return &_runs[_rowRuns[y]];
+    }
+
+    //-----------------------------------------------------------------
+    // Overlapping dirty rectangles are always merged, others only if the
+    // merged rectangle is not larger than the two rectangles together.
+    // If there are too many, they all collapse into their bounding box.
+    static const size_t MAX_DIRTY_RECTS = 16;
+
+    static inline i64 get_area(const Recti& rect)
+    {
+        return (i64)rect.getWidth() * rect.getHeight();
+    }
+
+    static inline Recti get_union(const Recti& a, const Recti& b)
+    {
+        return Recti(std::min(a.ul.x, b.ul.x),
+                     std::min(a.ul.y, b.ul.y),
+                     std::max(a.lr.x, b.lr.x),
+                     std::max(a.lr.y, b.lr.y));
+    }
+
+    // unlike Recti::getIntersection, the result is invalid if the
+    // rectangles do not intersect
+    static inline Recti clip_rect(const Recti& rect, const Recti& clip)
+    {
+        return Recti(std::max(rect.ul.x, clip.ul.x),
+                     std::max(rect.ul.y, clip.ul.y),
+                     std::min(rect.lr.x, clip.lr.x),
+                     std::min(rect.lr.y, clip.lr.y));
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::modified()
+    {
+        _buffer->version++;
+        _dirtyRects.assign(1, Recti(0, 0, _width - 1, _height - 1));
+        if (_parent && _parent->sharesPixels(this)) {
+            _parent->modified(Recti(_offset.x, _offset.y, _offset.x + _width - 1, _offset.y + _height - 1));
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::modified(const Recti& rect)
+    {
+        _buffer->version++;
+
+        Recti r = clip_rect(rect, Recti(0, 0, _width - 1, _height - 1));
+
+        if (!r.isValid()) {
+            return;
+        }
+
+        if (_parent && _parent->sharesPixels(this)) {
+            _parent->modified(Recti(r.ul.x + _offset.x, r.ul.y + _offset.y, r.lr.x + _offset.x, r.lr.y + _offset.y));
+        }
+
+        size_t i = 0;
+        while (i < _dirtyRects.size()) {
+            Recti u = get_union(_dirtyRects[i], r);
+            if (clip_rect(_dirtyRects[i], r).isValid() ||
+                get_area(u) <= get_area(_dirtyRects[i]) + get_area(r))
+            {
+                // the merged rectangle may now touch one of the previous ones
+                _dirtyRects.erase(_dirtyRects.begin() + i);
+                r = u;
+                i = 0;
+            } else {
+                i++;
+            }
+        }
+
+        if (_dirtyRects.size() >= MAX_DIRTY_RECTS) {
+            for (i = 0; i < _dirtyRects.size(); ++i) {
+                r = get_union(_dirtyRects[i], r);
+            }
+            _dirtyRects.clear();
+        }
+
+        _dirtyRects.push_back(r);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::updateRuns() const
+    {
+        if (_runsVersion == _buffer->version) {
+            return;
+        }
+        _runs.clear();
+        _rowRuns.resize(_height + 1);
+        const RGBA* p = _pixels;
+        for (int y = 0; y < _height; ++y) {
+            _rowRuns[y] = (int)_runs.size();
+            int x = 0;
+            while (x < _width) {
+                Run run;
+                run.type = get_run_type(p[x], _premultiplied);
+                int start = x;
+                while (++x < _width && get_run_type(p[x], _premultiplied) == run.type) {
+                    // extend run
+                }
+                run.length = x - start;
+                _runs.push_back(run);
+            }
+            p += _stride;
+        }
+        _rowRuns[_height] = (int)_runs.size();
+        _runsVersion = _buffer->version;
     }
 
     //-----------------------------------------------------------------
@@ -96,26 +472,60 @@ namespace sphere {
         if (width == _width && height == _height) {
             return;
         }
-        RGBA* new_pixels = new RGBA[width * height];
-        for (int i = 0; i < std::min(_height, height); ++i) {
-            memcpy(new_pixels + (i * width), _pixels + (i * _width), std::min(_width, width) * sizeof(RGBA));
+        RefPtr<PixelBuffer> old_buffer = _buffer;
+        RGBA* old_pixels = _pixels;
+        int   old_width  = _width;
+        int   old_height = _height;
+        int   old_stride = _stride;
+        allocate(width, height);
+        for (int i = 0; i < std::min(old_height, height); ++i) {
+            memcpy(_pixels + (i * _stride), old_pixels + (i * old_stride), std::min(old_width, width) * sizeof(RGBA));
         }
-        delete[] _pixels;
-        _pixels  = new_pixels;
-        _width   = width;
-        _height  = height;
+        modified();
     }
 
     //-----------------------------------------------------------------
     void
     Canvas::setAlpha(int alpha)
     {
-        RGBA* p = _pixels;
-        int   i = _width * _height;
-        while (i > 0) {
-            p->alpha = (u8)alpha;
-            p++;
-            i--;
+        modified();
+
+        for (int iy = 0; iy < _height; ++iy) {
+            RGBA* p = _pixels + iy * _stride;
+            int   i = _width;
+            if (_premultiplied) {
+                while (i > 0) {
+                    rgba_unpremultiply(p);
+                    p->alpha = (u8)alpha;
+                    rgba_premultiply(p);
+                    p++;
+                    i--;
+                }
+                continue;
+            }
+            while (i > 0) {
+                p->alpha = (u8)alpha;
+                p++;
+                i--;
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void replace_color_band(Canvas& canvas, const Recti& band, const void* args)
+    {
+        u32 c = ((const u32*)args)[0];
+        u32 n = ((const u32*)args)[1];
+        for (int iy = band.ul.y; iy <= band.lr.y; ++iy) {
+            u32* p = (u32*)canvas.getPixels() + iy * canvas.getStride();
+            int  i = canvas.getWidth();
+            while (i > 0) {
+                if (*p == c) {
+                    *p = n;
+                }
+                p++;
+                i--;
+            }
         }
     }
 
@@ -123,16 +533,32 @@ namespace sphere {
     void
     Canvas::replaceColor(const RGBA& color, const RGBA& newColor)
     {
-        u32  c = *(u32*)&color;
-        u32  n = *(u32*)&newColor;
-        u32* p =  (u32*)_pixels;
-        int  i = _width * _height;
-        while (i > 0) {
-            if (*p == c) {
-                *p = n;
+        modified();
+
+        RGBA pmcol[2];
+        const RGBA* col = &color;
+        const RGBA* new_col = &newColor;
+        if (_premultiplied) {
+            premultiply_colors(&color, &pmcol[0], 1);
+            premultiply_colors(&newColor, &pmcol[1], 1);
+            col = &pmcol[0];
+            new_col = &pmcol[1];
+        }
+
+        u32 colors[2] = {*(u32*)col, *(u32*)new_col};
+        for_each_band(*this, Recti(0, 0, _width - 1, _height - 1), replace_color_band, colors);
+    }
+
+    //-----------------------------------------------------------------
+    static void fill_band(Canvas& canvas, const Recti& band, const void* args)
+    {
+        u32 q = *(const u32*)args;
+        for (int iy = band.ul.y; iy <= band.lr.y; ++iy) {
+            u32* p = (u32*)canvas.getPixels() + iy * canvas.getStride();
+            for (int i = 0, j = canvas.getWidth(); i < j; ++i) {
+                *p = q;
+                p++;
             }
-            p++;
-            i--;
         }
     }
 
@@ -140,12 +566,30 @@ namespace sphere {
     void
     Canvas::fill(const RGBA& color)
     {
+        modified();
+
         assert(sizeof(RGBA) == sizeof(u32));
-        u32* p = (u32*)_pixels;
-        u32  q = *((u32*)&color);
-        for (int i = 0, j = _width * _height; i < j; ++i) {
-            *p = q;
-            p++;
+        RGBA c = color;
+        if (_premultiplied) {
+            rgba_premultiply(&c);
+        }
+        for_each_band(*this, Recti(0, 0, _width - 1, _height - 1), fill_band, &c);
+    }
+
+    //-----------------------------------------------------------------
+    static void grey_band(Canvas& canvas, const Recti& band, const void*)
+    {
+        for (int iy = band.ul.y; iy <= band.lr.y; ++iy) {
+            RGBA* p = canvas.getPixels() + iy * canvas.getStride();
+            int   i = canvas.getWidth();
+            while (i > 0) {
+                u8 greyed = (p->red + p->green + p->blue) / 3;
+                p->red   = greyed;
+                p->green = greyed;
+                p->blue  = greyed;
+                i--;
+                p++;
+            }
         }
     }
 
@@ -153,22 +597,17 @@ namespace sphere {
     void
     Canvas::grey()
     {
-        RGBA* p = _pixels;
-        int   i = _width * _height;
-        while (i > 0) {
-            u8 greyed = (p->red + p->green + p->blue) / 3;
-            p->red   = greyed;
-            p->green = greyed;
-            p->blue  = greyed;
-            i--;
-            p++;
-        }
+        modified();
+
+        for_each_band(*this, Recti(0, 0, _width - 1, _height - 1), grey_band, 0);
     }
 
     //-----------------------------------------------------------------
     void
     Canvas::flipHorizontally()
     {
+        modified();
+
         assert(sizeof(RGBA) == sizeof(u32));
 
         u32* l = (u32*)_pixels;
@@ -187,8 +626,8 @@ namespace sphere {
                 b--;
                 ix--;
             }
-            l += _width;
-            r += _width;
+            l += _stride;
+            r += _stride;
             iy--;
         }
     }
@@ -197,10 +636,12 @@ namespace sphere {
     void
     Canvas::flipVertically()
     {
+        modified();
+
         assert(sizeof(RGBA) == sizeof(u32));
 
         u32* u = (u32*)_pixels;
-        u32* d = (u32*)_pixels + _width * (_height - 1);
+        u32* d = (u32*)_pixels + _stride * (_height - 1);
 
         int iy = _height / 2;
         while (iy > 0) {
@@ -215,50 +656,133 @@ namespace sphere {
                 b++;
                 ix--;
             }
-            u += _width;
-            d -= _width;
+            u += _stride;
+            d -= _stride;
             iy--;
         }
     }
 
+    //-----------------------------------------------------------------
+    // Transposes n x n pixels in place. Pairs of blocks on opposite
+    // sides of the diagonal are swapped through a small buffer.
+    static const int TRANSPOSE_TILE = 32;
+
+    static void transpose_square(RGBA* pixels, int stride, int n)
+    {
+        RGBA tmp[TRANSPOSE_TILE * TRANSPOSE_TILE];
+        for (int by = 0; by < n; by += TRANSPOSE_TILE) {
+            int bh = std::min(TRANSPOSE_TILE, n - by);
+            for (int bx = by; bx < n; bx += TRANSPOSE_TILE) {
+                int bw = std::min(TRANSPOSE_TILE, n - bx);
+                RGBA* a = pixels + by * stride + bx; // bw x bh
+                RGBA* b = pixels + bx * stride + by; // bh x bw
+                TransposePixels(tmp, TRANSPOSE_TILE, a, stride, bw, bh);
+                if (a != b) {
+                    TransposePixels(a, stride, b, stride, bh, bw);
+                }
+                for (int i = 0; i < bw; ++i) {
+                    memcpy(b + i * stride, tmp + i * TRANSPOSE_TILE, bh * sizeof(RGBA));
+                }
+            }
+        }
+    }
+
     //-----------------------------------------------------------------
     void
-    Canvas::rotateCW()
+    Canvas::transpose()
     {
-        RGBA* new_p = new RGBA[_width * _height];
-        int   new_w = _height;
-        int   new_h = _width;
+        if (_width == _height) {
+            transpose_square(_pixels, _stride, _width);
+            modified();
+            return;
+        }
 
-        for (int iy = 0; iy < _height; ++iy) {
-            for (int ix = 0; ix < _width; ++ix) {
-                new_p[new_w * ix + (new_w - (iy + 1))] = _pixels[iy * _width + ix];
-            }
+        RefPtr<PixelBuffer> old_buffer = _buffer;
+        RGBA* old_p = _pixels;
+        int   old_w = _width;
+        int   old_h = _height;
+        int   old_s = _stride;
+        allocate(old_h, old_w);
+
+        TransposePixels(_pixels, _stride, old_p, old_s, old_w, old_h);
+
+        modified();
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::rotateCW()
+    {
+        if (_width == _height) {
+            // square canvases are rotated in place
+            transpose_square(_pixels, _stride, _width);
+            flipHorizontally();
+            return;
         }
 
-        delete[] _pixels;
-        _pixels = new_p;
-        _width  = new_w;
-        _height = new_h;
+        RefPtr<PixelBuffer> old_buffer = _buffer;
+        RGBA* old_p = _pixels;
+        int   old_w = _width;
+        int   old_h = _height;
+        int   old_s = _stride;
+        allocate(old_h, old_w);
+
+        // transpose the source bottom up
+        TransposePixels(_pixels, _stride, old_p + (old_h - 1) * old_s, -old_s, old_w, old_h);
+
+        modified();
     }
 
     //-----------------------------------------------------------------
     void
     Canvas::rotateCCW()
     {
-        RGBA* new_p = new RGBA[_width * _height];
-        int   new_w = _height;
-        int   new_h = _width;
+        if (_width == _height) {
+            // square canvases are rotated in place
+            transpose_square(_pixels, _stride, _width);
+            flipVertically();
+            return;
+        }
 
-        for (int iy = 0; iy < _height; ++iy) {
-            for (int ix = 0; ix < _width; ++ix) {
-                new_p[new_w * (_width - ix - 1) + iy] = _pixels[iy * _width + ix];
+        RefPtr<PixelBuffer> old_buffer = _buffer;
+        RGBA* old_p = _pixels;
+        int   old_w = _width;
+        int   old_h = _height;
+        int   old_s = _stride;
+        allocate(old_h, old_w);
+
+        // transpose into the destination bottom up
+        TransposePixels(_pixels + (_height - 1) * _stride, -_stride, old_p, old_s, old_w, old_h);
+
+        modified();
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::rotate180()
+    {
+        assert(sizeof(RGBA) == sizeof(u32));
+
+        int iy1 = 0;
+        int iy2 = _height - 1;
+        while (iy1 <= iy2) {
+            u32* a = (u32*)(_pixels + iy1 * _stride);
+            u32* b = (u32*)(_pixels + iy2 * _stride) + _width - 1;
+            // the middle row is swapped with itself
+            int ix = (iy1 == iy2 ? _width / 2 : _width);
+            while (ix > 0) {
+                u32 c = *a;
+                *a = *b;
+                *b = c;
+                a++;
+                b--;
+                ix--;
             }
+            iy1++;
+            iy2--;
         }
 
-        delete[] _pixels;
-        _pixels = new_p;
-        _width  = new_w;
-        _height = new_h;
+        modified();
     }
 
     //-----------------------------------------------------------------
@@ -291,117 +815,35 @@ namespace sphere {
     }
 
     //-----------------------------------------------------------------
-    typedef void (*BLENDFUNC_T)(RGBA*, const RGBA&);
-
-    static inline void rgba_replace(RGBA* dst, const RGBA& src)
+    // Liang-Barsky line clipping algorithm
+    static inline bool clip_line_test(const float& p, const float& q, float& u1, float& u2)
     {
-        dst->red   = src.red;
-        dst->green = src.green;
-        dst->blue  = src.blue;
-        dst->alpha = src.alpha;
-    }
+        float r;
 
-    static inline void rgba_alpha(RGBA* dst, const RGBA& src)
-    {
-        int sa =        src.alpha  + 1;
-        int da = (255 - src.alpha) + 1;
-        dst->red   = (dst->red   * da + src.red   * sa) >> 8;
-        dst->green = (dst->green * da + src.green * sa) >> 8;
-        dst->blue  = (dst->blue  * da + src.blue  * sa) >> 8;
-    }
+        if (p < 0.0)
+        {
+            r = q / p;
 
-    static inline void rgba_add(RGBA* dst, const RGBA& src)
-    {
-        dst->red   = std::min(dst->red   + src.red,   255);
-        dst->green = std::min(dst->green + src.green, 255);
-        dst->blue  = std::min(dst->blue  + src.blue,  255);
-    }
+            if (r > u2)
+                return false;
+            else if (r > u1)
+                u1 = r;
+        }
+        else if (p > 0.0)
+        {
+            r = q / p;
 
-    static inline void rgba_subtract(RGBA* dst, const RGBA& src)
-    {
-        dst->red   = std::max(dst->red   - src.red,   0);
-        dst->green = std::max(dst->green - src.green, 0);
-        dst->blue  = std::max(dst->blue  - src.blue,  0);
-    }
+            if (r < u1)
+                return false;
+            else if (r < u2)
+                u2 = r;
+        }
 
-    static inline void rgba_multiply(RGBA* dst, const RGBA& src)
-    {
-        dst->red   = dst->red   * (src.red   + 1) >> 8;
-        dst->green = dst->green * (src.green + 1) >> 8;
-        dst->blue  = dst->blue  * (src.blue  + 1) >> 8;
+        return true;
     }
 
-    //-----------------------------------------------------------------
-    typedef void (*BLENDFUNCFIX_T)(RGBA*, u32, u32, u32, u32);
-
-    static inline void rgba_replace_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
-    {
-        dst->red   = r >> 12;
-        dst->green = g >> 12;
-        dst->blue  = b >> 12;
-        dst->alpha = a >> 12;
-    }
-
-    static inline void rgba_alpha_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
-    {
-        int sa =        (a >> 12)  + 1;
-        int da = (255 - (a >> 12)) + 1;
-        dst->red   = (dst->red   * da + (r >> 12) * sa) >> 8;
-        dst->green = (dst->green * da + (g >> 12) * sa) >> 8;
-        dst->blue  = (dst->blue  * da + (b >> 12) * sa) >> 8;
-    }
-
-    static inline void rgba_add_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
-    {
-        dst->red   = std::min(dst->red   + (u8)(r >> 12), 255);
-        dst->green = std::min(dst->green + (u8)(g >> 12), 255);
-        dst->blue  = std::min(dst->blue  + (u8)(b >> 12), 255);
-    }
-
-    static inline void rgba_subtract_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
-    {
-        dst->red   = std::max(dst->red   - (u8)(r >> 12), 0);
-        dst->green = std::max(dst->green - (u8)(g >> 12), 0);
-        dst->blue  = std::max(dst->blue  - (u8)(b >> 12), 0);
-    }
-
-    static inline void rgba_multiply_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
-    {
-        dst->red   = dst->red   * ((r >> 12) + 1) >> 8;
-        dst->green = dst->green * ((g >> 12) + 1) >> 8;
-        dst->blue  = dst->blue  * ((b >> 12) + 1) >> 8;
-    }
-
-    //-----------------------------------------------------------------
-    // Liang-Barsky line clipping algorithm
-    static inline bool clip_line_test(const float& p, const float& q, float& u1, float& u2)
-    {
-        float r;
-
-        if (p < 0.0)
-        {
-            r = q / p;
-
-            if (r > u2)
-                return false;
-            else if (r > u1)
-                u1 = r;
-        }
-        else if (p > 0.0)
-        {
-            r = q / p;
-
-            if (r < u1)
-                return false;
-            else if (r < u2)
-                u2 = r;
-        }
-
-        return true;
-    }
-
-    template<typename clipT>
-    static bool clip_line(int& x1, int& y1, int& x2, int& y2, float& u1, float& u2, clipT clip)
+    template<typename clipT>
+    static bool clip_line(int& x1, int& y1, int& x2, int& y2, float& u1, float& u2, clipT clip)
     {
         float dx = (float)(x2 - x1);
         float dy;
@@ -468,13 +910,13 @@ namespace sphere {
             if (y1 == y2) {
                 i1 = bracket(x1, d.getScissor().ul.x, d.getScissor().lr.x);
                 i2 = bracket(x2, d.getScissor().ul.x, d.getScissor().lr.x);
-                dst     = d.getPixels() + y1 * d.getWidth() + i1;
+                dst     = d.getPixels() + y1 * d.getStride() + i1;
                 dst_inc = 1;
             } else {
                 i1 = bracket(y1, d.getScissor().ul.y, d.getScissor().lr.y);
                 i2 = bracket(y2, d.getScissor().ul.y, d.getScissor().lr.y);
-                dst     = d.getPixels() + i1 * d.getWidth() + x1;
-                dst_inc = d.getWidth();
+                dst     = d.getPixels() + i1 * d.getStride() + x1;
+                dst_inc = d.getStride();
             }
 
             int ix = 2;
@@ -500,7 +942,7 @@ namespace sphere {
                 }
             }
 
-            dst = d.getPixels() + y1 * d.getWidth() + x1;
+            dst = d.getPixels() + y1 * d.getStride() + x1;
 
             int dx = abs(x2 - x1);
             int dy = abs(y2 - y1);
@@ -516,11 +958,11 @@ namespace sphere {
             }
 
             if (y2 >= y1) {
-                yinc1 = d.getWidth();
-                yinc2 = d.getWidth();
+                yinc1 = d.getStride();
+                yinc2 = d.getStride();
             } else {
-                yinc1 = -d.getWidth();
-                yinc2 = -d.getWidth();
+                yinc1 = -d.getStride();
+                yinc2 = -d.getStride();
             }
 
             if (dx >= dy) {
@@ -584,15 +1026,15 @@ namespace sphere {
                 i2 = bracket(x2, d.getScissor().ul.x, d.getScissor().lr.x);
                 itemp   = x1;
                 idelta  = x2 - x1;
-                dst     = d.getPixels() + y1 * d.getWidth() + i1;
+                dst     = d.getPixels() + y1 * d.getStride() + i1;
                 dst_inc = 1;
             } else {
                 i1 = bracket(y1, d.getScissor().ul.y, d.getScissor().lr.y);
                 i2 = bracket(y2, d.getScissor().ul.y, d.getScissor().lr.y);
                 itemp   = y1;
                 idelta  = y2 - y1;
-                dst     = d.getPixels() + i1 * d.getWidth() + x1;
-                dst_inc = d.getWidth();
+                dst     = d.getPixels() + i1 * d.getStride() + x1;
+                dst_inc = d.getStride();
             }
 
             int ix = 2 + abs(i2 - i1);
@@ -639,7 +1081,7 @@ namespace sphere {
                 clip_color2_parametric(u1, u2, tc[0], tc[1]);
             }
 
-            dst = d.getPixels() + y1 * d.getWidth() + x1;
+            dst = d.getPixels() + y1 * d.getStride() + x1;
 
             int dx = abs(x2 - x1);
             int dy = abs(y2 - y1);
@@ -655,11 +1097,11 @@ namespace sphere {
             }
 
             if (y2 >= y1) {
-                yinc1 = d.getWidth();
-                yinc2 = d.getWidth();
+                yinc1 = d.getStride();
+                yinc2 = d.getStride();
             } else {
-                yinc1 = -d.getWidth();
-                yinc2 = -d.getWidth();
+                yinc1 = -d.getStride();
+                yinc2 = -d.getStride();
             }
 
             if (dx >= dy) {
@@ -710,6 +1152,104 @@ namespace sphere {
         }
     }
 
+    //-----------------------------------------------------------------
+    static inline bool is_point_clipped(int x, int y, const Recti& scissor)
+    {
+        // return true if point lies outside of the scissor
+        return (x > scissor.lr.x ||
+                y > scissor.lr.y ||
+                x < scissor.ul.x ||
+                y < scissor.ul.y);
+    }
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNCCOV_T blenderT>
+    static inline void plot_aa(Canvas& d, int x, int y, const RGBA& c, int cov, const Recti& clip)
+    {
+        if (cov > 0 && !is_point_clipped(x, y, clip)) {
+            blenderT(d.getPixels() + y * d.getStride() + x, c, cov);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // Xiaolin Wu's line algorithm. The line is walked along its major
+    // axis and each step covers the two pixels nearest to the line,
+    // weighted by their distance from it. The position on the minor
+    // axis is tracked exactly with an integer remainder, so lines with
+    // integer endpoints start and end with fully covered pixels.
+    template<BLENDFUNCCOV_T blenderT>
+    static void draw_line_aa(Canvas& d, int x1, int y1, int x2, int y2, RGBA c[2])
+    {
+        const Recti& clip = d.getScissor();
+        bool steep = abs(y2 - y1) > abs(x2 - x1);
+        RGBA tc[2] = {c[0], c[1]};
+
+        // walk along u, the major axis, in increasing direction
+        int u1 = (steep ? y1 : x1), v1 = (steep ? x1 : y1);
+        int u2 = (steep ? y2 : x2), v2 = (steep ? x2 : y2);
+        if (u1 > u2) {
+            std::swap(u1, u2);
+            std::swap(v1, v2);
+            std::swap(tc[0], tc[1]);
+        }
+
+        int du    = u2 - u1;
+        int dv    = abs(v2 - v1);
+        int vstep = (v2 >= v1 ? 1 : -1);
+
+        // skip the steps outside of the scissor
+        int lo = (steep ? clip.ul.y : clip.ul.x);
+        int hi = (steep ? clip.lr.y : clip.lr.x);
+        int first = std::max(lo - u1, 0);
+        int last  = std::min(hi - u1, du);
+        if (first > last) {
+            return;
+        }
+
+        // position on the minor axis, remainder in 1/du pixels
+        i64 dist = (i64)first * dv;
+        int v    = v1 + vstep * (int)(du ? dist / du : 0);
+        int rem  = (int)(du ? dist % du : 0);
+        u32 frac_scale = (du ? (256 << 16) / du : 0);
+
+        // fixed-point variables for color interpolation (20.12 notation)
+        int n = du + 1;
+        i32 step_r = (i32)(((tc[1].red   - tc[0].red)   / (float)n) * 4096.0);
+        i32 step_g = (i32)(((tc[1].green - tc[0].green) / (float)n) * 4096.0);
+        i32 step_b = (i32)(((tc[1].blue  - tc[0].blue)  / (float)n) * 4096.0);
+        i32 step_a = (i32)(((tc[1].alpha - tc[0].alpha) / (float)n) * 4096.0);
+        u32 cur_r = (tc[0].red   << 12) + step_r * first;
+        u32 cur_g = (tc[0].green << 12) + step_g * first;
+        u32 cur_b = (tc[0].blue  << 12) + step_b * first;
+        u32 cur_a = (tc[0].alpha << 12) + step_a * first;
+
+        for (int i = first; i <= last; ++i) {
+            RGBA col(cur_r >> 12, cur_g >> 12, cur_b >> 12, cur_a >> 12);
+            int  cov = std::min((int)((rem * frac_scale) >> 16), 255);
+            int  u   = u1 + i;
+
+            if (steep) {
+                plot_aa<blenderT>(d, v,         u, col, 255 - cov, clip);
+                plot_aa<blenderT>(d, v + vstep, u, col, cov,       clip);
+            } else {
+                plot_aa<blenderT>(d, u, v,         col, 255 - cov, clip);
+                plot_aa<blenderT>(d, u, v + vstep, col, cov,       clip);
+            }
+
+            rem += dv;
+            if (rem >= du) {
+                rem -= du;
+                v   += vstep;
+            }
+
+            // interpolate current color
+            cur_r += step_r;
+            cur_g += step_g;
+            cur_b += step_b;
+            cur_a += step_a;
+        }
+    }
+
     //-----------------------------------------------------------------
     void
     Canvas::drawLine(Vec2i pos[2], RGBA col[2])
@@ -722,43 +1262,103 @@ namespace sphere {
             return;
         }
 
-        if (col[0] == col[1]) {
-            switch (_blendMode) {
+        // antialiased lines also touch the pixels next to them
+        int border = (_antialias ? 1 : 0);
+        modified(clip_rect(Recti(std::min(pos[0].x, pos[1].x) - border,
+                                 std::min(pos[0].y, pos[1].y) - border,
+                                 std::max(pos[0].x, pos[1].x) + border,
+                                 std::max(pos[0].y, pos[1].y) + border), _scissor));
+
+        // premultiplied canvases expect premultiplied colors
+        RGBA pmcol[2];
+        if (_premultiplied) {
+            col = premultiply_colors(col, pmcol, 2);
+        }
+
+        if (_antialias) {
+            switch (get_blend_func(_blendMode, _premultiplied)) {
+            case BM_REPLACE:
+                draw_line_aa<rgba_replace_cov>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
+            case BM_ALPHA:
+                draw_line_aa<rgba_alpha_cov>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
+            case BM_ALPHA_PM:
+                draw_line_aa<rgba_alpha_pm_cov>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
+            case BM_ADD:
+                draw_line_aa<rgba_add_cov>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
+            case BM_ADD_PM:
+                draw_line_aa<rgba_add_pm_cov>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
+            case BM_SUBTRACT:
+                draw_line_aa<rgba_subtract_cov>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
+            case BM_MULTIPLY:
+                draw_line_aa<rgba_multiply_cov>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
+            case BM_MULTIPLY_PM:
+                draw_line_aa<rgba_multiply_pm_cov>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
+            default:
+                break;
+            }
+        } else if (col[0] == col[1]) {
+            switch (get_blend_func(_blendMode, _premultiplied)) {
             case BM_REPLACE:
                 draw_line<rgba_replace>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
                 break;
             case BM_ALPHA:
                 draw_line<rgba_alpha>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
                 break;
+            case BM_ALPHA_PM:
+                draw_line<rgba_alpha_pm>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
+                break;
             case BM_ADD:
                 draw_line<rgba_add>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
                 break;
+            case BM_ADD_PM:
+                draw_line<rgba_add_pm>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
+                break;
             case BM_SUBTRACT:
                 draw_line<rgba_subtract>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
                 break;
             case BM_MULTIPLY:
                 draw_line<rgba_multiply>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
                 break;
+            case BM_MULTIPLY_PM:
+                draw_line<rgba_multiply_pm>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
+                break;
             default:
                 break;
             }
         } else {
-            switch (_blendMode) {
+            switch (get_blend_func(_blendMode, _premultiplied)) {
             case BM_REPLACE:
                 draw_gradient_line<rgba_replace_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
                 break;
             case BM_ALPHA:
                 draw_gradient_line<rgba_alpha_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
                 break;
+            case BM_ALPHA_PM:
+                draw_gradient_line<rgba_alpha_pm_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
             case BM_ADD:
                 draw_gradient_line<rgba_add_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
                 break;
+            case BM_ADD_PM:
+                draw_gradient_line<rgba_add_pm_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
             case BM_SUBTRACT:
                 draw_gradient_line<rgba_subtract_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
                 break;
             case BM_MULTIPLY:
                 draw_gradient_line<rgba_multiply_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
                 break;
+            case BM_MULTIPLY_PM:
+                draw_gradient_line<rgba_multiply_pm_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
+                break;
             default:
                 break;
             }
@@ -767,14 +1367,14 @@ namespace sphere {
 
     //-----------------------------------------------------------------
     template<BLENDFUNC_T blenderT>
-    static void draw_rect(Canvas& d, const Recti& rect, const RGBA& col)
+    static void draw_rect(Canvas& d, const Recti& rect, const RGBA& col, const Recti& clip)
     {
-        Recti intersection = d.getScissor().getIntersection(rect);
+        Recti intersection = clip.getIntersection(rect);
         if (!intersection.isValid()) {
             return;
         }
 
-        RGBA* dst = d.getPixels() + intersection.getY() * d.getWidth() + intersection.getX();
+        RGBA* dst = d.getPixels() + intersection.getY() * d.getStride() + intersection.getX();
         int iy = intersection.getHeight();
         while (iy > 0) {
             int ix = intersection.getWidth();
@@ -783,7 +1383,7 @@ namespace sphere {
                 dst++;
                 ix--;
             }
-            dst += d.getWidth() - intersection.getWidth();
+            dst += d.getStride() - intersection.getWidth();
             iy--;
         }
     }
@@ -804,7 +1404,7 @@ namespace sphere {
 
     //-----------------------------------------------------------------
     template<BLENDFUNCFIX_T blenderT>
-    static void draw_gradient_rect(Canvas& d, const Recti& rect, RGBA col[4])
+    static void draw_gradient_rect(Canvas& d, const Recti& rect, RGBA col[4], const Recti& clip)
     {
         RGBA tc[4] = {col[0], col[1], col[2], col[3]};
         int x = rect.getX();
@@ -855,7 +1455,26 @@ namespace sphere {
         i32 step_r_b = ((tc[2].blue  - tc[1].blue)  << 12) / h;
         i32 step_r_a = ((tc[2].alpha - tc[1].alpha) << 12) / h;
 
-        RGBA* dst = d.getPixels() + y * d.getWidth() + x;
+        // only draw the rows inside of the clip rectangle,
+        // the rows above it still have to advance the colors
+        int last = std::min(y + h - 1, clip.lr.y);
+        int skip = std::max(clip.ul.y - y, 0);
+        if (skip > 0) {
+            l_r += step_l_r * skip;
+            l_g += step_l_g * skip;
+            l_b += step_l_b * skip;
+            l_a += step_l_a * skip;
+
+            r_r += step_r_r * skip;
+            r_g += step_r_g * skip;
+            r_b += step_r_b * skip;
+            r_a += step_r_a * skip;
+
+            y += skip;
+        }
+        h = last - y + 1;
+
+        RGBA* dst = d.getPixels() + y * d.getStride() + x;
 
         for (int iy = 0; iy < h; ++iy)
         {
@@ -881,7 +1500,7 @@ namespace sphere {
                 cur_a += step_a;
             }
 
-            dst += d.getWidth() - w;
+            dst += d.getStride() - w;
 
             // interpolate left and right colors
             l_r += step_l_r;
@@ -897,52 +1516,75 @@ namespace sphere {
     }
 
     //-----------------------------------------------------------------
-    void
-    Canvas::drawRect(const Recti& rect, RGBA col[4])
+    struct DrawRectArgs {
+        const Recti* rect;
+        RGBA*        col;
+    };
+
+    //-----------------------------------------------------------------
+    static void draw_rect_band(Canvas& d, const Recti& band, const void* args)
     {
-        if (!rect.isValid() || !_scissor.intersects(rect)) {
-            return;
-        }
+        const Recti& rect = *((const DrawRectArgs*)args)->rect;
+        RGBA*        col  =  ((const DrawRectArgs*)args)->col;
+        Recti        clip = get_band_clip(d, band);
 
         if (col[0] == col[1] &&
             col[0] == col[2] &&
             col[0] == col[3])
         {
-            switch (_blendMode) {
-            case BM_REPLACE:
-                draw_rect<rgba_replace>(*this, rect, col[0]);
+            switch (get_blend_func(d.getBlendMode(), d.isPremultiplied())) {
+            case Canvas::BM_REPLACE:
+                draw_rect<rgba_replace>(d, rect, col[0], clip);
                 break;
-            case BM_ALPHA:
-                draw_rect<rgba_alpha>(*this, rect, col[0]);
+            case Canvas::BM_ALPHA:
+                draw_rect<rgba_alpha>(d, rect, col[0], clip);
                 break;
-            case BM_ADD:
-                draw_rect<rgba_add>(*this, rect, col[0]);
+            case BM_ALPHA_PM:
+                draw_rect<rgba_alpha_pm>(d, rect, col[0], clip);
                 break;
-            case BM_SUBTRACT:
-                draw_rect<rgba_subtract>(*this, rect, col[0]);
+            case Canvas::BM_ADD:
+                draw_rect<rgba_add>(d, rect, col[0], clip);
                 break;
-            case BM_MULTIPLY:
-                draw_rect<rgba_multiply>(*this, rect, col[0]);
+            case BM_ADD_PM:
+                draw_rect<rgba_add_pm>(d, rect, col[0], clip);
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_rect<rgba_subtract>(d, rect, col[0], clip);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_rect<rgba_multiply>(d, rect, col[0], clip);
+                break;
+            case BM_MULTIPLY_PM:
+                draw_rect<rgba_multiply_pm>(d, rect, col[0], clip);
                 break;
             default:
                 break;
             }
         } else {
-            switch (_blendMode) {
-            case BM_REPLACE:
-                draw_gradient_rect<rgba_replace_fix>(*this, rect, col);
+            switch (get_blend_func(d.getBlendMode(), d.isPremultiplied())) {
+            case Canvas::BM_REPLACE:
+                draw_gradient_rect<rgba_replace_fix>(d, rect, col, clip);
                 break;
-            case BM_ALPHA:
-                draw_gradient_rect<rgba_alpha_fix>(*this, rect, col);
+            case Canvas::BM_ALPHA:
+                draw_gradient_rect<rgba_alpha_fix>(d, rect, col, clip);
                 break;
-            case BM_ADD:
-                draw_gradient_rect<rgba_add_fix>(*this, rect, col);
+            case BM_ALPHA_PM:
+                draw_gradient_rect<rgba_alpha_pm_fix>(d, rect, col, clip);
                 break;
-            case BM_SUBTRACT:
-                draw_gradient_rect<rgba_subtract_fix>(*this, rect, col);
+            case Canvas::BM_ADD:
+                draw_gradient_rect<rgba_add_fix>(d, rect, col, clip);
                 break;
-            case BM_MULTIPLY:
-                draw_gradient_rect<rgba_multiply_fix>(*this, rect, col);
+            case BM_ADD_PM:
+                draw_gradient_rect<rgba_add_pm_fix>(d, rect, col, clip);
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_gradient_rect<rgba_subtract_fix>(d, rect, col, clip);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_gradient_rect<rgba_multiply_fix>(d, rect, col, clip);
+                break;
+            case BM_MULTIPLY_PM:
+                draw_gradient_rect<rgba_multiply_pm_fix>(d, rect, col, clip);
                 break;
             default:
                 break;
@@ -951,18 +1593,28 @@ namespace sphere {
     }
 
     //-----------------------------------------------------------------
-    static inline bool is_point_clipped(int x, int y, const Recti& scissor)
+    void
+    Canvas::drawRect(const Recti& rect, RGBA col[4])
     {
-        // return true if point lies outside of the scissor
-        return (x > scissor.lr.x ||
-                y > scissor.lr.y ||
-                x < scissor.ul.x ||
-                y < scissor.ul.y);
+        if (!rect.isValid() || !_scissor.intersects(rect)) {
+            return;
+        }
+
+        modified(clip_rect(rect, _scissor));
+
+        // premultiplied canvases expect premultiplied colors
+        RGBA pmcol[4];
+        if (_premultiplied) {
+            col = premultiply_colors(col, pmcol, 4);
+        }
+
+        DrawRectArgs args = {&rect, col};
+        for_each_band(*this, _scissor.getIntersection(rect), draw_rect_band, &args);
     }
 
     //-----------------------------------------------------------------
     template<BLENDFUNC_T blenderT>
-    static void draw_circle_outline(Canvas& d, int x, int y, int r, const RGBA& c)
+    static void draw_circle_outline(Canvas& d, int x, int y, int r, const RGBA& c, const Recti& clip)
     {
         int f     = 1 - r;
         int ddF_x = 0;
@@ -970,9 +1622,7 @@ namespace sphere {
 
         int ix = 0;
         int iy = r;
-        int pitch = d.getWidth();
-
-        const Recti& clip = d.getScissor();
+        int pitch = d.getStride();
 
         RGBA* tl = d.getPixels() + (y - r)     * pitch + (x);
         RGBA* tr = d.getPixels() + (y - r)     * pitch + (x - 1);
@@ -1022,7 +1672,7 @@ namespace sphere {
 
     //-----------------------------------------------------------------
     template<BLENDFUNC_T blenderT>
-    static void draw_circle(Canvas& d, int x, int y, int r, const RGBA& c)
+    static void draw_circle(Canvas& d, int x, int y, int r, const RGBA& c, const Recti& clip)
     {
         int f     = 1 - r;
         int ddF_x = 0;
@@ -1031,9 +1681,8 @@ namespace sphere {
         int ix = 0;
         int iy = r;
         int clip_l, clip_r;
-        int pitch = d.getWidth();
+        int pitch = d.getStride();
 
-        const Recti& clip = d.getScissor();
         RGBA* dst         = d.getPixels();
         RGBA* tmp_dst     = NULL;
 
@@ -1091,73 +1740,104 @@ namespace sphere {
     }
 
     //-----------------------------------------------------------------
-    template<BLENDFUNC_T blenderT>
-    static void draw_gradient_circle(Canvas& d, int x, int y, int r, RGBA col[2])
+    // Colors of a gradient circle by squared distance from the center,
+    // so filling it needs neither sqrt nor sin per pixel. Small circles
+    // get an entry for every distance, larger ones share entries
+    // between neighbouring distances.
+    enum { CIRCLE_GRADIENT_SIZE = 1024 };
+
+    struct CircleGradient {
+        RGBA colors[CIRCLE_GRADIENT_SIZE + 1];
+        int  size;
+        i64  maxDist2; // squared distance of the edge
+        u64  scale;    // squared distance to index (32.32 notation)
+
+        const RGBA& operator()(i64 dist2) const {
+            if (dist2 >= maxDist2) {
+                return colors[size];
+            }
+            return colors[(int)(((u64)dist2 * scale) >> 32)];
+        }
+    };
+
+    //-----------------------------------------------------------------
+    static void init_circle_gradient(CircleGradient& g, i64 maxDist2, const RGBA col[2])
     {
-        RGBA tc[2] = {col[0], col[1]};
+        // channel differences
+        float fdr = (float)(col[1].red   - col[0].red);
+        float fdg = (float)(col[1].green - col[0].green);
+        float fdb = (float)(col[1].blue  - col[0].blue);
+        float fda = (float)(col[1].alpha - col[0].alpha);
+
+        const float PI_H = 3.1415927f / 2.0f;
 
+        g.size     = (int)std::min<i64>(maxDist2, CIRCLE_GRADIENT_SIZE);
+        g.maxDist2 = maxDist2;
+        g.scale    = ((u64)g.size << 32) / (u64)maxDist2;
+
+        for (int i = 0; i <= g.size; ++i) {
+            float dist   = sqrt((float)i / (float)g.size);
+            float factor = sin((float(1) - dist) * PI_H);
+            g.colors[i].red   = (u8)(col[1].red   - fdr * factor);
+            g.colors[i].green = (u8)(col[1].green - fdg * factor);
+            g.colors[i].blue  = (u8)(col[1].blue  - fdb * factor);
+            g.colors[i].alpha = (u8)(col[1].alpha - fda * factor);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNC_T blenderT>
+    static void draw_gradient_circle(Canvas& d, int x, int y, int r, const CircleGradient& gradient, const Recti& clip)
+    {
         int ix = 1;
         int iy = r;
         int n;
 
-        // channel differences
-        float fdr = (float)(tc[1].red   - tc[0].red);
-        float fdg = (float)(tc[1].green - tc[0].green);
-        float fdb = (float)(tc[1].blue  - tc[0].blue);
-        float fda = (float)(tc[1].alpha - tc[0].alpha);
-
-        float dist;
-        float factor;
-        float fr = (float)r;
-        const float PI_H = 3.1415927f / 2.0f;
-        const float RR   = (float)(r * r);
+        const float RR = (float)(r * r);
 
-        const Recti& clip = d.getScissor();
-        int pitch = d.getWidth();
+        int pitch = d.getStride();
         RGBA* pixels = d.getPixels();
 
         // draw gradient circle (goes through all points in an octant)
         while (ix <= iy) {
             n = iy + 1;
             while (--n >= ix) {
-                dist = sqrt((float)(ix*ix + n*n));
-
-                if (dist > r) {
-                    dist = fr;
+                // skip the color lookup if all reflections are clipped
+                if ((y - n      < clip.ul.y || y - n      > clip.lr.y) &&
+                    (y + n - 1  < clip.ul.y || y + n - 1  > clip.lr.y) &&
+                    (y - ix     < clip.ul.y || y - ix     > clip.lr.y) &&
+                    (y + ix - 1 < clip.ul.y || y + ix - 1 > clip.lr.y))
+                {
+                    continue;
                 }
 
-                // set correct color
-                factor = sin((float(1) - dist / fr) * PI_H);
-                tc[0].red   = (u8)(tc[1].red   - fdr * factor);
-                tc[0].green = (u8)(tc[1].green - fdg * factor);
-                tc[0].blue  = (u8)(tc[1].blue  - fdb * factor);
-                tc[0].alpha = (u8)(tc[1].alpha - fda * factor);
+                const RGBA& c = gradient(ix*ix + n*n);
 
                 // draw the point and reflect it seven times
                 if (!is_point_clipped(x + ix - 1, y - n, clip))
-                    blenderT(pixels + ((y - n) * pitch + (x + ix - 1)), tc[0]);
+                    blenderT(pixels + ((y - n) * pitch + (x + ix - 1)), c);
 
                 if (!is_point_clipped(x - ix, y - n, clip))
-                    blenderT(pixels + ((y - n) * pitch + (x - ix)), tc[0]);
+                    blenderT(pixels + ((y - n) * pitch + (x - ix)), c);
 
                 if (!is_point_clipped(x + ix - 1, y + n - 1, clip))
-                    blenderT(pixels + ((y + n - 1) * pitch + (x + ix - 1)), tc[0]);
+                    blenderT(pixels + ((y + n - 1) * pitch + (x + ix - 1)), c);
 
                 if (!is_point_clipped(x - ix, y + n - 1, clip))
-                    blenderT(pixels + ((y + n - 1) * pitch + (x - ix)), tc[0]);
+                    blenderT(pixels + ((y + n - 1) * pitch + (x - ix)), c);
 
                 if (ix != n) {
                     if (!is_point_clipped(x + n - 1, y - ix, clip))
-                        blenderT(pixels + ((y - ix) * pitch + (x + n - 1)), tc[0]);
+                        blenderT(pixels + ((y - ix) * pitch + (x + n - 1)), c);
 
                     if (!is_point_clipped(x - n, y - ix, clip))
-                        blenderT(pixels + ((y - ix) * pitch + (x - n)), tc[0]);
+                        blenderT(pixels + ((y - ix) * pitch + (x - n)), c);
 
                     if (!is_point_clipped(x + n - 1, y + ix - 1, clip))
-                        blenderT(pixels + ((y + ix - 1) * pitch + (x + n - 1)), tc[0]);
+                        blenderT(pixels + ((y + ix - 1) * pitch + (x + n - 1)), c);
 
                     if (!is_point_clipped(x - n, y + ix - 1, clip))
-                        blenderT(pixels + ((y + ix - 1) * pitch + (x - n)), tc[0]);
+                        blenderT(pixels + ((y + ix - 1) * pitch + (x - n)), c);
                 }
             }
 
@@ -1170,76 +1850,271 @@ namespace sphere {
     }
 
     //-----------------------------------------------------------------
-    void
-    Canvas::drawCircle(int x, int y, int radius, bool fill, RGBA col[2])
+    struct SolidCircleShader {
+        RGBA color;
+
+        explicit SolidCircleShader(const RGBA& c) : color(c) { }
+
+        const RGBA& operator()(i64 /* dist2 */) const {
+            return color;
+        }
+    };
+
+    //-----------------------------------------------------------------
+    // Antialiased circles are centered between the pixels (x - 1, y - 1)
+    // and (x, y), like the aliased ones. Distances are measured from the
+    // pixel centers in half pixels, which keeps them integral, and the
+    // coverage falls off linearly over one pixel around the edge.
+    static inline int get_circle_coverage(double edge, int dx2, int dy2)
     {
-        if (radius <= 0 ||
-            x + radius < _scissor.ul.x ||
-            x - radius > _scissor.lr.x ||
-            y + radius < _scissor.ul.y ||
-            y - radius > _scissor.lr.y)
-        {
-            return;
+        double dist = sqrt((double)dx2 * dx2 + (double)dy2 * dy2) * 0.5;
+        return bracket((int)((edge - dist) * 255.0 + 0.5), 0, 255);
+    }
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNCCOV_T blenderT, typename shaderT>
+    static void draw_circle_aa(Canvas& d, int x, int y, int r, const shaderT& shader, const Recti& clip)
+    {
+        int    y1    = std::max(y - r,     clip.ul.y);
+        int    y2    = std::min(y + r - 1, clip.lr.y);
+        double outer = r + 0.5; // no coverage from here on
+        double inner = r - 0.5; // full coverage up to here
+        int    pitch = d.getStride();
+
+        for (int py = y1; py <= y2; ++py) {
+            int    dy2 = 2 * (py - y) + 1;
+            double dy  = dy2 * 0.5;
+            double xo  = sqrt(std::max(outer * outer - dy * dy, 0.0));
+
+            int l  = std::max((int)ceil(x - 0.5 - xo),  clip.ul.x);
+            int rr = std::min((int)floor(x - 0.5 + xo), clip.lr.x);
+            if (l > rr) {
+                continue;
+            }
+
+            // fully covered span in the middle of the row
+            int fl = rr + 1;
+            int fr = rr;
+            if (inner * inner > dy * dy) {
+                double xi = sqrt(inner * inner - dy * dy);
+                fl = std::max((int)ceil(x - 0.5 - xi),  l);
+                fr = std::min((int)floor(x - 0.5 + xi), rr);
+            }
+
+            RGBA* row = d.getPixels() + py * pitch;
+            i64   dy4 = (i64)dy2 * dy2;
+
+            for (int px = l; px <= std::min(fl - 1, rr); ++px) {
+                int dx2 = 2 * (px - x) + 1;
+                blenderT(row + px, shader(dy4 + (i64)dx2 * dx2), get_circle_coverage(outer, dx2, dy2));
+            }
+            for (int px = fl; px <= fr; ++px) {
+                int dx2 = 2 * (px - x) + 1;
+                blenderT(row + px, shader(dy4 + (i64)dx2 * dx2), 255);
+            }
+            for (int px = std::max(fr + 1, fl); px <= rr; ++px) {
+                int dx2 = 2 * (px - x) + 1;
+                blenderT(row + px, shader(dy4 + (i64)dx2 * dx2), get_circle_coverage(outer, dx2, dy2));
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // The outline is a ring one pixel wide, covering the same pixels as
+    // the outermost pixels of the filled circle.
+    template<BLENDFUNCCOV_T blenderT>
+    static void draw_circle_outline_aa(Canvas& d, int x, int y, int r, const RGBA& c, const Recti& clip)
+    {
+        int    y1    = std::max(y - r,     clip.ul.y);
+        int    y2    = std::min(y + r - 1, clip.lr.y);
+        double outer = r + 0.5;
+        double hole  = r - 1.5; // no coverage up to here
+        int    pitch = d.getStride();
+
+        for (int py = y1; py <= y2; ++py) {
+            int    dy2 = 2 * (py - y) + 1;
+            double dy  = dy2 * 0.5;
+            double xo  = sqrt(std::max(outer * outer - dy * dy, 0.0));
+
+            int l  = (int)ceil(x - 0.5 - xo);
+            int rr = (int)floor(x - 0.5 + xo);
+
+            // the row crosses the hole in two spans, or touches it in one
+            int hl = rr;
+            int hr = rr + 1;
+            if (hole > 0 && hole * hole > dy * dy) {
+                double xh = sqrt(hole * hole - dy * dy);
+                hl = std::min((int)floor(x - 0.5 - xh), rr);
+                hr = std::max((int)ceil(x - 0.5 + xh),  hl + 1);
+            }
+
+            RGBA* row = d.getPixels() + py * pitch;
+            int spans[2][2] = {{l, hl}, {hr, rr}};
+
+            for (int i = 0; i < 2; ++i) {
+                int x1 = std::max(spans[i][0], clip.ul.x);
+                int x2 = std::min(spans[i][1], clip.lr.x);
+                for (int px = x1; px <= x2; ++px) {
+                    int    dx2  = 2 * (px - x) + 1;
+                    double dist = sqrt((double)dx2 * dx2 + (double)dy2 * dy2) * 0.5;
+                    int    cov  = (int)((1.0 - fabs(dist - (r - 0.5))) * 255.0 + 0.5);
+                    if (cov > 0) {
+                        blenderT(row + px, c, std::min(cov, 255));
+                    }
+                }
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    struct DrawCircleArgs {
+        int   x;
+        int   y;
+        int   radius;
+        bool  fill;
+        bool  antialias;
+        RGBA* col;
+        const CircleGradient* gradient; // if the colors differ
+    };
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNCCOV_T blenderT>
+    static void draw_circle_aa_band(Canvas& d, const DrawCircleArgs* a, const Recti& clip)
+    {
+        if (a->gradient) {
+            draw_circle_aa<blenderT>(d, a->x, a->y, a->radius, *a->gradient, clip);
+        } else if (a->fill) {
+            draw_circle_aa<blenderT>(d, a->x, a->y, a->radius, SolidCircleShader(a->col[0]), clip);
+        } else {
+            draw_circle_outline_aa<blenderT>(d, a->x, a->y, a->radius, a->col[0], clip);
         }
+    }
 
-        if (col[0] == col[1]) {
+    //-----------------------------------------------------------------
+    static void draw_circle_band(Canvas& d, const Recti& band, const void* args)
+    {
+        const DrawCircleArgs* a = (const DrawCircleArgs*)args;
+        int   x      = a->x;
+        int   y      = a->y;
+        int   radius = a->radius;
+        bool  fill   = a->fill;
+        RGBA* col    = a->col;
+        Recti clip   = get_band_clip(d, band);
+
+        if (a->antialias) {
+            switch (get_blend_func(d.getBlendMode(), d.isPremultiplied())) {
+            case Canvas::BM_REPLACE:
+                draw_circle_aa_band<rgba_replace_cov>(d, a, clip);
+                break;
+            case Canvas::BM_ALPHA:
+                draw_circle_aa_band<rgba_alpha_cov>(d, a, clip);
+                break;
+            case BM_ALPHA_PM:
+                draw_circle_aa_band<rgba_alpha_pm_cov>(d, a, clip);
+                break;
+            case Canvas::BM_ADD:
+                draw_circle_aa_band<rgba_add_cov>(d, a, clip);
+                break;
+            case BM_ADD_PM:
+                draw_circle_aa_band<rgba_add_pm_cov>(d, a, clip);
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_circle_aa_band<rgba_subtract_cov>(d, a, clip);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_circle_aa_band<rgba_multiply_cov>(d, a, clip);
+                break;
+            case BM_MULTIPLY_PM:
+                draw_circle_aa_band<rgba_multiply_pm_cov>(d, a, clip);
+                break;
+            default:
+                break;
+            }
+        } else if (col[0] == col[1]) {
             if (fill) {
-                switch (_blendMode) {
-                case BM_REPLACE:
-                    draw_circle<rgba_replace>(*this, x, y, radius, col[0]);
+                switch (get_blend_func(d.getBlendMode(), d.isPremultiplied())) {
+                case Canvas::BM_REPLACE:
+                    draw_circle<rgba_replace>(d, x, y, radius, col[0], clip);
+                    break;
+                case Canvas::BM_ALPHA:
+                    draw_circle<rgba_alpha>(d, x, y, radius, col[0], clip);
+                    break;
+                case BM_ALPHA_PM:
+                    draw_circle<rgba_alpha_pm>(d, x, y, radius, col[0], clip);
                     break;
-                case BM_ALPHA:
-                    draw_circle<rgba_alpha>(*this, x, y, radius, col[0]);
+                case Canvas::BM_ADD:
+                    draw_circle<rgba_add>(d, x, y, radius, col[0], clip);
                     break;
-                case BM_ADD:
-                    draw_circle<rgba_add>(*this, x, y, radius, col[0]);
+                case BM_ADD_PM:
+                    draw_circle<rgba_add_pm>(d, x, y, radius, col[0], clip);
                     break;
-                case BM_SUBTRACT:
-                    draw_circle<rgba_subtract>(*this, x, y, radius, col[0]);
+                case Canvas::BM_SUBTRACT:
+                    draw_circle<rgba_subtract>(d, x, y, radius, col[0], clip);
                     break;
-                case BM_MULTIPLY:
-                    draw_circle<rgba_multiply>(*this, x, y, radius, col[0]);
+                case Canvas::BM_MULTIPLY:
+                    draw_circle<rgba_multiply>(d, x, y, radius, col[0], clip);
+                    break;
+                case BM_MULTIPLY_PM:
+                    draw_circle<rgba_multiply_pm>(d, x, y, radius, col[0], clip);
                     break;
                 default:
                     break;
                 }
             } else {
-                switch (_blendMode) {
-                case BM_REPLACE:
-                    draw_circle_outline<rgba_replace>(*this, x, y, radius, col[0]);
+                switch (get_blend_func(d.getBlendMode(), d.isPremultiplied())) {
+                case Canvas::BM_REPLACE:
+                    draw_circle_outline<rgba_replace>(d, x, y, radius, col[0], clip);
+                    break;
+                case Canvas::BM_ALPHA:
+                    draw_circle_outline<rgba_alpha>(d, x, y, radius, col[0], clip);
+                    break;
+                case BM_ALPHA_PM:
+                    draw_circle_outline<rgba_alpha_pm>(d, x, y, radius, col[0], clip);
                     break;
-                case BM_ALPHA:
-                    draw_circle_outline<rgba_alpha>(*this, x, y, radius, col[0]);
+                case Canvas::BM_ADD:
+                    draw_circle_outline<rgba_add>(d, x, y, radius, col[0], clip);
                     break;
-                case BM_ADD:
-                    draw_circle_outline<rgba_add>(*this, x, y, radius, col[0]);
+                case BM_ADD_PM:
+                    draw_circle_outline<rgba_add_pm>(d, x, y, radius, col[0], clip);
                     break;
-                case BM_SUBTRACT:
-                    draw_circle_outline<rgba_subtract>(*this, x, y, radius, col[0]);
+                case Canvas::BM_SUBTRACT:
+                    draw_circle_outline<rgba_subtract>(d, x, y, radius, col[0], clip);
                     break;
-                case BM_MULTIPLY:
-                    draw_circle_outline<rgba_multiply>(*this, x, y, radius, col[0]);
+                case Canvas::BM_MULTIPLY:
+                    draw_circle_outline<rgba_multiply>(d, x, y, radius, col[0], clip);
+                    break;
+                case BM_MULTIPLY_PM:
+                    draw_circle_outline<rgba_multiply_pm>(d, x, y, radius, col[0], clip);
                     break;
                 default:
                     break;
                 }
             }
         } else {
-            switch (_blendMode) {
-            case BM_REPLACE:
-                draw_gradient_circle<rgba_replace>(*this, x, y, radius, col);
+            switch (get_blend_func(d.getBlendMode(), d.isPremultiplied())) {
+            case Canvas::BM_REPLACE:
+                draw_gradient_circle<rgba_replace>(d, x, y, radius, *a->gradient, clip);
                 break;
-            case BM_ALPHA:
-                draw_gradient_circle<rgba_alpha>(*this, x, y, radius, col);
+            case Canvas::BM_ALPHA:
+                draw_gradient_circle<rgba_alpha>(d, x, y, radius, *a->gradient, clip);
                 break;
-            case BM_ADD:
-                draw_gradient_circle<rgba_add>(*this, x, y, radius, col);
+            case BM_ALPHA_PM:
+                draw_gradient_circle<rgba_alpha_pm>(d, x, y, radius, *a->gradient, clip);
                 break;
-            case BM_SUBTRACT:
-                draw_gradient_circle<rgba_subtract>(*this, x, y, radius, col);
+            case Canvas::BM_ADD:
+                draw_gradient_circle<rgba_add>(d, x, y, radius, *a->gradient, clip);
                 break;
-            case BM_MULTIPLY:
-                draw_gradient_circle<rgba_multiply>(*this, x, y, radius, col);
+            case BM_ADD_PM:
+                draw_gradient_circle<rgba_add_pm>(d, x, y, radius, *a->gradient, clip);
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_gradient_circle<rgba_subtract>(d, x, y, radius, *a->gradient, clip);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_gradient_circle<rgba_multiply>(d, x, y, radius, *a->gradient, clip);
+                break;
+            case BM_MULTIPLY_PM:
+                draw_gradient_circle<rgba_multiply_pm>(d, x, y, radius, *a->gradient, clip);
                 break;
             default:
                 break;
@@ -1248,82 +2123,590 @@ namespace sphere {
     }
 
     //-----------------------------------------------------------------
-    template<BLENDFUNC_T blenderT>
-    static void draw_image(Canvas& dstImage, const Canvas& srcImage, const Recti& rect, const Vec2i& pos)
+    void
+    Canvas::drawCircle(int x, int y, int radius, bool fill, RGBA col[2])
     {
-        Recti dstRect = dstImage.getScissor().getIntersection(Recti(pos.x, pos.y, pos.x + rect.getWidth() - 1, pos.y + rect.getHeight() - 1));
-
-        if (!dstRect.isValid()) {
+        if (radius <= 0 ||
+            x + radius < _scissor.ul.x ||
+            x - radius > _scissor.lr.x ||
+            y + radius < _scissor.ul.y ||
+            y - radius > _scissor.lr.y)
+        {
             return;
         }
 
-        Recti srcRect = rect;
+        modified(clip_rect(Recti(x - radius, y - radius, x + radius, y + radius), _scissor));
 
-        if (dstRect.ul.x != pos.x) {
-            srcRect.ul.x += dstRect.ul.x - pos.x;
+        // premultiplied canvases expect premultiplied colors
+        RGBA pmcol[2];
+        if (_premultiplied) {
+            col = premultiply_colors(col, pmcol, 2);
         }
-        if (dstRect.ul.y != pos.y) {
-            srcRect.ul.y += dstRect.ul.y - pos.y;
-        }
-        if (dstRect.getWidth() != srcRect.getWidth()) {
-            srcRect.lr.x = srcRect.ul.x + dstRect.getWidth() - 1;
+
+        // gradients are looked up by squared distance, in half pixels
+        // for antialiased circles
+        CircleGradient gradient;
+        if (col[0] != col[1]) {
+            i64 r2 = (i64)radius * radius;
+            init_circle_gradient(gradient, _antialias ? r2 * 4 : r2, col);
         }
-        if (dstRect.getHeight() != srcRect.getHeight()) {
-            srcRect.lr.y = srcRect.ul.y + dstRect.getHeight() - 1;
+
+        DrawCircleArgs args = {x, y, radius, fill, _antialias, col, (col[0] != col[1] ? &gradient : 0)};
+        if (!fill && col[0] == col[1]) {
+            // outlines are too thin to be worth splitting
+            draw_circle_band(*this, _scissor, &args);
+        } else {
+            Recti bounds(x - radius, y - radius, x + radius - 1, y + radius - 1);
+            for_each_band(*this, _scissor.getIntersection(bounds), draw_circle_band, &args);
         }
+    }
 
-        int dpitch = dstImage.getWidth();
-        int dinc   = dpitch - dstRect.getWidth();
-        RGBA* dp   = dstImage.getPixels() + (dstRect.ul.y * dpitch) + dstRect.ul.x;
+    //-----------------------------------------------------------------
+    // Triangles are rasterized with edge functions, evaluated on pixel
+    // centers in doubled coordinates so everything stays integral.
+    // Pixels exactly on an edge belong to the triangle only if the edge
+    // is a top or left edge, so adjacent triangles never overlap.
+    struct TriangleEdges {
+        i64   a[3];
+        i64   b[3];
+        i64   c[3];
+        Recti bounds;
+    };
+
+    static bool setup_triangle_edges(const Vec2i pos[3], TriangleEdges& e)
+    {
+        i64 area = (i64)(pos[1].x - pos[0].x) * (pos[2].y - pos[0].y) -
+                   (i64)(pos[1].y - pos[0].y) * (pos[2].x - pos[0].x);
+        if (area == 0) {
+            return false;
+        }
 
-        int spitch = srcImage.getWidth();
-        int sinc   = spitch - srcRect.getWidth();
-        const RGBA* sp = srcImage.getPixels() + (srcRect.ul.y * spitch) + srcRect.ul.x;
+        // make the inside of every edge positive
+        int order[3] = {0, 1, 2};
+        if (area < 0) {
+            order[1] = 2;
+            order[2] = 1;
+        }
 
-        int iy = dstRect.getHeight();
-        while (iy > 0) {
-            int ix = dstRect.getWidth();
-            while (ix > 0) {
-                blenderT(dp, *sp);
-                dp++;
-                sp++;
-                ix--;
+        for (int i = 0; i < 3; ++i) {
+            const Vec2i& p = pos[order[i]];
+            const Vec2i& q = pos[order[(i + 1) % 3]];
+            i64 dx = q.x - p.x;
+            i64 dy = q.y - p.y;
+            // E(x, y) = dx * (2y + 1 - 2py) - dy * (2x + 1 - 2px)
+            e.a[i] = -2 * dy;
+            e.b[i] =  2 * dx;
+            e.c[i] = dx * (1 - 2 * (i64)p.y) - dy * (1 - 2 * (i64)p.x);
+            bool top_left = (dy < 0 || (dy == 0 && dx > 0));
+            if (!top_left) {
+                e.c[i] -= 1;
             }
-            dp += dinc;
-            sp += sinc;
-            iy--;
         }
+
+        // pixel centers covered by the vertices bounding box
+        e.bounds = Recti(std::min(std::min(pos[0].x, pos[1].x), pos[2].x),
+                         std::min(std::min(pos[0].y, pos[1].y), pos[2].y),
+                         std::max(std::max(pos[0].x, pos[1].x), pos[2].x) - 1,
+                         std::max(std::max(pos[0].y, pos[1].y), pos[2].y) - 1);
+        return true;
     }
 
     //-----------------------------------------------------------------
-    void
-    Canvas::drawImage(Canvas* image, const Vec2i& pos)
+    // An attribute interpolated linearly across the triangle,
+    // evaluated on pixel centers.
+    struct TrianglePlane {
+        f64 dx;
+        f64 dy;
+        f64 c;
+
+        void setup(const Vec2i pos[3], f64 v0, f64 v1, f64 v2) {
+            f64 x1 = pos[1].x - pos[0].x;
+            f64 y1 = pos[1].y - pos[0].y;
+            f64 x2 = pos[2].x - pos[0].x;
+            f64 y2 = pos[2].y - pos[0].y;
+            f64 det = x1 * y2 - x2 * y1;
+            dx = ((v1 - v0) * y2 - (v2 - v0) * y1) / det;
+            dy = ((v2 - v0) * x1 - (v1 - v0) * x2) / det;
+            c  = v0 - dx * (pos[0].x - 0.5) - dy * (pos[0].y - 0.5);
+        }
+
+        // value at the center of pixel (x, y) in 16.16 fixed point
+        i32 at(int x, int y) const {
+            return (i32)floor((c + dx * x + dy * y) * 65536.0 + 0.5);
+        }
+
+        i32 step() const {
+            return (i32)floor(dx * 65536.0 + 0.5);
+        }
+    };
+
+    //-----------------------------------------------------------------
+    // Shaders produce the colors of consecutive pixels in a row.
+    struct FlatShader {
+        RGBA col;
+
+        void begin(int, int) { }
+        RGBA next() { return col; }
+    };
+
+    //-----------------------------------------------------------------
+    static inline u8 clamp_fix(i32 v)
     {
-        assert(image);
+        return (u8)bracket(v >> 16, 0, 255);
+    }
 
-        Recti rect(0, 0, image->getWidth() - 1, image->getHeight() - 1);
+    struct GouraudShader {
+        TrianglePlane planes[4];
+        i32 r, g, b, a;
+        i32 dr, dg, db, da;
+
+        void begin(int x, int y) {
+            // round to the nearest color
+            r = planes[0].at(x, y) + 0x8000;
+            g = planes[1].at(x, y) + 0x8000;
+            b = planes[2].at(x, y) + 0x8000;
+            a = planes[3].at(x, y) + 0x8000;
+        }
+
+        RGBA next() {
+            RGBA c(clamp_fix(r), clamp_fix(g), clamp_fix(b), clamp_fix(a));
+            r += dr;
+            g += dg;
+            b += db;
+            a += da;
+            return c;
+        }
+    };
+
+    //-----------------------------------------------------------------
+    struct TextureShader {
+        const RGBA*   pixels;
+        int           width;
+        int           height;
+        int           pitch;
+        TrianglePlane planes[2];
+        i32 u, v;
+        i32 du, dv;
+        int convert; // 1 to premultiply, -1 to unpremultiply texels
+        bool masked;
+        RGBA mask;
+
+        void begin(int x, int y) {
+            u = planes[0].at(x, y);
+            v = planes[1].at(x, y);
+        }
+
+        RGBA next() {
+            int tx = bracket(u >> 16, 0, width  - 1);
+            int ty = bracket(v >> 16, 0, height - 1);
+            RGBA c = pixels[ty * pitch + tx];
+            u += du;
+            v += dv;
+            if (convert > 0) {
+                rgba_premultiply(&c);
+            } else if (convert < 0) {
+                rgba_unpremultiply(&c);
+            }
+            if (masked) {
+                c.red   = c.red   * (mask.red   + 1) >> 8;
+                c.green = c.green * (mask.green + 1) >> 8;
+                c.blue  = c.blue  * (mask.blue  + 1) >> 8;
+                c.alpha = c.alpha * (mask.alpha + 1) >> 8;
+            }
+            return c;
+        }
+    };
+
+    //-----------------------------------------------------------------
+    // Walks the triangle in 8x8 blocks. Blocks outside of an edge are
+    // skipped, blocks inside of all edges are filled without testing
+    // the pixels and only blocks crossed by an edge are tested per pixel.
+    template<BLENDFUNC_T blenderT, typename shaderT>
+    static void draw_triangle(Canvas& d, const TriangleEdges& e, shaderT shader, const Recti& clip)
+    {
+        int cx1 = std::max(clip.ul.x, e.bounds.ul.x);
+        int cy1 = std::max(clip.ul.y, e.bounds.ul.y);
+        int cx2 = std::min(clip.lr.x, e.bounds.lr.x);
+        int cy2 = std::min(clip.lr.y, e.bounds.lr.y);
+        if (cx1 > cx2 || cy1 > cy2) {
+            return;
+        }
+
+        int pitch = d.getStride();
+
+        for (int by = cy1 & ~7; by <= cy2; by += 8) {
+            int y1 = std::max(by, cy1);
+            int y2 = std::min(by + 7, cy2);
+
+            for (int bx = cx1 & ~7; bx <= cx2; bx += 8) {
+                int x1 = std::max(bx, cx1);
+                int x2 = std::min(bx + 7, cx2);
+
+                // classify block by the edge functions at its corners
+                bool outside = false;
+                bool inside  = true;
+                i64  row_e[3];
+                for (int i = 0; i < 3; ++i) {
+                    i64 e00 = e.a[i] * x1 + e.b[i] * y1 + e.c[i];
+                    i64 e10 = e00 + e.a[i] * (x2 - x1);
+                    i64 e01 = e00 + e.b[i] * (y2 - y1);
+                    i64 e11 = e10 + e.b[i] * (y2 - y1);
+                    i64 lo  = std::min(std::min(e00, e10), std::min(e01, e11));
+                    i64 hi  = std::max(std::max(e00, e10), std::max(e01, e11));
+                    if (hi < 0) {
+                        outside = true;
+                        break;
+                    }
+                    if (lo < 0) {
+                        inside = false;
+                    }
+                    row_e[i] = e00;
+                }
+                if (outside) {
+                    continue;
+                }
 
-        switch (_blendMode) {
-        case BM_REPLACE:
-            draw_image<rgba_replace>(*this, *image, rect, pos);
+                RGBA* row = d.getPixels() + y1 * pitch + x1;
+
+                if (inside) {
+                    for (int y = y1; y <= y2; ++y) {
+                        shader.begin(x1, y);
+                        RGBA* dst = row;
+                        for (int x = x1; x <= x2; ++x) {
+                            blenderT(dst, shader.next());
+                            dst++;
+                        }
+                        row += pitch;
+                    }
+                } else {
+                    for (int y = y1; y <= y2; ++y) {
+                        i64 e0 = row_e[0];
+                        i64 e1 = row_e[1];
+                        i64 e2 = row_e[2];
+                        shader.begin(x1, y);
+                        RGBA* dst = row;
+                        for (int x = x1; x <= x2; ++x) {
+                            RGBA c = shader.next();
+                            if ((e0 | e1 | e2) >= 0) {
+                                blenderT(dst, c);
+                            }
+                            e0 += e.a[0];
+                            e1 += e.a[1];
+                            e2 += e.a[2];
+                            dst++;
+                        }
+                        row_e[0] += e.b[0];
+                        row_e[1] += e.b[1];
+                        row_e[2] += e.b[2];
+                        row += pitch;
+                    }
+                }
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    template<typename shaderT>
+    struct DrawTriangleArgs {
+        TriangleEdges edges;
+        shaderT       shader;
+    };
+
+    //-----------------------------------------------------------------
+    template<typename shaderT>
+    static void draw_triangle_band(Canvas& d, const Recti& band, const void* args)
+    {
+        const TriangleEdges& e = ((const DrawTriangleArgs<shaderT>*)args)->edges;
+        const shaderT&  shader = ((const DrawTriangleArgs<shaderT>*)args)->shader;
+        Recti clip = get_band_clip(d, band);
+
+        switch (get_blend_func(d.getBlendMode(), d.isPremultiplied())) {
+        case Canvas::BM_REPLACE:
+            draw_triangle<rgba_replace>(d, e, shader, clip);
+            break;
+        case Canvas::BM_ALPHA:
+            draw_triangle<rgba_alpha>(d, e, shader, clip);
+            break;
+        case BM_ALPHA_PM:
+            draw_triangle<rgba_alpha_pm>(d, e, shader, clip);
+            break;
+        case Canvas::BM_ADD:
+            draw_triangle<rgba_add>(d, e, shader, clip);
             break;
-        case BM_ALPHA:
-            draw_image<rgba_alpha>(*this, *image, rect, pos);
+        case BM_ADD_PM:
+            draw_triangle<rgba_add_pm>(d, e, shader, clip);
             break;
-        case BM_ADD:
-            draw_image<rgba_add>(*this, *image, rect, pos);
+        case Canvas::BM_SUBTRACT:
+            draw_triangle<rgba_subtract>(d, e, shader, clip);
             break;
-        case BM_SUBTRACT:
-            draw_image<rgba_subtract>(*this, *image, rect, pos);
+        case Canvas::BM_MULTIPLY:
+            draw_triangle<rgba_multiply>(d, e, shader, clip);
             break;
-        case BM_MULTIPLY:
-            draw_image<rgba_multiply>(*this, *image, rect, pos);
+        case BM_MULTIPLY_PM:
+            draw_triangle<rgba_multiply_pm>(d, e, shader, clip);
             break;
         default:
             break;
         }
     }
 
+    //-----------------------------------------------------------------
+    static inline Recti get_triangle_area(const TriangleEdges& e, const Recti& scissor)
+    {
+        return Recti(std::max(e.bounds.ul.x, scissor.ul.x),
+                     std::max(e.bounds.ul.y, scissor.ul.y),
+                     std::min(e.bounds.lr.x, scissor.lr.x),
+                     std::min(e.bounds.lr.y, scissor.lr.y));
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawTriangle(Vec2i pos[3], RGBA col[3])
+    {
+        TriangleEdges edges;
+        if (!setup_triangle_edges(pos, edges)) {
+            return;
+        }
+        Recti area = get_triangle_area(edges, _scissor);
+        if (!area.isValid()) {
+            return;
+        }
+
+        modified(area);
+
+        // premultiplied canvases expect premultiplied colors
+        RGBA pmcol[3];
+        if (_premultiplied) {
+            col = premultiply_colors(col, pmcol, 3);
+        }
+
+        if (col[0] == col[1] && col[0] == col[2]) {
+            DrawTriangleArgs<FlatShader> args;
+            args.edges = edges;
+            args.shader.col = col[0];
+            for_each_band(*this, area, draw_triangle_band<FlatShader>, &args);
+        } else {
+            DrawTriangleArgs<GouraudShader> args;
+            args.edges = edges;
+            GouraudShader& shader = args.shader;
+            shader.planes[0].setup(pos, col[0].red,   col[1].red,   col[2].red);
+            shader.planes[1].setup(pos, col[0].green, col[1].green, col[2].green);
+            shader.planes[2].setup(pos, col[0].blue,  col[1].blue,  col[2].blue);
+            shader.planes[3].setup(pos, col[0].alpha, col[1].alpha, col[2].alpha);
+            shader.dr = shader.planes[0].step();
+            shader.dg = shader.planes[1].step();
+            shader.db = shader.planes[2].step();
+            shader.da = shader.planes[3].step();
+            for_each_band(*this, area, draw_triangle_band<GouraudShader>, &args);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawTexturedTriangle(Canvas* image, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask)
+    {
+        assert(image);
+
+        TriangleEdges edges;
+        if (!setup_triangle_edges(pos, edges)) {
+            return;
+        }
+        Recti area = get_triangle_area(edges, _scissor);
+        if (!area.isValid()) {
+            return;
+        }
+
+        modified(area);
+
+        DrawTriangleArgs<TextureShader> args;
+        args.edges = edges;
+        TextureShader& shader = args.shader;
+        shader.pixels = image->getPixels();
+        shader.width  = image->getWidth();
+        shader.pitch  = image->getStride();
+        shader.height = image->getHeight();
+        shader.planes[0].setup(pos, texcoord[0].x, texcoord[1].x, texcoord[2].x);
+        shader.planes[1].setup(pos, texcoord[0].y, texcoord[1].y, texcoord[2].y);
+        shader.du = shader.planes[0].step();
+        shader.dv = shader.planes[1].step();
+        shader.convert = 0;
+        if (image->isPremultiplied() != _premultiplied) {
+            shader.convert = (_premultiplied ? 1 : -1);
+        }
+        shader.mask = mask;
+        shader.masked = (shader.mask != RGBA(255, 255, 255, 255));
+        if (_premultiplied) {
+            rgba_premultiply(&shader.mask);
+        }
+
+        if (sharesPixels(image)) {
+            // rows depend on each other, so they must be drawn in order
+            draw_triangle_band<TextureShader>(*this, area, &args);
+        } else {
+            for_each_band(*this, area, draw_triangle_band<TextureShader>, &args);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static inline void copy_rgb(RGBA* dst, const RGBA* src, int n)
+    {
+        while (n > 0) {
+            dst->red   = src->red;
+            dst->green = src->green;
+            dst->blue  = src->blue;
+            dst++;
+            src++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // Alpha blends n pixels of row sy of src, starting at column sx.
+    // Transparent runs are skipped, opaque runs are copied (rgba_alpha
+    // keeps the destination alpha, rgba_alpha_pm does not) and only the
+    // translucent runs are actually blended.
+    static void blend_alpha_runs(RGBA* dst, const Canvas& src, int sx, int sy, int n, BLENDSPANFUNC_T blendSpan)
+    {
+        int numRuns;
+        const Canvas::Run* run = src.getRuns(sy, numRuns);
+        const RGBA* sp = src.getPixels() + sy * src.getStride();
+        bool premultiplied = src.isPremultiplied();
+
+        int x   = 0;
+        int end = sx + n;
+        while (numRuns > 0 && x < end) {
+            int x1 = std::max(x, sx);
+            int x2 = std::min(x + run->length, end);
+            if (x1 < x2) {
+                switch (run->type) {
+                case Canvas::RUN_OPAQUE:
+                    if (premultiplied) {
+                        memcpy(dst + (x1 - sx), sp + x1, (x2 - x1) * sizeof(RGBA));
+                    } else {
+                        copy_rgb(dst + (x1 - sx), sp + x1, x2 - x1);
+                    }
+                    break;
+                case Canvas::RUN_TRANSLUCENT:
+                    blendSpan(dst + (x1 - sx), sp + x1, x2 - x1);
+                    break;
+                default:
+                    break;
+                }
+            }
+            x += run->length;
+            run++;
+            numRuns--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    struct DrawImageArgs {
+        const Canvas*   src;
+        Vec2i           offset; // from destination to source coordinates
+        BLENDSPANFUNC_T blendSpan;
+        bool            useRuns;
+    };
+
+    //-----------------------------------------------------------------
+    static void draw_image_band(Canvas& dstImage, const Recti& band, const void* args)
+    {
+        const DrawImageArgs* a = (const DrawImageArgs*)args;
+        const Canvas& srcImage = *a->src;
+        BLENDSPANFUNC_T blendSpan = a->blendSpan;
+
+        // source rows in the other alpha format are converted on the fly
+        bool premultiplied = dstImage.isPremultiplied();
+        std::vector<RGBA> row;
+        if (srcImage.isPremultiplied() != premultiplied) {
+            row.resize(band.getWidth());
+        }
+
+        int dpitch = dstImage.getStride();
+        RGBA* dp   = dstImage.getPixels() + (band.ul.y * dpitch) + band.ul.x;
+
+        int spitch = srcImage.getStride();
+        const RGBA* sp = srcImage.getPixels() + ((band.ul.y + a->offset.y) * spitch) + band.ul.x + a->offset.x;
+
+        int width = band.getWidth();
+        int iy = band.getHeight();
+        int sy = band.ul.y + a->offset.y;
+        while (iy > 0) {
+            if (a->useRuns) {
+                blend_alpha_runs(dp, srcImage, band.ul.x + a->offset.x, sy, width, blendSpan);
+            } else if (row.empty()) {
+                blendSpan(dp, sp, width);
+            } else {
+                memcpy(&row[0], sp, width * sizeof(RGBA));
+                if (premultiplied) {
+                    PremultiplySpan(&row[0], width);
+                } else {
+                    UnpremultiplySpan(&row[0], width);
+                }
+                blendSpan(dp, &row[0], width);
+            }
+            dp += dpitch;
+            sp += spitch;
+            sy++;
+            iy--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void draw_image(Canvas& dstImage, const Canvas& srcImage, const Recti& rect, const Vec2i& pos, int blendMode)
+    {
+        Recti target(pos.x, pos.y, pos.x + rect.getWidth() - 1, pos.y + rect.getHeight() - 1);
+        Recti dstRect = dstImage.getScissor().getIntersection(target);
+
+        // getIntersection returns an empty (but valid) rectangle at the origin
+        // if there is no intersection, so make sure the result is really inside
+        if (!dstRect.isValid() || !target.contains(dstRect) || !dstImage.getScissor().contains(dstRect)) {
+            return;
+        }
+
+        // the vectorized kernels process several pixels at once, which
+        // would change the result of drawing a canvas (or a view of the
+        // same pixels) onto itself
+        bool self = dstImage.sharesPixels(&srcImage);
+        BLENDSPANFUNC_T blendSpan = GetBlendSpanFunc(blendMode, dstImage.isPremultiplied(), !self);
+        if (!blendSpan) {
+            return;
+        }
+
+        DrawImageArgs args;
+        args.src       = &srcImage;
+        args.offset    = Vec2i(rect.ul.x - pos.x, rect.ul.y - pos.y);
+        args.blendSpan = blendSpan;
+
+        // sprites are mostly transparent or opaque, alpha blending is
+        // a lot faster if only the translucent pixels are blended
+        args.useRuns = (!self && blendMode == Canvas::BM_ALPHA &&
+                        srcImage.isPremultiplied() == dstImage.isPremultiplied());
+        if (args.useRuns) {
+            // build the run table now, the bands only read it
+            int numRuns;
+            srcImage.getRuns(0, numRuns);
+        }
+
+        if (self) {
+            // rows depend on each other, so they must be drawn in order
+            draw_image_band(dstImage, dstRect, &args);
+        } else {
+            for_each_band(dstImage, dstRect, draw_image_band, &args);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawImage(Canvas* image, const Vec2i& pos)
+    {
+        assert(image);
+
+        Recti rect(0, 0, image->getWidth() - 1, image->getHeight() - 1);
+
+        modified(clip_rect(Recti(pos.x, pos.y, pos.x + rect.getWidth() - 1, pos.y + rect.getHeight() - 1), _scissor));
+        draw_image(*this, *image, rect, pos, _blendMode);
+    }
+
     //-----------------------------------------------------------------
     void
     Canvas::drawSubImage(Canvas* image, const Recti& rect, const Vec2i& pos)
@@ -1334,24 +2717,210 @@ namespace sphere {
             return;
         }
 
-        switch (_blendMode) {
-        case BM_REPLACE:
-            draw_image<rgba_replace>(*this, *image, rect, pos);
-            break;
-        case BM_ALPHA:
-            draw_image<rgba_alpha>(*this, *image, rect, pos);
-            break;
-        case BM_ADD:
-            draw_image<rgba_add>(*this, *image, rect, pos);
-            break;
-        case BM_SUBTRACT:
-            draw_image<rgba_subtract>(*this, *image, rect, pos);
-            break;
-        case BM_MULTIPLY:
-            draw_image<rgba_multiply>(*this, *image, rect, pos);
-            break;
-        default:
-            break;
+        modified(clip_rect(Recti(pos.x, pos.y, pos.x + rect.getWidth() - 1, pos.y + rect.getHeight() - 1), _scissor));
+        draw_image(*this, *image, rect, pos, _blendMode);
+    }
+
+    //-----------------------------------------------------------------
+    // Narrows [x1, x2] down to the pixels x for which t0 + x * dt lies
+    // within [0, max). Returns false if no pixel is left.
+    static inline bool clip_span(f64 t0, f64 dt, f64 max, int& x1, int& x2)
+    {
+        f64 lo = x1;
+        f64 hi = x2;
+        if (dt > 0) {
+            lo = std::max(lo, ceil(-t0 / dt));
+            hi = std::min(hi, ceil((max - t0) / dt) - 1);
+        } else if (dt < 0) {
+            lo = std::max(lo, floor((max - t0) / dt) + 1);
+            hi = std::min(hi, floor(-t0 / dt));
+        } else if (t0 < 0 || t0 >= max) {
+            return false;
+        }
+        if (lo > hi) {
+            return false;
+        }
+        x1 = (int)lo;
+        x2 = (int)hi;
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    static inline RGBA sample_bilinear(const RGBA* src, int pitch, int w, int h, i32 u, i32 v)
+    {
+        // the sample position is relative to the pixel centers
+        u -= 0x8000;
+        v -= 0x8000;
+        int x0 = u >> 16;
+        int y0 = v >> 16;
+        int fx = (u >> 8) & 0xFF;
+        int fy = (v >> 8) & 0xFF;
+        int x1 = bracket(x0 + 1, 0, w - 1);
+        int y1 = bracket(y0 + 1, 0, h - 1);
+        x0 = bracket(x0, 0, w - 1);
+        y0 = bracket(y0, 0, h - 1);
+
+        const RGBA& c00 = src[y0 * pitch + x0];
+        const RGBA& c10 = src[y0 * pitch + x1];
+        const RGBA& c01 = src[y1 * pitch + x0];
+        const RGBA& c11 = src[y1 * pitch + x1];
+
+        int r0 = (c00.red   * (256 - fx) + c10.red   * fx) >> 8;
+        int g0 = (c00.green * (256 - fx) + c10.green * fx) >> 8;
+        int b0 = (c00.blue  * (256 - fx) + c10.blue  * fx) >> 8;
+        int a0 = (c00.alpha * (256 - fx) + c10.alpha * fx) >> 8;
+
+        int r1 = (c01.red   * (256 - fx) + c11.red   * fx) >> 8;
+        int g1 = (c01.green * (256 - fx) + c11.green * fx) >> 8;
+        int b1 = (c01.blue  * (256 - fx) + c11.blue  * fx) >> 8;
+        int a1 = (c01.alpha * (256 - fx) + c11.alpha * fx) >> 8;
+
+        return RGBA((u8)((r0 * (256 - fy) + r1 * fy) >> 8),
+                    (u8)((g0 * (256 - fy) + g1 * fy) >> 8),
+                    (u8)((b0 * (256 - fy) + b1 * fy) >> 8),
+                    (u8)((a0 * (256 - fy) + a1 * fy) >> 8));
+    }
+
+    //-----------------------------------------------------------------
+    struct DrawImageTransformedArgs {
+        const Canvas*   src;
+        Recti           srcRect;
+        f64             inv[6]; // from destination to source coordinates
+        int             filter;
+        BLENDSPANFUNC_T blendSpan;
+    };
+
+    //-----------------------------------------------------------------
+    static void draw_image_transformed_band(Canvas& dstImage, const Recti& band, const void* args)
+    {
+        const DrawImageTransformedArgs* a = (const DrawImageTransformedArgs*)args;
+        const Canvas& srcImage = *a->src;
+        const f64* inv = a->inv;
+
+        int w      = a->srcRect.getWidth();
+        int h      = a->srcRect.getHeight();
+        int spitch = srcImage.getStride();
+        const RGBA* sp = srcImage.getPixels() + (a->srcRect.ul.y * spitch) + a->srcRect.ul.x;
+
+        int dpitch = dstImage.getStride();
+        bool premultiplied = dstImage.isPremultiplied();
+        bool convert = (srcImage.isPremultiplied() != premultiplied);
+
+        std::vector<RGBA> row(band.getWidth());
+
+        // source coordinates are stepped in 16.16 fixed point along each
+        // scanline, but recalculated for every scanline to avoid drift
+        i32 du = (i32)(inv[0] * 65536.0);
+        i32 dv = (i32)(inv[3] * 65536.0);
+
+        for (int y = band.ul.y; y <= band.lr.y; ++y) {
+            // source coordinates of the center of pixel (0, y)
+            f64 u0 = inv[0] * 0.5 + inv[1] * (y + 0.5) + inv[2];
+            f64 v0 = inv[3] * 0.5 + inv[4] * (y + 0.5) + inv[5];
+
+            int x1 = band.ul.x;
+            int x2 = band.lr.x;
+            if (!clip_span(u0, inv[0], w, x1, x2) ||
+                !clip_span(v0, inv[3], h, x1, x2))
+            {
+                continue;
+            }
+
+            i32 u = (i32)floor((u0 + x1 * inv[0]) * 65536.0);
+            i32 v = (i32)floor((v0 + x1 * inv[3]) * 65536.0);
+            int n = x2 - x1 + 1;
+
+            RGBA* rp = &row[0];
+            if (a->filter == Canvas::FILTER_BILINEAR) {
+                for (int i = 0; i < n; ++i) {
+                    rp[i] = sample_bilinear(sp, spitch, w, h, u, v);
+                    u += du;
+                    v += dv;
+                }
+            } else {
+                for (int i = 0; i < n; ++i) {
+                    // stepping may overshoot the edges by a fraction of a pixel
+                    int sx = bracket(u >> 16, 0, w - 1);
+                    int sy = bracket(v >> 16, 0, h - 1);
+                    rp[i] = sp[sy * spitch + sx];
+                    u += du;
+                    v += dv;
+                }
+            }
+
+            if (convert) {
+                if (premultiplied) {
+                    PremultiplySpan(rp, n);
+                } else {
+                    UnpremultiplySpan(rp, n);
+                }
+            }
+
+            a->blendSpan(dstImage.getPixels() + y * dpitch + x1, rp, n);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawImageTransformed(Canvas* image, const Recti& rect, const f32 m[6], int filter)
+    {
+        assert(image);
+
+        if (!rect.isValid() || !Recti(0, 0, image->getWidth()-1, image->getHeight()-1).contains(rect)) {
+            return;
+        }
+
+        // m maps source coordinates (relative to the upper left corner
+        // of rect) to destination coordinates: x' = m0*x + m1*y + m2
+        //                                      y' = m3*x + m4*y + m5
+        f64 det = (f64)m[0] * m[4] - (f64)m[1] * m[3];
+        if (fabs(det) < 1e-9) {
+            return; // degenerated to a line or point
+        }
+
+        DrawImageTransformedArgs args;
+        args.src     = image;
+        args.srcRect = rect;
+        args.filter  = filter;
+        args.inv[0]  =  m[4] / det;
+        args.inv[1]  = -m[1] / det;
+        args.inv[2]  = ((f64)m[1] * m[5] - (f64)m[2] * m[4]) / det;
+        args.inv[3]  = -m[3] / det;
+        args.inv[4]  =  m[0] / det;
+        args.inv[5]  = ((f64)m[2] * m[3] - (f64)m[0] * m[5]) / det;
+
+        args.blendSpan = GetBlendSpanFunc(_blendMode, _premultiplied);
+        if (!args.blendSpan) {
+            return;
+        }
+
+        // bounding box of the transformed rectangle
+        f32 w = (f32)rect.getWidth();
+        f32 h = (f32)rect.getHeight();
+        f32 xs[4] = {m[2], m[0] * w + m[2], m[1] * h + m[2], m[0] * w + m[1] * h + m[2]};
+        f32 ys[4] = {m[5], m[3] * w + m[5], m[4] * h + m[5], m[3] * w + m[4] * h + m[5]};
+        f32 x1 = std::min(std::min(xs[0], xs[1]), std::min(xs[2], xs[3]));
+        f32 x2 = std::max(std::max(xs[0], xs[1]), std::max(xs[2], xs[3]));
+        f32 y1 = std::min(std::min(ys[0], ys[1]), std::min(ys[2], ys[3]));
+        f32 y2 = std::max(std::max(ys[0], ys[1]), std::max(ys[2], ys[3]));
+
+        // clip in floating point, the corners may be far off the canvas
+        Recti bounds((int)floor(std::max(x1, (f32)_scissor.ul.x)),
+                     (int)floor(std::max(y1, (f32)_scissor.ul.y)),
+                     (int)ceil(std::min(x2, (f32)(_scissor.lr.x + 1))) - 1,
+                     (int)ceil(std::min(y2, (f32)(_scissor.lr.y + 1))) - 1);
+
+        if (!bounds.isValid()) {
+            return;
+        }
+
+        modified(bounds);
+
+        if (sharesPixels(image)) {
+            // rows depend on each other, so they must be drawn in order
+            draw_image_transformed_band(*this, bounds, &args);
+        } else {
+            for_each_band(*this, bounds, draw_image_transformed_band, &args);
         }
     }
 
@@ -2,6 +2,7 @@
 #define SPHERE_CANVAS_HPP
 
 #include <string>
+#include <vector>
 #include "../common/RefPtr.hpp"
 #include "../common/RefImpl.hpp"
 #include "../common/IRefCounted.hpp"
@@ -21,21 +22,52 @@ namespace sphere {
             BM_MULTIPLY,
         };
 
+        enum Filter {
+            FILTER_NEAREST = 0,
+            FILTER_BILINEAR,
+        };
+
+        // a run of pixels with the same kind of alpha in a row
+        enum RunType {
+            RUN_TRANSPARENT = 0,
+            RUN_OPAQUE,
+            RUN_TRANSLUCENT,
+        };
+
+        struct Run {
+            int type;
+            int length;
+        };
+
         static int GetNumBytesPerPixel();
 
-        static Canvas* Create(int width, int height, const RGBA* pixels = 0);
+        static Canvas* Create(int width, int height, const RGBA* pixels = 0, bool premultiplied = false);
 
         int   getWidth() const;
         int   getHeight() const;
         int   getPitch() const;
+        int   getStride() const;
         int   getNumPixels() const;
         RGBA* getPixels();
         const RGBA* getPixels() const;
+        bool  isPremultiplied() const;
+        bool  premultiply();
+        bool  unpremultiply();
+        const Run* getRuns(int y, int& numRuns) const;
+        const std::vector<Recti>& getDirtyRects() const;
+        void  clearDirtyRects();
+        bool  isParallel() const;
+        void  setParallel(bool parallel);
+        bool  getAntialias() const;
+        void  setAntialias(bool antialias);
         Canvas* cloneSection(const Recti& section);
+        Canvas* createView(const Recti& section);
+        bool  sharesPixels(const Canvas* canvas) const;
         const RGBA& getPixel(int x, int y) const;
         void  setPixel(int x, int y, const RGBA& color);
         const RGBA& getPixelByIndex(int index) const;
         void  setPixelByIndex(int index, const RGBA& color);
+        void  copyPixels(const RGBA* pixels, int stride, const Recti& rect);
         void  resize(int width, int height);
         void  setAlpha(int alpha);
         void  replaceColor(const RGBA& color, const RGBA& newColor);
@@ -45,6 +77,8 @@ namespace sphere {
         void  flipVertically();
         void  rotateCW();
         void  rotateCCW();
+        void  rotate180();
+        void  transpose();
         const Recti& getScissor() const;
         bool  setScissor(const Recti& scissor);
         int   getBlendMode() const;
@@ -52,19 +86,59 @@ namespace sphere {
         void  drawLine(Vec2i pos[2], RGBA col[2]);
         void  drawRect(const Recti& rect, RGBA col[4]);
         void  drawCircle(int x, int y, int radius, bool fill, RGBA col[2]);
+        void  drawTriangle(Vec2i pos[3], RGBA col[3]);
+        void  drawTexturedTriangle(Canvas* image, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask = RGBA(255, 255, 255));
         void  drawImage(Canvas* image, const Vec2i& pos);
         void  drawSubImage(Canvas* image, const Recti& rect, const Vec2i& pos);
+        void  drawImageTransformed(Canvas* image, const Recti& rect, const f32 m[6], int filter = FILTER_NEAREST);
 
     private:
+        // rows start at multiples of this many bytes
+        enum { ROW_ALIGNMENT = 16 };
+
+        // shared by a canvas and all of its views
+        struct PixelBuffer : public RefImpl<IRefCounted> {
+            u8*   memory;
+            RGBA* pixels;
+            u32   version;
+            int   numCanvases; // the alpha format of shared pixels cannot change
+
+            explicit PixelBuffer(int numPixels);
+            ~PixelBuffer();
+        };
+
         Canvas(int width, int height);
+        Canvas(Canvas& parent, const Recti& section);
         virtual ~Canvas();
 
+        void  allocate(int width, int height);
+
+        // must be called by every method that changes the pixels
+        void  modified();
+        void  modified(const Recti& rect);
+        void  updateRuns() const;
+
     private:
         int   _width;
         int   _height;
+        int   _stride;
         RGBA* _pixels;
+        RefPtr<PixelBuffer> _buffer;
+        RefPtr<Canvas>      _parent;  // if this is a view
+        Vec2i               _offset;  // position in the parent
         Recti _scissor;
         int   _blendMode;
+        bool  _premultiplied;
+        bool  _parallel;
+        bool  _antialias;
+
+        // built on demand by getRuns()
+        mutable std::vector<Run> _runs;
+        mutable std::vector<int> _rowRuns; // index of the first run of each row
+        mutable u32 _runsVersion;
+
+        // coalesced areas changed since the last clearDirtyRects()
+        std::vector<Recti> _dirtyRects;
     };
 
     typedef RefPtr<Canvas> CanvasPtr;
@@ -94,7 +168,14 @@ namespace sphere {
     inline int
     Canvas::getPitch() const
     {
-        return _width * sizeof(RGBA);
+        return _stride * sizeof(RGBA);
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    Canvas::getStride() const
+    {
+        return _stride;
     }
 
     //-----------------------------------------------------------------
@@ -118,6 +199,62 @@ namespace sphere {
         return _pixels;
     }
 
+    //-----------------------------------------------------------------
+    inline bool
+    Canvas::isPremultiplied() const
+    {
+        return _premultiplied;
+    }
+
+    //-----------------------------------------------------------------
+    inline bool
+    Canvas::isParallel() const
+    {
+        return _parallel;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    Canvas::setParallel(bool parallel)
+    {
+        _parallel = parallel;
+    }
+
+    //-----------------------------------------------------------------
+    inline bool
+    Canvas::getAntialias() const
+    {
+        return _antialias;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    Canvas::setAntialias(bool antialias)
+    {
+        _antialias = antialias;
+    }
+
+    //-----------------------------------------------------------------
+    inline bool
+    Canvas::sharesPixels(const Canvas* canvas) const
+    {
+        return _buffer.get() == canvas->_buffer.get();
+    }
+
+    //-----------------------------------------------------------------
+    inline const std::vector<Recti>&
+    Canvas::getDirtyRects() const
+    {
+        return _dirtyRects;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    Canvas::clearDirtyRects()
+    {
+        _dirtyRects.clear();
+    }
+
     //-----------------------------------------------------------------
     inline const Recti&
     Canvas::getScissor() const
@@ -0,0 +1,448 @@
+#include <cassert>
+#include <algorithm>
+#include "video.hpp"
+#include "DrawList.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Unlike Rect::getIntersection, this tells whether the rectangles
+    // overlap at all.
+    static bool intersect_rects(const Recti& a, const Recti& b, Recti& out)
+    {
+        out = Recti(
+            std::max(a.ul.x, b.ul.x),
+            std::max(a.ul.y, b.ul.y),
+            std::min(a.lr.x, b.lr.x),
+            std::min(a.lr.y, b.lr.y)
+        );
+        return out.isValid();
+    }
+
+    //-----------------------------------------------------------------
+    static Recti offset_rect(const Recti& rect, const Vec2i& offset)
+    {
+        return Recti(rect.ul.x + offset.x, rect.ul.y + offset.y, rect.lr.x + offset.x, rect.lr.y + offset.y);
+    }
+
+    //-----------------------------------------------------------------
+    DrawList*
+    DrawList::Create()
+    {
+        return new DrawList();
+    }
+
+    //-----------------------------------------------------------------
+    DrawList::DrawList()
+        : _numCommands(0)
+        , _bounds(0, 0, -1, -1)
+    {
+    }
+
+    //-----------------------------------------------------------------
+    DrawList::~DrawList()
+    {
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::clear()
+    {
+        _commands.clear();
+        _numCommands = 0;
+        _textures.clear();
+        _textureIndices.clear();
+        _bounds = Recti(0, 0, -1, -1);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::addOpcode(int opcode)
+    {
+        _commands.push_back(opcode);
+        _numCommands++;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::addPositions(const Vec2i* pos, int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            _commands.push_back(pos[i].x);
+            _commands.push_back(pos[i].y);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::addColor(const RGBA& col)
+    {
+        _commands.push_back((int)RGBA::Pack(col));
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::addTexture(ITexture* texture)
+    {
+        assert(texture);
+        std::map<ITexture*, int>::iterator it = _textureIndices.find(texture);
+        if (it != _textureIndices.end()) {
+            _commands.push_back(it->second);
+            return;
+        }
+        int index = (int)_textures.size();
+        texture->grab();
+        _textures.push_back(texture);
+        _textureIndices[texture] = index;
+        _commands.push_back(index);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::addRect(const Recti& rect)
+    {
+        _commands.push_back(rect.ul.x);
+        _commands.push_back(rect.ul.y);
+        _commands.push_back(rect.lr.x);
+        _commands.push_back(rect.lr.y);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::extendBounds(const Vec2i* pos, int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            if (!_bounds.isValid()) {
+                _bounds = Recti(pos[i], pos[i]);
+                continue;
+            }
+            _bounds.ul.x = std::min(_bounds.ul.x, pos[i].x);
+            _bounds.ul.y = std::min(_bounds.ul.y, pos[i].y);
+            _bounds.lr.x = std::max(_bounds.lr.x, pos[i].x);
+            _bounds.lr.y = std::max(_bounds.lr.y, pos[i].y);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::setBlendMode(int blendMode)
+    {
+        addOpcode(OP_SET_BLEND_MODE);
+        _commands.push_back(blendMode);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::setScissor(const Recti& scissor)
+    {
+        addOpcode(OP_SET_SCISSOR);
+        addRect(scissor);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::resetScissor()
+    {
+        addOpcode(OP_RESET_SCISSOR);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::drawPoint(const Vec2i& pos, const RGBA& col)
+    {
+        addOpcode(OP_DRAW_POINT);
+        addPositions(&pos, 1);
+        addColor(col);
+        extendBounds(&pos, 1);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::drawLine(Vec2i pos[2], RGBA col[2])
+    {
+        addOpcode(OP_DRAW_LINE);
+        addPositions(pos, 2);
+        addColor(col[0]);
+        addColor(col[1]);
+        extendBounds(pos, 2);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::drawTriangle(Vec2i pos[3], RGBA col[3])
+    {
+        addOpcode(OP_DRAW_TRIANGLE);
+        addPositions(pos, 3);
+        for (int i = 0; i < 3; ++i) {
+            addColor(col[i]);
+        }
+        extendBounds(pos, 3);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::drawRect(const Recti& rect, RGBA col[4])
+    {
+        addOpcode(OP_DRAW_RECT);
+        addRect(rect);
+        for (int i = 0; i < 4; ++i) {
+            addColor(col[i]);
+        }
+        extendBounds(&rect.ul, 1);
+        extendBounds(&rect.lr, 1);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::drawImage(ITexture* image, const Vec2i& pos, const RGBA& mask)
+    {
+        assert(image);
+        addOpcode(OP_DRAW_IMAGE);
+        addTexture(image);
+        addPositions(&pos, 1);
+        addColor(mask);
+        Vec2i corners[2] = {
+            pos,
+            Vec2i(pos.x + image->getSize().width - 1, pos.y + image->getSize().height - 1),
+        };
+        extendBounds(corners, 2);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::drawSubImage(ITexture* image, const Recti& src_rect, const Vec2i& pos, const RGBA& mask)
+    {
+        assert(image);
+        addOpcode(OP_DRAW_SUB_IMAGE);
+        addTexture(image);
+        addRect(src_rect);
+        addPositions(&pos, 1);
+        addColor(mask);
+        Vec2i corners[2] = {
+            pos,
+            Vec2i(pos.x + src_rect.getWidth() - 1, pos.y + src_rect.getHeight() - 1),
+        };
+        extendBounds(corners, 2);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::drawImageQuad(ITexture* image, Vec2i pos[4], const RGBA& mask)
+    {
+        assert(image);
+        addOpcode(OP_DRAW_IMAGE_QUAD);
+        addTexture(image);
+        addPositions(pos, 4);
+        addColor(mask);
+        extendBounds(pos, 4);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::drawSubImageQuad(ITexture* image, const Recti& src_rect, Vec2i pos[4], const RGBA& mask)
+    {
+        assert(image);
+        addOpcode(OP_DRAW_SUB_IMAGE_QUAD);
+        addTexture(image);
+        addRect(src_rect);
+        addPositions(pos, 4);
+        addColor(mask);
+        extendBounds(pos, 4);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DrawList::drawTexturedTriangle(ITexture* texture, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask)
+    {
+        assert(texture);
+        addOpcode(OP_DRAW_TEXTURED_TRIANGLE);
+        addTexture(texture);
+        addPositions(texcoord, 3);
+        addPositions(pos, 3);
+        addColor(mask);
+        extendBounds(pos, 3);
+    }
+
+    //-----------------------------------------------------------------
+    // Commands are replayed through the video API, so the OpenGL driver
+    // merges consecutive quads into one batch per texture. Draw commands
+    // following a scissor that lies outside of the clip are skipped.
+    void
+    DrawList::draw(const Vec2i& offset, const Recti* clip) const
+    {
+        if (_commands.empty() || !_bounds.isValid()) {
+            return;
+        }
+
+        Recti old_scissor;
+        video::GetFrameScissor(old_scissor);
+
+        Recti base_scissor = old_scissor;
+        if (clip && !intersect_rects(base_scissor, *clip, base_scissor)) {
+            return;
+        }
+        Recti visible;
+        if (!intersect_rects(offset_rect(_bounds, offset), base_scissor, visible)) {
+            return;
+        }
+
+        int old_blend_mode = video::GetBlendMode();
+        bool scissor_changed = false;
+        if (base_scissor != old_scissor) {
+            video::SetFrameScissor(base_scissor);
+            scissor_changed = true;
+        }
+
+        bool skip = false;
+        const int* cmd = &_commands[0];
+        const int* end = cmd + _commands.size();
+        while (cmd < end) {
+            int opcode = *cmd++;
+            switch (opcode) {
+                case OP_SET_BLEND_MODE: {
+                    video::SetBlendMode(*cmd++);
+                    break;
+                }
+                case OP_SET_SCISSOR: {
+                    Recti scissor(cmd[0], cmd[1], cmd[2], cmd[3]);
+                    cmd += 4;
+                    skip = !intersect_rects(offset_rect(scissor, offset), base_scissor, scissor);
+                    if (!skip) {
+                        video::SetFrameScissor(scissor);
+                        scissor_changed = true;
+                    }
+                    break;
+                }
+                case OP_RESET_SCISSOR: {
+                    video::SetFrameScissor(base_scissor);
+                    skip = false;
+                    break;
+                }
+                case OP_DRAW_POINT: {
+                    if (!skip) {
+                        video::DrawPoint(Vec2i(cmd[0] + offset.x, cmd[1] + offset.y), RGBA::Unpack((u32)cmd[2]));
+                    }
+                    cmd += 3;
+                    break;
+                }
+                case OP_DRAW_LINE: {
+                    if (!skip) {
+                        Vec2i pos[2] = {
+                            Vec2i(cmd[0] + offset.x, cmd[1] + offset.y),
+                            Vec2i(cmd[2] + offset.x, cmd[3] + offset.y),
+                        };
+                        RGBA col[2] = {
+                            RGBA::Unpack((u32)cmd[4]),
+                            RGBA::Unpack((u32)cmd[5]),
+                        };
+                        video::DrawLine(pos, col);
+                    }
+                    cmd += 6;
+                    break;
+                }
+                case OP_DRAW_TRIANGLE: {
+                    if (!skip) {
+                        Vec2i pos[3] = {
+                            Vec2i(cmd[0] + offset.x, cmd[1] + offset.y),
+                            Vec2i(cmd[2] + offset.x, cmd[3] + offset.y),
+                            Vec2i(cmd[4] + offset.x, cmd[5] + offset.y),
+                        };
+                        RGBA col[3] = {
+                            RGBA::Unpack((u32)cmd[6]),
+                            RGBA::Unpack((u32)cmd[7]),
+                            RGBA::Unpack((u32)cmd[8]),
+                        };
+                        video::DrawTriangle(pos, col);
+                    }
+                    cmd += 9;
+                    break;
+                }
+                case OP_DRAW_RECT: {
+                    if (!skip) {
+                        Recti rect(cmd[0] + offset.x, cmd[1] + offset.y, cmd[2] + offset.x, cmd[3] + offset.y);
+                        RGBA col[4] = {
+                            RGBA::Unpack((u32)cmd[4]),
+                            RGBA::Unpack((u32)cmd[5]),
+                            RGBA::Unpack((u32)cmd[6]),
+                            RGBA::Unpack((u32)cmd[7]),
+                        };
+                        video::DrawRect(rect, col);
+                    }
+                    cmd += 8;
+                    break;
+                }
+                case OP_DRAW_IMAGE: {
+                    if (!skip) {
+                        video::DrawImage(_textures[cmd[0]].get(), Vec2i(cmd[1] + offset.x, cmd[2] + offset.y), RGBA::Unpack((u32)cmd[3]));
+                    }
+                    cmd += 4;
+                    break;
+                }
+                case OP_DRAW_SUB_IMAGE: {
+                    if (!skip) {
+                        Recti src_rect(cmd[1], cmd[2], cmd[3], cmd[4]);
+                        video::DrawSubImage(_textures[cmd[0]].get(), src_rect, Vec2i(cmd[5] + offset.x, cmd[6] + offset.y), RGBA::Unpack((u32)cmd[7]));
+                    }
+                    cmd += 8;
+                    break;
+                }
+                case OP_DRAW_IMAGE_QUAD: {
+                    if (!skip) {
+                        Vec2i pos[4] = {
+                            Vec2i(cmd[1] + offset.x, cmd[2] + offset.y),
+                            Vec2i(cmd[3] + offset.x, cmd[4] + offset.y),
+                            Vec2i(cmd[5] + offset.x, cmd[6] + offset.y),
+                            Vec2i(cmd[7] + offset.x, cmd[8] + offset.y),
+                        };
+                        video::DrawImageQuad(_textures[cmd[0]].get(), pos, RGBA::Unpack((u32)cmd[9]));
+                    }
+                    cmd += 10;
+                    break;
+                }
+                case OP_DRAW_SUB_IMAGE_QUAD: {
+                    if (!skip) {
+                        Recti src_rect(cmd[1], cmd[2], cmd[3], cmd[4]);
+                        Vec2i pos[4] = {
+                            Vec2i(cmd[5]  + offset.x, cmd[6]  + offset.y),
+                            Vec2i(cmd[7]  + offset.x, cmd[8]  + offset.y),
+                            Vec2i(cmd[9]  + offset.x, cmd[10] + offset.y),
+                            Vec2i(cmd[11] + offset.x, cmd[12] + offset.y),
+                        };
+                        video::DrawSubImageQuad(_textures[cmd[0]].get(), src_rect, pos, RGBA::Unpack((u32)cmd[13]));
+                    }
+                    cmd += 14;
+                    break;
+                }
+                case OP_DRAW_TEXTURED_TRIANGLE: {
+                    if (!skip) {
+                        Vec2i texcoord[3] = {
+                            Vec2i(cmd[1], cmd[2]),
+                            Vec2i(cmd[3], cmd[4]),
+                            Vec2i(cmd[5], cmd[6]),
+                        };
+                        Vec2i pos[3] = {
+                            Vec2i(cmd[7]  + offset.x, cmd[8]  + offset.y),
+                            Vec2i(cmd[9]  + offset.x, cmd[10] + offset.y),
+                            Vec2i(cmd[11] + offset.x, cmd[12] + offset.y),
+                        };
+                        video::DrawTexturedTriangle(_textures[cmd[0]].get(), texcoord, pos, RGBA::Unpack((u32)cmd[13]));
+                    }
+                    cmd += 14;
+                    break;
+                }
+                default:
+                    assert(false);
+                    return;
+            }
+        }
+
+        if (scissor_changed) {
+            video::SetFrameScissor(old_scissor);
+        }
+        if (video::GetBlendMode() != old_blend_mode) {
+            video::SetBlendMode(old_blend_mode);
+        }
+    }
+
+} // namespace sphere
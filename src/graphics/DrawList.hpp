@@ -0,0 +1,111 @@
+#ifndef SPHERE_DRAWLIST_HPP
+#define SPHERE_DRAWLIST_HPP
+
+#include <map>
+#include <vector>
+#include "../common/RefPtr.hpp"
+#include "../common/RefImpl.hpp"
+#include "../common/IRefCounted.hpp"
+#include "../base/Vec2.hpp"
+#include "../base/Rect.hpp"
+#include "ITexture.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    // Records video draw calls, so content that does not change from
+    // frame to frame (window styles, backgrounds, static tile layers)
+    // can be replayed with one call instead of being rebuilt each frame.
+    // The commands are stored as a flat stream of integers, textures are
+    // referenced by index and kept alive by the list.
+    class DrawList : public RefImpl<IRefCounted> {
+    public:
+        static DrawList* Create();
+
+        bool  isEmpty() const;
+        int   getNumCommands() const;
+        const Recti& getBounds() const;
+        void  clear();
+
+        // state, the scissor is in list coordinates and is moved by the
+        // replay offset like everything else
+        void  setBlendMode(int blendMode);
+        void  setScissor(const Recti& scissor);
+        void  resetScissor();
+
+        void  drawPoint(const Vec2i& pos, const RGBA& col);
+        void  drawLine(Vec2i pos[2], RGBA col[2]);
+        void  drawTriangle(Vec2i pos[3], RGBA col[3]);
+        void  drawRect(const Recti& rect, RGBA col[4]);
+        void  drawImage(ITexture* image, const Vec2i& pos, const RGBA& mask = RGBA(255, 255, 255));
+        void  drawSubImage(ITexture* image, const Recti& src_rect, const Vec2i& pos, const RGBA& mask = RGBA(255, 255, 255));
+        void  drawImageQuad(ITexture* image, Vec2i pos[4], const RGBA& mask = RGBA(255, 255, 255));
+        void  drawSubImageQuad(ITexture* image, const Recti& src_rect, Vec2i pos[4], const RGBA& mask = RGBA(255, 255, 255));
+        void  drawTexturedTriangle(ITexture* texture, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask = RGBA(255, 255, 255));
+
+        // replays the commands moved by offset, clipped to the current
+        // frame scissor and clip, restores the scissor and blend mode
+        void  draw(const Vec2i& offset, const Recti* clip = 0) const;
+
+    private:
+        enum Opcode {
+            OP_SET_BLEND_MODE = 0,
+            OP_SET_SCISSOR,
+            OP_RESET_SCISSOR,
+            OP_DRAW_POINT,
+            OP_DRAW_LINE,
+            OP_DRAW_TRIANGLE,
+            OP_DRAW_RECT,
+            OP_DRAW_IMAGE,
+            OP_DRAW_SUB_IMAGE,
+            OP_DRAW_IMAGE_QUAD,
+            OP_DRAW_SUB_IMAGE_QUAD,
+            OP_DRAW_TEXTURED_TRIANGLE,
+        };
+
+        DrawList();
+        virtual ~DrawList();
+
+        void  addOpcode(int opcode);
+        void  addPositions(const Vec2i* pos, int count);
+        void  addColor(const RGBA& col);
+        void  addTexture(ITexture* texture);
+        void  addRect(const Recti& rect);
+        void  extendBounds(const Vec2i* pos, int count);
+
+    private:
+        std::vector<int>          _commands;
+        int                       _numCommands;
+        std::vector<TexturePtr>   _textures;
+        std::map<ITexture*, int>  _textureIndices;
+        Recti                     _bounds; // invalid if nothing was drawn
+    };
+
+    typedef RefPtr<DrawList> DrawListPtr;
+
+    //-----------------------------------------------------------------
+    inline bool
+    DrawList::isEmpty() const
+    {
+        return _numCommands == 0;
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    DrawList::getNumCommands() const
+    {
+        return _numCommands;
+    }
+
+    //-----------------------------------------------------------------
+    inline const Recti&
+    DrawList::getBounds() const
+    {
+        return _bounds;
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -4,6 +4,7 @@
 #include "../common/IRefCounted.hpp"
 #include "../common/RefPtr.hpp"
 #include "../base/Dim2.hpp"
+#include "../base/Rect.hpp"
 
 
 namespace sphere {
@@ -11,7 +12,9 @@ namespace sphere {
     class ITexture : public IRefCounted {
     public:
         virtual const Dim2i& getTextureSize() const = 0;
+        virtual const Recti& getTextureRect() const = 0; // area of the texture holding the pixels
         virtual const Dim2i& getSize() const = 0;
+        virtual bool isPremultiplied() const = 0;
 
     protected:
         ~ITexture() { }
@@ -0,0 +1,596 @@
+#include "../common/cpu.hpp"
+#if defined(SPHERE_SSE2)
+#  include <emmintrin.h>
+#endif
+#if defined(SPHERE_AVX2)
+#  include <immintrin.h>
+#endif
+#include "Canvas.hpp"
+#include "blend.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // scalar kernels
+    //-----------------------------------------------------------------
+    template<BLENDFUNC_T blenderT>
+    static void blend_span(RGBA* dst, const RGBA* src, int n)
+    {
+        while (n > 0) {
+            blenderT(dst, *src);
+            dst++;
+            src++;
+            n--;
+        }
+    }
+
+#if defined(SPHERE_SSE2)
+
+    //-----------------------------------------------------------------
+    // SSE2 kernels, 4 pixels per iteration
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("sse2")
+    static inline __m128i keep_alpha_sse2(__m128i result, __m128i dst)
+    {
+        // RGBA is stored as r, g, b, a bytes, i.e. alpha is the top byte of each little endian dword
+        const __m128i amask = _mm_set1_epi32(0xFF000000);
+        return _mm_or_si128(_mm_andnot_si128(amask, result), _mm_and_si128(amask, dst));
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("sse2")
+    static void blend_span_replace_sse2(RGBA* dst, const RGBA* src, int n)
+    {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+        }
+        blend_span<rgba_replace>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("sse2")
+    static inline __m128i blend_alpha_half_sse2(__m128i s16, __m128i d16)
+    {
+        const __m128i one  = _mm_set1_epi16(1);
+        const __m128i c256 = _mm_set1_epi16(256);
+
+        // two pixels in 16 bit lanes (r0 g0 b0 a0 r1 g1 b1 a1), broadcast the alphas
+        __m128i a16 = _mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+        a16 = _mm_shufflehi_epi16(a16, _MM_SHUFFLE(3, 3, 3, 3));
+
+        __m128i sa = _mm_add_epi16(a16, one);
+        __m128i da = _mm_sub_epi16(c256, a16);
+
+        // d * da + s * sa <= 255 * 257, so the sum fits into 16 unsigned bits
+        __m128i sum = _mm_add_epi16(_mm_mullo_epi16(d16, da), _mm_mullo_epi16(s16, sa));
+        return _mm_srli_epi16(sum, 8);
+    }
+
+    SPHERE_TARGET("sse2")
+    static void blend_span_alpha_sse2(RGBA* dst, const RGBA* src, int n)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+            __m128i lo = blend_alpha_half_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            __m128i hi = blend_alpha_half_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+            _mm_storeu_si128((__m128i*)(dst + i), keep_alpha_sse2(_mm_packus_epi16(lo, hi), d));
+        }
+        blend_span<rgba_alpha>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("sse2")
+    static void blend_span_add_sse2(RGBA* dst, const RGBA* src, int n)
+    {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), keep_alpha_sse2(_mm_adds_epu8(d, s), d));
+        }
+        blend_span<rgba_add>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("sse2")
+    static void blend_span_subtract_sse2(RGBA* dst, const RGBA* src, int n)
+    {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), keep_alpha_sse2(_mm_subs_epu8(d, s), d));
+        }
+        blend_span<rgba_subtract>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("sse2")
+    static void blend_span_multiply_sse2(RGBA* dst, const RGBA* src, int n)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one  = _mm_set1_epi16(1);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+            // d * (s + 1) <= 255 * 256
+            __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_add_epi16(_mm_unpacklo_epi8(s, zero), one));
+            __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_add_epi16(_mm_unpackhi_epi8(s, zero), one));
+
+            __m128i r = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+            _mm_storeu_si128((__m128i*)(dst + i), keep_alpha_sse2(r, d));
+        }
+        blend_span<rgba_multiply>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("sse2")
+    static inline __m128i blend_alpha_pm_half_sse2(__m128i s16, __m128i d16)
+    {
+        const __m128i c256 = _mm_set1_epi16(256);
+
+        __m128i a16 = _mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+        a16 = _mm_shufflehi_epi16(a16, _MM_SHUFFLE(3, 3, 3, 3));
+
+        // d * (256 - a) <= 255 * 256
+        return _mm_srli_epi16(_mm_mullo_epi16(d16, _mm_sub_epi16(c256, a16)), 8);
+    }
+
+    SPHERE_TARGET("sse2")
+    static void blend_span_alpha_pm_sse2(RGBA* dst, const RGBA* src, int n)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+            __m128i lo = blend_alpha_pm_half_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            __m128i hi = blend_alpha_pm_half_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+        }
+        blend_span<rgba_alpha_pm>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("sse2")
+    static void blend_span_add_pm_sse2(RGBA* dst, const RGBA* src, int n)
+    {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epu8(d, s));
+        }
+        blend_span<rgba_add_pm>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("sse2")
+    static inline __m128i blend_multiply_pm_half_sse2(__m128i s16, __m128i d16)
+    {
+        const __m128i c256 = _mm_set1_epi16(256);
+
+        __m128i a16 = _mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+        a16 = _mm_shufflehi_epi16(a16, _MM_SHUFFLE(3, 3, 3, 3));
+
+        // min(s + 256 - a, 256) <= 256, so the product fits into 16 unsigned bits
+        __m128i f = _mm_min_epi16(_mm_add_epi16(s16, _mm_sub_epi16(c256, a16)), c256);
+        return _mm_srli_epi16(_mm_mullo_epi16(d16, f), 8);
+    }
+
+    SPHERE_TARGET("sse2")
+    static void blend_span_multiply_pm_sse2(RGBA* dst, const RGBA* src, int n)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+            __m128i lo = blend_multiply_pm_half_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            __m128i hi = blend_multiply_pm_half_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+            _mm_storeu_si128((__m128i*)(dst + i), keep_alpha_sse2(_mm_packus_epi16(lo, hi), d));
+        }
+        blend_span<rgba_multiply_pm>(dst + i, src + i, n - i);
+    }
+
+#endif // SPHERE_SSE2
+
+#if defined(SPHERE_AVX2)
+
+    //-----------------------------------------------------------------
+    // AVX2 kernels, 8 pixels per iteration
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("avx2")
+    static inline __m256i keep_alpha_avx2(__m256i result, __m256i dst)
+    {
+        const __m256i amask = _mm256_set1_epi32(0xFF000000);
+        return _mm256_or_si256(_mm256_andnot_si256(amask, result), _mm256_and_si256(amask, dst));
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("avx2")
+    static void blend_span_replace_avx2(RGBA* dst, const RGBA* src, int n)
+    {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+        }
+        blend_span<rgba_replace>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("avx2")
+    static inline __m256i blend_alpha_half_avx2(__m256i s16, __m256i d16)
+    {
+        const __m256i one  = _mm256_set1_epi16(1);
+        const __m256i c256 = _mm256_set1_epi16(256);
+
+        __m256i a16 = _mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+        a16 = _mm256_shufflehi_epi16(a16, _MM_SHUFFLE(3, 3, 3, 3));
+
+        __m256i sa = _mm256_add_epi16(a16, one);
+        __m256i da = _mm256_sub_epi16(c256, a16);
+
+        __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(d16, da), _mm256_mullo_epi16(s16, sa));
+        return _mm256_srli_epi16(sum, 8);
+    }
+
+    SPHERE_TARGET("avx2")
+    static void blend_span_alpha_avx2(RGBA* dst, const RGBA* src, int n)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+
+            // unpack and pack work within 128 bit lanes, so the pixel order is preserved
+            __m256i lo = blend_alpha_half_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+            __m256i hi = blend_alpha_half_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+
+            _mm256_storeu_si256((__m256i*)(dst + i), keep_alpha_avx2(_mm256_packus_epi16(lo, hi), d));
+        }
+        blend_span<rgba_alpha>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("avx2")
+    static void blend_span_add_avx2(RGBA* dst, const RGBA* src, int n)
+    {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), keep_alpha_avx2(_mm256_adds_epu8(d, s), d));
+        }
+        blend_span<rgba_add>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("avx2")
+    static void blend_span_subtract_avx2(RGBA* dst, const RGBA* src, int n)
+    {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), keep_alpha_avx2(_mm256_subs_epu8(d, s), d));
+        }
+        blend_span<rgba_subtract>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("avx2")
+    static void blend_span_multiply_avx2(RGBA* dst, const RGBA* src, int n)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one  = _mm256_set1_epi16(1);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+
+            __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_add_epi16(_mm256_unpacklo_epi8(s, zero), one));
+            __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_add_epi16(_mm256_unpackhi_epi8(s, zero), one));
+
+            __m256i r = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+            _mm256_storeu_si256((__m256i*)(dst + i), keep_alpha_avx2(r, d));
+        }
+        blend_span<rgba_multiply>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("avx2")
+    static inline __m256i blend_alpha_pm_half_avx2(__m256i s16, __m256i d16)
+    {
+        const __m256i c256 = _mm256_set1_epi16(256);
+
+        __m256i a16 = _mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+        a16 = _mm256_shufflehi_epi16(a16, _MM_SHUFFLE(3, 3, 3, 3));
+
+        return _mm256_srli_epi16(_mm256_mullo_epi16(d16, _mm256_sub_epi16(c256, a16)), 8);
+    }
+
+    SPHERE_TARGET("avx2")
+    static void blend_span_alpha_pm_avx2(RGBA* dst, const RGBA* src, int n)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+
+            __m256i lo = blend_alpha_pm_half_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+            __m256i hi = blend_alpha_pm_half_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+        }
+        blend_span<rgba_alpha_pm>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("avx2")
+    static void blend_span_add_pm_avx2(RGBA* dst, const RGBA* src, int n)
+    {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_adds_epu8(d, s));
+        }
+        blend_span<rgba_add_pm>(dst + i, src + i, n - i);
+    }
+
+    //-----------------------------------------------------------------
+    SPHERE_TARGET("avx2")
+    static inline __m256i blend_multiply_pm_half_avx2(__m256i s16, __m256i d16)
+    {
+        const __m256i c256 = _mm256_set1_epi16(256);
+
+        __m256i a16 = _mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+        a16 = _mm256_shufflehi_epi16(a16, _MM_SHUFFLE(3, 3, 3, 3));
+
+        __m256i f = _mm256_min_epi16(_mm256_add_epi16(s16, _mm256_sub_epi16(c256, a16)), c256);
+        return _mm256_srli_epi16(_mm256_mullo_epi16(d16, f), 8);
+    }
+
+    SPHERE_TARGET("avx2")
+    static void blend_span_multiply_pm_avx2(RGBA* dst, const RGBA* src, int n)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+
+            __m256i lo = blend_multiply_pm_half_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+            __m256i hi = blend_multiply_pm_half_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+
+            _mm256_storeu_si256((__m256i*)(dst + i), keep_alpha_avx2(_mm256_packus_epi16(lo, hi), d));
+        }
+        blend_span<rgba_multiply_pm>(dst + i, src + i, n - i);
+    }
+
+#endif // SPHERE_AVX2
+
+    //-----------------------------------------------------------------
+    // dispatch
+    //-----------------------------------------------------------------
+    namespace {
+
+        const int NUM_BLEND_MODES = Canvas::BM_MULTIPLY + 1;
+
+        // straight alpha kernels followed by premultiplied alpha kernels
+        const BLENDSPANFUNC_T g_ScalarSpanFuncs[2 * NUM_BLEND_MODES] = {
+            blend_span<rgba_replace>,
+            blend_span<rgba_alpha>,
+            blend_span<rgba_add>,
+            blend_span<rgba_subtract>,
+            blend_span<rgba_multiply>,
+
+            blend_span<rgba_replace>,
+            blend_span<rgba_alpha_pm>,
+            blend_span<rgba_add_pm>,
+            blend_span<rgba_subtract>,
+            blend_span<rgba_multiply_pm>,
+        };
+
+#if defined(SPHERE_SSE2)
+        const BLENDSPANFUNC_T g_SSE2SpanFuncs[2 * NUM_BLEND_MODES] = {
+            blend_span_replace_sse2,
+            blend_span_alpha_sse2,
+            blend_span_add_sse2,
+            blend_span_subtract_sse2,
+            blend_span_multiply_sse2,
+
+            blend_span_replace_sse2,
+            blend_span_alpha_pm_sse2,
+            blend_span_add_pm_sse2,
+            blend_span_subtract_sse2,
+            blend_span_multiply_pm_sse2,
+        };
+#endif
+
+#if defined(SPHERE_AVX2)
+        const BLENDSPANFUNC_T g_AVX2SpanFuncs[2 * NUM_BLEND_MODES] = {
+            blend_span_replace_avx2,
+            blend_span_alpha_avx2,
+            blend_span_add_avx2,
+            blend_span_subtract_avx2,
+            blend_span_multiply_avx2,
+
+            blend_span_replace_avx2,
+            blend_span_alpha_pm_avx2,
+            blend_span_add_pm_avx2,
+            blend_span_subtract_avx2,
+            blend_span_multiply_pm_avx2,
+        };
+#endif
+
+        struct SpanTable {
+            const BLENDSPANFUNC_T* funcs;
+            const char* isa;
+        };
+
+        SpanTable select_span_table()
+        {
+            SpanTable table = { g_ScalarSpanFuncs, "scalar" };
+#if defined(SPHERE_AVX2)
+            if (HasAVX2()) {
+                table.funcs = g_AVX2SpanFuncs;
+                table.isa   = "avx2";
+                return table;
+            }
+#endif
+#if defined(SPHERE_SSE2)
+            if (HasSSE2()) {
+                table.funcs = g_SSE2SpanFuncs;
+                table.isa   = "sse2";
+                return table;
+            }
+#endif
+            return table;
+        }
+
+        // the cpu is queried only once, during static initialization
+        const SpanTable g_SpanTable = select_span_table();
+
+        //-----------------------------------------------------------------
+        // transpose kernels, each handles a block of at most
+        // TRANSPOSE_BLOCK x TRANSPOSE_BLOCK pixels
+        //-----------------------------------------------------------------
+        const int TRANSPOSE_BLOCK = 32;
+
+        typedef void (*TRANSPOSEFUNC_T)(RGBA* dst, int dstStride, const RGBA* src, int srcStride, int width, int height);
+
+        void transpose_block(RGBA* dst, int dstStride, const RGBA* src, int srcStride, int width, int height)
+        {
+            for (int y = 0; y < height; ++y) {
+                const RGBA* s = src + y * srcStride;
+                RGBA* d = dst + y;
+                for (int x = 0; x < width; ++x) {
+                    *d = s[x];
+                    d += dstStride;
+                }
+            }
+        }
+
+#if defined(SPHERE_SSE2)
+        SPHERE_TARGET("sse2")
+        void transpose_block_sse2(RGBA* dst, int dstStride, const RGBA* src, int srcStride, int width, int height)
+        {
+            int w4 = width  & ~3;
+            int h4 = height & ~3;
+            for (int y = 0; y < h4; y += 4) {
+                const RGBA* s = src + y * srcStride;
+                for (int x = 0; x < w4; x += 4) {
+                    __m128i r0 = _mm_loadu_si128((const __m128i*)(s + x));
+                    __m128i r1 = _mm_loadu_si128((const __m128i*)(s + x + srcStride));
+                    __m128i r2 = _mm_loadu_si128((const __m128i*)(s + x + srcStride * 2));
+                    __m128i r3 = _mm_loadu_si128((const __m128i*)(s + x + srcStride * 3));
+
+                    // 4x4 transpose of 32 bit pixels
+                    __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+                    __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+                    __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+                    __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+                    RGBA* d = dst + x * dstStride + y;
+                    _mm_storeu_si128((__m128i*)(d),                 _mm_unpacklo_epi64(t0, t1));
+                    _mm_storeu_si128((__m128i*)(d + dstStride),     _mm_unpackhi_epi64(t0, t1));
+                    _mm_storeu_si128((__m128i*)(d + dstStride * 2), _mm_unpacklo_epi64(t2, t3));
+                    _mm_storeu_si128((__m128i*)(d + dstStride * 3), _mm_unpackhi_epi64(t2, t3));
+                }
+            }
+
+            // remaining columns and rows
+            if (w4 < width) {
+                transpose_block(dst + w4 * dstStride, dstStride, src + w4, srcStride, width - w4, h4);
+            }
+            if (h4 < height) {
+                transpose_block(dst + h4, dstStride, src + h4 * srcStride, srcStride, width, height - h4);
+            }
+        }
+#endif
+
+        TRANSPOSEFUNC_T select_transpose_func()
+        {
+#if defined(SPHERE_SSE2)
+            if (HasSSE2()) {
+                return transpose_block_sse2;
+            }
+#endif
+            return transpose_block;
+        }
+
+        const TRANSPOSEFUNC_T g_TransposeBlock = select_transpose_func();
+
+    } // namespace
+
+    //-----------------------------------------------------------------
+    BLENDSPANFUNC_T GetBlendSpanFunc(int blendMode, bool premultiplied, bool vectorized)
+    {
+        if (blendMode < 0 || blendMode >= NUM_BLEND_MODES) {
+            return 0;
+        }
+        int index = (premultiplied ? NUM_BLEND_MODES + blendMode : blendMode);
+        if (!vectorized || !g_SpanTable.funcs) {
+            return g_ScalarSpanFuncs[index];
+        }
+        return g_SpanTable.funcs[index];
+    }
+
+    //-----------------------------------------------------------------
+    void PremultiplySpan(RGBA* pixels, int n)
+    {
+        while (n > 0) {
+            rgba_premultiply(pixels);
+            pixels++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void UnpremultiplySpan(RGBA* pixels, int n)
+    {
+        while (n > 0) {
+            rgba_unpremultiply(pixels);
+            pixels++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void TransposePixels(RGBA* dst, int dstStride, const RGBA* src, int srcStride, int width, int height)
+    {
+        for (int by = 0; by < height; by += TRANSPOSE_BLOCK) {
+            int bh = std::min(TRANSPOSE_BLOCK, height - by);
+            for (int bx = 0; bx < width; bx += TRANSPOSE_BLOCK) {
+                int bw = std::min(TRANSPOSE_BLOCK, width - bx);
+                g_TransposeBlock(dst + bx * dstStride + by, dstStride,
+                                 src + by * srcStride + bx, srcStride,
+                                 bw, bh);
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    const char* GetBlendSpanISA()
+    {
+        return g_SpanTable.isa ? g_SpanTable.isa : "scalar";
+    }
+
+} // namespace sphere
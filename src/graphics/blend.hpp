@@ -0,0 +1,273 @@
+#ifndef SPHERE_BLEND_HPP
+#define SPHERE_BLEND_HPP
+
+#include <algorithm>
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    typedef void (*BLENDFUNC_T)(RGBA*, const RGBA&);
+
+    inline void rgba_replace(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = src.red;
+        dst->green = src.green;
+        dst->blue  = src.blue;
+        dst->alpha = src.alpha;
+    }
+
+    inline void rgba_alpha(RGBA* dst, const RGBA& src)
+    {
+        int sa =        src.alpha  + 1;
+        int da = (255 - src.alpha) + 1;
+        dst->red   = (dst->red   * da + src.red   * sa) >> 8;
+        dst->green = (dst->green * da + src.green * sa) >> 8;
+        dst->blue  = (dst->blue  * da + src.blue  * sa) >> 8;
+    }
+
+    inline void rgba_add(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = std::min(dst->red   + src.red,   255);
+        dst->green = std::min(dst->green + src.green, 255);
+        dst->blue  = std::min(dst->blue  + src.blue,  255);
+    }
+
+    inline void rgba_subtract(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = std::max(dst->red   - src.red,   0);
+        dst->green = std::max(dst->green - src.green, 0);
+        dst->blue  = std::max(dst->blue  - src.blue,  0);
+    }
+
+    inline void rgba_multiply(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = dst->red   * (src.red   + 1) >> 8;
+        dst->green = dst->green * (src.green + 1) >> 8;
+        dst->blue  = dst->blue  * (src.blue  + 1) >> 8;
+    }
+
+    //-----------------------------------------------------------------
+    typedef void (*BLENDFUNCFIX_T)(RGBA*, u32, u32, u32, u32);
+
+    inline void rgba_replace_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        dst->red   = r >> 12;
+        dst->green = g >> 12;
+        dst->blue  = b >> 12;
+        dst->alpha = a >> 12;
+    }
+
+    inline void rgba_alpha_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        int sa =        (a >> 12)  + 1;
+        int da = (255 - (a >> 12)) + 1;
+        dst->red   = (dst->red   * da + (r >> 12) * sa) >> 8;
+        dst->green = (dst->green * da + (g >> 12) * sa) >> 8;
+        dst->blue  = (dst->blue  * da + (b >> 12) * sa) >> 8;
+    }
+
+    inline void rgba_add_fix(RGBA* dst, u32 r, u32 g, u32 b, u32)
+    {
+        dst->red   = std::min(dst->red   + (u8)(r >> 12), 255);
+        dst->green = std::min(dst->green + (u8)(g >> 12), 255);
+        dst->blue  = std::min(dst->blue  + (u8)(b >> 12), 255);
+    }
+
+    inline void rgba_subtract_fix(RGBA* dst, u32 r, u32 g, u32 b, u32)
+    {
+        dst->red   = std::max(dst->red   - (u8)(r >> 12), 0);
+        dst->green = std::max(dst->green - (u8)(g >> 12), 0);
+        dst->blue  = std::max(dst->blue  - (u8)(b >> 12), 0);
+    }
+
+    inline void rgba_multiply_fix(RGBA* dst, u32 r, u32 g, u32 b, u32)
+    {
+        dst->red   = dst->red   * ((r >> 12) + 1) >> 8;
+        dst->green = dst->green * ((g >> 12) + 1) >> 8;
+        dst->blue  = dst->blue  * ((b >> 12) + 1) >> 8;
+    }
+
+    //-----------------------------------------------------------------
+    // Premultiplied alpha versions of the blenders. Replace and subtract
+    // are the same for both formats, add is the Porter-Duff plus operator.
+    inline void rgba_alpha_pm(RGBA* dst, const RGBA& src)
+    {
+        int da = 256 - src.alpha;
+        dst->red   = std::min(src.red   + ((dst->red   * da) >> 8), 255);
+        dst->green = std::min(src.green + ((dst->green * da) >> 8), 255);
+        dst->blue  = std::min(src.blue  + ((dst->blue  * da) >> 8), 255);
+        dst->alpha = std::min(src.alpha + ((dst->alpha * da) >> 8), 255);
+    }
+
+    inline void rgba_add_pm(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = std::min(dst->red   + src.red,   255);
+        dst->green = std::min(dst->green + src.green, 255);
+        dst->blue  = std::min(dst->blue  + src.blue,  255);
+        dst->alpha = std::min(dst->alpha + src.alpha, 255);
+    }
+
+    inline void rgba_multiply_pm(RGBA* dst, const RGBA& src)
+    {
+        // transparent source pixels leave the destination untouched
+        int da = 256 - src.alpha;
+        dst->red   = dst->red   * std::min(src.red   + da, 256) >> 8;
+        dst->green = dst->green * std::min(src.green + da, 256) >> 8;
+        dst->blue  = dst->blue  * std::min(src.blue  + da, 256) >> 8;
+    }
+
+    inline void rgba_alpha_pm_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        RGBA src((u8)(r >> 12), (u8)(g >> 12), (u8)(b >> 12), (u8)(a >> 12));
+        rgba_alpha_pm(dst, src);
+    }
+
+    inline void rgba_add_pm_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        RGBA src((u8)(r >> 12), (u8)(g >> 12), (u8)(b >> 12), (u8)(a >> 12));
+        rgba_add_pm(dst, src);
+    }
+
+    inline void rgba_multiply_pm_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        RGBA src((u8)(r >> 12), (u8)(g >> 12), (u8)(b >> 12), (u8)(a >> 12));
+        rgba_multiply_pm(dst, src);
+    }
+
+    //-----------------------------------------------------------------
+    // Blenders for antialiased primitives. The source only covers part
+    // of the pixel, coverage 255 gives the same result as the plain
+    // blender and coverage 0 leaves the destination untouched.
+    typedef void (*BLENDFUNCCOV_T)(RGBA*, const RGBA&, int);
+
+    inline void rgba_replace_cov(RGBA* dst, const RGBA& src, int cov)
+    {
+        int s = cov + 1;
+        dst->red   = dst->red   + (((src.red   - dst->red)   * s) >> 8);
+        dst->green = dst->green + (((src.green - dst->green) * s) >> 8);
+        dst->blue  = dst->blue  + (((src.blue  - dst->blue)  * s) >> 8);
+        dst->alpha = dst->alpha + (((src.alpha - dst->alpha) * s) >> 8);
+    }
+
+    inline void rgba_alpha_cov(RGBA* dst, const RGBA& src, int cov)
+    {
+        RGBA c = src;
+        c.alpha = (u8)(src.alpha * (cov + 1) >> 8);
+        rgba_alpha(dst, c);
+    }
+
+    inline void rgba_add_cov(RGBA* dst, const RGBA& src, int cov)
+    {
+        int s = cov + 1;
+        RGBA c((u8)(src.red * s >> 8), (u8)(src.green * s >> 8), (u8)(src.blue * s >> 8), src.alpha);
+        rgba_add(dst, c);
+    }
+
+    inline void rgba_subtract_cov(RGBA* dst, const RGBA& src, int cov)
+    {
+        int s = cov + 1;
+        RGBA c((u8)(src.red * s >> 8), (u8)(src.green * s >> 8), (u8)(src.blue * s >> 8), src.alpha);
+        rgba_subtract(dst, c);
+    }
+
+    inline void rgba_multiply_cov(RGBA* dst, const RGBA& src, int cov)
+    {
+        // partially covered pixels are multiplied by a lighter color
+        int s = cov + 1;
+        RGBA c((u8)(255 - ((255 - src.red)   * s >> 8)),
+               (u8)(255 - ((255 - src.green) * s >> 8)),
+               (u8)(255 - ((255 - src.blue)  * s >> 8)),
+               src.alpha);
+        rgba_multiply(dst, c);
+    }
+
+    inline void rgba_scale_pm(RGBA& c, const RGBA& src, int cov)
+    {
+        int s = cov + 1;
+        c.red   = (u8)(src.red   * s >> 8);
+        c.green = (u8)(src.green * s >> 8);
+        c.blue  = (u8)(src.blue  * s >> 8);
+        c.alpha = (u8)(src.alpha * s >> 8);
+    }
+
+    inline void rgba_alpha_pm_cov(RGBA* dst, const RGBA& src, int cov)
+    {
+        RGBA c;
+        rgba_scale_pm(c, src, cov);
+        rgba_alpha_pm(dst, c);
+    }
+
+    inline void rgba_add_pm_cov(RGBA* dst, const RGBA& src, int cov)
+    {
+        RGBA c;
+        rgba_scale_pm(c, src, cov);
+        rgba_add_pm(dst, c);
+    }
+
+    inline void rgba_multiply_pm_cov(RGBA* dst, const RGBA& src, int cov)
+    {
+        RGBA c;
+        rgba_scale_pm(c, src, cov);
+        rgba_multiply_pm(dst, c);
+    }
+
+    //-----------------------------------------------------------------
+    // Conversion between straight and premultiplied alpha.
+    inline void rgba_premultiply(RGBA* c)
+    {
+        // with t = x + 128, (t + (t >> 8)) >> 8 is x / 255 rounded to nearest
+        u32 a = c->alpha;
+        u32 r = c->red   * a + 128;
+        u32 g = c->green * a + 128;
+        u32 b = c->blue  * a + 128;
+        c->red   = (u8)((r + (r >> 8)) >> 8);
+        c->green = (u8)((g + (g >> 8)) >> 8);
+        c->blue  = (u8)((b + (b >> 8)) >> 8);
+    }
+
+    inline void rgba_unpremultiply(RGBA* c)
+    {
+        u32 a = c->alpha;
+        if (a == 0) {
+            c->red   = 0;
+            c->green = 0;
+            c->blue  = 0;
+        } else if (a != 255) {
+            c->red   = (u8)std::min<u32>((c->red   * 255 + a / 2) / a, 255);
+            c->green = (u8)std::min<u32>((c->green * 255 + a / 2) / a, 255);
+            c->blue  = (u8)std::min<u32>((c->blue  * 255 + a / 2) / a, 255);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // Blends a row of n source pixels onto n destination pixels.
+    // The vectorized kernels produce exactly the same results as
+    // the per pixel blenders above, but src and dst must not overlap.
+    typedef void (*BLENDSPANFUNC_T)(RGBA* dst, const RGBA* src, int n);
+
+    // Returns the span blender for a Canvas::BlendMode, or 0 if the
+    // blend mode is invalid. Both src and dst must be premultiplied if
+    // premultiplied is true. Unless vectorized is false, the fastest
+    // kernel supported by the cpu (selected once at startup) is returned.
+    BLENDSPANFUNC_T GetBlendSpanFunc(int blendMode, bool premultiplied = false, bool vectorized = true);
+
+    // Converts a row of n pixels in place.
+    void PremultiplySpan(RGBA* pixels, int n);
+    void UnpremultiplySpan(RGBA* pixels, int n);
+
+    // Transposes width x height pixels of src into height x width pixels
+    // of dst, in blocks small enough to stay in the cache. Strides are in
+    // pixels and may be negative to mirror the rows. src and dst must not
+    // overlap.
+    void TransposePixels(RGBA* dst, int dstStride, const RGBA* src, int srcStride, int width, int height);
+
+    // Returns the name of the selected instruction set ("avx2", "sse2" or "scalar").
+    const char* GetBlendSpanISA();
+
+} // namespace sphere
+
+
+#endif
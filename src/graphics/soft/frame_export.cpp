@@ -0,0 +1,165 @@
+#include <cassert>
+#include <cstring>
+#include "../../common/platform.hpp"
+#include "frame_export.hpp"
+
+#ifdef SPHERE_WINDOWS
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+
+namespace sphere {
+    namespace video {
+        namespace soft {
+
+            //-----------------------------------------------------------------
+            // Orders the writes to the shared memory for readers running
+            // on other processors.
+            static inline void memory_barrier()
+            {
+            #ifdef SPHERE_WINDOWS
+                MemoryBarrier();
+            #else
+                __sync_synchronize();
+            #endif
+            }
+
+            //-----------------------------------------------------------------
+            FrameExport*
+            FrameExport::Create(const std::string& name, int numSlots, int maxPixels)
+            {
+                assert(!name.empty());
+                assert(numSlots > 0);
+                assert(maxPixels > 0);
+
+                // the header is padded to 64 bytes, the slots are 64 byte aligned
+                int slot_size = (sizeof(FrameExportSlot) + maxPixels * Canvas::GetNumBytesPerPixel() + 63) & ~63;
+                int size = 64 + numSlots * slot_size;
+
+                void* handle = 0;
+                void* memory = 0;
+
+            #ifdef SPHERE_WINDOWS
+                handle = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, 0, size, name.c_str());
+                if (!handle) {
+                    return 0;
+                }
+                memory = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+                if (!memory) {
+                    CloseHandle(handle);
+                    return 0;
+                }
+            #else
+                std::string shm_name = (name[0] == '/' ? name : "/" + name);
+                int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if (fd == -1) {
+                    return 0;
+                }
+                if (ftruncate(fd, size) != 0) {
+                    close(fd);
+                    shm_unlink(shm_name.c_str());
+                    return 0;
+                }
+                memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd);
+                if (memory == MAP_FAILED) {
+                    shm_unlink(shm_name.c_str());
+                    return 0;
+                }
+            #endif
+
+                memset(memory, 0, size);
+
+                FrameExportHeader* header = (FrameExportHeader*)memory;
+                header->version   = FRAME_EXPORT_VERSION;
+                header->numSlots  = numSlots;
+                header->slotSize  = slot_size;
+                header->maxPixels = maxPixels;
+
+                // readers may look at the memory as soon as it has a magic
+                memory_barrier();
+                header->magic = FRAME_EXPORT_MAGIC;
+
+                FrameExport* frame_export = new FrameExport();
+                frame_export->_name   = name;
+                frame_export->_header = header;
+                frame_export->_size   = size;
+                frame_export->_handle = handle;
+                return frame_export;
+            }
+
+            //-----------------------------------------------------------------
+            FrameExport::FrameExport()
+                : _header(0)
+                , _size(0)
+                , _handle(0)
+            {
+            }
+
+            //-----------------------------------------------------------------
+            FrameExport::~FrameExport()
+            {
+                // readers still mapping the memory have to reopen it
+                _header->closed = 1;
+                memory_barrier();
+
+            #ifdef SPHERE_WINDOWS
+                UnmapViewOfFile(_header);
+                CloseHandle((HANDLE)_handle);
+            #else
+                munmap(_header, _size);
+                shm_unlink((_name[0] == '/' ? _name : "/" + _name).c_str());
+            #endif
+            }
+
+            //-----------------------------------------------------------------
+            FrameExportSlot*
+            FrameExport::getSlot(int index)
+            {
+                return (FrameExportSlot*)((u8*)_header + 64 + index * _header->slotSize);
+            }
+
+            //-----------------------------------------------------------------
+            void
+            FrameExport::exportFrame(Canvas* frame, u32 timestamp)
+            {
+                assert(frame);
+                assert(canExport(frame->getWidth(), frame->getHeight()));
+
+                u32 frame_index = _header->frameCount;
+                FrameExportSlot* slot = getSlot(frame_index % _header->numSlots);
+
+                // odd while the slot is written
+                slot->sequence++;
+                memory_barrier();
+
+                slot->frameIndex = frame_index;
+                slot->width      = frame->getWidth();
+                slot->height     = frame->getHeight();
+                slot->timestamp  = timestamp;
+
+                RGBA* pixels = (RGBA*)(slot + 1);
+                int row_size = frame->getWidth() * Canvas::GetNumBytesPerPixel();
+                if (frame->getStride() == frame->getWidth()) {
+                    memcpy(pixels, frame->getPixels(), row_size * frame->getHeight());
+                } else {
+                    for (int y = 0; y < frame->getHeight(); ++y) {
+                        memcpy(pixels + y * frame->getWidth(), frame->getPixels() + y * frame->getStride(), row_size);
+                    }
+                }
+
+                memory_barrier();
+                slot->sequence++;
+
+                // publish the frame
+                memory_barrier();
+                _header->frameCount = frame_index + 1;
+            }
+
+        } // namespace soft
+    } // namespace video
+} // namespace sphere
@@ -0,0 +1,104 @@
+#ifndef SPHERE_FRAME_EXPORT_HPP
+#define SPHERE_FRAME_EXPORT_HPP
+
+#include <string>
+#include "../../common/types.hpp"
+#include "../Canvas.hpp"
+
+#define FRAME_EXPORT_MAGIC   0x58465053 // "SPFX"
+#define FRAME_EXPORT_VERSION 1
+
+
+namespace sphere {
+    namespace video {
+        namespace soft {
+
+            // Layout of the shared memory frames are exported to, for
+            // viewers and encoders running in other processes. It starts
+            // with the header, padded to 64 bytes, followed by numSlots
+            // slots of slotSize bytes. Each slot is a slot header followed
+            // by the pixels of a frame, RGBA with 8 bits per channel, rows
+            // of width pixels.
+            //
+            // The engine never waits for readers. The sequence of a slot
+            // is odd while the slot is written; readers check that it is
+            // even before and unchanged after reading the pixels,
+            // otherwise the frame was overwritten in the meantime. The
+            // frame count is increased after a slot was written, the
+            // newest frame is in slot (frameCount - 1) % numSlots. If the
+            // frame outgrows the slots, the memory is created again and
+            // closed is set in the old header, readers have to reopen it.
+            struct FrameExportHeader {
+                u32 magic;
+                u32 version;
+                u32 numSlots;
+                u32 slotSize;       // in bytes, including the slot header
+                u32 maxPixels;      // width * height a slot has room for
+                u32 reserved;
+                volatile u32 closed;
+                volatile u32 frameCount;
+            };
+
+            struct FrameExportSlot {
+                volatile u32 sequence;
+                u32 frameIndex;     // starting at 0
+                u32 width;
+                u32 height;
+                u32 timestamp;      // system::GetTicks() of the swap
+                u32 reserved[3];
+            };
+
+            // Writes frames into a ring of slots in shared memory. The
+            // memory is named name, a POSIX shared memory object on unix
+            // and a file mapping on Windows, and is removed when the
+            // export is destroyed.
+            class FrameExport {
+            public:
+                static FrameExport* Create(const std::string& name, int numSlots, int maxPixels);
+
+                ~FrameExport();
+
+                const std::string& getName() const;
+                int  getNumSlots() const;
+                bool canExport(int width, int height) const;
+                void exportFrame(Canvas* frame, u32 timestamp);
+
+            private:
+                FrameExport();
+
+                FrameExportSlot* getSlot(int index);
+
+            private:
+                std::string        _name;
+                FrameExportHeader* _header;
+                int                _size;
+                void*              _handle; // file mapping on Windows
+            };
+
+            //-----------------------------------------------------------------
+            inline const std::string&
+            FrameExport::getName() const
+            {
+                return _name;
+            }
+
+            //-----------------------------------------------------------------
+            inline int
+            FrameExport::getNumSlots() const
+            {
+                return (int)_header->numSlots;
+            }
+
+            //-----------------------------------------------------------------
+            inline bool
+            FrameExport::canExport(int width, int height) const
+            {
+                return width * height <= (int)_header->maxPixels;
+            }
+
+        } // namespace soft
+    } // namespace video
+} // namespace sphere
+
+
+#endif
@@ -0,0 +1,828 @@
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include "../../version.hpp"
+#include "../../system/system.hpp"
+#include "frame_export.hpp"
+#include "soft_video.hpp"
+
+#define DEFAULT_WINDOW_WIDTH  640
+#define DEFAULT_WINDOW_HEIGHT 480
+
+// pending frame readbacks, which hold a copy of the frame each
+#define FRAME_READBACK_SLOTS 2
+
+
+namespace sphere {
+    namespace video {
+        namespace soft {
+
+            //-----------------------------------------------------------------
+            struct Texture : public RefImpl<ITexture> {
+                CanvasPtr pixels;
+                Dim2i     size;
+                Recti     rect;
+                bool      renderTarget;
+                CanvasPtr backBuffer; // of a streaming texture
+                bool      locked;
+
+                ~Texture();
+
+                // ITexture implementation
+                const Dim2i& getTextureSize() const {
+                    return size;
+                }
+                const Recti& getTextureRect() const {
+                    return rect;
+                }
+                const Dim2i& getSize() const {
+                    return size;
+                }
+                bool isPremultiplied() const {
+                    return pixels->isPremultiplied();
+                }
+            };
+
+            //-----------------------------------------------------------------
+            struct FrameReadback {
+                int       handle; // 0 if the slot is free
+                CanvasPtr canvas;
+            };
+
+            //-----------------------------------------------------------------
+            // globals
+            Dim2i       g_DefaultDisplayMode(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
+            std::vector<Dim2i> g_DisplayModes;
+            Dim2i       g_WindowSize;
+            bool        g_WindowIsFullScreen = false;
+            std::string g_WindowTitle;
+            CanvasPtr   g_Frame;
+            CanvasPtr   g_Capture;
+            int         g_BlendMode = BM_ALPHA;
+            VideoStats  g_VideoStats;
+            FrameReadback g_FrameReadbacks[FRAME_READBACK_SLOTS];
+            int         g_NextFrameReadback = 1;
+            RefPtr<Texture> g_RenderTarget;
+            int         g_TextureMemoryBudget = 0;
+            TextureMemoryStats g_TextureMemory;
+            FrameExport* g_FrameExport = 0;
+
+            //-----------------------------------------------------------------
+            // The textures are canvases in system memory already, so they
+            // are only counted and never evicted.
+            static void add_texture_memory(int bytes)
+            {
+                g_TextureMemory.usage += bytes;
+                if (g_TextureMemory.usage > g_TextureMemory.peakUsage) {
+                    g_TextureMemory.peakUsage = g_TextureMemory.usage;
+                }
+            }
+
+            //-----------------------------------------------------------------
+            Texture::~Texture()
+            {
+                int num_buffers = (backBuffer ? 2 : 1);
+                g_TextureMemory.usage -= num_buffers * size.width * size.height * Canvas::GetNumBytesPerPixel();
+            }
+
+            //-----------------------------------------------------------------
+            // Returns the canvas that is drawn into.
+            static Canvas* get_target()
+            {
+                return g_RenderTarget ? g_RenderTarget->pixels.get() : g_Frame.get();
+            }
+
+            //-----------------------------------------------------------------
+            // Redirects drawing to a render target or back to the frame if
+            // target is 0. The scissor is reset to the whole target.
+            static void set_render_target(Texture* target)
+            {
+                if (target != g_RenderTarget.get()) {
+                    if (target) {
+                        target->grab();
+                    }
+                    g_RenderTarget = target;
+                }
+                Canvas* canvas = get_target();
+                canvas->setBlendMode(g_BlendMode);
+                canvas->setScissor(Recti(0, 0, canvas->getWidth() - 1, canvas->getHeight() - 1));
+            }
+
+            //-----------------------------------------------------------------
+            // Copies a canvas into a section of another one, converting
+            // the pixels to the alpha format of the destination.
+            static void copy_pixels(Canvas* dst, const Vec2i& pos, Canvas* src, const Recti& section)
+            {
+                CanvasPtr converted;
+                const RGBA* pixels = src->getPixels() + section.ul.y * src->getStride() + section.ul.x;
+                int stride = src->getStride();
+
+                if (src->isPremultiplied() != dst->isPremultiplied()) {
+                    converted = src->cloneSection(section);
+                    if (dst->isPremultiplied()) {
+                        converted->premultiply();
+                    } else {
+                        converted->unpremultiply();
+                    }
+                    pixels = converted->getPixels();
+                    stride = converted->getStride();
+                }
+
+                dst->copyPixels(pixels, stride, Recti(pos.x, pos.y, pos.x + section.getWidth() - 1, pos.y + section.getHeight() - 1));
+            }
+
+            //-----------------------------------------------------------------
+            static inline bool is_white(const RGBA& c)
+            {
+                return c.red == 255 && c.green == 255 && c.blue == 255 && c.alpha == 255;
+            }
+
+            //-----------------------------------------------------------------
+            // Draws a section of an image onto a quad, split into two
+            // triangles along the diagonal from pos[0] to pos[2] like the
+            // hardware does.
+            static void draw_quad(Canvas* image, const Recti& rect, Vec2i pos[4], const RGBA& mask)
+            {
+                Vec2i ul(rect.ul.x,     rect.ul.y);
+                Vec2i ur(rect.lr.x + 1, rect.ul.y);
+                Vec2i lr(rect.lr.x + 1, rect.lr.y + 1);
+                Vec2i ll(rect.ul.x,     rect.lr.y + 1);
+
+                Vec2i texcoord1[3] = {ul, ur, lr};
+                Vec2i pos1[3]      = {pos[0], pos[1], pos[2]};
+                get_target()->drawTexturedTriangle(image, texcoord1, pos1, mask);
+
+                Vec2i texcoord2[3] = {ul, lr, ll};
+                Vec2i pos2[3]      = {pos[0], pos[2], pos[3]};
+                get_target()->drawTexturedTriangle(image, texcoord2, pos2, mask);
+            }
+
+            //-----------------------------------------------------------------
+            // Copies the frame into the next slot of the frame export. If
+            // the frame has grown too large, the export is created again
+            // with larger slots.
+            static void export_frame()
+            {
+                if (!g_FrameExport->canExport(g_Frame->getWidth(), g_Frame->getHeight())) {
+                    std::string name = g_FrameExport->getName();
+                    int num_slots = g_FrameExport->getNumSlots();
+                    delete g_FrameExport;
+                    g_FrameExport = FrameExport::Create(name, num_slots, g_Frame->getWidth() * g_Frame->getHeight());
+                    if (!g_FrameExport) {
+                        return;
+                    }
+                }
+                g_FrameExport->exportFrame(g_Frame.get(), (u32)system::GetTicks());
+            }
+
+            //-----------------------------------------------------------------
+            static void clear_frame()
+            {
+                g_Frame->fill(RGBA(0, 0, 0, 255));
+                g_Frame->clearDirtyRects();
+            }
+
+            //-----------------------------------------------------------------
+            const Dim2i& GetDefaultDisplayMode()
+            {
+                return g_DefaultDisplayMode;
+            }
+
+            //-----------------------------------------------------------------
+            const std::vector<Dim2i>& GetDisplayModes()
+            {
+                return g_DisplayModes;
+            }
+
+            //-----------------------------------------------------------------
+            bool SetWindowMode(int width, int height, bool fullScreen)
+            {
+                assert(g_Frame);
+                assert(width > 0);
+                assert(height > 0);
+
+                if (g_WindowSize.width != width || g_WindowSize.height != height) {
+                    g_RenderTarget = 0;
+                    g_Frame = Canvas::Create(width, height);
+                    g_Frame->setBlendMode(g_BlendMode);
+                    g_Frame->setParallel(true);
+                    clear_frame();
+                    g_WindowSize = Dim2i(width, height);
+                }
+
+                // there is no display to switch, any size will do
+                g_WindowIsFullScreen = fullScreen;
+
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            const Dim2i& GetWindowSize()
+            {
+                return g_WindowSize;
+            }
+
+            //-----------------------------------------------------------------
+            bool IsWindowFullScreen()
+            {
+                return g_WindowIsFullScreen;
+            }
+
+            //-----------------------------------------------------------------
+            bool IsWindowActive()
+            {
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            const std::string& GetWindowTitle()
+            {
+                return g_WindowTitle;
+            }
+
+            //-----------------------------------------------------------------
+            void SetWindowTitle(const std::string& title)
+            {
+                g_WindowTitle = title;
+            }
+
+            //-----------------------------------------------------------------
+            void SetWindowIcon(Canvas* icon)
+            {
+                assert(icon);
+            }
+
+            //-----------------------------------------------------------------
+            void SwapWindowBuffers()
+            {
+                assert(g_Frame);
+
+                // every frame starts drawing into the frame
+                if (g_RenderTarget) {
+                    set_render_target(0);
+                }
+
+                if (g_FrameExport) {
+                    export_frame();
+                }
+
+                clear_frame();
+            }
+
+            //-----------------------------------------------------------------
+            bool PeekWindowEvent(int)
+            {
+                return false;
+            }
+
+            //-----------------------------------------------------------------
+            bool GetWindowEvent(WindowEvent&)
+            {
+                return false;
+            }
+
+            //-----------------------------------------------------------------
+            void ClearWindowEvents()
+            {
+            }
+
+            //-----------------------------------------------------------------
+            Canvas* GetFrame()
+            {
+                return g_Frame.get();
+            }
+
+            //-----------------------------------------------------------------
+            void GetFrameScissor(Recti& scissor)
+            {
+                scissor = get_target()->getScissor();
+            }
+
+            //-----------------------------------------------------------------
+            bool SetFrameScissor(const Recti& scissor)
+            {
+                Canvas* target = get_target();
+                if (!Recti(0, 0, target->getWidth() - 1, target->getHeight() - 1).contains(scissor)) {
+                    return false;
+                }
+                return target->setScissor(scissor);
+            }
+
+            //-----------------------------------------------------------------
+            Canvas* CloneFrame(Recti* section)
+            {
+                Canvas* target = get_target();
+                Recti frame_rect(0, 0, target->getWidth() - 1, target->getHeight() - 1);
+                if (section) {
+                    if (!section->isValid() || !frame_rect.contains(*section)) {
+                        return 0;
+                    }
+                    return target->cloneSection(*section);
+                }
+                return target->cloneSection(frame_rect);
+            }
+
+            //-----------------------------------------------------------------
+            int RequestFrameReadback(Recti* section)
+            {
+                FrameReadback* r = 0;
+                for (int i = 0; i < FRAME_READBACK_SLOTS; i++) {
+                    if (g_FrameReadbacks[i].handle == 0) {
+                        r = &g_FrameReadbacks[i];
+                        break;
+                    }
+                }
+                if (!r) {
+                    return 0;
+                }
+
+                // the frame is in memory, so the readback is done right away
+                r->canvas = CloneFrame(section);
+                if (!r->canvas) {
+                    return 0;
+                }
+                r->handle = g_NextFrameReadback;
+                g_NextFrameReadback = (r->handle == INT_MAX ? 1 : r->handle + 1);
+                return r->handle;
+            }
+
+            //-----------------------------------------------------------------
+            Canvas* PollFrameReadback(int handle, bool* pending)
+            {
+                if (pending) {
+                    *pending = false;
+                }
+                FrameReadback* r = 0;
+                for (int i = 0; i < FRAME_READBACK_SLOTS; i++) {
+                    if (handle != 0 && g_FrameReadbacks[i].handle == handle) {
+                        r = &g_FrameReadbacks[i];
+                        break;
+                    }
+                }
+                if (!r) {
+                    return 0;
+                }
+                r->handle = 0;
+                return r->canvas.release();
+            }
+
+            //-----------------------------------------------------------------
+            int GetBlendMode()
+            {
+                return g_BlendMode;
+            }
+
+            //-----------------------------------------------------------------
+            bool SetBlendMode(int blendMode)
+            {
+                // the canvas blend modes are the same as ours
+                if (!get_target()->setBlendMode(blendMode)) {
+                    return false;
+                }
+                g_BlendMode = blendMode;
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            bool CaptureFrame(const Recti& rect)
+            {
+                Canvas* target = get_target();
+                Recti frame_rect(0, 0, target->getWidth() - 1, target->getHeight() - 1);
+                if (!rect.isValid() || !frame_rect.contains(rect)) {
+                    return false;
+                }
+
+                // reuse the capture canvas if it is big enough
+                if (!g_Capture ||
+                    g_Capture->getWidth()  < rect.getWidth() ||
+                    g_Capture->getHeight() < rect.getHeight())
+                {
+                    g_Capture = Canvas::Create(rect.getWidth(), rect.getHeight());
+                }
+
+                copy_pixels(g_Capture.get(), Vec2i(0, 0), target, rect);
+
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            void DrawCaptureQuad(const Recti& rect, Vec2i pos[4], const RGBA& mask)
+            {
+                if (!g_Capture) {
+                    return;
+                }
+
+                Recti capture_rect(0, 0, g_Capture->getWidth() - 1, g_Capture->getHeight() - 1);
+                if (!rect.isValid() || !capture_rect.contains(rect)) {
+                    return;
+                }
+
+                draw_quad(g_Capture.get(), rect, pos, mask);
+            }
+
+            //-----------------------------------------------------------------
+            ITexture* CreateTexture(int width, int height, const RGBA* pixels, bool premultiplied, int stride)
+            {
+                assert(width  > 0);
+                assert(height > 0);
+
+                if (stride == 0) {
+                    stride = width;
+                }
+
+                CanvasPtr canvas = Canvas::Create(width, height, 0, premultiplied);
+                if (pixels) {
+                    canvas->copyPixels(pixels, stride, Recti(0, 0, width - 1, height - 1));
+                }
+
+                Texture* t = new Texture;
+                t->pixels = canvas;
+                t->size   = Dim2i(width, height);
+                t->rect   = Recti(0, 0, width - 1, height - 1);
+                t->renderTarget = false;
+                t->locked = false;
+
+                add_texture_memory(width * height * Canvas::GetNumBytesPerPixel());
+
+                return t;
+            }
+
+            //-----------------------------------------------------------------
+            bool UpdateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* rect)
+            {
+                assert(texture);
+                assert(newPixels);
+
+                Texture* t = (Texture*)texture;
+
+                int x = 0;
+                int y = 0;
+                int w = newPixels->getWidth();
+                int h = newPixels->getHeight();
+
+                if (rect) {
+                    if (!rect->isValid() || !rect->isInside(0, 0, t->size.width - 1, t->size.height - 1)) {
+                        return false;
+                    }
+
+                    x = rect->ul.x;
+                    y = rect->ul.y;
+                    w = rect->getWidth();
+                    h = rect->getHeight();
+                }
+
+                if (w != newPixels->getWidth() ||
+                    h != newPixels->getHeight() ||
+                    x + w > t->size.width ||
+                    y + h > t->size.height)
+                {
+                    return false;
+                }
+
+                copy_pixels(t->pixels.get(), Vec2i(x, y), newPixels, Recti(0, 0, w - 1, h - 1));
+
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            bool UpdateTextureDirtyPixels(ITexture* texture, Canvas* canvas)
+            {
+                assert(texture);
+                assert(canvas);
+
+                Texture* t = (Texture*)texture;
+
+                if (canvas->getWidth()  != t->size.width ||
+                    canvas->getHeight() != t->size.height)
+                {
+                    return false;
+                }
+
+                const std::vector<Recti>& dirtyRects = canvas->getDirtyRects();
+                for (size_t i = 0; i < dirtyRects.size(); ++i) {
+                    copy_pixels(t->pixels.get(), dirtyRects[i].ul, canvas, dirtyRects[i]);
+                }
+
+                canvas->clearDirtyRects();
+
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            Canvas* GrabTexturePixels(ITexture* texture)
+            {
+                assert(texture);
+
+                Texture* t = (Texture*)texture;
+                return t->pixels->cloneSection(Recti(0, 0, t->size.width - 1, t->size.height - 1));
+            }
+
+            //-----------------------------------------------------------------
+            ITexture* CreateRenderTarget(int width, int height)
+            {
+                assert(width  > 0);
+                assert(height > 0);
+
+                // start out transparent, the canvas blenders only update
+                // the alpha of premultiplied canvases
+                CanvasPtr canvas = Canvas::Create(width, height, 0, true);
+                canvas->fill(RGBA(0, 0, 0, 0));
+                canvas->clearDirtyRects();
+                canvas->setParallel(true);
+
+                Texture* t = new Texture;
+                t->pixels = canvas;
+                t->size   = Dim2i(width, height);
+                t->rect   = Recti(0, 0, width - 1, height - 1);
+                t->renderTarget = true;
+                t->locked = false;
+
+                add_texture_memory(width * height * Canvas::GetNumBytesPerPixel());
+
+                return t;
+            }
+
+            //-----------------------------------------------------------------
+            bool SetRenderTarget(ITexture* target)
+            {
+                Texture* t = (Texture*)target;
+                if (t && !t->renderTarget) {
+                    return false;
+                }
+                set_render_target(t);
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            ITexture* GetRenderTarget()
+            {
+                return g_RenderTarget.get();
+            }
+
+            //-----------------------------------------------------------------
+            // Streaming textures are drawn into a back buffer, which is
+            // swapped with the pixels of the texture on unlock.
+            ITexture* CreateStreamingTexture(int width, int height)
+            {
+                assert(width  > 0);
+                assert(height > 0);
+
+                CanvasPtr front = Canvas::Create(width, height);
+                CanvasPtr back  = Canvas::Create(width, height);
+                front->fill(RGBA(0, 0, 0, 0));
+                back->fill(RGBA(0, 0, 0, 0));
+                front->clearDirtyRects();
+                back->clearDirtyRects();
+
+                Texture* t = new Texture;
+                t->pixels = front;
+                t->size   = Dim2i(width, height);
+                t->rect   = Recti(0, 0, width - 1, height - 1);
+                t->renderTarget = false;
+                t->backBuffer = back;
+                t->locked = false;
+
+                // front and back buffer
+                add_texture_memory(2 * width * height * Canvas::GetNumBytesPerPixel());
+
+                return t;
+            }
+
+            //-----------------------------------------------------------------
+            Canvas* LockStreamingTexture(ITexture* texture)
+            {
+                assert(texture);
+
+                Texture* t = (Texture*)texture;
+                if (!t->backBuffer || t->locked) {
+                    return 0;
+                }
+                t->locked = true;
+                return t->backBuffer.get();
+            }
+
+            //-----------------------------------------------------------------
+            bool UnlockStreamingTexture(ITexture* texture)
+            {
+                assert(texture);
+
+                Texture* t = (Texture*)texture;
+                if (!t->backBuffer || !t->locked) {
+                    return false;
+                }
+                t->locked = false;
+                CanvasPtr front = t->pixels;
+                t->pixels = t->backBuffer;
+                t->backBuffer = front;
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            int GetTextureMemoryBudget()
+            {
+                return g_TextureMemoryBudget;
+            }
+
+            //-----------------------------------------------------------------
+            void SetTextureMemoryBudget(int budget)
+            {
+                g_TextureMemoryBudget = budget;
+            }
+
+            //-----------------------------------------------------------------
+            const TextureMemoryStats& GetTextureMemoryStats()
+            {
+                return g_TextureMemory;
+            }
+
+            //-----------------------------------------------------------------
+            void DrawPoint(const Vec2i& pos, const RGBA& color)
+            {
+                RGBA col[4] = {color, color, color, color};
+                get_target()->drawRect(Recti(pos.x, pos.y, pos.x, pos.y), col);
+            }
+
+            //-----------------------------------------------------------------
+            void DrawLine(Vec2i pos[2], RGBA col[2])
+            {
+                get_target()->drawLine(pos, col);
+            }
+
+            //-----------------------------------------------------------------
+            void DrawTriangle(Vec2i pos[3], RGBA col[3])
+            {
+                get_target()->drawTriangle(pos, col);
+            }
+
+            //-----------------------------------------------------------------
+            void DrawRect(const Recti& rect, RGBA col[4])
+            {
+                if (!rect.isValid()) {
+                    return;
+                }
+                get_target()->drawRect(rect, col);
+            }
+
+            //-----------------------------------------------------------------
+            void DrawImage(ITexture* image, const Vec2i& pos, const RGBA& mask)
+            {
+                assert(image);
+
+                Texture* t = (Texture*)image;
+
+                if (is_white(mask)) {
+                    get_target()->drawImage(t->pixels.get(), pos);
+                } else {
+                    Vec2i quad[4] = {
+                        pos,
+                        Vec2i(pos.x + t->size.width, pos.y),
+                        Vec2i(pos.x + t->size.width, pos.y + t->size.height),
+                        Vec2i(pos.x, pos.y + t->size.height),
+                    };
+                    draw_quad(t->pixels.get(), Recti(0, 0, t->size.width - 1, t->size.height - 1), quad, mask);
+                }
+            }
+
+            //-----------------------------------------------------------------
+            void DrawSubImage(ITexture* image, const Recti& rect, const Vec2i& pos, const RGBA& mask)
+            {
+                assert(image);
+
+                Recti image_rect(0, 0, image->getSize().width-1, image->getSize().height-1);
+                if (!rect.isValid() || !image_rect.contains(rect)) {
+                    return;
+                }
+
+                Texture* t = (Texture*)image;
+
+                if (is_white(mask)) {
+                    get_target()->drawSubImage(t->pixels.get(), rect, pos);
+                } else {
+                    Vec2i quad[4] = {
+                        pos,
+                        Vec2i(pos.x + rect.getWidth(), pos.y),
+                        Vec2i(pos.x + rect.getWidth(), pos.y + rect.getHeight()),
+                        Vec2i(pos.x, pos.y + rect.getHeight()),
+                    };
+                    draw_quad(t->pixels.get(), rect, quad, mask);
+                }
+            }
+
+            //-----------------------------------------------------------------
+            void DrawImageQuad(ITexture* image, Vec2i pos[4], const RGBA& mask)
+            {
+                assert(image);
+
+                Texture* t = (Texture*)image;
+                draw_quad(t->pixels.get(), Recti(0, 0, t->size.width - 1, t->size.height - 1), pos, mask);
+            }
+
+            //-----------------------------------------------------------------
+            void DrawSubImageQuad(ITexture* image, const Recti& rect, Vec2i pos[4], const RGBA& mask)
+            {
+                assert(image);
+
+                Recti image_rect(0, 0, image->getSize().width-1, image->getSize().height-1);
+                if (!rect.isValid() || !image_rect.contains(rect)) {
+                    return;
+                }
+
+                Texture* t = (Texture*)image;
+                draw_quad(t->pixels.get(), rect, pos, mask);
+            }
+
+            //-----------------------------------------------------------------
+            void DrawTexturedTriangle(ITexture* texture, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask)
+            {
+                assert(texture);
+
+                Texture* t = (Texture*)texture;
+                get_target()->drawTexturedTriangle(t->pixels.get(), texcoord, pos, mask);
+            }
+
+            //-----------------------------------------------------------------
+            const VideoStats& GetVideoStats()
+            {
+                // there are no GL draw calls or state changes to count
+                return g_VideoStats;
+            }
+
+            //-----------------------------------------------------------------
+            bool SetFrameExport(const std::string& name, int numSlots)
+            {
+                assert(g_Frame);
+
+                if (g_FrameExport) {
+                    delete g_FrameExport;
+                    g_FrameExport = 0;
+                }
+                if (name.empty()) {
+                    return true;
+                }
+                if (numSlots <= 0) {
+                    return false;
+                }
+                g_FrameExport = FrameExport::Create(name, numSlots, g_Frame->getWidth() * g_Frame->getHeight());
+                return g_FrameExport != 0;
+            }
+
+            //-----------------------------------------------------------------
+            bool InitVideo(const Log& log)
+            {
+                // any size works without a display, these are just the
+                // usual ones for games that pick from the list
+                static const int modes[][2] = {
+                    { 320,  240}, { 640,  480}, { 800,  600}, {1024,  768},
+                    {1280,  720}, {1280, 1024}, {1600, 1200}, {1920, 1080},
+                };
+                g_DisplayModes.clear();
+                for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+                    g_DisplayModes.push_back(Dim2i(modes[i][0], modes[i][1]));
+                }
+
+                // build default window title
+                std::ostringstream oss;
+                oss << "Sphere ";
+                oss << SPHERE_MAJOR;
+                oss << ".";
+                oss << SPHERE_MINOR;
+                oss << " ";
+                oss << SPHERE_AFFIX;
+
+                g_WindowSize         = Dim2i(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
+                g_WindowIsFullScreen = false;
+                g_WindowTitle        = oss.str();
+                g_BlendMode          = BM_ALPHA;
+
+                // large operations on the frame are split among the worker threads
+                g_Frame = Canvas::Create(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
+                g_Frame->setBlendMode(g_BlendMode);
+                g_Frame->setParallel(true);
+                clear_frame();
+
+                log.info() << "Using software video driver, frames are drawn into memory";
+
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            void DeinitVideo()
+            {
+                if (g_FrameExport) {
+                    delete g_FrameExport;
+                    g_FrameExport = 0;
+                }
+                g_RenderTarget = 0;
+                g_Frame   = 0;
+                g_Capture = 0;
+                for (int i = 0; i < FRAME_READBACK_SLOTS; i++) {
+                    g_FrameReadbacks[i].handle = 0;
+                    g_FrameReadbacks[i].canvas = 0;
+                }
+                g_DisplayModes.clear();
+            }
+
+        } // namespace soft
+    } // namespace video
+} // namespace sphere
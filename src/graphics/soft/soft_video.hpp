@@ -0,0 +1,86 @@
+#ifndef SPHERE_SOFT_VIDEO_HPP
+#define SPHERE_SOFT_VIDEO_HPP
+
+#include "../video.hpp"
+
+
+namespace sphere {
+    namespace video {
+
+        // Software implementation of the video API. Everything is drawn
+        // into a canvas in memory, there is no window and no events, so
+        // games can run headless. The platform backends forward to it if
+        // the software driver was selected.
+        namespace soft {
+
+            // display
+            const Dim2i& GetDefaultDisplayMode();
+            const std::vector<Dim2i>& GetDisplayModes();
+
+            // window
+            bool SetWindowMode(int width, int height, bool fullScreen);
+            const Dim2i& GetWindowSize();
+            bool IsWindowFullScreen();
+            bool IsWindowActive();
+            const std::string& GetWindowTitle();
+            void SetWindowTitle(const std::string& title);
+            void SetWindowIcon(Canvas* icon);
+            void SwapWindowBuffers();
+            bool PeekWindowEvent(int event = -1);
+            bool GetWindowEvent(WindowEvent& event);
+            void ClearWindowEvents();
+
+            // frame buffer
+            Canvas* GetFrame();
+            void GetFrameScissor(Recti& scissor);
+            bool SetFrameScissor(const Recti& scissor);
+            Canvas* CloneFrame(Recti* section = 0);
+            int RequestFrameReadback(Recti* section = 0);
+            Canvas* PollFrameReadback(int handle, bool* pending = 0);
+
+            int  GetBlendMode();
+            bool SetBlendMode(int blendMode);
+
+            bool CaptureFrame(const Recti& rect);
+            void DrawCaptureQuad(const Recti& rect, Vec2i pos[4], const RGBA& mask = RGBA(255, 255, 255));
+
+            ITexture* CreateTexture(int width, int height, const RGBA* pixels = 0, bool premultiplied = false, int stride = 0);
+            bool UpdateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* section = 0);
+            bool UpdateTextureDirtyPixels(ITexture* texture, Canvas* canvas);
+            Canvas* GrabTexturePixels(ITexture* texture);
+
+            ITexture* CreateRenderTarget(int width, int height);
+            bool SetRenderTarget(ITexture* target);
+            ITexture* GetRenderTarget();
+
+            ITexture* CreateStreamingTexture(int width, int height);
+            Canvas* LockStreamingTexture(ITexture* texture);
+            bool UnlockStreamingTexture(ITexture* texture);
+
+            int  GetTextureMemoryBudget();
+            void SetTextureMemoryBudget(int budget);
+            const TextureMemoryStats& GetTextureMemoryStats();
+
+            void DrawPoint(const Vec2i& pos, const RGBA& col);
+            void DrawLine(Vec2i pos[2], RGBA col[2]);
+            void DrawTriangle(Vec2i pos[3], RGBA col[3]);
+            void DrawRect(const Recti& rect, RGBA col[4]);
+            void DrawImage(ITexture* image, const Vec2i& pos, const RGBA& mask = RGBA(255, 255, 255));
+            void DrawSubImage(ITexture* image, const Recti& src_rect, const Vec2i& pos, const RGBA& mask = RGBA(255, 255, 255));
+            void DrawImageQuad(ITexture* image, Vec2i pos[4], const RGBA& mask = RGBA(255, 255, 255));
+            void DrawSubImageQuad(ITexture* image, const Recti& src_rect, Vec2i pos[4], const RGBA& mask = RGBA(255, 255, 255));
+            void DrawTexturedTriangle(ITexture* texture, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask = RGBA(255, 255, 255));
+
+            const VideoStats& GetVideoStats();
+
+            bool SetFrameExport(const std::string& name, int numSlots = 3);
+
+            bool InitVideo(const Log& log);
+            void DeinitVideo();
+
+        } // namespace soft
+    } // namespace video
+} // namespace sphere
+
+
+#endif
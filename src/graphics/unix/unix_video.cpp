@@ -0,0 +1,310 @@
+#include "../soft/soft_video.hpp"
+
+
+// There is no windowed driver on unix yet, everything is drawn by the
+// software driver.
+
+namespace sphere {
+    namespace video {
+
+        //-----------------------------------------------------------------
+        const Dim2i& GetDefaultDisplayMode()
+        {
+            return soft::GetDefaultDisplayMode();
+        }
+
+        //-----------------------------------------------------------------
+        const std::vector<Dim2i>& GetDisplayModes()
+        {
+            return soft::GetDisplayModes();
+        }
+
+        //-----------------------------------------------------------------
+        bool SetWindowMode(int width, int height, bool fullScreen)
+        {
+            return soft::SetWindowMode(width, height, fullScreen);
+        }
+
+        //-----------------------------------------------------------------
+        const Dim2i& GetWindowSize()
+        {
+            return soft::GetWindowSize();
+        }
+
+        //-----------------------------------------------------------------
+        bool IsWindowFullScreen()
+        {
+            return soft::IsWindowFullScreen();
+        }
+
+        //-----------------------------------------------------------------
+        bool IsWindowActive()
+        {
+            return soft::IsWindowActive();
+        }
+
+        //-----------------------------------------------------------------
+        const std::string& GetWindowTitle()
+        {
+            return soft::GetWindowTitle();
+        }
+
+        //-----------------------------------------------------------------
+        void SetWindowTitle(const std::string& title)
+        {
+            soft::SetWindowTitle(title);
+        }
+
+        //-----------------------------------------------------------------
+        void SetWindowIcon(Canvas* icon)
+        {
+            soft::SetWindowIcon(icon);
+        }
+
+        //-----------------------------------------------------------------
+        void SwapWindowBuffers()
+        {
+            soft::SwapWindowBuffers();
+        }
+
+        //-----------------------------------------------------------------
+        bool PeekWindowEvent(int event)
+        {
+            return soft::PeekWindowEvent(event);
+        }
+
+        //-----------------------------------------------------------------
+        bool GetWindowEvent(WindowEvent& event)
+        {
+            return soft::GetWindowEvent(event);
+        }
+
+        //-----------------------------------------------------------------
+        void ClearWindowEvents()
+        {
+            soft::ClearWindowEvents();
+        }
+
+        //-----------------------------------------------------------------
+        void GetFrameScissor(Recti& scissor)
+        {
+            soft::GetFrameScissor(scissor);
+        }
+
+        //-----------------------------------------------------------------
+        bool SetFrameScissor(const Recti& scissor)
+        {
+            return soft::SetFrameScissor(scissor);
+        }
+
+        //-----------------------------------------------------------------
+        Canvas* CloneFrame(Recti* section)
+        {
+            return soft::CloneFrame(section);
+        }
+
+        //-----------------------------------------------------------------
+        int RequestFrameReadback(Recti* section)
+        {
+            return soft::RequestFrameReadback(section);
+        }
+
+        //-----------------------------------------------------------------
+        Canvas* PollFrameReadback(int handle, bool* pending)
+        {
+            return soft::PollFrameReadback(handle, pending);
+        }
+
+        //-----------------------------------------------------------------
+        int GetBlendMode()
+        {
+            return soft::GetBlendMode();
+        }
+
+        //-----------------------------------------------------------------
+        bool SetBlendMode(int blendMode)
+        {
+            return soft::SetBlendMode(blendMode);
+        }
+
+        //-----------------------------------------------------------------
+        bool CaptureFrame(const Recti& rect)
+        {
+            return soft::CaptureFrame(rect);
+        }
+
+        //-----------------------------------------------------------------
+        void DrawCaptureQuad(const Recti& rect, Vec2i pos[4], const RGBA& mask)
+        {
+            soft::DrawCaptureQuad(rect, pos, mask);
+        }
+
+        //-----------------------------------------------------------------
+        ITexture* CreateTexture(int width, int height, const RGBA* pixels, bool premultiplied, int stride)
+        {
+            return soft::CreateTexture(width, height, pixels, premultiplied, stride);
+        }
+
+        //-----------------------------------------------------------------
+        bool UpdateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* section)
+        {
+            return soft::UpdateTexturePixels(texture, newPixels, section);
+        }
+
+        //-----------------------------------------------------------------
+        bool UpdateTextureDirtyPixels(ITexture* texture, Canvas* canvas)
+        {
+            return soft::UpdateTextureDirtyPixels(texture, canvas);
+        }
+
+        //-----------------------------------------------------------------
+        Canvas* GrabTexturePixels(ITexture* texture)
+        {
+            return soft::GrabTexturePixels(texture);
+        }
+
+        //-----------------------------------------------------------------
+        ITexture* CreateRenderTarget(int width, int height)
+        {
+            return soft::CreateRenderTarget(width, height);
+        }
+
+        //-----------------------------------------------------------------
+        bool SetRenderTarget(ITexture* target)
+        {
+            return soft::SetRenderTarget(target);
+        }
+
+        //-----------------------------------------------------------------
+        ITexture* GetRenderTarget()
+        {
+            return soft::GetRenderTarget();
+        }
+
+        //-----------------------------------------------------------------
+        ITexture* CreateStreamingTexture(int width, int height)
+        {
+            return soft::CreateStreamingTexture(width, height);
+        }
+
+        //-----------------------------------------------------------------
+        Canvas* LockStreamingTexture(ITexture* texture)
+        {
+            return soft::LockStreamingTexture(texture);
+        }
+
+        //-----------------------------------------------------------------
+        bool UnlockStreamingTexture(ITexture* texture)
+        {
+            return soft::UnlockStreamingTexture(texture);
+        }
+
+        //-----------------------------------------------------------------
+        int GetTextureMemoryBudget()
+        {
+            return soft::GetTextureMemoryBudget();
+        }
+
+        //-----------------------------------------------------------------
+        void SetTextureMemoryBudget(int budget)
+        {
+            soft::SetTextureMemoryBudget(budget);
+        }
+
+        //-----------------------------------------------------------------
+        const TextureMemoryStats& GetTextureMemoryStats()
+        {
+            return soft::GetTextureMemoryStats();
+        }
+
+        //-----------------------------------------------------------------
+        void DrawPoint(const Vec2i& pos, const RGBA& col)
+        {
+            soft::DrawPoint(pos, col);
+        }
+
+        //-----------------------------------------------------------------
+        void DrawLine(Vec2i pos[2], RGBA col[2])
+        {
+            soft::DrawLine(pos, col);
+        }
+
+        //-----------------------------------------------------------------
+        void DrawTriangle(Vec2i pos[3], RGBA col[3])
+        {
+            soft::DrawTriangle(pos, col);
+        }
+
+        //-----------------------------------------------------------------
+        void DrawRect(const Recti& rect, RGBA col[4])
+        {
+            soft::DrawRect(rect, col);
+        }
+
+        //-----------------------------------------------------------------
+        void DrawImage(ITexture* image, const Vec2i& pos, const RGBA& mask)
+        {
+            soft::DrawImage(image, pos, mask);
+        }
+
+        //-----------------------------------------------------------------
+        void DrawSubImage(ITexture* image, const Recti& src_rect, const Vec2i& pos, const RGBA& mask)
+        {
+            soft::DrawSubImage(image, src_rect, pos, mask);
+        }
+
+        //-----------------------------------------------------------------
+        void DrawImageQuad(ITexture* image, Vec2i pos[4], const RGBA& mask)
+        {
+            soft::DrawImageQuad(image, pos, mask);
+        }
+
+        //-----------------------------------------------------------------
+        void DrawSubImageQuad(ITexture* image, const Recti& src_rect, Vec2i pos[4], const RGBA& mask)
+        {
+            soft::DrawSubImageQuad(image, src_rect, pos, mask);
+        }
+
+        //-----------------------------------------------------------------
+        void DrawTexturedTriangle(ITexture* texture, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask)
+        {
+            soft::DrawTexturedTriangle(texture, texcoord, pos, mask);
+        }
+
+        //-----------------------------------------------------------------
+        const VideoStats& GetVideoStats()
+        {
+            return soft::GetVideoStats();
+        }
+
+        //-----------------------------------------------------------------
+        bool SetFrameExport(const std::string& name, int numSlots)
+        {
+            return soft::SetFrameExport(name, numSlots);
+        }
+
+        namespace internal {
+
+            //-----------------------------------------------------------------
+            bool InitVideo(const Log& log, const std::string& driver)
+            {
+                if (driver != "software") {
+                    log.info() << "Video driver '" << driver << "' not available, using software video driver";
+                }
+                return soft::InitVideo(log);
+            }
+
+            //-----------------------------------------------------------------
+            void DeinitVideo()
+            {
+                soft::DeinitVideo();
+            }
+
+            //-----------------------------------------------------------------
+            void ProcessWindowEvents()
+            {
+            }
+
+        } // namespace internal
+    } // namespace video
+} // namespace sphere
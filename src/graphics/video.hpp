@@ -77,6 +77,13 @@ namespace sphere {
         bool SetFrameScissor(const Recti& scissor);
         Canvas* CloneFrame(Recti* section = 0);
 
+        // asynchronous version of CloneFrame, the pixels can be polled
+        // after the next SwapWindowBuffers; request returns 0 if there
+        // are too many pending readbacks, poll returns 0 while pending
+        // is true and sets it to false for invalid handles
+        int RequestFrameReadback(Recti* section = 0);
+        Canvas* PollFrameReadback(int handle, bool* pending = 0);
+
         enum {
             BM_REPLACE = 0,
             BM_ALPHA,
@@ -91,10 +98,42 @@ namespace sphere {
         bool CaptureFrame(const Recti& rect);
         void DrawCaptureQuad(const Recti& rect, Vec2i pos[4], const RGBA& mask = RGBA(255, 255, 255));
 
-        ITexture* CreateTexture(int width, int height, const RGBA* pixels = 0);
+        // stride is the distance between two rows of pixels, 0 means width
+        ITexture* CreateTexture(int width, int height, const RGBA* pixels = 0, bool premultiplied = false, int stride = 0);
         bool UpdateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* section = 0);
+        bool UpdateTextureDirtyPixels(ITexture* texture, Canvas* canvas);
         Canvas* GrabTexturePixels(ITexture* texture);
 
+        // render targets are textures that can be drawn into, while one
+        // is set all drawing and frame buffer functions apply to it; 0
+        // means the frame buffer, which is set again by SwapWindowBuffers
+        ITexture* CreateRenderTarget(int width, int height);
+        bool SetRenderTarget(ITexture* target);
+        ITexture* GetRenderTarget();
+
+        // streaming textures are meant to change every frame; lock returns
+        // a canvas, which belongs to the texture, to draw the new pixels
+        // into, its contents are undefined; unlock uploads the pixels
+        // without waiting for the GPU
+        ITexture* CreateStreamingTexture(int width, int height);
+        Canvas* LockStreamingTexture(ITexture* texture);
+        bool UnlockStreamingTexture(ITexture* texture);
+
+        // texture memory in bytes, including the padding of textures with
+        // power of two sizes; if the budget is exceeded, the textures that
+        // were not drawn for the longest time are moved to system memory
+        // and uploaded again when they are drawn; 0 means no budget
+        struct TextureMemoryStats {
+            int usage;
+            int peakUsage;
+            int evictedUsage; // held in system memory
+            int evictions;
+        };
+
+        int  GetTextureMemoryBudget();
+        void SetTextureMemoryBudget(int budget);
+        const TextureMemoryStats& GetTextureMemoryStats();
+
         void DrawPoint(const Vec2i& pos, const RGBA& col);
         void DrawLine(Vec2i pos[2], RGBA col[2]);
         void DrawTriangle(Vec2i pos[3], RGBA col[3]);
@@ -105,9 +144,28 @@ namespace sphere {
         void DrawSubImageQuad(ITexture* image, const Recti& src_rect, Vec2i pos[4], const RGBA& mask = RGBA(255, 255, 255));
         void DrawTexturedTriangle(ITexture* texture, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask = RGBA(255, 255, 255));
 
+        // statistics of the last frame, redundant state changes are the
+        // ones the driver skipped because the state was already set
+        struct VideoStats {
+            int drawCalls;
+            int stateChanges;
+            int redundantStateChanges;
+        };
+
+        const VideoStats& GetVideoStats();
+
+        // Publishes every swapped frame into a ring of numSlots frames in
+        // shared memory named name, so a viewer or encoder can read them
+        // without the engine waiting for it (see soft/frame_export.hpp for
+        // the layout). Only the software video driver exports frames, an
+        // empty name stops exporting.
+        bool SetFrameExport(const std::string& name, int numSlots = 3);
+
         namespace internal {
 
-            bool InitVideo(const Log& log);
+            // driver is "opengl" or "software", the latter draws into
+            // memory without opening a window
+            bool InitVideo(const Log& log, const std::string& driver);
             void DeinitVideo();
             void ProcessWindowEvents();
 
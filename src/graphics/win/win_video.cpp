@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <cmath>
 #include <deque>
+#include <list>
 #include <sstream>
 #include <windows.h>
 
@@ -16,7 +19,9 @@
 #include "../../io/filesystem.hpp"
 #include "../../io/numio.hpp"
 #include "../../io/imageio.hpp"
+#include "../blend.hpp"
 #include "../video.hpp"
+#include "../soft/soft_video.hpp"
 
 #ifndef GL_FUNC_ADD_EXT
 #  define GL_FUNC_ADD_EXT 0x8006
@@ -30,6 +35,42 @@
 #  define GL_FUNC_REVERSE_SUBTRACT_EXT 0x800B
 #endif
 
+#ifndef GL_PIXEL_PACK_BUFFER_ARB
+#  define GL_PIXEL_PACK_BUFFER_ARB 0x88EB
+#endif
+
+#ifndef GL_STREAM_READ_ARB
+#  define GL_STREAM_READ_ARB 0x88E1
+#endif
+
+#ifndef GL_READ_ONLY_ARB
+#  define GL_READ_ONLY_ARB 0x88B8
+#endif
+
+#ifndef GL_PIXEL_UNPACK_BUFFER_ARB
+#  define GL_PIXEL_UNPACK_BUFFER_ARB 0x88EC
+#endif
+
+#ifndef GL_STREAM_DRAW_ARB
+#  define GL_STREAM_DRAW_ARB 0x88E0
+#endif
+
+#ifndef GL_WRITE_ONLY_ARB
+#  define GL_WRITE_ONLY_ARB 0x88B9
+#endif
+
+#ifndef GL_FRAMEBUFFER_EXT
+#  define GL_FRAMEBUFFER_EXT 0x8D40
+#endif
+
+#ifndef GL_COLOR_ATTACHMENT0_EXT
+#  define GL_COLOR_ATTACHMENT0_EXT 0x8CE0
+#endif
+
+#ifndef GL_FRAMEBUFFER_COMPLETE_EXT
+#  define GL_FRAMEBUFFER_COMPLETE_EXT 0x8CD5
+#endif
+
 #define DEFAULT_WINDOW_WIDTH  640
 #define DEFAULT_WINDOW_HEIGHT 480
 
@@ -38,36 +79,149 @@
 
 #define EVENT_QUEUE_MAX_SIZE 1024
 
+// quads per batch, the vertices are indexed with GLushort
+#define QUAD_BATCH_MAX_SIZE 4096
+
+// textures up to this size share atlas pages
+#define ATLAS_MAX_TEXTURE_SIZE 64
+#define ATLAS_PAGE_SIZE        1024
+
+// pending asynchronous frame readbacks, one per pixel buffer object
+#define FRAME_READBACK_SLOTS 2
+
+// pixel buffer objects per streaming texture, used in turn
+#define STREAMING_TEXTURE_BUFFERS 2
+
 
 //-----------------------------------------------------------------
 // GL extension function pointers
 void (APIENTRY *glBlendEquationEXT)(GLenum) = 0;
+void (APIENTRY *glBlendFuncSeparateEXT)(GLenum, GLenum, GLenum, GLenum) = 0;
+void (APIENTRY *glGenBuffersARB)(GLsizei, GLuint*) = 0;
+void (APIENTRY *glDeleteBuffersARB)(GLsizei, const GLuint*) = 0;
+void (APIENTRY *glBindBufferARB)(GLenum, GLuint) = 0;
+void (APIENTRY *glBufferDataARB)(GLenum, ptrdiff_t, const GLvoid*, GLenum) = 0;
+GLvoid* (APIENTRY *glMapBufferARB)(GLenum, GLenum) = 0;
+GLboolean (APIENTRY *glUnmapBufferARB)(GLenum) = 0;
+void (APIENTRY *glGenFramebuffersEXT)(GLsizei, GLuint*) = 0;
+void (APIENTRY *glDeleteFramebuffersEXT)(GLsizei, const GLuint*) = 0;
+void (APIENTRY *glBindFramebufferEXT)(GLenum, GLuint) = 0;
+void (APIENTRY *glFramebufferTexture2DEXT)(GLenum, GLenum, GLenum, GLuint, GLint) = 0;
+GLenum (APIENTRY *glCheckFramebufferStatusEXT)(GLenum) = 0;
 
 
 namespace sphere {
     namespace video {
 
         //-----------------------------------------------------------------
-        struct Texture : public RefImpl<ITexture> {
+        // Small textures are packed into shared atlas pages, so that they
+        // don't need a GL texture of their own and can be batched together.
+        // The free space of a page is tracked with a skyline, i.e. the
+        // height of the used area for each span of columns. The space of
+        // deleted textures is not reused, the whole page is deleted
+        // together with its last texture.
+        struct SkylineNode {
+            int x;
+            int y;
+            int width;
+        };
+
+        struct AtlasPage {
             GLuint textureName;
-            Dim2i  textureSize;
             Dim2i  size;
+            int    numTextures;
+            std::vector<SkylineNode> skyline;
+        };
 
-            ~Texture() {
-                glDeleteTextures(1, &textureName);
-            }
+        //-----------------------------------------------------------------
+        // Streaming textures are written in a canvas in system memory,
+        // which is copied into a pixel buffer object when the texture is
+        // unlocked, so the upload to the texture doesn't block. The
+        // buffers are used in turn and orphaned before they are written,
+        // so unlocking never waits for an upload still in progress.
+        struct TextureStream {
+            CanvasPtr canvas;
+            GLuint    buffers[STREAMING_TEXTURE_BUFFERS];
+            int       nextBuffer;
+            bool      locked;
+        };
+
+        //-----------------------------------------------------------------
+        // Render targets have a framebuffer object the texture is attached
+        // to. They are drawn like the frame buffer, with GL's origin in the
+        // lower left corner, so their pixels are stored upside down.
+        // Textures that have a GL texture of their own and are not render
+        // targets can be evicted to system memory, resident ones are kept
+        // in a list ordered by when they were last drawn.
+        struct Texture : public RefImpl<ITexture> {
+            GLuint     textureName; // 0 if evicted
+            Dim2i      textureSize;
+            Recti      textureRect;
+            Dim2i      size;
+            bool       premultiplied;
+            AtlasPage* atlasPage;
+            GLuint     framebuffer;
+            TextureStream* stream;  // 0 unless streaming
+            CanvasPtr  shadow;      // pixels of an evicted texture
+            int        lastDrawn;   // frame count, -1 if never drawn
+            std::list<Texture*>::iterator lruEntry;
+
+            ~Texture();
 
             // ITexture implementation
             const Dim2i& getTextureSize() const {
                 return textureSize;
             }
+            const Recti& getTextureRect() const {
+                return textureRect;
+            }
             const Dim2i& getSize() const {
                 return size;
             }
+            bool isPremultiplied() const {
+                return premultiplied;
+            }
         };
 
         //-----------------------------------------------------------------
-        // globals
+        // Textured quads are not drawn right away but collected in a batch,
+        // which is drawn with a single glDrawElements call once the texture
+        // or any other state the quads depend on changes.
+        struct QuadVertex {
+            GLfloat texcoord[2];
+            RGBA    color;
+            GLint   pos[2];
+        };
+
+        //-----------------------------------------------------------------
+        // Shadow copy of the GL state, so that redundant state changes can
+        // be skipped and getters don't have to query GL.
+        struct GLState {
+            GLuint boundTexture;
+            bool   texturing;
+            bool   vertexArrays;
+            GLenum blendEquation;
+            GLenum blendSrc;
+            GLenum blendDst;
+            GLenum blendSrcAlpha;
+            GLenum blendDstAlpha;
+            GLint  scissor[4];
+        };
+
+        //-----------------------------------------------------------------
+        // Frame readbacks read the frame buffer into a pixel buffer object,
+        // so glReadPixels returns without waiting for the GPU. The buffer
+        // is mapped after the next swap, when the pixels have arrived.
+        // Without pixel buffer objects the frame is cloned right away.
+        struct FrameReadback {
+            int       handle; // 0 if the slot is free
+            GLuint    buffer;
+            int       bufferSize;
+            Dim2i     size;
+            int       frame;
+            bool      premultiplied; // read from a render target
+            CanvasPtr canvas;
+        };
 
         //-----------------------------------------------------------------
         // globals
@@ -84,9 +238,27 @@ namespace sphere {
         int         g_MaxTextureSize = 0;
         bool        g_NPOTTexturesSupported = false;
         int         g_BlendMode = BM_ALPHA;
+        bool        g_PremultipliedBlending = false;
         GLuint      g_Capture = 0;
         int         g_CaptureWidth = 0;
         int         g_CaptureHeight = 0;
+        bool        g_SoftwareDriver = false;
+        GLuint      g_QuadBatchTexture = 0;
+        std::vector<QuadVertex> g_QuadBatch;
+        std::vector<GLushort>   g_QuadBatchIndices;
+        std::vector<AtlasPage*> g_AtlasPages;
+        GLState     g_GLState;
+        VideoStats  g_VideoStats;
+        VideoStats  g_FrameStats;
+        int         g_FrameCount = 0;
+        bool        g_PixelBuffersSupported = false;
+        FrameReadback g_FrameReadbacks[FRAME_READBACK_SLOTS];
+        int         g_NextFrameReadback = 1;
+        bool        g_FramebuffersSupported = false;
+        RefPtr<Texture> g_RenderTarget;
+        int         g_TextureMemoryBudget = 0;
+        TextureMemoryStats  g_TextureMemory;
+        std::list<Texture*> g_TextureLRU; // most recently drawn first
 
         static int WinKeyToSphereKey[256] = {
             /* 0x00 */ -1,
@@ -348,268 +520,1037 @@ namespace sphere {
         };
 
         //-----------------------------------------------------------------
-        const Dim2i& GetDefaultDisplayMode()
+        static void bind_texture(GLuint textureName)
         {
-            return g_DefaultDisplayMode;
+            if (textureName == g_GLState.boundTexture) {
+                g_VideoStats.redundantStateChanges++;
+                return;
+            }
+            glBindTexture(GL_TEXTURE_2D, textureName);
+            g_GLState.boundTexture = textureName;
+            g_VideoStats.stateChanges++;
         }
 
         //-----------------------------------------------------------------
-        const std::vector<Dim2i>& GetDisplayModes()
+        static void delete_texture(GLuint textureName)
         {
-            return g_DisplayModes;
+            // deleting the bound texture reverts the binding to 0
+            if (textureName == g_GLState.boundTexture) {
+                g_GLState.boundTexture = 0;
+            }
+            glDeleteTextures(1, &textureName);
         }
 
         //-----------------------------------------------------------------
-        bool SetWindowMode(int width, int height, bool fullScreen)
+        static void enable_texturing(bool enable)
         {
-            assert(g_Window);
-            assert(width > 0);
-            assert(height > 0);
-
-            if (g_WindowSize.width != width || g_WindowSize.height != height) {
-                if (g_WindowIsFullScreen) {
-                    // restore display mode to defaults
-                    ChangeDisplaySettings(NULL, 0);
-
-                    // set window style
-                    SetWindowLong(g_Window, GWL_STYLE, BASIC_WINDOW_STYLE);
-
-                    g_WindowIsFullScreen = false;
-                }
-
-                // get adjusted metrics
-                RECT rect = {0, 0, width, height};
-                AdjustWindowRectEx(&rect, GetWindowLong(g_Window, GWL_STYLE), FALSE, 0);
-                int w = rect.right  - rect.left;
-                int h = rect.bottom - rect.top;
-                int x = (GetSystemMetrics(SM_CXSCREEN) - w) / 2;
-                int y = (GetSystemMetrics(SM_CYSCREEN) - h) / 2;
-
-                // change window size and position
-                if (!MoveWindow(g_Window, x, y, w, h, TRUE)) {
-                    return false;
-                }
-                g_WindowSize = Dim2i(width, height);
-
-                // change viewport
-                glViewport(0, 0, width, height);
-
-                // change projection matrix
-                glMatrixMode(GL_PROJECTION);
-                glLoadIdentity();
-                glOrtho(0, width, height, 0, -1, 1);
-
-                // set up modelview matrix
-                glMatrixMode(GL_MODELVIEW);
-                glLoadIdentity();
-                glTranslatef(0.375, 0.375, 0.0);
-
-                // reset clipping rectangle
-                glScissor(0, 0, width, height);
+            if (enable == g_GLState.texturing) {
+                g_VideoStats.redundantStateChanges++;
+                return;
             }
-
-            if (fullScreen && !g_WindowIsFullScreen) {
-                // see if the display mode is supported
-                bool mode_supported = false;
-                for (size_t i = 0; i < g_DisplayModes.size(); i++) {
-                    if (g_DisplayModes[i].width  == g_WindowSize.width &&
-                        g_DisplayModes[i].height == g_WindowSize.height)
-                    {
-                        mode_supported = true;
-                        break;
-                    }
-                }
-
-                if (!mode_supported) {
-                    return false;
-                }
-
-                DEVMODE dm;
-                memset(&dm, 0, sizeof(dm));
-                dm.dmSize       = sizeof(dm);
-                dm.dmFields     = DM_PELSWIDTH | DM_PELSHEIGHT;
-                dm.dmPelsWidth  = g_WindowSize.width;
-                dm.dmPelsHeight = g_WindowSize.height;
-
-                // change display mode
-                if (ChangeDisplaySettings(&dm, CDS_FULLSCREEN) != DISP_CHANGE_SUCCESSFUL) {
-                    // restore display mode to defaults
-                    ChangeDisplaySettings(NULL, 0);
-
-                    return false;
-                }
-
-                // set window style to a style appropriate for full-screen windows
-                SetWindowLong(g_Window, GWL_STYLE, FULLSCREEN_WINDOW_STYLE);
-
-                // set window as the topmost window and align it with the screen boundaries
-                SetWindowPos(g_Window, HWND_TOPMOST, 0, 0, g_WindowSize.width, g_WindowSize.height, SWP_SHOWWINDOW);
-
-                g_WindowIsFullScreen = true;
-
-            } else if (!fullScreen && g_WindowIsFullScreen) {
-                // restore display mode to default display mode
-                ChangeDisplaySettings(NULL, 0);
-
-                // set window style
-                SetWindowLong(g_Window, GWL_STYLE, BASIC_WINDOW_STYLE);
-
-                // get adjusted metrics
-                RECT rect = {0, 0, width, height};
-                AdjustWindowRectEx(&rect, GetWindowLong(g_Window, GWL_STYLE), FALSE, 0);
-                int w = rect.right  - rect.left;
-                int h = rect.bottom - rect.top;
-                int x = (GetSystemMetrics(SM_CXSCREEN) - w) / 2;
-                int y = (GetSystemMetrics(SM_CYSCREEN) - h) / 2;
-
-                // change window size and position
-                MoveWindow(g_Window, x, y, w, h, TRUE);
-
-                g_WindowIsFullScreen = false;
+            if (enable) {
+                glEnable(GL_TEXTURE_2D);
+            } else {
+                glDisable(GL_TEXTURE_2D);
             }
+            g_GLState.texturing = enable;
+            g_VideoStats.stateChanges++;
+        }
 
-            static bool first_call = true;
-            if (first_call) {
-                ShowWindow(g_Window, SW_SHOW);
-                first_call = false;
+        //-----------------------------------------------------------------
+        // The vertex arrays are only used by the quad batch and don't
+        // affect glBegin/glEnd, so they are never disabled again.
+        static void enable_vertex_arrays()
+        {
+            if (g_GLState.vertexArrays) {
+                g_VideoStats.redundantStateChanges++;
+                return;
             }
-
-            return true;
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glEnableClientState(GL_COLOR_ARRAY);
+            glEnableClientState(GL_VERTEX_ARRAY);
+            g_GLState.vertexArrays = true;
+            g_VideoStats.stateChanges++;
         }
 
         //-----------------------------------------------------------------
-        const Dim2i& GetWindowSize()
+        static void set_blend_equation(GLenum equation)
         {
-            assert(g_Window);
-            return g_WindowSize;
+            if (!glBlendEquationEXT) {
+                return;
+            }
+            if (equation == g_GLState.blendEquation) {
+                g_VideoStats.redundantStateChanges++;
+                return;
+            }
+            glBlendEquationEXT(equation);
+            g_GLState.blendEquation = equation;
+            g_VideoStats.stateChanges++;
         }
 
         //-----------------------------------------------------------------
-        bool IsWindowFullScreen()
+        static void set_blend_func(GLenum src, GLenum dst, GLenum srcAlpha, GLenum dstAlpha)
         {
-            assert(g_Window);
-            return g_WindowIsFullScreen;
+            if (src      == g_GLState.blendSrc      && dst      == g_GLState.blendDst &&
+                srcAlpha == g_GLState.blendSrcAlpha && dstAlpha == g_GLState.blendDstAlpha) {
+                g_VideoStats.redundantStateChanges++;
+                return;
+            }
+            if (srcAlpha == src && dstAlpha == dst) {
+                glBlendFunc(src, dst);
+            } else {
+                assert(glBlendFuncSeparateEXT);
+                glBlendFuncSeparateEXT(src, dst, srcAlpha, dstAlpha);
+            }
+            g_GLState.blendSrc      = src;
+            g_GLState.blendDst      = dst;
+            g_GLState.blendSrcAlpha = srcAlpha;
+            g_GLState.blendDstAlpha = dstAlpha;
+            g_VideoStats.stateChanges++;
         }
 
         //-----------------------------------------------------------------
-        bool IsWindowActive()
+        // Sets the blend factors of the blend mode for the alpha format of
+        // what is drawn. Render targets hold premultiplied pixels like the
+        // canvases of the software driver, so while one is bound, straight
+        // alpha sources are premultiplied as they are blended and alpha
+        // is blended with the over operator.
+        static void update_blend_func()
         {
-            assert(g_Window);
-            return g_Window == GetActiveWindow();
+            bool src_pm = g_PremultipliedBlending;
+            bool dst_pm = (g_RenderTarget.get() != 0);
+            switch (g_BlendMode) {
+                case BM_REPLACE:
+                    set_blend_func((dst_pm && !src_pm ? GL_SRC_ALPHA : GL_ONE), GL_ZERO, GL_ONE, GL_ZERO);
+                    break;
+                case BM_ALPHA: {
+                    GLenum src = (src_pm ? GL_ONE : GL_SRC_ALPHA);
+                    if (dst_pm) {
+                        set_blend_func(src, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+                    } else {
+                        set_blend_func(src, GL_ONE_MINUS_SRC_ALPHA, src, GL_ONE_MINUS_SRC_ALPHA);
+                    }
+                    break;
+                }
+                case BM_ADD:
+                case BM_SUBTRACT:
+                    set_blend_func(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
+                    break;
+                case BM_MULTIPLY: {
+                    GLenum dst = (src_pm ? GL_ONE_MINUS_SRC_ALPHA : GL_ZERO);
+                    set_blend_func(GL_DST_COLOR, dst, GL_DST_COLOR, dst);
+                    break;
+                }
+                default:
+                    break;
+            }
         }
 
         //-----------------------------------------------------------------
-        const std::string& GetWindowTitle()
+        // Takes GL window coordinates, y points up.
+        static void set_scissor(GLint x, GLint y, GLint width, GLint height)
         {
-            assert(g_Window);
-            return g_WindowTitle;
+            GLint* box = g_GLState.scissor;
+            if (box[0] == x && box[1] == y && box[2] == width && box[3] == height) {
+                g_VideoStats.redundantStateChanges++;
+                return;
+            }
+            glScissor(x, y, width, height);
+            box[0] = x;
+            box[1] = y;
+            box[2] = width;
+            box[3] = height;
+            g_VideoStats.stateChanges++;
         }
 
         //-----------------------------------------------------------------
-        void SetWindowTitle(const std::string& title)
+        // Puts GL into the state the shadow copy starts from.
+        static void reset_gl_state()
         {
-            assert(g_Window);
-            if (title != g_WindowTitle && SetWindowText(g_Window, title.c_str())) {
-                g_WindowTitle = title;
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glDisable(GL_TEXTURE_2D);
+            glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+            glDisableClientState(GL_COLOR_ARRAY);
+            glDisableClientState(GL_VERTEX_ARRAY);
+            if (glBlendEquationEXT) {
+                glBlendEquationEXT(GL_FUNC_ADD_EXT);
             }
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glScissor(0, 0, g_WindowSize.width, g_WindowSize.height);
+
+            g_GLState.boundTexture  = 0;
+            g_GLState.texturing     = false;
+            g_GLState.vertexArrays  = false;
+            g_GLState.blendEquation = GL_FUNC_ADD_EXT;
+            g_GLState.blendSrc      = GL_SRC_ALPHA;
+            g_GLState.blendDst      = GL_ONE_MINUS_SRC_ALPHA;
+            g_GLState.blendSrcAlpha = GL_SRC_ALPHA;
+            g_GLState.blendDstAlpha = GL_ONE_MINUS_SRC_ALPHA;
+            g_GLState.scissor[0]    = 0;
+            g_GLState.scissor[1]    = 0;
+            g_GLState.scissor[2]    = g_WindowSize.width;
+            g_GLState.scissor[3]    = g_WindowSize.height;
         }
 
         //-----------------------------------------------------------------
-        void SetWindowIcon(Canvas* icon)
+        // Draws the pending quads. Must be called before anything else is
+        // drawn or before the frame buffer or the texture is accessed.
+        static void flush_quad_batch()
         {
-            assert(g_Window);
-            assert(icon);
+            if (g_QuadBatch.empty()) {
+                return;
+            }
 
-            // create temporary buffer
-            int buf_size = 40 + icon->getHeight() * icon->getWidth() * 4;
-            BlobPtr buf = Blob::Create(buf_size);
+            // GL_QUADS leaves it to the driver how quads are split into
+            // triangles, which changes the texture mapping of quads that
+            // aren't parallelograms, so the triangles are given explicitly
+            if (g_QuadBatchIndices.empty()) {
+                g_QuadBatchIndices.resize(QUAD_BATCH_MAX_SIZE * 6);
+                for (int i = 0; i < QUAD_BATCH_MAX_SIZE; i++) {
+                    GLushort* idx = &g_QuadBatchIndices[i * 6];
+                    GLushort  v   = (GLushort)(i * 4);
+                    idx[0] = v;
+                    idx[1] = v + 1;
+                    idx[2] = v + 2;
+                    idx[3] = v;
+                    idx[4] = v + 2;
+                    idx[5] = v + 3;
+                }
+            }
 
-            // write the BITMAPINFO header
-            writei32l(buf.get(), 40);
-            writei32l(buf.get(), icon->getWidth());
-            writei32l(buf.get(), icon->getHeight() * 2);
-            writei16l(buf.get(), 1);
-            writei16l(buf.get(), 32);
-            writei32l(buf.get(), BI_RGB);
-            writei32l(buf.get(), icon->getHeight() * icon->getWidth() * 4);
-            writei32l(buf.get(), 0);
-            writei32l(buf.get(), 0);
-            writei32l(buf.get(), 0);
-            writei32l(buf.get(), 0);
+            bind_texture(g_QuadBatchTexture);
+            enable_texturing(true);
+            enable_vertex_arrays();
 
-            // write the pixels upside down into the buffer
-            for (int y = icon->getHeight()-1; y >= 0; y--) {
-                buf->write(icon->getPixels() + y * icon->getWidth(), icon->getPitch());
-            }
+            glTexCoordPointer(2, GL_FLOAT, sizeof(QuadVertex), g_QuadBatch[0].texcoord);
+            glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(QuadVertex), &g_QuadBatch[0].color);
+            glVertexPointer(2, GL_INT, sizeof(QuadVertex), g_QuadBatch[0].pos);
 
-            // create icon
-            HICON icon_handle = CreateIconFromResource(buf->getBuffer(), buf_size, TRUE, 0x00030000);
+            GLsizei num_quads = (GLsizei)(g_QuadBatch.size() / 4);
+            glDrawElements(GL_TRIANGLES, num_quads * 6, GL_UNSIGNED_SHORT, &g_QuadBatchIndices[0]);
+            g_VideoStats.drawCalls++;
 
-            // set icon
-            SendMessage(g_Window, WM_SETICON, ICON_SMALL, (LPARAM)icon_handle);
-            SendMessage(g_Window, WM_SETICON, ICON_BIG,   (LPARAM)icon_handle);
+            g_QuadBatch.clear();
         }
 
         //-----------------------------------------------------------------
-        void SwapWindowBuffers()
+        static int get_texture_bytes(const Dim2i& textureSize)
         {
-            assert(g_Window);
-            SwapBuffers(g_DeviceContext);
-            glClear(GL_COLOR_BUFFER_BIT);
+            // GL_RGBA8
+            return textureSize.width * textureSize.height * 4;
         }
 
         //-----------------------------------------------------------------
-        bool PeekWindowEvent(int event)
+        static void add_texture_memory(int bytes)
         {
-            if (event == -1) {
-                return !g_EventQueue.empty();
+            g_TextureMemory.usage += bytes;
+            if (g_TextureMemory.usage > g_TextureMemory.peakUsage) {
+                g_TextureMemory.peakUsage = g_TextureMemory.usage;
             }
-            for (size_t i = 0; i < g_EventQueue.size(); i++) {
-                if (g_EventQueue[i].type == event) {
-                    return true;
-                }
-            }
-            return false;
         }
 
         //-----------------------------------------------------------------
-        bool GetWindowEvent(WindowEvent& event)
+        static bool is_evictable(const Texture* t)
         {
-            if (g_EventQueue.empty()) {
-                return false;
-            }
-            event = g_EventQueue.front();
-            g_EventQueue.pop_front();
-            return true;
+            return !t->atlasPage && !t->framebuffer && !t->stream;
         }
 
         //-----------------------------------------------------------------
-        void ClearWindowEvents()
+        // Creates a GL texture of tex_w x tex_h pixels with the width x
+        // height pixels in its upper left corner. The pixels may be 0.
+        static GLuint create_gl_texture(int width, int height, int tex_w, int tex_h, const RGBA* pixels, int stride)
         {
-            g_EventQueue.clear();
-        }
+            RGBA* tex_p = 0;
+
+            if (pixels) {
+                tex_p = (RGBA*)pixels;
+
+                if (tex_w != width || tex_h != height) {
+                    // allocate a new pixel buffer
+                    tex_p = new RGBA[tex_w * tex_h];
+
+                    // copy the pixels into the new buffer
+                    for (int i = 0; i < height; i++) {
+                        memcpy(tex_p + i * tex_w, pixels + i * stride, width * sizeof(RGBA));
+                    }
+                } else if (stride != width) {
+                    // padded rows are read in place
+                    glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+                }
+            }
+
+            // create texture name
+            GLuint tex_n;
+            glGenTextures(1, &tex_n);
+
+            // bind texture
+            bind_texture(tex_n);
+
+            // set up wrap parameters
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+
+            // set up filter parameters
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+            // define pixels
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex_w, tex_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex_p);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+            // if we allocated a buffer, delete it
+            if (tex_p && tex_p != pixels) {
+                delete[] tex_p;
+            }
+
+            return tex_n;
+        }
+
+        //-----------------------------------------------------------------
+        // Reads all pixels of the GL texture, including the padding.
+        static Canvas* read_gl_texture(Texture* t)
+        {
+            CanvasPtr canvas = Canvas::Create(t->textureSize.width, t->textureSize.height, 0, t->premultiplied);
+
+            bind_texture(t->textureName);
+
+            glPixelStorei(GL_PACK_ROW_LENGTH, canvas->getStride());
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, canvas->getPixels());
+            glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+            return canvas.release();
+        }
+
+        //-----------------------------------------------------------------
+        // Moves the pixels of a texture to system memory and deletes the
+        // GL texture.
+        static void evict_texture(Texture* t)
+        {
+            assert(is_evictable(t) && !t->shadow);
+
+            if (t->textureName == g_QuadBatchTexture) {
+                flush_quad_batch();
+            }
+            t->shadow = read_gl_texture(t);
+            delete_texture(t->textureName);
+            t->textureName = 0;
+            g_TextureLRU.erase(t->lruEntry);
+
+            int bytes = get_texture_bytes(t->textureSize);
+            g_TextureMemory.usage        -= bytes;
+            g_TextureMemory.evictedUsage += bytes;
+            g_TextureMemory.evictions++;
+        }
+
+        //-----------------------------------------------------------------
+        // Uploads the pixels of an evicted texture again.
+        static void restore_texture(Texture* t)
+        {
+            if (!t->shadow) {
+                return;
+            }
+            const Dim2i& tex_size = t->textureSize;
+            t->textureName = create_gl_texture(tex_size.width, tex_size.height, tex_size.width, tex_size.height, t->shadow->getPixels(), t->shadow->getStride());
+            t->shadow = 0;
+            t->lruEntry = g_TextureLRU.insert(g_TextureLRU.begin(), t);
+
+            int bytes = get_texture_bytes(tex_size);
+            g_TextureMemory.evictedUsage -= bytes;
+            add_texture_memory(bytes);
+        }
+
+        //-----------------------------------------------------------------
+        // Evicts the least recently drawn textures until the usage is
+        // within the budget. Textures drawn in the current frame are kept,
+        // they would only be uploaded again before the frame is complete.
+        static void enforce_texture_memory_budget()
+        {
+            while (g_TextureMemoryBudget > 0 &&
+                   g_TextureMemory.usage > g_TextureMemoryBudget &&
+                   !g_TextureLRU.empty())
+            {
+                Texture* t = g_TextureLRU.back();
+                if (t->lastDrawn == g_FrameCount) {
+                    break;
+                }
+                evict_texture(t);
+            }
+        }
+
+        //-----------------------------------------------------------------
+        // Must be called before a texture is drawn, moves it to the front
+        // of the list or uploads it again if it was evicted.
+        static void touch_texture(Texture* t)
+        {
+            if (t->lastDrawn == g_FrameCount) {
+                return;
+            }
+            t->lastDrawn = g_FrameCount;
+            if (t->shadow) {
+                restore_texture(t);
+                enforce_texture_memory_budget();
+            } else if (is_evictable(t)) {
+                g_TextureLRU.splice(g_TextureLRU.begin(), g_TextureLRU, t->lruEntry);
+            }
+        }
+
+        //-----------------------------------------------------------------
+        // Appends a quad to the batch and returns its four vertices, which
+        // are drawn with the given texture. The batch is flushed first if
+        // it uses another texture or is full.
+        static QuadVertex* add_batch_quad(GLuint textureName)
+        {
+            if (textureName != g_QuadBatchTexture || g_QuadBatch.size() >= QUAD_BATCH_MAX_SIZE * 4) {
+                flush_quad_batch();
+                g_QuadBatchTexture = textureName;
+            }
+            size_t n = g_QuadBatch.size();
+            g_QuadBatch.resize(n + 4);
+            return &g_QuadBatch[n];
+        }
+
+        //-----------------------------------------------------------------
+        // Same for quads drawn with a texture, which may be evicted.
+        static QuadVertex* add_batch_quad(Texture* t)
+        {
+            touch_texture(t);
+            return add_batch_quad(t->textureName);
+        }
+
+        //-----------------------------------------------------------------
+        static void set_quad_vertex(QuadVertex& v, GLfloat s, GLfloat t, const RGBA& color, int x, int y)
+        {
+            v.texcoord[0] = s;
+            v.texcoord[1] = t;
+            v.color  = color;
+            v.pos[0] = x;
+            v.pos[1] = y;
+        }
+
+        //-----------------------------------------------------------------
+        // Returns the t coordinate of the top edge of a row of the image.
+        static GLfloat get_tex_y(Texture* t, int y)
+        {
+            if (t->framebuffer) {
+                // render targets are upside down
+                return (GLfloat)(t->size.height - y) / (GLfloat)t->textureSize.height;
+            }
+            return (GLfloat)(t->textureRect.ul.y + y) / (GLfloat)t->textureSize.height;
+        }
+
+        //-----------------------------------------------------------------
+        // Returns the size of the GL texture needed for an image, false
+        // if it is too big.
+        static bool get_texture_size(int width, int height, int& tex_w, int& tex_h)
+        {
+            tex_w = width;
+            tex_h = height;
+
+            // if NPOT textures are not supported, calculate a good texture size
+            if (!g_NPOTTexturesSupported) {
+                double log2_w = log10((double)tex_w) / log10(2.0);
+                double log2_h = log10((double)tex_h) / log10(2.0);
+
+                if (log2_w != floor(log2_w)) {
+                    tex_w = 1 << (int)ceil(log2_w);
+                }
+
+                if (log2_h != floor(log2_h)) {
+                    tex_h = 1 << (int)ceil(log2_h);
+                }
+            }
+
+            // make sure texture is, at max, MaxTextureSize by MaxTextureSize
+            return tex_w <= g_MaxTextureSize && tex_h <= g_MaxTextureSize;
+        }
+
+        //-----------------------------------------------------------------
+        // Returns the texture coordinates of a section of the texture.
+        static void get_tex_coords(Texture* t, const Recti& section, GLfloat& x, GLfloat& y, GLfloat& w, GLfloat& h)
+        {
+            x = (GLfloat)(t->textureRect.ul.x + section.ul.x) / (GLfloat)t->textureSize.width;
+            y = get_tex_y(t, section.ul.y);
+            w = (GLfloat)section.getWidth()  / (GLfloat)t->textureSize.width;
+            h = get_tex_y(t, section.lr.y + 1) - y;
+        }
+
+        //-----------------------------------------------------------------
+        // Returns the lowest y at which a width x height rectangle fits
+        // into the page if its left edge is at skyline node i, or -1 if
+        // it doesn't fit there.
+        static int fit_skyline(const AtlasPage* page, size_t i, int width, int height)
+        {
+            const std::vector<SkylineNode>& skyline = page->skyline;
+            if (skyline[i].x + width > page->size.width) {
+                return -1;
+            }
+            int y = 0;
+            int remaining = width;
+            while (remaining > 0) {
+                y = std::max(y, skyline[i].y);
+                if (y + height > page->size.height) {
+                    return -1;
+                }
+                remaining -= skyline[i].width;
+                i++;
+            }
+            return y;
+        }
+
+        //-----------------------------------------------------------------
+        // Finds the lowest position in the page for a width x height
+        // rectangle and marks it as used.
+        static bool pack_skyline(AtlasPage* page, int width, int height, Vec2i& pos)
+        {
+            std::vector<SkylineNode>& skyline = page->skyline;
+
+            int best_index  = -1;
+            int best_bottom = page->size.height + 1;
+            int best_width  = page->size.width + 1;
+            for (size_t i = 0; i < skyline.size(); i++) {
+                int y = fit_skyline(page, i, width, height);
+                if (y >= 0 && (y + height < best_bottom ||
+                              (y + height == best_bottom && skyline[i].width < best_width)))
+                {
+                    best_index  = (int)i;
+                    best_bottom = y + height;
+                    best_width  = skyline[i].width;
+                    pos = Vec2i(skyline[i].x, y);
+                }
+            }
+            if (best_index < 0) {
+                return false;
+            }
+
+            // raise the skyline over the new rectangle
+            SkylineNode node = {pos.x, pos.y + height, width};
+            skyline.insert(skyline.begin() + best_index, node);
+
+            // shrink or remove the nodes it covers
+            size_t next = best_index + 1;
+            while (next < skyline.size()) {
+                const SkylineNode& prev = skyline[next - 1];
+                int overlap = (prev.x + prev.width) - skyline[next].x;
+                if (overlap <= 0) {
+                    break;
+                }
+                skyline[next].x     += overlap;
+                skyline[next].width -= overlap;
+                if (skyline[next].width > 0) {
+                    break;
+                }
+                skyline.erase(skyline.begin() + next);
+            }
+
+            // merge neighbors of the same height
+            for (size_t i = 1; i < skyline.size(); ) {
+                if (skyline[i - 1].y == skyline[i].y) {
+                    skyline[i - 1].width += skyline[i].width;
+                    skyline.erase(skyline.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        static AtlasPage* create_atlas_page()
+        {
+            int page_size = ATLAS_PAGE_SIZE;
+
+            AtlasPage* page = new AtlasPage;
+            page->size = Dim2i(page_size, page_size);
+            page->numTextures = 0;
+
+            SkylineNode node = {0, 0, page_size};
+            page->skyline.push_back(node);
+
+            // the unused space between the textures is transparent
+            std::vector<RGBA> empty(page_size * page_size, RGBA(0, 0, 0, 0));
+
+            glGenTextures(1, &page->textureName);
+            bind_texture(page->textureName);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, page_size, page_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, &empty[0]);
+            add_texture_memory(get_texture_bytes(page->size));
+
+            g_AtlasPages.push_back(page);
+            return page;
+        }
+
+        //-----------------------------------------------------------------
+        // Creates a texture in an atlas page, or returns 0 if the texture
+        // is too big for the atlas.
+        static Texture* create_atlas_texture(int width, int height, const RGBA* pixels, bool premultiplied, int stride)
+        {
+            if (width  > ATLAS_MAX_TEXTURE_SIZE ||
+                height > ATLAS_MAX_TEXTURE_SIZE ||
+                g_MaxTextureSize < ATLAS_PAGE_SIZE)
+            {
+                return 0;
+            }
+
+            // leave a gap of one pixel so that the textures don't bleed
+            // into each other
+            AtlasPage* page = 0;
+            Vec2i pos;
+            for (size_t i = 0; i < g_AtlasPages.size(); i++) {
+                if (pack_skyline(g_AtlasPages[i], width + 1, height + 1, pos)) {
+                    page = g_AtlasPages[i];
+                    break;
+                }
+            }
+            if (!page) {
+                page = create_atlas_page();
+                if (!pack_skyline(page, width + 1, height + 1, pos)) {
+                    return 0;
+                }
+            }
+
+            if (pixels) {
+                bind_texture(page->textureName);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, pos.x, pos.y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            }
+
+            page->numTextures++;
+
+            Texture* t = new Texture;
+            t->textureName   = page->textureName;
+            t->textureSize   = page->size;
+            t->textureRect   = Recti(pos.x, pos.y, pos.x + width - 1, pos.y + height - 1);
+            t->size          = Dim2i(width, height);
+            t->premultiplied = premultiplied;
+            t->atlasPage     = page;
+            t->framebuffer   = 0;
+            t->stream        = 0;
+            t->lastDrawn     = -1;
+
+            return t;
+        }
+
+        //-----------------------------------------------------------------
+        // Returns the size of what is drawn into, the render target or
+        // the frame buffer.
+        static const Dim2i& get_target_size()
+        {
+            return g_RenderTarget ? g_RenderTarget->size : g_WindowSize;
+        }
+
+        //-----------------------------------------------------------------
+        // Redirects drawing to a render target or back to the frame buffer
+        // if target is 0. The scissor is reset to the whole target.
+        static void bind_render_target(Texture* target)
+        {
+            flush_quad_batch();
+
+            if (g_FramebuffersSupported) {
+                glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, (target ? target->framebuffer : 0));
+            }
+            if (target != g_RenderTarget.get()) {
+                if (target) {
+                    target->grab();
+                }
+                g_RenderTarget = target;
+                update_blend_func();
+            }
+
+            const Dim2i& size = get_target_size();
+
+            // change viewport
+            glViewport(0, 0, size.width, size.height);
+
+            // change projection matrix
+            glMatrixMode(GL_PROJECTION);
+            glLoadIdentity();
+            glOrtho(0, size.width, size.height, 0, -1, 1);
+            glMatrixMode(GL_MODELVIEW);
+
+            set_scissor(0, 0, size.width, size.height);
+        }
+
+        //-----------------------------------------------------------------
+        Texture::~Texture()
+        {
+            if (shadow) {
+                // evicted, there is no GL texture
+                g_TextureMemory.evictedUsage -= get_texture_bytes(textureSize);
+                return;
+            }
+            if (is_evictable(this)) {
+                g_TextureLRU.erase(lruEntry);
+            }
+
+            if (atlasPage) {
+                // the page is deleted together with its last texture
+                if (--atlasPage->numTextures > 0) {
+                    return;
+                }
+                g_AtlasPages.erase(std::find(g_AtlasPages.begin(), g_AtlasPages.end(), atlasPage));
+                delete atlasPage;
+            }
+
+            // the batch may still refer to the texture
+            if (textureName == g_QuadBatchTexture) {
+                flush_quad_batch();
+            }
+            if (framebuffer) {
+                glDeleteFramebuffersEXT(1, &framebuffer);
+            }
+            if (stream) {
+                if (g_PixelBuffersSupported) {
+                    glDeleteBuffersARB(STREAMING_TEXTURE_BUFFERS, stream->buffers);
+                }
+                delete stream;
+            }
+            delete_texture(textureName);
+            g_TextureMemory.usage -= get_texture_bytes(textureSize);
+        }
+
+        //-----------------------------------------------------------------
+        const Dim2i& GetDefaultDisplayMode()
+        {
+            if (g_SoftwareDriver) {
+                return soft::GetDefaultDisplayMode();
+            }
+
+            return g_DefaultDisplayMode;
+        }
+
+        //-----------------------------------------------------------------
+        const std::vector<Dim2i>& GetDisplayModes()
+        {
+            if (g_SoftwareDriver) {
+                return soft::GetDisplayModes();
+            }
+
+            return g_DisplayModes;
+        }
+
+        //-----------------------------------------------------------------
+        bool SetWindowMode(int width, int height, bool fullScreen)
+        {
+            if (g_SoftwareDriver) {
+                return soft::SetWindowMode(width, height, fullScreen);
+            }
+
+            assert(g_Window);
+            assert(width > 0);
+            assert(height > 0);
+
+            flush_quad_batch();
+
+            if (g_WindowSize.width != width || g_WindowSize.height != height) {
+                // the viewport below is the one of the frame buffer
+                if (g_RenderTarget) {
+                    bind_render_target(0);
+                }
+
+                if (g_WindowIsFullScreen) {
+                    // restore display mode to defaults
+                    ChangeDisplaySettings(NULL, 0);
+
+                    // set window style
+                    SetWindowLong(g_Window, GWL_STYLE, BASIC_WINDOW_STYLE);
+
+                    g_WindowIsFullScreen = false;
+                }
+
+                // get adjusted metrics
+                RECT rect = {0, 0, width, height};
+                AdjustWindowRectEx(&rect, GetWindowLong(g_Window, GWL_STYLE), FALSE, 0);
+                int w = rect.right  - rect.left;
+                int h = rect.bottom - rect.top;
+                int x = (GetSystemMetrics(SM_CXSCREEN) - w) / 2;
+                int y = (GetSystemMetrics(SM_CYSCREEN) - h) / 2;
+
+                // change window size and position
+                if (!MoveWindow(g_Window, x, y, w, h, TRUE)) {
+                    return false;
+                }
+                g_WindowSize = Dim2i(width, height);
+
+                // change viewport
+                glViewport(0, 0, width, height);
+
+                // change projection matrix
+                glMatrixMode(GL_PROJECTION);
+                glLoadIdentity();
+                glOrtho(0, width, height, 0, -1, 1);
+
+                // set up modelview matrix
+                glMatrixMode(GL_MODELVIEW);
+                glLoadIdentity();
+                glTranslatef(0.375, 0.375, 0.0);
+
+                // reset clipping rectangle
+                set_scissor(0, 0, width, height);
+            }
+
+            if (fullScreen && !g_WindowIsFullScreen) {
+                // see if the display mode is supported
+                bool mode_supported = false;
+                for (size_t i = 0; i < g_DisplayModes.size(); i++) {
+                    if (g_DisplayModes[i].width  == g_WindowSize.width &&
+                        g_DisplayModes[i].height == g_WindowSize.height)
+                    {
+                        mode_supported = true;
+                        break;
+                    }
+                }
+
+                if (!mode_supported) {
+                    return false;
+                }
+
+                DEVMODE dm;
+                memset(&dm, 0, sizeof(dm));
+                dm.dmSize       = sizeof(dm);
+                dm.dmFields     = DM_PELSWIDTH | DM_PELSHEIGHT;
+                dm.dmPelsWidth  = g_WindowSize.width;
+                dm.dmPelsHeight = g_WindowSize.height;
+
+                // change display mode
+                if (ChangeDisplaySettings(&dm, CDS_FULLSCREEN) != DISP_CHANGE_SUCCESSFUL) {
+                    // restore display mode to defaults
+                    ChangeDisplaySettings(NULL, 0);
+
+                    return false;
+                }
+
+                // set window style to a style appropriate for full-screen windows
+                SetWindowLong(g_Window, GWL_STYLE, FULLSCREEN_WINDOW_STYLE);
+
+                // set window as the topmost window and align it with the screen boundaries
+                SetWindowPos(g_Window, HWND_TOPMOST, 0, 0, g_WindowSize.width, g_WindowSize.height, SWP_SHOWWINDOW);
+
+                g_WindowIsFullScreen = true;
+
+            } else if (!fullScreen && g_WindowIsFullScreen) {
+                // restore display mode to default display mode
+                ChangeDisplaySettings(NULL, 0);
+
+                // set window style
+                SetWindowLong(g_Window, GWL_STYLE, BASIC_WINDOW_STYLE);
+
+                // get adjusted metrics
+                RECT rect = {0, 0, width, height};
+                AdjustWindowRectEx(&rect, GetWindowLong(g_Window, GWL_STYLE), FALSE, 0);
+                int w = rect.right  - rect.left;
+                int h = rect.bottom - rect.top;
+                int x = (GetSystemMetrics(SM_CXSCREEN) - w) / 2;
+                int y = (GetSystemMetrics(SM_CYSCREEN) - h) / 2;
+
+                // change window size and position
+                MoveWindow(g_Window, x, y, w, h, TRUE);
+
+                g_WindowIsFullScreen = false;
+            }
+
+            static bool first_call = true;
+            if (first_call) {
+                ShowWindow(g_Window, SW_SHOW);
+                first_call = false;
+            }
+
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        const Dim2i& GetWindowSize()
+        {
+            if (g_SoftwareDriver) {
+                return soft::GetWindowSize();
+            }
+
+            assert(g_Window);
+            return g_WindowSize;
+        }
+
+        //-----------------------------------------------------------------
+        bool IsWindowFullScreen()
+        {
+            if (g_SoftwareDriver) {
+                return soft::IsWindowFullScreen();
+            }
+
+            assert(g_Window);
+            return g_WindowIsFullScreen;
+        }
+
+        //-----------------------------------------------------------------
+        bool IsWindowActive()
+        {
+            if (g_SoftwareDriver) {
+                return soft::IsWindowActive();
+            }
+
+            assert(g_Window);
+            return g_Window == GetActiveWindow();
+        }
+
+        //-----------------------------------------------------------------
+        const std::string& GetWindowTitle()
+        {
+            if (g_SoftwareDriver) {
+                return soft::GetWindowTitle();
+            }
+
+            assert(g_Window);
+            return g_WindowTitle;
+        }
+
+        //-----------------------------------------------------------------
+        void SetWindowTitle(const std::string& title)
+        {
+            if (g_SoftwareDriver) {
+                soft::SetWindowTitle(title);
+                return;
+            }
+
+            assert(g_Window);
+            if (title != g_WindowTitle && SetWindowText(g_Window, title.c_str())) {
+                g_WindowTitle = title;
+            }
+        }
+
+        //-----------------------------------------------------------------
+        void SetWindowIcon(Canvas* icon)
+        {
+            if (g_SoftwareDriver) {
+                soft::SetWindowIcon(icon);
+                return;
+            }
+
+            assert(g_Window);
+            assert(icon);
+
+            // create temporary buffer
+            int buf_size = 40 + icon->getHeight() * icon->getWidth() * 4;
+            BlobPtr buf = Blob::Create(buf_size);
+
+            // write the BITMAPINFO header
+            writei32l(buf.get(), 40);
+            writei32l(buf.get(), icon->getWidth());
+            writei32l(buf.get(), icon->getHeight() * 2);
+            writei16l(buf.get(), 1);
+            writei16l(buf.get(), 32);
+            writei32l(buf.get(), BI_RGB);
+            writei32l(buf.get(), icon->getHeight() * icon->getWidth() * 4);
+            writei32l(buf.get(), 0);
+            writei32l(buf.get(), 0);
+            writei32l(buf.get(), 0);
+            writei32l(buf.get(), 0);
+
+            // write the pixels upside down into the buffer
+            for (int y = icon->getHeight()-1; y >= 0; y--) {
+                buf->write(icon->getPixels() + y * icon->getStride(), icon->getWidth() * Canvas::GetNumBytesPerPixel());
+            }
+
+            // create icon
+            HICON icon_handle = CreateIconFromResource(buf->getBuffer(), buf_size, TRUE, 0x00030000);
+
+            // set icon
+            SendMessage(g_Window, WM_SETICON, ICON_SMALL, (LPARAM)icon_handle);
+            SendMessage(g_Window, WM_SETICON, ICON_BIG,   (LPARAM)icon_handle);
+        }
+
+        //-----------------------------------------------------------------
+        void SwapWindowBuffers()
+        {
+            if (g_SoftwareDriver) {
+                soft::SwapWindowBuffers();
+                return;
+            }
+
+            assert(g_Window);
+            flush_quad_batch();
+
+            // every frame starts drawing into the frame buffer
+            if (g_RenderTarget) {
+                bind_render_target(0);
+            }
+
+            SwapBuffers(g_DeviceContext);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            // start counting the next frame
+            g_FrameStats = g_VideoStats;
+            memset(&g_VideoStats, 0, sizeof(g_VideoStats));
+            g_FrameCount++;
+
+            // the textures of the last frame may be evicted now
+            enforce_texture_memory_budget();
+        }
+
+        //-----------------------------------------------------------------
+        bool PeekWindowEvent(int event)
+        {
+            if (event == -1) {
+                return !g_EventQueue.empty();
+            }
+            for (size_t i = 0; i < g_EventQueue.size(); i++) {
+                if (g_EventQueue[i].type == event) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        //-----------------------------------------------------------------
+        bool GetWindowEvent(WindowEvent& event)
+        {
+            if (g_EventQueue.empty()) {
+                return false;
+            }
+            event = g_EventQueue.front();
+            g_EventQueue.pop_front();
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        void ClearWindowEvents()
+        {
+            g_EventQueue.clear();
+        }
 
         //-----------------------------------------------------------------
         void GetFrameScissor(Recti& scissor)
         {
-            GLint rect[4];
-            glGetIntegerv(GL_SCISSOR_BOX, rect);
+            if (g_SoftwareDriver) {
+                soft::GetFrameScissor(scissor);
+                return;
+            }
+
+            const GLint* box = g_GLState.scissor;
 
-            scissor.ul.x = rect[0];
-            scissor.ul.y = rect[1] - g_WindowSize.height + rect[3];
-            scissor.lr.x = (rect[0] + rect[2]) - 1;
-            scissor.lr.y = (scissor.ul.y + rect[3]) - 1;
+            scissor.ul.x = box[0];
+            scissor.ul.y = get_target_size().height - (box[1] + box[3]);
+            scissor.lr.x = (box[0] + box[2]) - 1;
+            scissor.lr.y = (scissor.ul.y + box[3]) - 1;
         }
 
         //-----------------------------------------------------------------
         bool SetFrameScissor(const Recti& scissor)
         {
-            if (!Recti(0, 0, g_WindowSize.width - 1, g_WindowSize.height - 1).contains(scissor)) {
+            if (g_SoftwareDriver) {
+                return soft::SetFrameScissor(scissor);
+            }
+
+            const Dim2i& size = get_target_size();
+            if (!Recti(0, 0, size.width - 1, size.height - 1).contains(scissor)) {
                 return false;
             }
-            glScissor(
+            flush_quad_batch();
+            set_scissor(
                 scissor.ul.x,
-                (g_WindowSize.height - scissor.getY()) - scissor.getHeight(),
+                (size.height - scissor.getY()) - scissor.getHeight(),
                 scissor.getWidth(),
                 scissor.getHeight()
             );
@@ -617,251 +1558,733 @@ namespace sphere {
         }
 
         //-----------------------------------------------------------------
-        Canvas* CloneFrame(Recti* section)
+        // Converts a frame section to GL window coordinates.
+        static bool get_frame_section(Recti* section, int& x, int& y, int& w, int& h)
         {
-            int x = 0;
-            int y = 0;
-            int w = g_WindowSize.width;
-            int h = g_WindowSize.height;
+            const Dim2i& size = get_target_size();
+
+            x = 0;
+            y = 0;
+            w = size.width;
+            h = size.height;
 
             if (section) {
-                if (!section->isValid() || !Recti(0, 0, g_WindowSize.width - 1, g_WindowSize.height - 1).contains(*section)) {
-                    return 0;
+                if (!section->isValid() || !Recti(0, 0, size.width - 1, size.height - 1).contains(*section)) {
+                    return false;
                 }
                 x = section->getX();
-                y = g_WindowSize.height - (section->getY() + section->getHeight());
+                y = size.height - (section->getY() + section->getHeight());
                 w = section->getWidth();
                 h = section->getHeight();
             }
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        Canvas* CloneFrame(Recti* section)
+        {
+            if (g_SoftwareDriver) {
+                return soft::CloneFrame(section);
+            }
+
+            int x, y, w, h;
+            if (!get_frame_section(section, x, y, w, h)) {
+                return 0;
+            }
 
-            // create canvas
-            CanvasPtr canvas = Canvas::Create(w, h);
+            flush_quad_batch();
+
+            // create canvas, render targets hold premultiplied pixels
+            CanvasPtr canvas = Canvas::Create(w, h, 0, g_RenderTarget.get() != 0);
 
             // copy pixels into canvas
+            glPixelStorei(GL_PACK_ROW_LENGTH, canvas->getStride());
             glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, canvas->getPixels());
+            glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+            // GL's origin is the lower left corner
+            canvas->flipVertically();
+
+            return canvas.release();
+        }
+
+        //-----------------------------------------------------------------
+        int RequestFrameReadback(Recti* section)
+        {
+            if (g_SoftwareDriver) {
+                return soft::RequestFrameReadback(section);
+            }
+
+            int x, y, w, h;
+            if (!get_frame_section(section, x, y, w, h)) {
+                return 0;
+            }
+
+            FrameReadback* r = 0;
+            for (int i = 0; i < FRAME_READBACK_SLOTS; i++) {
+                if (g_FrameReadbacks[i].handle == 0) {
+                    r = &g_FrameReadbacks[i];
+                    break;
+                }
+            }
+            if (!r) {
+                return 0;
+            }
+
+            if (g_PixelBuffersSupported) {
+                flush_quad_batch();
+
+                int size = w * h * sizeof(RGBA);
+                if (r->buffer == 0) {
+                    glGenBuffersARB(1, &r->buffer);
+                }
+                glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, r->buffer);
+                if (r->bufferSize < size) {
+                    glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, size, 0, GL_STREAM_READ_ARB);
+                    r->bufferSize = size;
+                }
+                glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+                glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+                r->size  = Dim2i(w, h);
+                r->frame = g_FrameCount;
+                r->premultiplied = (g_RenderTarget.get() != 0);
+            } else {
+                r->canvas = CloneFrame(section);
+                if (!r->canvas) {
+                    return 0;
+                }
+            }
+
+            r->handle = g_NextFrameReadback;
+            g_NextFrameReadback = (r->handle == INT_MAX ? 1 : r->handle + 1);
+            return r->handle;
+        }
+
+        //-----------------------------------------------------------------
+        Canvas* PollFrameReadback(int handle, bool* pending)
+        {
+            if (g_SoftwareDriver) {
+                return soft::PollFrameReadback(handle, pending);
+            }
+
+            if (pending) {
+                *pending = false;
+            }
+
+            FrameReadback* r = 0;
+            for (int i = 0; i < FRAME_READBACK_SLOTS; i++) {
+                if (handle != 0 && g_FrameReadbacks[i].handle == handle) {
+                    r = &g_FrameReadbacks[i];
+                    break;
+                }
+            }
+            if (!r) {
+                return 0;
+            }
+
+            if (r->canvas) {
+                r->handle = 0;
+                CanvasPtr canvas = r->canvas;
+                r->canvas = 0;
+                return canvas.release();
+            }
+
+            if (r->frame == g_FrameCount) {
+                // mapping the buffer now would wait for the GPU
+                if (pending) {
+                    *pending = true;
+                }
+                return 0;
+            }
+            r->handle = 0;
+
+            CanvasPtr canvas = Canvas::Create(r->size.width, r->size.height, 0, r->premultiplied);
 
-            // flip canvas
-            canvas->flipHorizontally();
+            glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, r->buffer);
+            const RGBA* pixels = (const RGBA*)glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+            if (pixels) {
+                // flip the rows while copying, GL's origin is the lower left corner
+                int w = r->size.width;
+                int h = r->size.height;
+                for (int i = 0; i < h; i++) {
+                    memcpy(canvas->getPixels() + i * canvas->getStride(), pixels + (h - 1 - i) * w, w * sizeof(RGBA));
+                }
+                glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+            }
+            glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
 
+            if (!pixels) {
+                return 0;
+            }
             return canvas.release();
         }
 
         //-----------------------------------------------------------------
         int GetBlendMode()
         {
+            if (g_SoftwareDriver) {
+                return soft::GetBlendMode();
+            }
+
             return g_BlendMode;
         }
 
         //-----------------------------------------------------------------
         bool SetBlendMode(int blendMode)
         {
+            if (g_SoftwareDriver) {
+                return soft::SetBlendMode(blendMode);
+            }
+
+            flush_quad_batch();
+
             switch (blendMode) {
                 case BM_REPLACE:
-                    if (glBlendEquationEXT) {
-                        glBlendEquationEXT(GL_FUNC_ADD_EXT);
-                    }
-                    glBlendFunc(GL_ONE, GL_ZERO);
-                    break;
                 case BM_ALPHA:
-                    if (glBlendEquationEXT) {
-                        glBlendEquationEXT(GL_FUNC_ADD_EXT);
-                    }
-                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-                    break;
                 case BM_ADD:
-                    if (glBlendEquationEXT) {
-                        glBlendEquationEXT(GL_FUNC_ADD_EXT);
-                    }
-                    glBlendFunc(GL_ONE, GL_ONE);
+                case BM_MULTIPLY:
+                    set_blend_equation(GL_FUNC_ADD_EXT);
                     break;
                 case BM_SUBTRACT:
                     if (!glBlendEquationEXT) {
                         // subtractive blending needs glBlendEquationEXT
                         return false;
                     }
-                    glBlendEquationEXT(GL_FUNC_REVERSE_SUBTRACT_EXT);
-                    glBlendFunc(GL_ONE, GL_ONE);
-                    break;
-                case BM_MULTIPLY:
-                    if (glBlendEquationEXT) {
-                        glBlendEquationEXT(GL_FUNC_ADD_EXT);
-                    }
-                    glBlendFunc(GL_DST_COLOR, GL_ZERO);
+                    set_blend_equation(GL_FUNC_REVERSE_SUBTRACT_EXT);
                     break;
                 default:
                     return false;
             }
             g_BlendMode = blendMode;
+            g_PremultipliedBlending = false;
+            update_blend_func();
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        // Premultiplied textures need other blend factors for BM_ALPHA and
+        // BM_MULTIPLY, the other blend modes work with both alpha formats.
+        static void set_premultiplied_blending(bool premultiplied)
+        {
+            if (premultiplied == g_PremultipliedBlending) {
+                return;
+            }
+            flush_quad_batch();
+            g_PremultipliedBlending = premultiplied;
+            update_blend_func();
+        }
+
+        //-----------------------------------------------------------------
+        // Sets up blending for drawing the texture and returns the mask
+        // color in the alpha format of the texture.
+        static RGBA begin_texture_blending(Texture* t, const RGBA& mask)
+        {
+            set_premultiplied_blending(t->premultiplied);
+            RGBA m = mask;
+            if (t->premultiplied) {
+                rgba_premultiply(&m);
+            }
+            return m;
+        }
+
+        //-----------------------------------------------------------------
+        ITexture* CreateTexture(int width, int height, const RGBA* pixels, bool premultiplied, int stride)
+        {
+            if (g_SoftwareDriver) {
+                return soft::CreateTexture(width, height, pixels, premultiplied, stride);
+            }
+
+            assert(width  > 0);
+            assert(height > 0);
+
+            if (stride == 0) {
+                stride = width;
+            }
+
+            Texture* atlas_texture = create_atlas_texture(width, height, pixels, premultiplied, stride);
+            if (atlas_texture) {
+                return atlas_texture;
+            }
+
+            int tex_w;
+            int tex_h;
+            if (!get_texture_size(width, height, tex_w, tex_h)) {
+                return 0;
+            }
+
+            GLuint tex_n = create_gl_texture(width, height, tex_w, tex_h, pixels, stride);
+
+            Texture* t = new Texture;
+            t->textureName = tex_n;
+            t->textureSize = Dim2i(tex_w, tex_h);
+            t->textureRect = Recti(0, 0, width - 1, height - 1);
+            t->size        = Dim2i(width, height);
+            t->premultiplied = premultiplied;
+            t->atlasPage   = 0;
+            t->framebuffer = 0;
+            t->stream      = 0;
+            t->lastDrawn   = -1;
+            t->lruEntry    = g_TextureLRU.insert(g_TextureLRU.begin(), t);
+
+            add_texture_memory(get_texture_bytes(t->textureSize));
+            enforce_texture_memory_budget();
+
+            return t;
+        }
+
+        //-----------------------------------------------------------------
+        bool UpdateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* rect)
+        {
+            if (g_SoftwareDriver) {
+                return soft::UpdateTexturePixels(texture, newPixels, rect);
+            }
+
+            assert(texture);
+            assert(newPixels);
+
+            Texture* t = (Texture*)texture;
+
+            int x = 0;
+            int y = 0;
+            int w = newPixels->getWidth();
+            int h = newPixels->getHeight();
+
+            if (rect) {
+                if (!rect->isValid() || !rect->isInside(0, 0, t->getSize().width - 1, t->getSize().height - 1)) {
+                    return false;
+                }
+
+                x = rect->ul.x;
+                y = rect->ul.y;
+                w = rect->getWidth();
+                h = rect->getHeight();
+            }
+
+            if (w != newPixels->getWidth() ||
+                h != newPixels->getHeight())
+            {
+                return false;
+            }
+
+            // convert the pixels to the alpha format of the texture
+            CanvasPtr converted;
+            if (newPixels->isPremultiplied() != t->premultiplied) {
+                converted = newPixels->cloneSection(Recti(0, 0, w - 1, h - 1));
+                if (t->premultiplied) {
+                    converted->premultiply();
+                } else {
+                    converted->unpremultiply();
+                }
+                newPixels = converted.get();
+            }
+
+            restore_texture(t);
+
+            // render targets are upside down
+            if (t->framebuffer) {
+                if (!converted) {
+                    converted = newPixels->cloneSection(Recti(0, 0, w - 1, h - 1));
+                    newPixels = converted.get();
+                }
+                converted->flipVertically();
+                y = t->size.height - (y + h);
+            }
+
+            // draw pending quads with the old pixels
+            if (t->textureName == g_QuadBatchTexture || t == g_RenderTarget.get()) {
+                flush_quad_batch();
+            }
+
+            // bind texture
+            bind_texture(t->textureName);
+
+            // update texture pixels
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, newPixels->getStride());
+            glTexSubImage2D(GL_TEXTURE_2D, 0, t->textureRect.ul.x + x, t->textureRect.ul.y + y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, newPixels->getPixels());
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        bool UpdateTextureDirtyPixels(ITexture* texture, Canvas* canvas)
+        {
+            if (g_SoftwareDriver) {
+                return soft::UpdateTextureDirtyPixels(texture, canvas);
+            }
+
+            assert(texture);
+            assert(canvas);
+
+            Texture* t = (Texture*)texture;
+
+            if (canvas->getWidth()  != t->size.width ||
+                canvas->getHeight() != t->size.height)
+            {
+                return false;
+            }
+
+            const std::vector<Recti>& dirtyRects = canvas->getDirtyRects();
+            if (dirtyRects.empty()) {
+                return true;
+            }
+
+            restore_texture(t);
+
+            // draw pending quads with the old pixels
+            if (t->textureName == g_QuadBatchTexture || t == g_RenderTarget.get()) {
+                flush_quad_batch();
+            }
+
+            // bind texture
+            bind_texture(t->textureName);
+
+            // if no conversion is needed, the dirty rectangles are
+            // uploaded straight out of the canvas
+            bool convert = (canvas->isPremultiplied() != t->premultiplied);
+
+            for (size_t i = 0; i < dirtyRects.size(); ++i) {
+                const Recti& r = dirtyRects[i];
+                const RGBA* pixels = canvas->getPixels() + r.ul.y * canvas->getStride() + r.ul.x;
+                int stride = canvas->getStride();
+                int y = t->textureRect.ul.y + r.ul.y;
+
+                // convert the pixels to the alpha format of the texture,
+                // render targets also need them upside down
+                CanvasPtr converted;
+                if (convert || t->framebuffer) {
+                    converted = canvas->cloneSection(r);
+                    if (convert && t->premultiplied) {
+                        converted->premultiply();
+                    } else if (convert) {
+                        converted->unpremultiply();
+                    }
+                    if (t->framebuffer) {
+                        converted->flipVertically();
+                        y = t->size.height - (r.ul.y + r.getHeight());
+                    }
+                    pixels = converted->getPixels();
+                    stride = converted->getStride();
+                }
+
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, t->textureRect.ul.x + r.ul.x, y, r.getWidth(), r.getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            }
+
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+            canvas->clearDirtyRects();
+
             return true;
         }
 
         //-----------------------------------------------------------------
-        ITexture* CreateTexture(int width, int height, const RGBA* pixels)
+        Canvas* GrabTexturePixels(ITexture* texture)
+        {
+            if (g_SoftwareDriver) {
+                return soft::GrabTexturePixels(texture);
+            }
+
+            assert(texture);
+
+            Texture* t = (Texture*)texture;
+
+            // evicted textures don't need to be uploaded again
+            if (t->shadow) {
+                return t->shadow->cloneSection(t->textureRect);
+            }
+
+            // draw pending quads into the render target
+            if (t == g_RenderTarget.get()) {
+                flush_quad_batch();
+            }
+
+            // copy texture pixels into canvas
+            CanvasPtr canvas = read_gl_texture(t);
+
+            // cut the real image out of the texture
+            if (t->atlasPage) {
+                canvas = canvas->cloneSection(t->textureRect);
+            } else {
+                canvas->resize(t->size.width, t->size.height);
+            }
+
+            // render targets are upside down
+            if (t->framebuffer) {
+                canvas->flipVertically();
+            }
+
+            return canvas.release();
+        }
+
+        //-----------------------------------------------------------------
+        ITexture* CreateRenderTarget(int width, int height)
         {
+            if (g_SoftwareDriver) {
+                return soft::CreateRenderTarget(width, height);
+            }
+
             assert(width  > 0);
             assert(height > 0);
 
-            int tex_w = width;
-            int tex_h = height;
+            if (!g_FramebuffersSupported) {
+                return 0;
+            }
+
+            int tex_w;
+            int tex_h;
+            if (!get_texture_size(width, height, tex_w, tex_h)) {
+                return 0;
+            }
+
+            // allocate texture buffer
+            GLuint tex_n = create_gl_texture(width, height, tex_w, tex_h, 0, 0);
 
-            // if NPOT textures are not supported, calculate a good texture size
-            if (!g_NPOTTexturesSupported) {
-                double log2_w = log10((double)tex_w) / log10(2.0);
-                double log2_h = log10((double)tex_h) / log10(2.0);
+            // pending quads belong to the current target
+            flush_quad_batch();
 
-                if (log2_w != floor(log2_w)) {
-                    tex_w = 1 << (int)ceil(log2_w);
-                }
+            // attach the texture to a framebuffer object
+            GLuint fb_n;
+            glGenFramebuffersEXT(1, &fb_n);
+            glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fb_n);
+            glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, tex_n, 0);
 
-                if (log2_h != floor(log2_h)) {
-                    tex_h = 1 << (int)ceil(log2_h);
-                }
+            bool complete = (glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT);
+            if (complete) {
+                // start out transparent, without the scissor limiting the clear
+                glDisable(GL_SCISSOR_TEST);
+                glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glEnable(GL_SCISSOR_TEST);
             }
 
-            // make sure texture is, at max, MaxTextureSize by MaxTextureSize
-            if (tex_w > g_MaxTextureSize ||
-                tex_h > g_MaxTextureSize)
-            {
+            glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, (g_RenderTarget ? g_RenderTarget->framebuffer : 0));
+
+            if (!complete) {
+                glDeleteFramebuffersEXT(1, &fb_n);
+                delete_texture(tex_n);
                 return 0;
             }
 
-            RGBA* tex_p = 0;
+            Texture* t = new Texture;
+            t->textureName = tex_n;
+            t->textureSize = Dim2i(tex_w, tex_h);
+            t->textureRect = Recti(0, 0, width - 1, height - 1);
+            t->size        = Dim2i(width, height);
+            t->premultiplied = true; // blended like a premultiplied canvas
+            t->atlasPage   = 0;
+            t->framebuffer = fb_n;
+            t->stream      = 0;
+            t->lastDrawn   = -1;
 
-            if (pixels) {
-                tex_p = (RGBA*)pixels;
+            add_texture_memory(get_texture_bytes(t->textureSize));
+            enforce_texture_memory_budget();
 
-                if (tex_w != width || tex_h != height) {
-                    // allocate a new pixel buffer
-                    tex_p = new RGBA[tex_w * tex_h];
+            return t;
+        }
 
-                    // copy the pixels into the new buffer
-                    for (int i = 0; i < height; i++) {
-                        memcpy(tex_p + i * tex_w, pixels + i * width, width * sizeof(RGBA));
-                    }
-                }
+        //-----------------------------------------------------------------
+        bool SetRenderTarget(ITexture* target)
+        {
+            if (g_SoftwareDriver) {
+                return soft::SetRenderTarget(target);
             }
 
-            // create texture name
-            GLuint tex_n;
-            glGenTextures(1, &tex_n);
+            Texture* t = (Texture*)target;
+            if (t && !t->framebuffer) {
+                return false;
+            }
+            bind_render_target(t);
+            return true;
+        }
 
-            // bind texture
-            glBindTexture(GL_TEXTURE_2D, tex_n);
+        //-----------------------------------------------------------------
+        ITexture* GetRenderTarget()
+        {
+            if (g_SoftwareDriver) {
+                return soft::GetRenderTarget();
+            }
 
-            // set up wrap parameters
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+            return g_RenderTarget.get();
+        }
 
-            // set up filter parameters
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        //-----------------------------------------------------------------
+        ITexture* CreateStreamingTexture(int width, int height)
+        {
+            if (g_SoftwareDriver) {
+                return soft::CreateStreamingTexture(width, height);
+            }
 
-            // define pixels
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex_w, tex_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex_p);
+            assert(width  > 0);
+            assert(height > 0);
 
-            // unbind texture
-            glBindTexture(GL_TEXTURE_2D, 0);
+            int tex_w;
+            int tex_h;
+            if (!get_texture_size(width, height, tex_w, tex_h)) {
+                return 0;
+            }
 
-            // if we allocated a buffer, delete it
-            if (tex_p && tex_p != pixels) {
-                delete[] tex_p;
+            TextureStream* stream = new TextureStream;
+            stream->canvas = Canvas::Create(width, height);
+            stream->canvas->fill(RGBA(0, 0, 0, 0));
+            stream->canvas->clearDirtyRects();
+            stream->nextBuffer = 0;
+            stream->locked     = false;
+            if (g_PixelBuffersSupported) {
+                glGenBuffersARB(STREAMING_TEXTURE_BUFFERS, stream->buffers);
             }
 
+            GLuint tex_n = create_gl_texture(width, height, tex_w, tex_h, stream->canvas->getPixels(), stream->canvas->getStride());
+
             Texture* t = new Texture;
             t->textureName = tex_n;
             t->textureSize = Dim2i(tex_w, tex_h);
+            t->textureRect = Recti(0, 0, width - 1, height - 1);
             t->size        = Dim2i(width, height);
+            t->premultiplied = false;
+            t->atlasPage   = 0;
+            t->framebuffer = 0;
+            t->stream      = stream;
+            t->lastDrawn   = -1;
+
+            add_texture_memory(get_texture_bytes(t->textureSize));
+            enforce_texture_memory_budget();
 
             return t;
         }
 
         //-----------------------------------------------------------------
-        bool UpdateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* rect)
+        Canvas* LockStreamingTexture(ITexture* texture)
         {
+            if (g_SoftwareDriver) {
+                return soft::LockStreamingTexture(texture);
+            }
+
             assert(texture);
-            assert(newPixels);
 
             Texture* t = (Texture*)texture;
+            if (!t->stream || t->stream->locked) {
+                return 0;
+            }
+            t->stream->locked = true;
+            return t->stream->canvas.get();
+        }
 
-            int x = 0;
-            int y = 0;
-            int w = newPixels->getWidth();
-            int h = newPixels->getHeight();
-
-            if (rect) {
-                if (!rect->isValid() || !rect->isInside(0, 0, t->getSize().width - 1, t->getSize().height - 1)) {
-                    return false;
-                }
-
-                x = rect->ul.x;
-                y = rect->ul.y;
-                w = rect->getWidth();
-                h = rect->getHeight();
+        //-----------------------------------------------------------------
+        bool UnlockStreamingTexture(ITexture* texture)
+        {
+            if (g_SoftwareDriver) {
+                return soft::UnlockStreamingTexture(texture);
             }
 
-            if (w != newPixels->getWidth() ||
-                h != newPixels->getHeight())
-            {
+            assert(texture);
+
+            Texture* t = (Texture*)texture;
+            if (!t->stream || !t->stream->locked) {
                 return false;
             }
+            TextureStream* stream = t->stream;
+            stream->locked = false;
 
-            // bind texture
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-
-            // update texture pixels
-            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, newPixels->getPixels());
+            Canvas* canvas = stream->canvas.get();
 
-            // unbind texture
-            glBindTexture(GL_TEXTURE_2D, 0);
+            // draw pending quads with the old pixels
+            if (t->textureName == g_QuadBatchTexture) {
+                flush_quad_batch();
+            }
+            t->premultiplied = canvas->isPremultiplied();
+
+            bind_texture(t->textureName);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, canvas->getStride());
+
+            if (g_PixelBuffersSupported) {
+                int size = canvas->getPitch() * canvas->getHeight();
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, stream->buffers[stream->nextBuffer]);
+                stream->nextBuffer = (stream->nextBuffer + 1) % STREAMING_TEXTURE_BUFFERS;
+
+                // orphan the old contents, the GPU may still be reading them
+                glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, size, 0, GL_STREAM_DRAW_ARB);
+                void* buffer = glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+                if (buffer) {
+                    memcpy(buffer, canvas->getPixels(), size);
+                    glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+
+                    // the pixels are taken from the buffer, returns right away
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, t->size.width, t->size.height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+                    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+                    return true;
+                }
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+            }
 
+            // without pixel buffer objects the upload is synchronous
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, t->size.width, t->size.height, GL_RGBA, GL_UNSIGNED_BYTE, canvas->getPixels());
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
             return true;
         }
 
         //-----------------------------------------------------------------
-        Canvas* GrabTexturePixels(ITexture* texture)
+        int GetTextureMemoryBudget()
         {
-            assert(texture);
-
-            Texture* t = (Texture*)texture;
-
-            // create canvas
-            CanvasPtr canvas = Canvas::Create(t->textureSize.width, t->textureSize.height);
+            if (g_SoftwareDriver) {
+                return soft::GetTextureMemoryBudget();
+            }
 
-            // bind texture
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
+            return g_TextureMemoryBudget;
+        }
 
-            // copy texture pixels into canvas
-            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, canvas->getPixels());
+        //-----------------------------------------------------------------
+        void SetTextureMemoryBudget(int budget)
+        {
+            if (g_SoftwareDriver) {
+                soft::SetTextureMemoryBudget(budget);
+                return;
+            }
 
-            // unbind texture
-            glBindTexture(GL_TEXTURE_2D, 0);
+            g_TextureMemoryBudget = budget;
+            enforce_texture_memory_budget();
+        }
 
-            // resize canvas to the real image dimensions
-            canvas->resize(t->size.width, t->size.height);
+        //-----------------------------------------------------------------
+        const TextureMemoryStats& GetTextureMemoryStats()
+        {
+            if (g_SoftwareDriver) {
+                return soft::GetTextureMemoryStats();
+            }
 
-            return canvas.release();
+            return g_TextureMemory;
         }
 
         //-----------------------------------------------------------------
         bool CaptureFrame(const Recti& rect)
         {
-            Recti frame_rect(0, 0, g_WindowSize.width, g_WindowSize.height);
+            if (g_SoftwareDriver) {
+                return soft::CaptureFrame(rect);
+            }
+
+            const Dim2i& size = get_target_size();
+            Recti frame_rect(0, 0, size.width, size.height);
             if (!rect.isValid() || !frame_rect.contains(rect)) {
                 return false;
             }
 
             int x = rect.getX();
-            int y = g_WindowSize.height - (rect.getY() + rect.getHeight());
+            int y = size.height - (rect.getY() + rect.getHeight());
             int w = rect.getWidth();
             int h = rect.getHeight();
 
+            flush_quad_batch();
+
             // if not yet created, create the capture texture
             if (g_Capture == 0) {
                 // create texture name
                 glGenTextures(1, &g_Capture);
 
                 // bind texture
-                glBindTexture(GL_TEXTURE_2D, g_Capture);
+                bind_texture(g_Capture);
 
                 // set up wrap parameters
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
@@ -874,32 +2297,14 @@ namespace sphere {
 
             // ensure the capture texture is big enough
             if (w > g_CaptureWidth || h > g_CaptureHeight) {
-                int tex_w = w;
-                int tex_h = h;
-
-                // if NPOT textures are not supported, calculate a good texture size
-                if (!g_NPOTTexturesSupported) {
-                    double log2_w = log10((double)tex_w) / log10(2.0);
-                    double log2_h = log10((double)tex_h) / log10(2.0);
-
-                    if (log2_w != floor(log2_w)) {
-                        tex_w = 1 << (int)ceil(log2_w);
-                    }
-
-                    if (log2_h != floor(log2_h)) {
-                        tex_h = 1 << (int)ceil(log2_h);
-                    }
-                }
-
-                // make sure texture is, at max, MaxTextureSize by MaxTextureSize
-                if (tex_w > g_MaxTextureSize ||
-                    tex_h > g_MaxTextureSize)
-                {
+                int tex_w;
+                int tex_h;
+                if (!get_texture_size(w, h, tex_w, tex_h)) {
                     return false;
                 }
 
                 // bind texture
-                glBindTexture(GL_TEXTURE_2D, g_Capture);
+                bind_texture(g_Capture);
 
                 // allocate new texture buffer
                 glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex_w, tex_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
@@ -909,7 +2314,7 @@ namespace sphere {
             }
 
             // bind the capture texture
-            glBindTexture(GL_TEXTURE_2D, g_Capture);
+            bind_texture(g_Capture);
 
             // copy pixels from frame buffer into the capture texture
             glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, w, h);
@@ -920,6 +2325,13 @@ namespace sphere {
         //-----------------------------------------------------------------
         void DrawCaptureQuad(const Recti& rect, Vec2i pos[4], const RGBA& mask)
         {
+            if (g_SoftwareDriver) {
+                soft::DrawCaptureQuad(rect, pos, mask);
+                return;
+            }
+
+            set_premultiplied_blending(false);
+
             if (g_Capture == 0 || g_CaptureWidth == 0 || g_CaptureHeight == 0) {
                 return;
             }
@@ -934,42 +2346,46 @@ namespace sphere {
             GLfloat  w = (GLfloat)rect.getWidth()  / (GLfloat)g_CaptureWidth;
             GLfloat  h = (GLfloat)rect.getHeight() / (GLfloat)g_CaptureHeight;
 
-            glBindTexture(GL_TEXTURE_2D, g_Capture);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(x, y+h);
-            glVertex2i(pos[0].x, pos[0].y);
-
-            glTexCoord2f(x+w, y+h);
-            glVertex2i(pos[1].x, pos[1].y);
-
-            glTexCoord2f(x+w, y);
-            glVertex2i(pos[2].x, pos[2].y);
-
-            glTexCoord2f(x, y);
-            glVertex2i(pos[3].x, pos[3].y);
-
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            QuadVertex* v = add_batch_quad(g_Capture);
+            set_quad_vertex(v[0], x, y + h, mask, pos[0].x, pos[0].y);
+            set_quad_vertex(v[1], x + w, y + h, mask, pos[1].x, pos[1].y);
+            set_quad_vertex(v[2], x + w, y, mask, pos[2].x, pos[2].y);
+            set_quad_vertex(v[3], x, y, mask, pos[3].x, pos[3].y);
         }
 
         //-----------------------------------------------------------------
         void DrawPoint(const Vec2i& pos, const RGBA& color)
         {
+            if (g_SoftwareDriver) {
+                soft::DrawPoint(pos, color);
+                return;
+            }
+
+            flush_quad_batch();
+            set_premultiplied_blending(false);
+            enable_texturing(false);
+
             glBegin(GL_POINTS);
 
             glColor4ubv((GLubyte*)&color);
             glVertex2i(pos.x, pos.y);
 
             glEnd();
+            g_VideoStats.drawCalls++;
         }
 
         //-----------------------------------------------------------------
         void DrawLine(Vec2i pos[2], RGBA col[2])
         {
+            if (g_SoftwareDriver) {
+                soft::DrawLine(pos, col);
+                return;
+            }
+
+            flush_quad_batch();
+            set_premultiplied_blending(false);
+            enable_texturing(false);
+
             glBegin(GL_LINES);
 
             glColor4ubv((GLubyte*)&col[0]);
@@ -979,11 +2395,21 @@ namespace sphere {
             glVertex2i(pos[1].x, pos[1].y);
 
             glEnd();
+            g_VideoStats.drawCalls++;
         }
 
         //-----------------------------------------------------------------
         void DrawTriangle(Vec2i pos[3], RGBA col[3])
         {
+            if (g_SoftwareDriver) {
+                soft::DrawTriangle(pos, col);
+                return;
+            }
+
+            flush_quad_batch();
+            set_premultiplied_blending(false);
+            enable_texturing(false);
+
             glBegin(GL_TRIANGLES);
 
             glColor4ubv((GLubyte*)&col[0]);
@@ -996,15 +2422,25 @@ namespace sphere {
             glVertex2i(pos[2].x, pos[2].y);
 
             glEnd();
+            g_VideoStats.drawCalls++;
         }
 
         //-----------------------------------------------------------------
         void DrawRect(const Recti& rect, RGBA col[4])
         {
+            if (g_SoftwareDriver) {
+                soft::DrawRect(rect, col);
+                return;
+            }
+
             if (!rect.isValid()) {
                 return;
             }
 
+            flush_quad_batch();
+            set_premultiplied_blending(false);
+            enable_texturing(false);
+
             glBegin(GL_QUADS);
 
             glColor4ubv((GLubyte*)&col[0]);
@@ -1020,42 +2456,40 @@ namespace sphere {
             glVertex2i(rect.ul.x, rect.lr.y + 1);
 
             glEnd();
+            g_VideoStats.drawCalls++;
         }
 
         //-----------------------------------------------------------------
         void DrawImage(ITexture* image, const Vec2i& pos, const RGBA& mask)
         {
+            if (g_SoftwareDriver) {
+                soft::DrawImage(image, pos, mask);
+                return;
+            }
+
             assert(image);
 
             Texture* t = (Texture*)image;
-            GLfloat  w = (GLfloat)t->size.width  / (GLfloat)t->textureSize.width;
-            GLfloat  h = (GLfloat)t->size.height / (GLfloat)t->textureSize.height;
-
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(0, 0);
-            glVertex2i(pos.x, pos.y);
-
-            glTexCoord2f(w, 0);
-            glVertex2i(pos.x + t->size.width, pos.y);
+            GLfloat  x, y, w, h;
+            get_tex_coords(t, Recti(0, 0, t->size.width - 1, t->size.height - 1), x, y, w, h);
 
-            glTexCoord2f(w, h);
-            glVertex2i(pos.x + t->size.width, pos.y + t->size.height);
+            RGBA m = begin_texture_blending(t, mask);
 
-            glTexCoord2f(0, h);
-            glVertex2i(pos.x, pos.y + t->size.height);
-
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            QuadVertex* v = add_batch_quad(t);
+            set_quad_vertex(v[0], x, y, m, pos.x, pos.y);
+            set_quad_vertex(v[1], x + w, y, m, pos.x + t->size.width, pos.y);
+            set_quad_vertex(v[2], x + w, y + h, m, pos.x + t->size.width, pos.y + t->size.height);
+            set_quad_vertex(v[3], x, y + h, m, pos.x, pos.y + t->size.height);
         }
 
         //-----------------------------------------------------------------
         void DrawSubImage(ITexture* image, const Recti& rect, const Vec2i& pos, const RGBA& mask)
         {
+            if (g_SoftwareDriver) {
+                soft::DrawSubImage(image, rect, pos, mask);
+                return;
+            }
+
             assert(image);
 
             Recti image_rect(0, 0, image->getSize().width-1, image->getSize().height-1);
@@ -1064,68 +2498,50 @@ namespace sphere {
             }
 
             Texture* t = (Texture*)image;
-            GLfloat  x = (GLfloat)rect.getX()      / (GLfloat)t->textureSize.width;
-            GLfloat  y = (GLfloat)rect.getY()      / (GLfloat)t->textureSize.height;
-            GLfloat  w = (GLfloat)rect.getWidth()  / (GLfloat)t->textureSize.width;
-            GLfloat  h = (GLfloat)rect.getHeight() / (GLfloat)t->textureSize.height;
-
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(x, y);
-            glVertex2i(pos.x, pos.y);
-
-            glTexCoord2f(x + w, y);
-            glVertex2i(pos.x + rect.getWidth(), pos.y);
+            GLfloat  x, y, w, h;
+            get_tex_coords(t, rect, x, y, w, h);
 
-            glTexCoord2f(x + w, y + h);
-            glVertex2i(pos.x + rect.getWidth(), pos.y + rect.getHeight());
+            RGBA m = begin_texture_blending(t, mask);
 
-            glTexCoord2f(x, y + h);
-            glVertex2i(pos.x, pos.y + rect.getHeight());
-
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            QuadVertex* v = add_batch_quad(t);
+            set_quad_vertex(v[0], x, y, m, pos.x, pos.y);
+            set_quad_vertex(v[1], x + w, y, m, pos.x + rect.getWidth(), pos.y);
+            set_quad_vertex(v[2], x + w, y + h, m, pos.x + rect.getWidth(), pos.y + rect.getHeight());
+            set_quad_vertex(v[3], x, y + h, m, pos.x, pos.y + rect.getHeight());
         }
 
         //-----------------------------------------------------------------
         void DrawImageQuad(ITexture* texture, Vec2i pos[4], const RGBA& mask)
         {
+            if (g_SoftwareDriver) {
+                soft::DrawImageQuad(texture, pos, mask);
+                return;
+            }
+
             assert(texture);
 
             Texture* t = (Texture*)texture;
-            GLfloat  w = (GLfloat)t->size.width  / (GLfloat)t->textureSize.width;
-            GLfloat  h = (GLfloat)t->size.height / (GLfloat)t->textureSize.height;
-
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(0, 0);
-            glVertex2i(pos[0].x, pos[0].y);
-
-            glTexCoord2f(w, 0);
-            glVertex2i(pos[1].x, pos[1].y);
-
-            glTexCoord2f(w, h);
-            glVertex2i(pos[2].x, pos[2].y);
+            GLfloat  x, y, w, h;
+            get_tex_coords(t, Recti(0, 0, t->size.width - 1, t->size.height - 1), x, y, w, h);
 
-            glTexCoord2f(0, h);
-            glVertex2i(pos[3].x, pos[3].y);
+            RGBA m = begin_texture_blending(t, mask);
 
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            QuadVertex* v = add_batch_quad(t);
+            set_quad_vertex(v[0], x, y, m, pos[0].x, pos[0].y);
+            set_quad_vertex(v[1], x + w, y, m, pos[1].x, pos[1].y);
+            set_quad_vertex(v[2], x + w, y + h, m, pos[2].x, pos[2].y);
+            set_quad_vertex(v[3], x, y + h, m, pos[3].x, pos[3].y);
         }
 
         //-----------------------------------------------------------------
         void DrawSubImageQuad(ITexture* image, const Recti& rect, Vec2i pos[4], const RGBA& mask)
         {
-            assert(texture);
+            if (g_SoftwareDriver) {
+                soft::DrawSubImageQuad(image, rect, pos, mask);
+                return;
+            }
+
+            assert(image);
 
             Recti image_rect(0, 0, image->getSize().width-1, image->getSize().height-1);
             if (!rect.isValid() || !image_rect.contains(rect)) {
@@ -1133,59 +2549,62 @@ namespace sphere {
             }
 
             Texture* t = (Texture*)image;
-            GLfloat  x = (GLfloat)rect.getX()      / (GLfloat)t->textureSize.width;
-            GLfloat  y = (GLfloat)rect.getY()      / (GLfloat)t->textureSize.height;
-            GLfloat  w = (GLfloat)rect.getWidth()  / (GLfloat)t->textureSize.width;
-            GLfloat  h = (GLfloat)rect.getHeight() / (GLfloat)t->textureSize.height;
-
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(x, y);
-            glVertex2i(pos[0].x, pos[0].y);
-
-            glTexCoord2f(x + w, y);
-            glVertex2i(pos[1].x, pos[1].y);
-
-            glTexCoord2f(x + w, y + h);
-            glVertex2i(pos[2].x, pos[2].y);
+            GLfloat  x, y, w, h;
+            get_tex_coords(t, rect, x, y, w, h);
 
-            glTexCoord2f(x, y + h);
-            glVertex2i(pos[3].x, pos[3].y);
+            RGBA m = begin_texture_blending(t, mask);
 
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            QuadVertex* v = add_batch_quad(t);
+            set_quad_vertex(v[0], x, y, m, pos[0].x, pos[0].y);
+            set_quad_vertex(v[1], x + w, y, m, pos[1].x, pos[1].y);
+            set_quad_vertex(v[2], x + w, y + h, m, pos[2].x, pos[2].y);
+            set_quad_vertex(v[3], x, y + h, m, pos[3].x, pos[3].y);
         }
 
         //-----------------------------------------------------------------
         void DrawTexturedTriangle(ITexture* texture, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask)
         {
+            if (g_SoftwareDriver) {
+                soft::DrawTexturedTriangle(texture, texcoord, pos, mask);
+                return;
+            }
+
             assert(texture);
 
             Texture* t  = (Texture*)texture;
+            GLfloat  tx = (GLfloat)t->textureRect.ul.x;
             GLfloat  tw = (GLfloat)t->textureSize.width;
-            GLfloat  th = (GLfloat)t->textureSize.height;
 
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
+            RGBA m = begin_texture_blending(t, mask);
 
-            glBegin(GL_TRIANGLES);
-            glColor4ubv((GLubyte*)&mask);
+            // batched as a quad with the last vertex doubled
+            QuadVertex* v = add_batch_quad(t);
+            set_quad_vertex(v[0], (tx + texcoord[0].x) / tw, get_tex_y(t, texcoord[0].y), m, pos[0].x, pos[0].y);
+            set_quad_vertex(v[1], (tx + texcoord[1].x) / tw, get_tex_y(t, texcoord[1].y), m, pos[1].x, pos[1].y);
+            set_quad_vertex(v[2], (tx + texcoord[2].x) / tw, get_tex_y(t, texcoord[2].y), m, pos[2].x, pos[2].y);
+            v[3] = v[2];
+        }
 
-            glTexCoord2f(texcoord[0].x / tw, texcoord[0].y / th);
-            glVertex2i(pos[0].x, pos[0].y);
+        //-----------------------------------------------------------------
+        const VideoStats& GetVideoStats()
+        {
+            if (g_SoftwareDriver) {
+                return soft::GetVideoStats();
+            }
 
-            glTexCoord2f(texcoord[1].x / tw, texcoord[1].y / th);
-            glVertex2i(pos[1].x, pos[1].y);
+            return g_FrameStats;
+        }
 
-            glTexCoord2f(texcoord[2].x / tw, texcoord[2].y / th);
-            glVertex2i(pos[2].x, pos[2].y);
+        //-----------------------------------------------------------------
+        bool SetFrameExport(const std::string& name, int numSlots)
+        {
+            if (g_SoftwareDriver) {
+                return soft::SetFrameExport(name, numSlots);
+            }
 
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            // the frame is in video memory, reading it back every frame
+            // would stall the pipeline
+            return name.empty();
         }
 
         namespace internal {
@@ -1371,8 +2790,15 @@ namespace sphere {
             }
 
             //-----------------------------------------------------------------
-            bool InitVideo(const Log& log)
+            bool InitVideo(const Log& log, const std::string& driver)
             {
+                if (driver == "software") {
+                    g_SoftwareDriver = true;
+                    return soft::InitVideo(log);
+                } else if (driver != "opengl") {
+                    log.warning() << "Unknown video driver '" << driver << "', using opengl";
+                }
+
                 PIXELFORMATDESCRIPTOR pfd;
                 DEVMODE dm;
 
@@ -1444,7 +2870,7 @@ namespace sphere {
 
                         // write the pixels upside down into the buffer
                         for (int y = icon->getHeight()-1; y >= 0; y--) {
-                            buf->write(icon->getPixels() + y * icon->getWidth(), icon->getPitch());
+                            buf->write(icon->getPixels() + y * icon->getStride(), icon->getWidth() * Canvas::GetNumBytesPerPixel());
                         }
 
                         // create icon
@@ -1567,6 +2993,44 @@ namespace sphere {
                     log.info() << "Subtractive blending not supported";
                 }
 
+                // get pixel buffer object support
+                g_PixelBuffersSupported = false;
+                if (strstr((const char*)glGetString(GL_EXTENSIONS), "GL_ARB_pixel_buffer_object")) {
+                    *((void**)&glGenBuffersARB)    = wglGetProcAddress("glGenBuffersARB");
+                    *((void**)&glDeleteBuffersARB) = wglGetProcAddress("glDeleteBuffersARB");
+                    *((void**)&glBindBufferARB)    = wglGetProcAddress("glBindBufferARB");
+                    *((void**)&glBufferDataARB)    = wglGetProcAddress("glBufferDataARB");
+                    *((void**)&glMapBufferARB)     = wglGetProcAddress("glMapBufferARB");
+                    *((void**)&glUnmapBufferARB)   = wglGetProcAddress("glUnmapBufferARB");
+                    g_PixelBuffersSupported = glGenBuffersARB && glDeleteBuffersARB && glBindBufferARB &&
+                                              glBufferDataARB && glMapBufferARB && glUnmapBufferARB;
+                }
+                if (g_PixelBuffersSupported) {
+                    log.info() << "Pixel buffer objects supported";
+                } else {
+                    log.info() << "Pixel buffer objects not supported";
+                }
+
+                // get framebuffer object support, render targets are
+                // premultiplied and need separate alpha blend factors
+                g_FramebuffersSupported = false;
+                if (strstr((const char*)glGetString(GL_EXTENSIONS), "GL_EXT_framebuffer_object") &&
+                    strstr((const char*)glGetString(GL_EXTENSIONS), "GL_EXT_blend_func_separate")) {
+                    *((void**)&glBlendFuncSeparateEXT)      = wglGetProcAddress("glBlendFuncSeparateEXT");
+                    *((void**)&glGenFramebuffersEXT)        = wglGetProcAddress("glGenFramebuffersEXT");
+                    *((void**)&glDeleteFramebuffersEXT)     = wglGetProcAddress("glDeleteFramebuffersEXT");
+                    *((void**)&glBindFramebufferEXT)        = wglGetProcAddress("glBindFramebufferEXT");
+                    *((void**)&glFramebufferTexture2DEXT)   = wglGetProcAddress("glFramebufferTexture2DEXT");
+                    *((void**)&glCheckFramebufferStatusEXT) = wglGetProcAddress("glCheckFramebufferStatusEXT");
+                    g_FramebuffersSupported = glGenFramebuffersEXT && glDeleteFramebuffersEXT && glBindFramebufferEXT &&
+                                              glFramebufferTexture2DEXT && glCheckFramebufferStatusEXT && glBlendFuncSeparateEXT;
+                }
+                if (g_FramebuffersSupported) {
+                    log.info() << "Render targets supported";
+                } else {
+                    log.info() << "Render targets not supported";
+                }
+
                 // get maximum texture size
                 g_MaxTextureSize = 0;
                 glGetIntegerv(GL_MAX_TEXTURE_SIZE, &g_MaxTextureSize);
@@ -1590,13 +3054,14 @@ namespace sphere {
 
                 // set up clipping
                 glEnable(GL_SCISSOR_TEST);
-                glScissor(0, 0, DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
 
                 // set up blending
                 glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
                 g_BlendMode = BM_ALPHA;
 
+                // set up the scissor, blend function and texture state
+                reset_gl_state();
+
                 // disable depth testing
                 glDisable(GL_DEPTH_TEST);
 
@@ -1635,6 +3100,16 @@ namespace sphere {
             //-----------------------------------------------------------------
             void DeinitVideo()
             {
+                if (g_SoftwareDriver) {
+                    soft::DeinitVideo();
+                    g_SoftwareDriver = false;
+                    return;
+                }
+
+                // pending quads are not drawn anymore
+                g_QuadBatch.clear();
+                g_QuadBatchTexture = 0;
+
                 if (g_Window) {
                     if (g_WindowIsFullScreen) {
                         // restore desktop display mode
@@ -1642,14 +3117,28 @@ namespace sphere {
                     }
 
                     if (g_DeviceContext) {
+                        // delete render target
+                        g_RenderTarget = 0;
+
                         // delete capture
                         if (g_Capture > 0) {
-                            glDeleteTextures(1, &g_Capture);
+                            delete_texture(g_Capture);
                             g_Capture = 0;
                             g_CaptureWidth = 0;
                             g_CaptureHeight = 0;
                         }
 
+                        // delete frame readbacks
+                        for (int i = 0; i < FRAME_READBACK_SLOTS; i++) {
+                            if (g_FrameReadbacks[i].buffer > 0) {
+                                glDeleteBuffersARB(1, &g_FrameReadbacks[i].buffer);
+                            }
+                            g_FrameReadbacks[i].handle     = 0;
+                            g_FrameReadbacks[i].buffer     = 0;
+                            g_FrameReadbacks[i].bufferSize = 0;
+                            g_FrameReadbacks[i].canvas     = 0;
+                        }
+
                         // reset GL context
                         wglMakeCurrent(g_DeviceContext, 0);
 
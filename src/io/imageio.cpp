@@ -1,6 +1,7 @@
 #include <cassert>
 #include <memory>
 #include <corona.h>
+#include "../graphics/blend.hpp"
 #include "imageio.hpp"
 
 
@@ -46,7 +47,7 @@ namespace sphere {
         };
 
         //-----------------------------------------------------------------
-        Canvas* LoadImage(IStream* stream)
+        Canvas* LoadImage(IStream* stream, bool premultiplied)
         {
             assert(stream);
             assert(stream->isReadable());
@@ -55,7 +56,11 @@ namespace sphere {
             if (!img.get()) {
                 return 0;
             }
-            return Canvas::Create(img->getWidth(), img->getHeight(), (const RGBA*)img->getPixels());
+            Canvas* canvas = Canvas::Create(img->getWidth(), img->getHeight(), (const RGBA*)img->getPixels());
+            if (premultiplied) {
+                canvas->premultiply();
+            }
+            return canvas;
         }
 
         //-----------------------------------------------------------------
@@ -67,7 +72,14 @@ namespace sphere {
             if (!img.get()) {
                 return false;
             }
-            memcpy(img->getPixels(), image->getPixels(), image->getNumPixels() * Canvas::GetNumBytesPerPixel());
+            RGBA* dst = (RGBA*)img->getPixels();
+            for (int y = 0; y < image->getHeight(); ++y) {
+                memcpy(dst + y * image->getWidth(), image->getPixels() + y * image->getStride(), image->getWidth() * Canvas::GetNumBytesPerPixel());
+            }
+            if (image->isPremultiplied()) {
+                // image files always store straight alpha
+                UnpremultiplySpan(dst, image->getNumPixels());
+            }
             CoronaFileAdapter cfa(stream);
             return corona::SaveImage(&cfa, corona::FF_PNG, img.get());
         }
@@ -8,7 +8,7 @@
 namespace sphere {
     namespace io {
 
-        Canvas* LoadImage(IStream* stream);
+        Canvas* LoadImage(IStream* stream, bool premultiplied = false);
         bool    SaveImage(Canvas* image, IStream* stream);
 
     } // namespace io
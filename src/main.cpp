@@ -1,3 +1,4 @@
+#include <climits>
 #include <cstdlib>
 #include <vector>
 #include <string>
@@ -7,11 +8,28 @@
 #include "audio/audio.hpp"
 #include "input/input.hpp"
 #include "script/vm.hpp"
+#include "script/profiler.hpp"
 #include "Log.hpp"
 #include "Config.hpp"
 #include "version.hpp"
 
 
+//-----------------------------------------------------------------
+// globals
+static std::string g_ProfilerOutput;
+
+//-----------------------------------------------------------------
+static void write_profiler_output()
+{
+    sphere::script::StopProfiler();
+    if (!g_ProfilerOutput.empty()) {
+        sphere::FilePtr file = sphere::io::filesystem::OpenFile(g_ProfilerOutput, sphere::IFile::FM_OUT);
+        if (file) {
+            sphere::script::WriteProfilerStacks(file.get());
+        }
+    }
+}
+
 //-----------------------------------------------------------------
 int main(int argc, char* argv[])
 {
@@ -30,6 +48,12 @@ int main(int argc, char* argv[])
         } else if (arg == "-main" && i + 1 < argc) {
             config.MainScript = argv[i + 1];
             i++;
+        } else if (arg == "-video" && i + 1 < argc) {
+            config.VideoDriver = argv[i + 1];
+            i++;
+        } else if (arg == "-export" && i + 1 < argc) {
+            config.FrameExport = argv[i + 1];
+            i++;
         } else if (arg == "-arg" && i + 1 < argc) {
             config.GameArgs.push_back(argv[i + 1]);
             i++;
@@ -60,11 +84,21 @@ int main(int argc, char* argv[])
 
     // initialize video
     log.info() << "Initializing video";
-    if (!sphere::video::internal::InitVideo(log)) {
+    if (!sphere::video::internal::InitVideo(log, config.VideoDriver)) {
         log.error() << "Could not initialize video";
         return 0;
     }
     atexit(sphere::video::internal::DeinitVideo);
+    int budget = config.TextureMemoryBudget;
+    if (budget > INT_MAX / (1024 * 1024)) {
+        // the budget is set in bytes, which must fit in an int
+        log.warning() << "Texture memory budget of " << budget << " MB is too large, using " << INT_MAX / (1024 * 1024) << " MB";
+        budget = INT_MAX / (1024 * 1024);
+    }
+    sphere::video::SetTextureMemoryBudget(budget * 1024 * 1024);
+    if (!config.FrameExport.empty() && !sphere::video::SetFrameExport(config.FrameExport, config.FrameExportSlots)) {
+        log.warning() << "Could not export frames to '" << config.FrameExport << "'";
+    }
 
     // initialize audio
     log.info() << "Initializing audio";
@@ -84,11 +118,28 @@ int main(int argc, char* argv[])
 
     // initialize vm
     log.info() << "Initializing script VM";
+    if (!config.Profiler.empty() || config.ProfileNatives) {
+        // natives are registered through the profiler
+        sphere::script::internal::EnableNativeProfiling();
+    }
     if (!sphere::script::internal::InitVM(log)) {
         log.error() << "Could not initialize script VM";
         return 0;
     }
     atexit(sphere::script::internal::DeinitVM);
+    sphere::script::SetScriptCache(config.ScriptCachePath, config.ScriptCacheSize * 1024 * 1024);
+
+    // start profiler, it is stopped before the vm is closed
+    if (!config.Profiler.empty()) {
+        int mode = (config.Profiler == "calls" ? sphere::script::PROFILER_CALLS : sphere::script::PROFILER_SAMPLING);
+        if (sphere::script::StartProfiler(mode, config.ProfilerInterval)) {
+            log.info() << "Profiling scripts (" << config.Profiler << "), writing to '" << config.ProfilerOutput << "'";
+            g_ProfilerOutput = config.ProfilerOutput;
+            atexit(write_profiler_output);
+        } else {
+            log.warning() << "Could not start profiler";
+        }
+    }
 
     // run game
     log.info() << "Running game";
@@ -96,8 +147,7 @@ int main(int argc, char* argv[])
     // load main script
     if (sphere::io::filesystem::FileExists("/data/" + config.MainScript + SCRIPT_FILE_EXT)) {
         std::string filename = "/data/" + config.MainScript + SCRIPT_FILE_EXT;
-        sphere::FilePtr file = sphere::io::filesystem::OpenFile(filename);
-        if (!sphere::script::CompileStream(file.get(), file->getName())) {
+        if (!sphere::script::CompileFile(filename)) {
             log.error() << "Could not compile '" << filename << "': " << sphere::script::GetLastError();
             return 0;
         }
@@ -10,6 +10,11 @@
 namespace sphere {
     namespace script {
 
+        //-----------------------------------------------------------------
+        // globals
+        static HSQOBJECT g_SoundClass;
+        static HSQOBJECT g_SoundEffectClass;
+
         namespace internal {
 
             static SQInteger _sound_destructor(SQUserPointer p, SQInteger size);
@@ -22,26 +27,11 @@ namespace sphere {
         {
             assert(sound);
 
-            // get sound class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "Sound", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_SOUND) {
-                sq_poptop(v);
+            // create instance
+            if (!util::CreateInstance(v, g_SoundClass)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop sound class
-            sq_remove(v, -2);
-
             // set up instance
             sq_setreleasehook(v, -1, internal::_sound_destructor);
             sq_setinstanceup(v, -1, (SQUserPointer)sound);
@@ -67,26 +57,11 @@ namespace sphere {
         {
             assert(soundeffect);
 
-            // get soundeffect class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "SoundEffect", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_SOUNDEFFECT) {
-                sq_poptop(v);
+            // create instance
+            if (!util::CreateInstance(v, g_SoundEffectClass)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop soundeffect class
-            sq_remove(v, -2);
-
             // set up instance
             sq_setreleasehook(v, -1, internal::_soundeffect_destructor);
             sq_setinstanceup(v, -1, (SQUserPointer)soundeffect);
@@ -438,6 +413,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep sound class for binding objects
+                util::KeepClass(v, -1, g_SoundClass);
+
                 // register sound class in root table
                 sq_pushroottable(v);
                 sq_pushstring(v, "Sound", -1);
@@ -465,6 +443,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep soundeffect class for binding objects
+                util::KeepClass(v, -1, g_SoundEffectClass);
+
 
                 // register soundeffect class in root table
                 sq_pushroottable(v);
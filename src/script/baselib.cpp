@@ -1,6 +1,7 @@
 #include <cassert>
 #include "../io/numio.hpp"
 #include "macros.hpp"
+#include "binding.hpp"
 #include "util.hpp"
 #include "iolib.hpp"
 #include "vm.hpp"
@@ -10,6 +11,12 @@
 namespace sphere {
     namespace script {
 
+        //-----------------------------------------------------------------
+        // globals
+        static HSQOBJECT g_RectClass;
+        static HSQOBJECT g_Vec2Class;
+        static HSQOBJECT g_BlobClass;
+
         namespace internal {
 
             static SQInteger _blob_destructor(SQUserPointer p, SQInteger size);
@@ -19,26 +26,11 @@ namespace sphere {
         //-----------------------------------------------------------------
         bool BindRect(HSQUIRRELVM v, const Recti& rect)
         {
-            // get rect class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "Rect", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_RECT) {
-                sq_poptop(v);
+            // create instance
+            if (!util::CreateInstance(v, g_RectClass)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop rect class
-            sq_remove(v, -2);
-
             // set up instance
             SQUserPointer p = 0;
             sq_getinstanceup(v, -1, &p, 0);
@@ -61,26 +53,11 @@ namespace sphere {
         //-----------------------------------------------------------------
         bool BindVec2(HSQUIRRELVM v, const Vec2f& vec)
         {
-            // get vec2 class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "Vec2", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_VEC2) {
-                sq_poptop(v);
+            // create instance
+            if (!util::CreateInstance(v, g_Vec2Class)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop vec2 class
-            sq_remove(v, -2);
-
             // set up instance
             SQUserPointer p = 0;
             sq_getinstanceup(v, -1, &p, 0);
@@ -105,26 +82,11 @@ namespace sphere {
         {
             assert(blob);
 
-            // get blob class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "Blob", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_BLOB) {
-                sq_poptop(v);
+            // create instance
+            if (!util::CreateInstance(v, g_BlobClass)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop blob class
-            sq_remove(v, -2);
-
             // set up instance
             sq_setreleasehook(v, -1, internal::_blob_destructor);
             sq_setinstanceup(v, -1, (SQUserPointer)blob);
@@ -549,32 +511,23 @@ namespace sphere {
 
             //-----------------------------------------------------------------
             // Vec2._add(rhs)
-            static SQInteger _vec2__add(HSQUIRRELVM v)
+            Vec2f _vec2__add(Vec2f& This, const Vec2f& rhs)
             {
-                SETUP_VEC2_OBJECT()
-                CHECK_NARGS(1)
-                GET_ARG_VEC2(1, rhs)
-                RET_VEC2(*This + *rhs)
+                return This + rhs;
             }
 
             //-----------------------------------------------------------------
             // Vec2._sub(rhs)
-            static SQInteger _vec2__sub(HSQUIRRELVM v)
+            Vec2f _vec2__sub(Vec2f& This, const Vec2f& rhs)
             {
-                SETUP_VEC2_OBJECT()
-                CHECK_NARGS(1)
-                GET_ARG_VEC2(1, rhs)
-                RET_VEC2(*This - *rhs)
+                return This - rhs;
             }
 
             //-----------------------------------------------------------------
             // Vec2._mul(scalar)
-            static SQInteger _vec2__mul(HSQUIRRELVM v)
+            Vec2f _vec2__mul(Vec2f& This, float scalar)
             {
-                SETUP_VEC2_OBJECT()
-                CHECK_NARGS(1)
-                GET_ARG_FLOAT(1, scalar)
-                RET_VEC2(*This * scalar)
+                return This * scalar;
             }
 
             //-----------------------------------------------------------------
@@ -719,9 +672,9 @@ namespace sphere {
                 {"add",             "Vec2.add",             _vec2_add             },
                 {"subtract",        "Vec2.subtract",        _vec2_subtract        },
                 {"multiply",        "Vec2.multiply",        _vec2_multiply        },
-                {"_add",            "Vec2._add",            _vec2__add            },
-                {"_sub",            "Vec2._sub",            _vec2__sub            },
-                {"_mul",            "Vec2._mul",            _vec2__mul            },
+                {"_add",            "Vec2._add",            NATIVE_METHOD(_vec2__add) },
+                {"_sub",            "Vec2._sub",            NATIVE_METHOD(_vec2__sub) },
+                {"_mul",            "Vec2._mul",            NATIVE_METHOD(_vec2__mul) },
                 {"_get",            "Vec2._get",            _vec2__get            },
                 {"_set",            "Vec2._set",            _vec2__set            },
                 {"_typeof",         "Vec2._typeof",         _vec2__typeof         },
@@ -1187,6 +1140,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep rect class for binding objects
+                util::KeepClass(v, -1, g_RectClass);
+
                 // register rect class in root table
                 sq_pushroottable(v);
                 sq_pushstring(v, "Rect", -1);
@@ -1215,6 +1171,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep vec2 class for binding objects
+                util::KeepClass(v, -1, g_Vec2Class);
+
                 // register vec2 class in root table
                 sq_pushroottable(v);
                 sq_pushstring(v, "Vec2", -1);
@@ -1254,6 +1213,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep blob class for binding objects
+                util::KeepClass(v, -1, g_BlobClass);
+
                 // register blob class in root table
                 sq_pushroottable(v);
                 sq_pushstring(v, "Blob", -1);
@@ -0,0 +1,596 @@
+#ifndef SPHERE_SCRIPT_BINDING_HPP
+#define SPHERE_SCRIPT_BINDING_HPP
+
+#include <squirrel.h>
+#include "vm.hpp"
+#include "baselib.hpp"
+#include "graphicslib.hpp"
+
+// Generates a SQFUNCTION from a C++ function, which reads the arguments
+// with their typed getter, calls the function and pushes its result. A
+// method takes the instance it is called on as first parameter.
+//
+// The bound function must have external linkage (C++03 does not accept
+// static functions as template arguments). Optional parameters must come
+// last.
+#define NATIVE_FUNCTION(f)  sphere::script::binding::GetSignature(f).function<f>()
+#define NATIVE_METHOD(f)    sphere::script::binding::GetSignature(f).method<f>()
+
+
+namespace sphere {
+    namespace script {
+        namespace binding {
+
+            // trailing argument the script may leave out
+            template<typename T>
+            struct Optional {
+                bool given;
+                T    value;
+
+                Optional() : given(false), value() {
+                }
+
+                const T& get(const T& defval) const {
+                    return given ? value : defval;
+                }
+            };
+
+            template<typename T> struct Plain           { typedef T Type; };
+            template<typename T> struct Plain<T&>       { typedef T Type; };
+            template<typename T> struct Plain<const T&> { typedef T Type; };
+
+            // Reads one argument, there is a specialization per supported
+            // parameter type.
+            template<typename T>
+            class Arg;
+
+            template<>
+            class Arg<int> {
+            public:
+                enum { Required = 1 };
+
+                static const char* TypeName() {
+                    return "an integer";
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    SQInteger value;
+                    if (SQ_FAILED(sq_getinteger(v, idx, &value))) {
+                        return false;
+                    }
+                    _value = (int)value;
+                    return true;
+                }
+
+                int& value() {
+                    return _value;
+                }
+
+            private:
+                int _value;
+            };
+
+            template<>
+            class Arg<float> {
+            public:
+                enum { Required = 1 };
+
+                static const char* TypeName() {
+                    return "a float";
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    SQFloat value;
+                    if (SQ_FAILED(sq_getfloat(v, idx, &value))) {
+                        return false;
+                    }
+                    _value = (float)value;
+                    return true;
+                }
+
+                float& value() {
+                    return _value;
+                }
+
+            private:
+                float _value;
+            };
+
+            template<>
+            class Arg<bool> {
+            public:
+                enum { Required = 1 };
+
+                static const char* TypeName() {
+                    return "a bool";
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    SQBool value;
+                    if (SQ_FAILED(sq_getbool(v, idx, &value))) {
+                        return false;
+                    }
+                    _value = value == SQTrue;
+                    return true;
+                }
+
+                bool& value() {
+                    return _value;
+                }
+
+            private:
+                bool _value;
+            };
+
+            template<>
+            class Arg<const char*> {
+            public:
+                enum { Required = 1 };
+
+                static const char* TypeName() {
+                    return "a string";
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    const SQChar* value;
+                    if (SQ_FAILED(sq_getstring(v, idx, &value))) {
+                        return false;
+                    }
+                    _value = value;
+                    return true;
+                }
+
+                const char*& value() {
+                    return _value;
+                }
+
+            private:
+                const char* _value;
+            };
+
+            template<>
+            class Arg<Recti> {
+            public:
+                enum { Required = 1 };
+
+                static const char* TypeName() {
+                    return "a Rect instance";
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    _value = GetRect(v, idx);
+                    return _value != 0;
+                }
+
+                Recti& value() {
+                    return *_value;
+                }
+
+            private:
+                Recti* _value;
+            };
+
+            template<>
+            class Arg<Vec2f> {
+            public:
+                enum { Required = 1 };
+
+                static const char* TypeName() {
+                    return "a Vec2 instance";
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    _value = GetVec2(v, idx);
+                    return _value != 0;
+                }
+
+                Vec2f& value() {
+                    return *_value;
+                }
+
+            private:
+                Vec2f* _value;
+            };
+
+            template<>
+            class Arg<Blob*> {
+            public:
+                enum { Required = 1 };
+
+                static const char* TypeName() {
+                    return "a Blob instance";
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    _value = GetBlob(v, idx);
+                    return _value != 0;
+                }
+
+                Blob*& value() {
+                    return _value;
+                }
+
+            private:
+                Blob* _value;
+            };
+
+            template<>
+            class Arg<Canvas*> {
+            public:
+                enum { Required = 1 };
+
+                static const char* TypeName() {
+                    return "a Canvas instance";
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    _value = GetCanvas(v, idx);
+                    return _value != 0;
+                }
+
+                Canvas*& value() {
+                    return _value;
+                }
+
+            private:
+                Canvas* _value;
+            };
+
+            template<>
+            class Arg<ITexture*> {
+            public:
+                enum { Required = 1 };
+
+                static const char* TypeName() {
+                    return "a Texture instance";
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    _value = GetTexture(v, idx);
+                    return _value != 0;
+                }
+
+                ITexture*& value() {
+                    return _value;
+                }
+
+            private:
+                ITexture* _value;
+            };
+
+            template<typename T>
+            class Arg<Optional<T> > {
+            public:
+                enum { Required = 0 };
+
+                static const char* TypeName() {
+                    return Arg<T>::TypeName();
+                }
+
+                bool get(HSQUIRRELVM v, SQInteger idx) {
+                    if (!_arg.get(v, idx)) {
+                        return false;
+                    }
+                    _value.given = true;
+                    _value.value = _arg.value();
+                    return true;
+                }
+
+                Optional<T>& value() {
+                    return _value;
+                }
+
+            private:
+                Arg<T>      _arg;
+                Optional<T> _value;
+            };
+
+            // Pushes a result, there is an overload per supported return type.
+            inline SQInteger Push(HSQUIRRELVM v, int value)          { sq_pushinteger(v, value); return 1; }
+            inline SQInteger Push(HSQUIRRELVM v, float value)        { sq_pushfloat(v, value); return 1; }
+            inline SQInteger Push(HSQUIRRELVM v, bool value)         { sq_pushbool(v, value); return 1; }
+            inline SQInteger Push(HSQUIRRELVM v, const char* value)  { sq_pushstring(v, value, -1); return 1; }
+            inline SQInteger Push(HSQUIRRELVM v, const Recti& value) { BindRect(v, value); return 1; }
+            inline SQInteger Push(HSQUIRRELVM v, const Vec2f& value) { BindVec2(v, value); return 1; }
+
+            // Checks the number of arguments for a function whose first
+            // parameter is read from stack index first.
+            inline bool CheckNargs(SQInteger top, SQInteger first, int required, int count)
+            {
+                int nargs = (int)top - 1;
+                int skip  = 2 - (int)first; // the instance of a method is no argument
+                if (nargs >= required - skip && nargs <= count - skip) {
+                    return true;
+                }
+                if (required == count) {
+                    ThrowError("Invalid number of arguments (%d), expected %d", nargs, count - skip);
+                } else if (nargs < required - skip) {
+                    ThrowError("Invalid number of arguments (%d), expected at least %d", nargs, required - skip);
+                } else {
+                    ThrowError("Invalid number of arguments (%d), expected at most %d", nargs, count - skip);
+                }
+                return false;
+            }
+
+            // Optional arguments the script left out are not read.
+            template<typename T>
+            inline bool GetArg(HSQUIRRELVM v, SQInteger top, SQInteger idx, Arg<T>& arg)
+            {
+                if ((!Arg<T>::Required && idx > top) || arg.get(v, idx)) {
+                    return true;
+                }
+                if (idx == 1) {
+                    ThrowError("Invalid type of environment object, expected %s", Arg<T>::TypeName());
+                } else {
+                    ThrowError("Invalid argument %d, expected %s", (int)idx - 1, Arg<T>::TypeName());
+                }
+                return false;
+            }
+
+            // Calls the function and pushes its result.
+            template<typename R>
+            struct Invoke {
+                static SQInteger Call(HSQUIRRELVM v, R (*f)()) {
+                    return Push(v, f());
+                }
+
+                template<typename A1>
+                static SQInteger Call(HSQUIRRELVM v, R (*f)(A1), Arg<typename Plain<A1>::Type>& a1) {
+                    return Push(v, f(a1.value()));
+                }
+
+                template<typename A1, typename A2>
+                static SQInteger Call(HSQUIRRELVM v, R (*f)(A1, A2), Arg<typename Plain<A1>::Type>& a1, Arg<typename Plain<A2>::Type>& a2) {
+                    return Push(v, f(a1.value(), a2.value()));
+                }
+
+                template<typename A1, typename A2, typename A3>
+                static SQInteger Call(HSQUIRRELVM v, R (*f)(A1, A2, A3), Arg<typename Plain<A1>::Type>& a1, Arg<typename Plain<A2>::Type>& a2, Arg<typename Plain<A3>::Type>& a3) {
+                    return Push(v, f(a1.value(), a2.value(), a3.value()));
+                }
+
+                template<typename A1, typename A2, typename A3, typename A4>
+                static SQInteger Call(HSQUIRRELVM v, R (*f)(A1, A2, A3, A4), Arg<typename Plain<A1>::Type>& a1, Arg<typename Plain<A2>::Type>& a2, Arg<typename Plain<A3>::Type>& a3, Arg<typename Plain<A4>::Type>& a4) {
+                    return Push(v, f(a1.value(), a2.value(), a3.value(), a4.value()));
+                }
+
+                template<typename A1, typename A2, typename A3, typename A4, typename A5>
+                static SQInteger Call(HSQUIRRELVM v, R (*f)(A1, A2, A3, A4, A5), Arg<typename Plain<A1>::Type>& a1, Arg<typename Plain<A2>::Type>& a2, Arg<typename Plain<A3>::Type>& a3, Arg<typename Plain<A4>::Type>& a4, Arg<typename Plain<A5>::Type>& a5) {
+                    return Push(v, f(a1.value(), a2.value(), a3.value(), a4.value(), a5.value()));
+                }
+            };
+
+            template<>
+            struct Invoke<void> {
+                static SQInteger Call(HSQUIRRELVM, void (*f)()) {
+                    f();
+                    return 0;
+                }
+
+                template<typename A1>
+                static SQInteger Call(HSQUIRRELVM, void (*f)(A1), Arg<typename Plain<A1>::Type>& a1) {
+                    f(a1.value());
+                    return 0;
+                }
+
+                template<typename A1, typename A2>
+                static SQInteger Call(HSQUIRRELVM, void (*f)(A1, A2), Arg<typename Plain<A1>::Type>& a1, Arg<typename Plain<A2>::Type>& a2) {
+                    f(a1.value(), a2.value());
+                    return 0;
+                }
+
+                template<typename A1, typename A2, typename A3>
+                static SQInteger Call(HSQUIRRELVM, void (*f)(A1, A2, A3), Arg<typename Plain<A1>::Type>& a1, Arg<typename Plain<A2>::Type>& a2, Arg<typename Plain<A3>::Type>& a3) {
+                    f(a1.value(), a2.value(), a3.value());
+                    return 0;
+                }
+
+                template<typename A1, typename A2, typename A3, typename A4>
+                static SQInteger Call(HSQUIRRELVM, void (*f)(A1, A2, A3, A4), Arg<typename Plain<A1>::Type>& a1, Arg<typename Plain<A2>::Type>& a2, Arg<typename Plain<A3>::Type>& a3, Arg<typename Plain<A4>::Type>& a4) {
+                    f(a1.value(), a2.value(), a3.value(), a4.value());
+                    return 0;
+                }
+
+                template<typename A1, typename A2, typename A3, typename A4, typename A5>
+                static SQInteger Call(HSQUIRRELVM, void (*f)(A1, A2, A3, A4, A5), Arg<typename Plain<A1>::Type>& a1, Arg<typename Plain<A2>::Type>& a2, Arg<typename Plain<A3>::Type>& a3, Arg<typename Plain<A4>::Type>& a4, Arg<typename Plain<A5>::Type>& a5) {
+                    f(a1.value(), a2.value(), a3.value(), a4.value(), a5.value());
+                    return 0;
+                }
+            };
+
+            // GetSignature deduces the parameter types of a function, the
+            // function itself is then passed as template argument so the
+            // generated SQFUNCTION calls it directly.
+            template<typename R>
+            struct Signature0 {
+                template<R (*F)(), SQInteger First>
+                static SQInteger Call(HSQUIRRELVM v) {
+                    SQInteger top = sq_gettop(v);
+                    if (!CheckNargs(top, First, 0, 0)) {
+                        return SQ_ERROR;
+                    }
+                    return Invoke<R>::Call(v, F);
+                }
+
+                template<R (*F)()>
+                SQFUNCTION function() const {
+                    return &Call<F, 2>;
+                }
+            };
+
+            template<typename R>
+            inline Signature0<R> GetSignature(R (*)()) {
+                return Signature0<R>();
+            }
+
+            template<typename R, typename A1>
+            struct Signature1 {
+                template<R (*F)(A1), SQInteger First>
+                static SQInteger Call(HSQUIRRELVM v) {
+                    SQInteger top = sq_gettop(v);
+                    Arg<typename Plain<A1>::Type> a1;
+                    if (!CheckNargs(top, First, Arg<typename Plain<A1>::Type>::Required, 1) ||
+                        !GetArg(v, top, First, a1)) {
+                        return SQ_ERROR;
+                    }
+                    return Invoke<R>::Call(v, F, a1);
+                }
+
+                template<R (*F)(A1)>
+                SQFUNCTION function() const {
+                    return &Call<F, 2>;
+                }
+
+                template<R (*F)(A1)>
+                SQFUNCTION method() const {
+                    return &Call<F, 1>;
+                }
+            };
+
+            template<typename R, typename A1>
+            inline Signature1<R, A1> GetSignature(R (*)(A1)) {
+                return Signature1<R, A1>();
+            }
+
+            template<typename R, typename A1, typename A2>
+            struct Signature2 {
+                template<R (*F)(A1, A2), SQInteger First>
+                static SQInteger Call(HSQUIRRELVM v) {
+                    SQInteger top = sq_gettop(v);
+                    Arg<typename Plain<A1>::Type> a1;
+                    Arg<typename Plain<A2>::Type> a2;
+                    if (!CheckNargs(top, First, Arg<typename Plain<A1>::Type>::Required + Arg<typename Plain<A2>::Type>::Required, 2) ||
+                        !GetArg(v, top, First, a1) ||
+                        !GetArg(v, top, First + 1, a2)) {
+                        return SQ_ERROR;
+                    }
+                    return Invoke<R>::Call(v, F, a1, a2);
+                }
+
+                template<R (*F)(A1, A2)>
+                SQFUNCTION function() const {
+                    return &Call<F, 2>;
+                }
+
+                template<R (*F)(A1, A2)>
+                SQFUNCTION method() const {
+                    return &Call<F, 1>;
+                }
+            };
+
+            template<typename R, typename A1, typename A2>
+            inline Signature2<R, A1, A2> GetSignature(R (*)(A1, A2)) {
+                return Signature2<R, A1, A2>();
+            }
+
+            template<typename R, typename A1, typename A2, typename A3>
+            struct Signature3 {
+                template<R (*F)(A1, A2, A3), SQInteger First>
+                static SQInteger Call(HSQUIRRELVM v) {
+                    SQInteger top = sq_gettop(v);
+                    Arg<typename Plain<A1>::Type> a1;
+                    Arg<typename Plain<A2>::Type> a2;
+                    Arg<typename Plain<A3>::Type> a3;
+                    if (!CheckNargs(top, First, Arg<typename Plain<A1>::Type>::Required + Arg<typename Plain<A2>::Type>::Required + Arg<typename Plain<A3>::Type>::Required, 3) ||
+                        !GetArg(v, top, First, a1) ||
+                        !GetArg(v, top, First + 1, a2) ||
+                        !GetArg(v, top, First + 2, a3)) {
+                        return SQ_ERROR;
+                    }
+                    return Invoke<R>::Call(v, F, a1, a2, a3);
+                }
+
+                template<R (*F)(A1, A2, A3)>
+                SQFUNCTION function() const {
+                    return &Call<F, 2>;
+                }
+
+                template<R (*F)(A1, A2, A3)>
+                SQFUNCTION method() const {
+                    return &Call<F, 1>;
+                }
+            };
+
+            template<typename R, typename A1, typename A2, typename A3>
+            inline Signature3<R, A1, A2, A3> GetSignature(R (*)(A1, A2, A3)) {
+                return Signature3<R, A1, A2, A3>();
+            }
+
+            template<typename R, typename A1, typename A2, typename A3, typename A4>
+            struct Signature4 {
+                template<R (*F)(A1, A2, A3, A4), SQInteger First>
+                static SQInteger Call(HSQUIRRELVM v) {
+                    SQInteger top = sq_gettop(v);
+                    Arg<typename Plain<A1>::Type> a1;
+                    Arg<typename Plain<A2>::Type> a2;
+                    Arg<typename Plain<A3>::Type> a3;
+                    Arg<typename Plain<A4>::Type> a4;
+                    if (!CheckNargs(top, First, Arg<typename Plain<A1>::Type>::Required + Arg<typename Plain<A2>::Type>::Required + Arg<typename Plain<A3>::Type>::Required + Arg<typename Plain<A4>::Type>::Required, 4) ||
+                        !GetArg(v, top, First, a1) ||
+                        !GetArg(v, top, First + 1, a2) ||
+                        !GetArg(v, top, First + 2, a3) ||
+                        !GetArg(v, top, First + 3, a4)) {
+                        return SQ_ERROR;
+                    }
+                    return Invoke<R>::Call(v, F, a1, a2, a3, a4);
+                }
+
+                template<R (*F)(A1, A2, A3, A4)>
+                SQFUNCTION function() const {
+                    return &Call<F, 2>;
+                }
+
+                template<R (*F)(A1, A2, A3, A4)>
+                SQFUNCTION method() const {
+                    return &Call<F, 1>;
+                }
+            };
+
+            template<typename R, typename A1, typename A2, typename A3, typename A4>
+            inline Signature4<R, A1, A2, A3, A4> GetSignature(R (*)(A1, A2, A3, A4)) {
+                return Signature4<R, A1, A2, A3, A4>();
+            }
+
+            template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5>
+            struct Signature5 {
+                template<R (*F)(A1, A2, A3, A4, A5), SQInteger First>
+                static SQInteger Call(HSQUIRRELVM v) {
+                    SQInteger top = sq_gettop(v);
+                    Arg<typename Plain<A1>::Type> a1;
+                    Arg<typename Plain<A2>::Type> a2;
+                    Arg<typename Plain<A3>::Type> a3;
+                    Arg<typename Plain<A4>::Type> a4;
+                    Arg<typename Plain<A5>::Type> a5;
+                    if (!CheckNargs(top, First, Arg<typename Plain<A1>::Type>::Required + Arg<typename Plain<A2>::Type>::Required + Arg<typename Plain<A3>::Type>::Required + Arg<typename Plain<A4>::Type>::Required + Arg<typename Plain<A5>::Type>::Required, 5) ||
+                        !GetArg(v, top, First, a1) ||
+                        !GetArg(v, top, First + 1, a2) ||
+                        !GetArg(v, top, First + 2, a3) ||
+                        !GetArg(v, top, First + 3, a4) ||
+                        !GetArg(v, top, First + 4, a5)) {
+                        return SQ_ERROR;
+                    }
+                    return Invoke<R>::Call(v, F, a1, a2, a3, a4, a5);
+                }
+
+                template<R (*F)(A1, A2, A3, A4, A5)>
+                SQFUNCTION function() const {
+                    return &Call<F, 2>;
+                }
+
+                template<R (*F)(A1, A2, A3, A4, A5)>
+                SQFUNCTION method() const {
+                    return &Call<F, 1>;
+                }
+            };
+
+            template<typename R, typename A1, typename A2, typename A3, typename A4, typename A5>
+            inline Signature5<R, A1, A2, A3, A4, A5> GetSignature(R (*)(A1, A2, A3, A4, A5)) {
+                return Signature5<R, A1, A2, A3, A4, A5>();
+            }
+
+        } // namespace binding
+    } // namespace script
+} // namespace sphere
+
+
+#endif
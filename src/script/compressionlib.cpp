@@ -9,6 +9,10 @@
 namespace sphere {
     namespace script {
 
+        //-----------------------------------------------------------------
+        // globals
+        static HSQOBJECT g_ZStreamClass;
+
         namespace internal {
 
             static SQInteger _zstream_destructor(SQUserPointer p, SQInteger size);
@@ -20,26 +24,11 @@ namespace sphere {
         {
             assert(stream);
 
-            // get zstream class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "ZStream", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_ZSTREAM) {
-                sq_poptop(v);
+            // create instance
+            if (!util::CreateInstance(v, g_ZStreamClass)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop zstream class
-            sq_remove(v, -2);
-
             // set up instance
             sq_setreleasehook(v, -1, internal::_zstream_destructor);
             sq_setinstanceup(v, -1, (SQUserPointer)stream);
@@ -229,6 +218,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep zstream class for binding objects
+                util::KeepClass(v, -1, g_ZStreamClass);
+
                 // register zstream class in root table
                 sq_pushroottable(v);
                 sq_pushstring(v, "ZStream", -1);
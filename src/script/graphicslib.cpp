@@ -1,7 +1,9 @@
 #include <cassert>
+#include <cmath>
 #include "../io/numio.hpp"
 #include "../io/imageio.hpp"
 #include "macros.hpp"
+#include "binding.hpp"
 #include "util.hpp"
 #include "vm.hpp"
 #include "baselib.hpp"
@@ -12,6 +14,11 @@
 namespace sphere {
     namespace script {
 
+        //-----------------------------------------------------------------
+        // globals
+        static HSQOBJECT g_CanvasClass;
+        static HSQOBJECT g_TextureClass;
+
         namespace internal {
 
             static SQInteger _canvas_destructor(SQUserPointer p, SQInteger size);
@@ -24,26 +31,11 @@ namespace sphere {
         {
             assert(canvas);
 
-            // get canvas class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "Canvas", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_CANVAS) {
-                sq_poptop(v); // pop whatever we got
+            // create instance
+            if (!util::CreateInstance(v, g_CanvasClass)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop canvas class
-            sq_remove(v, -2);
-
             // set up instance
             sq_setreleasehook(v, -1, internal::_canvas_destructor);
             sq_setinstanceup(v, -1, (SQUserPointer)canvas);
@@ -69,26 +61,11 @@ namespace sphere {
         {
             assert(texture);
 
-            // get texture class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "Texture", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_TEXTURE) {
-                sq_poptop(v); // pop whatever we got
+            // create instance
+            if (!util::CreateInstance(v, g_TextureClass)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop texture class
-            sq_remove(v, -2);
-
             // set up instance
             sq_setreleasehook(v, -1, internal::_texture_destructor);
             sq_setinstanceup(v, -1, (SQUserPointer)texture);
@@ -117,6 +94,31 @@ namespace sphere {
                     THROW_ERROR("Invalid type of environment object, expected a Canvas instance") \
                 }
 
+            //-----------------------------------------------------------------
+            // canvas rows may be padded, so pixels are read and written row by row
+            static bool read_pixels(IStream* stream, Canvas* canvas)
+            {
+                int row_size = canvas->getWidth() * Canvas::GetNumBytesPerPixel();
+                for (int y = 0; y < canvas->getHeight(); ++y) {
+                    if (stream->read(canvas->getPixels() + y * canvas->getStride(), row_size) != row_size) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            //-----------------------------------------------------------------
+            static bool write_pixels(IStream* stream, const Canvas* canvas)
+            {
+                int row_size = canvas->getWidth() * Canvas::GetNumBytesPerPixel();
+                for (int y = 0; y < canvas->getHeight(); ++y) {
+                    if (stream->write(canvas->getPixels() + y * canvas->getStride(), row_size) != row_size) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
             //-----------------------------------------------------------------
             static SQInteger _canvas_destructor(SQUserPointer p, SQInteger size)
             {
@@ -148,13 +150,14 @@ namespace sphere {
             }
 
             //-----------------------------------------------------------------
-            // Canvas.FromBuffer(width, height, pixels)
+            // Canvas.FromBuffer(width, height, pixels [, premultiply = false])
             static SQInteger _canvas_FromBuffer(HSQUIRRELVM v)
             {
-                CHECK_NARGS(3)
+                CHECK_MIN_NARGS(3)
                 GET_ARG_INT(1, width)
                 GET_ARG_INT(2, height)
                 GET_ARG_BLOB(3, pixels)
+                GET_OPTARG_BOOL(4, premultiply, SQFalse)
                 if (width <= 0) {
                     THROW_ERROR1("Invalid width: %d", width)
                 }
@@ -165,22 +168,25 @@ namespace sphere {
                 if (pixels->getSize() != expected_size) {
                     THROW_ERROR2("Invalid buffer size: %d, expected: %d", pixels->getSize(), expected_size)
                 }
-                CanvasPtr image = Canvas::Create(width, height);
-                memcpy(image->getPixels(), pixels->getBuffer(), pixels->getSize());
+                CanvasPtr image = Canvas::Create(width, height, (const RGBA*)pixels->getBuffer());
+                if (premultiply == SQTrue) {
+                    image->premultiply();
+                }
                 RET_CANVAS(image.get())
             }
 
             //-----------------------------------------------------------------
-            // Canvas.FromFile(filename)
+            // Canvas.FromFile(filename [, premultiply = false])
             static SQInteger _canvas_FromFile(HSQUIRRELVM v)
             {
-                CHECK_NARGS(1)
+                CHECK_MIN_NARGS(1)
                 GET_ARG_STRING(1, filename)
+                GET_OPTARG_BOOL(2, premultiply, SQFalse)
                 FilePtr file = io::filesystem::OpenFile(filename);
                 if (!file) {
                     THROW_ERROR("Could not open file")
                 }
-                CanvasPtr image = io::LoadImage(file.get());
+                CanvasPtr image = io::LoadImage(file.get(), premultiply == SQTrue);
                 if (!image) {
                     THROW_ERROR("Could not load image")
                 }
@@ -188,15 +194,16 @@ namespace sphere {
             }
 
             //-----------------------------------------------------------------
-            // Canvas.FromStream(stream)
+            // Canvas.FromStream(stream [, premultiply = false])
             static SQInteger _canvas_FromStream(HSQUIRRELVM v)
             {
-                CHECK_NARGS(1)
+                CHECK_MIN_NARGS(1)
                 GET_ARG_STREAM(1, stream)
+                GET_OPTARG_BOOL(2, premultiply, SQFalse)
                 if (!stream->isOpen() || !stream->isReadable()) {
                     THROW_ERROR("Invalid stream")
                 }
-                CanvasPtr image = io::LoadImage(stream);
+                CanvasPtr image = io::LoadImage(stream, premultiply == SQTrue);
                 if (!image) {
                     THROW_ERROR("Could not load image")
                 }
@@ -242,10 +249,105 @@ namespace sphere {
             {
                 SETUP_CANVAS_OBJECT()
                 BlobPtr pixels = Blob::Create(This->getNumPixels() * Canvas::GetNumBytesPerPixel());
-                memcpy(pixels->getBuffer(), This->getPixels(), pixels->getSize());
+                int row_size = This->getWidth() * Canvas::GetNumBytesPerPixel();
+                for (int y = 0; y < This->getHeight(); ++y) {
+                    memcpy((u8*)pixels->getBuffer() + y * row_size, This->getPixels() + y * This->getStride(), row_size);
+                }
                 RET_BLOB(pixels.get())
             }
 
+            //-----------------------------------------------------------------
+            // Canvas.isPremultiplied()
+            static SQInteger _canvas_isPremultiplied(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                RET_BOOL(This->isPremultiplied())
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.premultiply()
+            static SQInteger _canvas_premultiply(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                if (!This->premultiply()) {
+                    THROW_ERROR("Cannot change the alpha format of pixels shared with a view")
+                }
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.unpremultiply()
+            static SQInteger _canvas_unpremultiply(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                if (!This->unpremultiply()) {
+                    THROW_ERROR("Cannot change the alpha format of pixels shared with a view")
+                }
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.isParallel()
+            static SQInteger _canvas_isParallel(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                RET_BOOL(This->isParallel())
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.setParallel(parallel)
+            static SQInteger _canvas_setParallel(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                CHECK_NARGS(1)
+                GET_ARG_BOOL(1, parallel)
+                This->setParallel(parallel);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.getAntialias()
+            static SQInteger _canvas_getAntialias(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                RET_BOOL(This->getAntialias())
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.setAntialias(antialias)
+            static SQInteger _canvas_setAntialias(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                CHECK_NARGS(1)
+                GET_ARG_BOOL(1, antialias)
+                This->setAntialias(antialias);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.getDirtyRects()
+            static SQInteger _canvas_getDirtyRects(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                const std::vector<Recti>& dirtyRects = This->getDirtyRects();
+                sq_newarray(v, dirtyRects.size());
+                for (int i = 0; i < (int)dirtyRects.size(); ++i) {
+                    sq_pushinteger(v, i);
+                    BindRect(v, dirtyRects[i]);
+                    sq_rawset(v, -3);
+                }
+                return 1;
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.clearDirtyRects()
+            static SQInteger _canvas_clearDirtyRects(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                This->clearDirtyRects();
+                RET_VOID()
+            }
+
             //-----------------------------------------------------------------
             // Canvas.cloneSection(section)
             static SQInteger _canvas_cloneSection(HSQUIRRELVM v)
@@ -260,6 +362,20 @@ namespace sphere {
                 RET_CANVAS(canvas.get())
             }
 
+            //-----------------------------------------------------------------
+            // Canvas.createView(section)
+            static SQInteger _canvas_createView(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                CHECK_NARGS(1)
+                GET_ARG_RECT(1, section)
+                CanvasPtr canvas = This->createView(*section);
+                if (!canvas) {
+                    THROW_ERROR("Could not create view")
+                }
+                RET_CANVAS(canvas.get())
+            }
+
             //-----------------------------------------------------------------
             // Canvas.getPixel(x, y)
             static SQInteger _canvas_getPixel(HSQUIRRELVM v)
@@ -412,6 +528,24 @@ namespace sphere {
                 RET_VOID()
             }
 
+            //-----------------------------------------------------------------
+            // Canvas.rotate180()
+            static SQInteger _canvas_rotate180(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                This->rotate180();
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.transpose()
+            static SQInteger _canvas_transpose(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                This->transpose();
+                RET_VOID()
+            }
+
             //-----------------------------------------------------------------
             // Canvas.getScissor()
             static SQInteger _canvas_getScissor(HSQUIRRELVM v)
@@ -535,6 +669,35 @@ namespace sphere {
                 RET_VOID()
             }
 
+            //-----------------------------------------------------------------
+            // Canvas.drawTriangle(x1, y1, x2, y2, x3, y3, col1 [, col2, col3])
+            static SQInteger _canvas_drawTriangle(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                CHECK_MIN_NARGS(7)
+                GET_ARG_INT(1, x1)
+                GET_ARG_INT(2, y1)
+                GET_ARG_INT(3, x2)
+                GET_ARG_INT(4, y2)
+                GET_ARG_INT(5, x3)
+                GET_ARG_INT(6, y3)
+                GET_ARG_INT(7, col1)
+                GET_OPTARG_INT(8, col2, col1)
+                GET_OPTARG_INT(9, col3, col1)
+                Vec2i positions[3] = {
+                    Vec2i(x1, y1),
+                    Vec2i(x2, y2),
+                    Vec2i(x3, y3),
+                };
+                RGBA colors[3] = {
+                    RGBA::Unpack((u32)col1),
+                    RGBA::Unpack((u32)col2),
+                    RGBA::Unpack((u32)col3),
+                };
+                This->drawTriangle(positions, colors);
+                RET_VOID()
+            }
+
             //-----------------------------------------------------------------
             // Canvas.drawImage(image, x, y)
             static SQInteger _canvas_drawImage(HSQUIRRELVM v)
@@ -565,6 +728,112 @@ namespace sphere {
                 RET_VOID()
             }
 
+            //-----------------------------------------------------------------
+            // Canvas.drawImageQuad(image, x1, y1, x2, y2, x3, y3, x4, y4 [, filter = FILTER_NEAREST])
+            static SQInteger _canvas_drawImageQuad(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                CHECK_MIN_NARGS(9)
+                GET_ARG_CANVAS(1, image)
+                GET_ARG_FLOAT(2, x1)
+                GET_ARG_FLOAT(3, y1)
+                GET_ARG_FLOAT(4, x2)
+                GET_ARG_FLOAT(5, y2)
+                GET_ARG_FLOAT(6, x3)
+                GET_ARG_FLOAT(7, y3)
+                GET_ARG_FLOAT(8, x4)
+                GET_ARG_FLOAT(9, y4)
+                GET_OPTARG_INT(10, filter, Canvas::FILTER_NEAREST)
+                if (filter != Canvas::FILTER_NEAREST && filter != Canvas::FILTER_BILINEAR) {
+                    THROW_ERROR("Invalid filter")
+                }
+                // an affine transformation only maps the image onto a
+                // parallelogram, other quads are drawn as two textured
+                // triangles (1, 2, 3) and (1, 3, 4) without filtering
+                if (fabs((x1 + x3) - (x2 + x4)) > 0.5f || fabs((y1 + y3) - (y2 + y4)) > 0.5f) {
+                    int w = image->getWidth();
+                    int h = image->getHeight();
+                    Vec2i corners[4] = {
+                        Vec2i((int)floor(x1 + 0.5f), (int)floor(y1 + 0.5f)),
+                        Vec2i((int)floor(x2 + 0.5f), (int)floor(y2 + 0.5f)),
+                        Vec2i((int)floor(x3 + 0.5f), (int)floor(y3 + 0.5f)),
+                        Vec2i((int)floor(x4 + 0.5f), (int)floor(y4 + 0.5f)),
+                    };
+                    Vec2i texcoords1[3] = {Vec2i(0, 0), Vec2i(w, 0), Vec2i(w, h)};
+                    Vec2i positions1[3] = {corners[0], corners[1], corners[2]};
+                    Vec2i texcoords2[3] = {Vec2i(0, 0), Vec2i(w, h), Vec2i(0, h)};
+                    Vec2i positions2[3] = {corners[0], corners[2], corners[3]};
+                    This->drawTexturedTriangle(image, texcoords1, positions1);
+                    This->drawTexturedTriangle(image, texcoords2, positions2);
+                    RET_VOID()
+                }
+                f32 w = (f32)image->getWidth();
+                f32 h = (f32)image->getHeight();
+                f32 m[6] = {
+                    (f32)(x2 - x1) / w, (f32)(x4 - x1) / h, (f32)x1,
+                    (f32)(y2 - y1) / w, (f32)(y4 - y1) / h, (f32)y1,
+                };
+                This->drawImageTransformed(image, Recti(0, 0, image->getWidth() - 1, image->getHeight() - 1), m, filter);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.drawImageScaled(image, x, y, width, height [, filter = FILTER_NEAREST])
+            static SQInteger _canvas_drawImageScaled(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                CHECK_MIN_NARGS(5)
+                GET_ARG_CANVAS(1, image)
+                GET_ARG_FLOAT(2, x)
+                GET_ARG_FLOAT(3, y)
+                GET_ARG_FLOAT(4, width)
+                GET_ARG_FLOAT(5, height)
+                GET_OPTARG_INT(6, filter, Canvas::FILTER_NEAREST)
+                if (filter != Canvas::FILTER_NEAREST && filter != Canvas::FILTER_BILINEAR) {
+                    THROW_ERROR("Invalid filter")
+                }
+                f32 m[6] = {
+                    (f32)width / image->getWidth(), 0, (f32)x,
+                    0, (f32)height / image->getHeight(), (f32)y,
+                };
+                This->drawImageTransformed(image, Recti(0, 0, image->getWidth() - 1, image->getHeight() - 1), m, filter);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // Canvas.drawTexturedTriangle(image, tx1, ty1, tx2, ty2, tx3, ty3, x1, y1, x2, y2, x3, y3 [, mask = CreateColor(255, 255, 255)])
+            static SQInteger _canvas_drawTexturedTriangle(HSQUIRRELVM v)
+            {
+                SETUP_CANVAS_OBJECT()
+                CHECK_MIN_NARGS(13)
+                GET_ARG_CANVAS(1, image)
+                GET_ARG_INT(2, tx1)
+                GET_ARG_INT(3, ty1)
+                GET_ARG_INT(4, tx2)
+                GET_ARG_INT(5, ty2)
+                GET_ARG_INT(6, tx3)
+                GET_ARG_INT(7, ty3)
+                GET_ARG_INT(8, x1)
+                GET_ARG_INT(9, y1)
+                GET_ARG_INT(10, x2)
+                GET_ARG_INT(11, y2)
+                GET_ARG_INT(12, x3)
+                GET_ARG_INT(13, y3)
+                GET_OPTARG_INT(14, mask, RGBA::Pack(255, 255, 255))
+                Vec2i texcoords[3] = {
+                    Vec2i(tx1, ty1),
+                    Vec2i(tx2, ty2),
+                    Vec2i(tx3, ty3),
+                };
+                Vec2i positions[3] = {
+                    Vec2i(x1, y1),
+                    Vec2i(x2, y2),
+                    Vec2i(x3, y3),
+                };
+                This->drawTexturedTriangle(image, texcoords, positions, RGBA::Unpack((u32)mask));
+                RET_VOID()
+            }
+
             //-----------------------------------------------------------------
             // Canvas._get(index)
             static SQInteger _canvas__get(HSQUIRRELVM v)
@@ -657,7 +926,7 @@ namespace sphere {
                 SETUP_CANVAS_OBJECT()
                 CHECK_NARGS(1)
                 GET_ARG_CANVAS(1, original)
-                This = Canvas::Create(original->getWidth(), original->getHeight(), original->getPixels());
+                This = original->cloneSection(Recti(0, 0, original->getWidth() - 1, original->getHeight() - 1));
                 sq_setinstanceup(v, 1, (SQUserPointer)This);
                 sq_setreleasehook(v, 1, _canvas_destructor);
                 RET_VOID()
@@ -689,9 +958,14 @@ namespace sphere {
                     goto throw_write_error;
                 }
 
-                // write pixels
-                int pixels_size = instance->getNumPixels() * Canvas::GetNumBytesPerPixel();
-                if (stream->write(instance->getPixels(), pixels_size) != pixels_size) {
+                // write pixels (always with straight alpha)
+                if (instance->isPremultiplied()) {
+                    CanvasPtr straight = instance->cloneSection(Recti(0, 0, instance->getWidth() - 1, instance->getHeight() - 1));
+                    straight->unpremultiply();
+                    if (!write_pixels(stream, straight.get())) {
+                        goto throw_write_error;
+                    }
+                } else if (!write_pixels(stream, instance)) {
                     goto throw_write_error;
                 }
 
@@ -727,8 +1001,7 @@ namespace sphere {
                 CanvasPtr instance = Canvas::Create(width, height);
 
                 // read pixels
-                int pixels_size = width * height * Canvas::GetNumBytesPerPixel();
-                if (stream->read(instance->getPixels(), pixels_size) != pixels_size) {
+                if (!read_pixels(stream, instance.get())) {
                     THROW_ERROR("Read error")
                 }
 
@@ -737,38 +1010,54 @@ namespace sphere {
 
             //-----------------------------------------------------------------
             static util::Function _canvas_methods[] = {
-                {"constructor",         "Canvas.constructor",       _canvas_constructor       },
-                {"saveToFile",          "Canvas.saveToFile",        _canvas_saveToFile        },
-                {"saveToStream",        "Canvas.saveToStream",      _canvas_saveToStream      },
-                {"getPixels",           "Canvas.getPixels",         _canvas_getPixels         },
-                {"cloneSection",        "Canvas.cloneSection",      _canvas_cloneSection      },
-                {"getPixel",            "Canvas.getPixel",          _canvas_getPixel          },
-                {"setPixel",            "Canvas.setPixel",          _canvas_setPixel          },
-                {"getPixelByIndex",     "Canvas.getPixelByIndex",   _canvas_getPixelByIndex   },
-                {"setPixelByIndex",     "Canvas.setPixelByIndex",   _canvas_setPixelByIndex   },
-                {"resize",              "Canvas.resize",            _canvas_resize            },
-                {"setAlpha",            "Canvas.setAlpha",          _canvas_setAlpha          },
-                {"replaceColor",        "Canvas.replaceColor",      _canvas_replaceColor      },
-                {"fill",                "Canvas.fill",              _canvas_fill              },
-                {"flipHorizontally",    "Canvas.flipHorizontally",  _canvas_flipHorizontally  },
-                {"flipVertically",      "Canvas.flipVertically",    _canvas_flipVertically    },
-                {"rotateCW",            "Canvas.rotateCW",          _canvas_rotateCW          },
-                {"rotateCCW",           "Canvas.rotateCCW",         _canvas_rotateCCW         },
-                {"getScissor",          "getScissor",               _canvas_getScissor        },
-                {"setScissor",          "setScissor",               _canvas_setScissor        },
-                {"getBlendMode",        "getBlendMode",             _canvas_getBlendMode      },
-                {"setBlendMode",        "setBlendMode",             _canvas_setBlendMode      },
-                {"drawLine",            "Canvas.drawLine",          _canvas_drawLine          },
-                {"drawRect",            "Canvas.drawRect",          _canvas_drawRect          },
-                {"drawCircle",          "Canvas.drawCircle",        _canvas_drawCircle        },
-                {"drawImage",           "Canvas.drawImage",         _canvas_drawImage         },
-                {"drawSubImage",        "Canvas.drawSubImage",      _canvas_drawSubImage      },
-                {"_get",                "Canvas._get",              _canvas__get              },
-                {"_set",                "Canvas._set",              _canvas__set              },
-                {"_typeof",             "Canvas._typeof",           _canvas__typeof           },
-                {"_tostring",           "Canvas._tostring",         _canvas__tostring         },
-                {"_nexti",              "Canvas._nexti",            _canvas__nexti            },
-                {"_cloned",             "Canvas._cloned",           _canvas__cloned           },
+                {"constructor",           "Canvas.constructor",           _canvas_constructor          },
+                {"saveToFile",            "Canvas.saveToFile",            _canvas_saveToFile           },
+                {"saveToStream",          "Canvas.saveToStream",          _canvas_saveToStream         },
+                {"getPixels",             "Canvas.getPixels",             _canvas_getPixels            },
+                {"isPremultiplied",       "Canvas.isPremultiplied",       _canvas_isPremultiplied      },
+                {"premultiply",           "Canvas.premultiply",           _canvas_premultiply          },
+                {"unpremultiply",         "Canvas.unpremultiply",         _canvas_unpremultiply        },
+                {"isParallel",            "Canvas.isParallel",            _canvas_isParallel           },
+                {"setParallel",           "Canvas.setParallel",           _canvas_setParallel          },
+                {"getAntialias",          "Canvas.getAntialias",          _canvas_getAntialias         },
+                {"setAntialias",          "Canvas.setAntialias",          _canvas_setAntialias         },
+                {"getDirtyRects",         "Canvas.getDirtyRects",         _canvas_getDirtyRects        },
+                {"clearDirtyRects",       "Canvas.clearDirtyRects",       _canvas_clearDirtyRects      },
+                {"cloneSection",          "Canvas.cloneSection",          _canvas_cloneSection         },
+                {"createView",            "Canvas.createView",            _canvas_createView           },
+                {"getPixel",              "Canvas.getPixel",              _canvas_getPixel             },
+                {"setPixel",              "Canvas.setPixel",              _canvas_setPixel             },
+                {"getPixelByIndex",       "Canvas.getPixelByIndex",       _canvas_getPixelByIndex      },
+                {"setPixelByIndex",       "Canvas.setPixelByIndex",       _canvas_setPixelByIndex      },
+                {"resize",                "Canvas.resize",                _canvas_resize               },
+                {"setAlpha",              "Canvas.setAlpha",              _canvas_setAlpha             },
+                {"replaceColor",          "Canvas.replaceColor",          _canvas_replaceColor         },
+                {"fill",                  "Canvas.fill",                  _canvas_fill                 },
+                {"flipHorizontally",      "Canvas.flipHorizontally",      _canvas_flipHorizontally     },
+                {"flipVertically",        "Canvas.flipVertically",        _canvas_flipVertically       },
+                {"rotateCW",              "Canvas.rotateCW",              _canvas_rotateCW             },
+                {"rotateCCW",             "Canvas.rotateCCW",             _canvas_rotateCCW            },
+                {"rotate180",             "Canvas.rotate180",             _canvas_rotate180            },
+                {"transpose",             "Canvas.transpose",             _canvas_transpose            },
+                {"getScissor",            "getScissor",                   _canvas_getScissor           },
+                {"setScissor",            "setScissor",                   _canvas_setScissor           },
+                {"getBlendMode",          "getBlendMode",                 _canvas_getBlendMode         },
+                {"setBlendMode",          "setBlendMode",                 _canvas_setBlendMode         },
+                {"drawLine",              "Canvas.drawLine",              _canvas_drawLine             },
+                {"drawRect",              "Canvas.drawRect",              _canvas_drawRect             },
+                {"drawCircle",            "Canvas.drawCircle",            _canvas_drawCircle           },
+                {"drawTriangle",          "Canvas.drawTriangle",          _canvas_drawTriangle         },
+                {"drawImage",             "Canvas.drawImage",             _canvas_drawImage            },
+                {"drawSubImage",          "Canvas.drawSubImage",          _canvas_drawSubImage         },
+                {"drawImageQuad",         "Canvas.drawImageQuad",         _canvas_drawImageQuad        },
+                {"drawImageScaled",       "Canvas.drawImageScaled",       _canvas_drawImageScaled      },
+                {"drawTexturedTriangle",  "Canvas.drawTexturedTriangle",  _canvas_drawTexturedTriangle },
+                {"_get",                  "Canvas._get",                  _canvas__get                 },
+                {"_set",                  "Canvas._set",                  _canvas__set                 },
+                {"_typeof",               "Canvas._typeof",               _canvas__typeof              },
+                {"_tostring",             "Canvas._tostring",             _canvas__tostring            },
+                {"_nexti",                "Canvas._nexti",                _canvas__nexti               },
+                {"_cloned",               "Canvas._cloned",               _canvas__cloned              },
                 {0,0}
             };
 
@@ -828,14 +1117,14 @@ namespace sphere {
                 GET_OPTARG_RECT(2, section)
                 TexturePtr texture;
                 if (section) {
-                    CanvasPtr sub_canvas = canvas->cloneSection(*section);
+                    CanvasPtr sub_canvas = canvas->createView(*section);
                     if (!sub_canvas) {
                         // the only possible case
                         THROW_ERROR("Invalid section")
                     }
-                    texture = video::CreateTexture(sub_canvas->getWidth(), sub_canvas->getHeight(), sub_canvas->getPixels());
+                    texture = video::CreateTexture(sub_canvas->getWidth(), sub_canvas->getHeight(), sub_canvas->getPixels(), sub_canvas->isPremultiplied(), sub_canvas->getStride());
                 } else {
-                    texture = video::CreateTexture(canvas->getWidth(), canvas->getHeight(), canvas->getPixels());
+                    texture = video::CreateTexture(canvas->getWidth(), canvas->getHeight(), canvas->getPixels(), canvas->isPremultiplied(), canvas->getStride());
                 }
                 if (!texture) {
                     THROW_ERROR("Could not create texture")
@@ -844,20 +1133,21 @@ namespace sphere {
             }
 
             //-----------------------------------------------------------------
-            // Texture.FromFile(filename)
+            // Texture.FromFile(filename [, premultiply = false])
             static SQInteger _texture_FromFile(HSQUIRRELVM v)
             {
-                CHECK_NARGS(1)
+                CHECK_MIN_NARGS(1)
                 GET_ARG_STRING(1, filename)
+                GET_OPTARG_BOOL(2, premultiply, SQFalse)
                 FilePtr file = io::filesystem::OpenFile(filename);
                 if (!file) {
                     THROW_ERROR("Could not open file")
                 }
-                CanvasPtr image = io::LoadImage(file.get());
+                CanvasPtr image = io::LoadImage(file.get(), premultiply == SQTrue);
                 if (!image) {
                     THROW_ERROR("Could not load image")
                 }
-                TexturePtr texture = video::CreateTexture(image->getWidth(), image->getHeight(), image->getPixels());
+                TexturePtr texture = video::CreateTexture(image->getWidth(), image->getHeight(), image->getPixels(), image->isPremultiplied(), image->getStride());
                 if (!texture) {
                     THROW_ERROR("Could not create texture")
                 }
@@ -865,16 +1155,17 @@ namespace sphere {
             }
 
             //-----------------------------------------------------------------
-            // Texture.FromStream(stream)
+            // Texture.FromStream(stream [, premultiply = false])
             static SQInteger _texture_FromStream(HSQUIRRELVM v)
             {
-                CHECK_NARGS(1)
+                CHECK_MIN_NARGS(1)
                 GET_ARG_STREAM(1, stream)
-                CanvasPtr image = io::LoadImage(stream);
+                GET_OPTARG_BOOL(2, premultiply, SQFalse)
+                CanvasPtr image = io::LoadImage(stream, premultiply == SQTrue);
                 if (!image) {
                     THROW_ERROR("Could not load image")
                 }
-                TexturePtr texture = video::CreateTexture(image->getWidth(), image->getHeight(), image->getPixels());
+                TexturePtr texture = video::CreateTexture(image->getWidth(), image->getHeight(), image->getPixels(), image->isPremultiplied(), image->getStride());
                 if (!texture) {
                     THROW_ERROR("Could not create texture")
                 }
@@ -895,6 +1186,19 @@ namespace sphere {
                 RET_VOID()
             }
 
+            //-----------------------------------------------------------------
+            // Texture.updateDirtyPixels(canvas)
+            static SQInteger _texture_updateDirtyPixels(HSQUIRRELVM v)
+            {
+                SETUP_TEXTURE_OBJECT()
+                CHECK_NARGS(1)
+                GET_ARG_CANVAS(1, canvas)
+                if (!video::UpdateTextureDirtyPixels(This, canvas)) {
+                    THROW_ERROR("Could not update pixels")
+                }
+                RET_VOID()
+            }
+
             //-----------------------------------------------------------------
             // Texture.createCanvas()
             static SQInteger _texture_createCanvas(HSQUIRRELVM v)
@@ -904,6 +1208,37 @@ namespace sphere {
                 RET_CANVAS(canvas.get())
             }
 
+            //-----------------------------------------------------------------
+            // Texture.isPremultiplied()
+            static SQInteger _texture_isPremultiplied(HSQUIRRELVM v)
+            {
+                SETUP_TEXTURE_OBJECT()
+                RET_BOOL(This->isPremultiplied())
+            }
+
+            //-----------------------------------------------------------------
+            // Texture.lock()
+            static SQInteger _texture_lock(HSQUIRRELVM v)
+            {
+                SETUP_TEXTURE_OBJECT()
+                Canvas* canvas = video::LockStreamingTexture(This);
+                if (!canvas) {
+                    THROW_ERROR("Texture is not streaming or already locked")
+                }
+                RET_CANVAS(canvas)
+            }
+
+            //-----------------------------------------------------------------
+            // Texture.unlock()
+            static SQInteger _texture_unlock(HSQUIRRELVM v)
+            {
+                SETUP_TEXTURE_OBJECT()
+                if (!video::UnlockStreamingTexture(This)) {
+                    THROW_ERROR("Texture is not locked")
+                }
+                RET_VOID()
+            }
+
             //-----------------------------------------------------------------
             // Texture._get(index)
             static SQInteger _texture__get(HSQUIRRELVM v)
@@ -938,7 +1273,7 @@ namespace sphere {
                 CHECK_NARGS(1)
                 GET_ARG_TEXTURE(1, original)
                 CanvasPtr canvas = video::GrabTexturePixels(original);
-                This = video::CreateTexture(canvas->getWidth(), canvas->getHeight(), canvas->getPixels());
+                This = video::CreateTexture(canvas->getWidth(), canvas->getHeight(), canvas->getPixels(), canvas->isPremultiplied(), canvas->getStride());
                 if (!This) {
                     THROW_ERROR("Could not create texture")
                 }
@@ -972,8 +1307,9 @@ namespace sphere {
                     THROW_ERROR("Invalid output stream")
                 }
 
-                // convert texture to canvas
+                // convert texture to canvas (always with straight alpha)
                 CanvasPtr canvas = video::GrabTexturePixels(instance);
+                canvas->unpremultiply();
 
                 // write class name
                 const char* class_name = "Texture";
@@ -990,8 +1326,7 @@ namespace sphere {
                 }
 
                 // write pixels
-                int pixels_size = canvas->getNumPixels() * Canvas::GetNumBytesPerPixel();
-                if (stream->write(canvas->getPixels(), pixels_size) != pixels_size) {
+                if (!write_pixels(stream, canvas.get())) {
                     goto throw_write_error;
                 }
 
@@ -1028,26 +1363,29 @@ namespace sphere {
                 CanvasPtr canvas = Canvas::Create(width, height);
 
                 // read pixels
-                int pixels_size = canvas->getNumPixels() * Canvas::GetNumBytesPerPixel();
-                if (stream->read(canvas->getPixels(), pixels_size) != pixels_size) {
+                if (!read_pixels(stream, canvas.get())) {
                     THROW_ERROR("Read error")
                 }
 
                 // create texture
-                TexturePtr instance = video::CreateTexture(canvas->getWidth(), canvas->getHeight(), canvas->getPixels());
+                TexturePtr instance = video::CreateTexture(canvas->getWidth(), canvas->getHeight(), canvas->getPixels(), false, canvas->getStride());
 
                 RET_TEXTURE(instance.get())
             }
 
             //-----------------------------------------------------------------
             static util::Function _texture_methods[] = {
-                {"constructor",     "Texture.constructor",  _texture_constructor  },
-                {"updatePixels",    "Texture.updatePixels", _texture_updatePixels },
-                {"createCanvas",    "Texture.createCanvas", _texture_createCanvas },
-                {"_get",            "Texture._get",         _texture__get         },
-                {"_typeof",         "Texture._typeof",      _texture__typeof      },
-                {"_cloned",         "Texture._cloned",      _texture__cloned      },
-                {"_tostring",       "Texture._tostring",    _texture__tostring    },
+                {"constructor",        "Texture.constructor",        _texture_constructor       },
+                {"updatePixels",       "Texture.updatePixels",       _texture_updatePixels      },
+                {"updateDirtyPixels",  "Texture.updateDirtyPixels",  _texture_updateDirtyPixels },
+                {"createCanvas",       "Texture.createCanvas",       _texture_createCanvas      },
+                {"isPremultiplied",    "Texture.isPremultiplied",    _texture_isPremultiplied   },
+                {"lock",               "Texture.lock",               _texture_lock              },
+                {"unlock",             "Texture.unlock",             _texture_unlock            },
+                {"_get",               "Texture._get",               _texture__get              },
+                {"_typeof",            "Texture._typeof",            _texture__typeof           },
+                {"_cloned",            "Texture._cloned",            _texture__cloned           },
+                {"_tostring",          "Texture._tostring",          _texture__tostring         },
                 {0,0}
             };
 
@@ -1061,43 +1399,413 @@ namespace sphere {
                 {0,0}
             };
 
+            #define SETUP_DRAWLIST_OBJECT() \
+                DrawList* This = 0; \
+                if (SQ_FAILED(sq_getinstanceup(v, 1, (SQUserPointer*)&This, TT_DRAWLIST))) { \
+                    THROW_ERROR("Invalid type of environment object, expected a DrawList instance") \
+                }
+
             //-----------------------------------------------------------------
-            // CreateColor(red, green, blue [, alpha = 255])
-            static SQInteger _graphics_CreateColor(HSQUIRRELVM v)
+            static SQInteger _drawlist_destructor(SQUserPointer p, SQInteger size)
             {
-                CHECK_MIN_NARGS(3)
-                GET_ARG_INT(1, red)
-                GET_ARG_INT(2, green)
-                GET_ARG_INT(3, blue)
-                GET_OPTARG_INT(4, alpha, 255)
-                RET_INT(RGBA::Pack(red, green, blue, alpha))
+                assert(p);
+                ((DrawList*)p)->drop();
+                return 0;
             }
 
             //-----------------------------------------------------------------
-            // UnpackRed(color)
-            static SQInteger _graphics_UnpackRed(HSQUIRRELVM v)
+            // DrawList()
+            static SQInteger _drawlist_constructor(HSQUIRRELVM v)
             {
-                CHECK_NARGS(1)
-                GET_ARG_INT(1, color)
-                RET_INT(RGBA::Unpack((u32)color).red)
+                SETUP_DRAWLIST_OBJECT()
+                This = DrawList::Create();
+                sq_setinstanceup(v, 1, (SQUserPointer)This);
+                sq_setreleasehook(v, 1, _drawlist_destructor);
+                RET_VOID()
             }
 
             //-----------------------------------------------------------------
-            // UnpackGreen(color)
-            static SQInteger _graphics_UnpackGreen(HSQUIRRELVM v)
+            // DrawList.isEmpty()
+            static SQInteger _drawlist_isEmpty(HSQUIRRELVM v)
             {
-                CHECK_NARGS(1)
-                GET_ARG_INT(1, color)
-                RET_INT(RGBA::Unpack((u32)color).green)
+                SETUP_DRAWLIST_OBJECT()
+                RET_BOOL(This->isEmpty())
             }
 
             //-----------------------------------------------------------------
-            // UnpackBlue(color)
-            static SQInteger _graphics_UnpackBlue(HSQUIRRELVM v)
+            // DrawList.clear()
+            static SQInteger _drawlist_clear(HSQUIRRELVM v)
             {
-                CHECK_NARGS(1)
-                GET_ARG_INT(1, color)
-                RET_INT(RGBA::Unpack((u32)color).blue)
+                SETUP_DRAWLIST_OBJECT()
+                This->clear();
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.setBlendMode(blendMode)
+            static SQInteger _drawlist_setBlendMode(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_NARGS(1)
+                GET_ARG_INT(1, blendMode)
+                switch (blendMode) {
+                    case video::BM_REPLACE:
+                    case video::BM_ALPHA:
+                    case video::BM_ADD:
+                    case video::BM_SUBTRACT:
+                    case video::BM_MULTIPLY:
+                        break;
+                    default:
+                        THROW_ERROR("Invalid blend mode")
+                }
+                This->setBlendMode(blendMode);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.setScissor(scissor)
+            static SQInteger _drawlist_setScissor(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_NARGS(1)
+                GET_ARG_RECT(1, scissor)
+                if (!scissor->isValid()) {
+                    THROW_ERROR("Invalid scissor")
+                }
+                This->setScissor(*scissor);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.resetScissor()
+            static SQInteger _drawlist_resetScissor(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                This->resetScissor();
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.drawPoint(x, y, color)
+            static SQInteger _drawlist_drawPoint(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_NARGS(3)
+                GET_ARG_INT(1, x)
+                GET_ARG_INT(2, y)
+                GET_ARG_INT(3, color)
+                This->drawPoint(Vec2i(x, y), RGBA::Unpack((u32)color));
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.drawLine(x1, y1, x2, y2, col1 [, col2])
+            static SQInteger _drawlist_drawLine(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_MIN_NARGS(5)
+                GET_ARG_INT(1, x1)
+                GET_ARG_INT(2, y1)
+                GET_ARG_INT(3, x2)
+                GET_ARG_INT(4, y2)
+                GET_ARG_INT(5, col1)
+                GET_OPTARG_INT(6, col2, col1)
+                Vec2i positions[2] = {
+                    Vec2i(x1, y1),
+                    Vec2i(x2, y2),
+                };
+                RGBA colors[2] = {
+                    RGBA::Unpack((u32)col1),
+                    RGBA::Unpack((u32)col2),
+                };
+                This->drawLine(positions, colors);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.drawTriangle(x1, y1, x2, y2, x3, y3, col1 [, col2, col3])
+            static SQInteger _drawlist_drawTriangle(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_MIN_NARGS(7)
+                GET_ARG_INT(1, x1)
+                GET_ARG_INT(2, y1)
+                GET_ARG_INT(3, x2)
+                GET_ARG_INT(4, y2)
+                GET_ARG_INT(5, x3)
+                GET_ARG_INT(6, y3)
+                GET_ARG_INT(7, col1)
+                GET_OPTARG_INT(8, col2, col1)
+                GET_OPTARG_INT(9, col3, col1)
+                Vec2i positions[3] = {
+                    Vec2i(x1, y1),
+                    Vec2i(x2, y2),
+                    Vec2i(x3, y3),
+                };
+                RGBA colors[3] = {
+                    RGBA::Unpack((u32)col1),
+                    RGBA::Unpack((u32)col2),
+                    RGBA::Unpack((u32)col3),
+                };
+                This->drawTriangle(positions, colors);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.drawRect(x, y, width, height, col1 [, col2, col3, col4])
+            static SQInteger _drawlist_drawRect(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_MIN_NARGS(5)
+                GET_ARG_INT(1, x)
+                GET_ARG_INT(2, y)
+                GET_ARG_INT(3, width)
+                GET_ARG_INT(4, height)
+                GET_ARG_INT(5, col1)
+                GET_OPTARG_INT(6, col2, col1)
+                GET_OPTARG_INT(7, col3, col1)
+                GET_OPTARG_INT(8, col4, col1)
+                RGBA colors[4] = {
+                    RGBA::Unpack((u32)col1),
+                    RGBA::Unpack((u32)col2),
+                    RGBA::Unpack((u32)col3),
+                    RGBA::Unpack((u32)col4),
+                };
+                This->drawRect(Recti(x, y, x + width - 1, y + height - 1), colors);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.drawImage(image, x, y [, mask = CreateColor(255, 255, 255)])
+            static SQInteger _drawlist_drawImage(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_MIN_NARGS(3)
+                GET_ARG_TEXTURE(1, image)
+                GET_ARG_INT(2, x)
+                GET_ARG_INT(3, y)
+                GET_OPTARG_INT(4, mask, RGBA::Pack(255, 255, 255))
+                This->drawImage(image, Vec2i(x, y), RGBA::Unpack((u32)mask));
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.drawSubImage(image, ox, oy, width, height, x, y [, mask = CreateColor(255, 255, 255)])
+            static SQInteger _drawlist_drawSubImage(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_MIN_NARGS(7)
+                GET_ARG_TEXTURE(1, image)
+                GET_ARG_INT(2, ox)
+                GET_ARG_INT(3, oy)
+                GET_ARG_INT(4, width)
+                GET_ARG_INT(5, height)
+                GET_ARG_INT(6, x)
+                GET_ARG_INT(7, y)
+                GET_OPTARG_INT(8, mask, RGBA::Pack(255, 255, 255))
+                This->drawSubImage(image, Recti(ox, oy, ox + width - 1, oy + height - 1), Vec2i(x, y), RGBA::Unpack((u32)mask));
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.drawImageQuad(image, x1, y1, x2, y2, x3, y3, x4, y4 [, mask = CreateColor(255, 255, 255)])
+            static SQInteger _drawlist_drawImageQuad(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_MIN_NARGS(9)
+                GET_ARG_TEXTURE(1, image)
+                GET_ARG_INT(2, x1)
+                GET_ARG_INT(3, y1)
+                GET_ARG_INT(4, x2)
+                GET_ARG_INT(5, y2)
+                GET_ARG_INT(6, x3)
+                GET_ARG_INT(7, y3)
+                GET_ARG_INT(8, x4)
+                GET_ARG_INT(9, y4)
+                GET_OPTARG_INT(10, mask, RGBA::Pack(255, 255, 255))
+                Vec2i positions[4] = {
+                    Vec2i(x1, y1),
+                    Vec2i(x2, y2),
+                    Vec2i(x3, y3),
+                    Vec2i(x4, y4),
+                };
+                This->drawImageQuad(image, positions, RGBA::Unpack((u32)mask));
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.drawSubImageQuad(image, ox, oy, width, height, x1, y1, x2, y2, x3, y3, x4, y4 [, mask = CreateColor(255, 255, 255)])
+            static SQInteger _drawlist_drawSubImageQuad(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_MIN_NARGS(13)
+                GET_ARG_TEXTURE(1, image)
+                GET_ARG_INT(2, ox)
+                GET_ARG_INT(3, oy)
+                GET_ARG_INT(4, width)
+                GET_ARG_INT(5, height)
+                GET_ARG_INT(6, x1)
+                GET_ARG_INT(7, y1)
+                GET_ARG_INT(8, x2)
+                GET_ARG_INT(9, y2)
+                GET_ARG_INT(10, x3)
+                GET_ARG_INT(11, y3)
+                GET_ARG_INT(12, x4)
+                GET_ARG_INT(13, y4)
+                GET_OPTARG_INT(14, mask, RGBA::Pack(255, 255, 255))
+                Vec2i positions[4] = {
+                    Vec2i(x1, y1),
+                    Vec2i(x2, y2),
+                    Vec2i(x3, y3),
+                    Vec2i(x4, y4),
+                };
+                This->drawSubImageQuad(image, Recti(ox, oy, ox + width - 1, oy + height - 1), positions, RGBA::Unpack((u32)mask));
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.drawTexturedTriangle(texture, tx1, ty1, tx2, ty2, tx3, ty3, x1, y1, x2, y2, x3, y3 [, mask = CreateColor(255, 255, 255)])
+            static SQInteger _drawlist_drawTexturedTriangle(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_MIN_NARGS(13)
+                GET_ARG_TEXTURE(1, tex)
+                GET_ARG_INT(2, tx1)
+                GET_ARG_INT(3, ty1)
+                GET_ARG_INT(4, tx2)
+                GET_ARG_INT(5, ty2)
+                GET_ARG_INT(6, tx3)
+                GET_ARG_INT(7, ty3)
+                GET_ARG_INT(8, x1)
+                GET_ARG_INT(9, y1)
+                GET_ARG_INT(10, x2)
+                GET_ARG_INT(11, y2)
+                GET_ARG_INT(12, x3)
+                GET_ARG_INT(13, y3)
+                GET_OPTARG_INT(14, mask, RGBA::Pack(255, 255, 255))
+                Vec2i texcoords[3] = {
+                    Vec2i(tx1, ty1),
+                    Vec2i(tx2, ty2),
+                    Vec2i(tx3, ty3),
+                };
+                Vec2i positions[3] = {
+                    Vec2i(x1, y1),
+                    Vec2i(x2, y2),
+                    Vec2i(x3, y3),
+                };
+                This->drawTexturedTriangle(tex, texcoords, positions, RGBA::Unpack((u32)mask));
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList.draw([x = 0, y = 0, clip])
+            static SQInteger _drawlist_draw(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                GET_OPTARG_INT(1, x, 0)
+                GET_OPTARG_INT(2, y, 0)
+                GET_OPTARG_RECT(3, clip)
+                This->draw(Vec2i(x, y), clip);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList._get(index)
+            static SQInteger _drawlist__get(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                CHECK_NARGS(1)
+                GET_ARG_STRING(1, index)
+                if (strcmp(index, "numCommands") == 0) {
+                    RET_INT(This->getNumCommands())
+                } else {
+                    // index not found
+                    sq_pushnull(v);
+                    return sq_throwobject(v);
+                }
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList._typeof()
+            static SQInteger _drawlist__typeof(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                RET_STRING("DrawList")
+            }
+
+            //-----------------------------------------------------------------
+            // DrawList._tostring()
+            static SQInteger _drawlist__tostring(HSQUIRRELVM v)
+            {
+                SETUP_DRAWLIST_OBJECT()
+                std::ostringstream oss;
+                oss << "<DrawList instance at " << This;
+                oss << " (" << This->getNumCommands();
+                oss << ")>";
+                RET_STRING(oss.str().c_str())
+            }
+
+            //-----------------------------------------------------------------
+            static util::Function _drawlist_methods[] = {
+                {"constructor",           "DrawList.constructor",           _drawlist_constructor          },
+                {"isEmpty",               "DrawList.isEmpty",               _drawlist_isEmpty              },
+                {"clear",                 "DrawList.clear",                 _drawlist_clear                },
+                {"setBlendMode",          "DrawList.setBlendMode",          _drawlist_setBlendMode         },
+                {"setScissor",            "DrawList.setScissor",            _drawlist_setScissor           },
+                {"resetScissor",          "DrawList.resetScissor",          _drawlist_resetScissor         },
+                {"drawPoint",             "DrawList.drawPoint",             _drawlist_drawPoint            },
+                {"drawLine",              "DrawList.drawLine",              _drawlist_drawLine             },
+                {"drawTriangle",          "DrawList.drawTriangle",          _drawlist_drawTriangle         },
+                {"drawRect",              "DrawList.drawRect",              _drawlist_drawRect             },
+                {"drawImage",             "DrawList.drawImage",             _drawlist_drawImage            },
+                {"drawSubImage",          "DrawList.drawSubImage",          _drawlist_drawSubImage         },
+                {"drawImageQuad",         "DrawList.drawImageQuad",         _drawlist_drawImageQuad        },
+                {"drawSubImageQuad",      "DrawList.drawSubImageQuad",      _drawlist_drawSubImageQuad     },
+                {"drawTexturedTriangle",  "DrawList.drawTexturedTriangle",  _drawlist_drawTexturedTriangle },
+                {"draw",                  "DrawList.draw",                  _drawlist_draw                 },
+                {"_get",                  "DrawList._get",                  _drawlist__get                 },
+                {"_typeof",               "DrawList._typeof",               _drawlist__typeof              },
+                {"_tostring",             "DrawList._tostring",             _drawlist__tostring            },
+                {0,0}
+            };
+
+            //-----------------------------------------------------------------
+            // CreateColor(red, green, blue [, alpha = 255])
+            static SQInteger _graphics_CreateColor(HSQUIRRELVM v)
+            {
+                CHECK_MIN_NARGS(3)
+                GET_ARG_INT(1, red)
+                GET_ARG_INT(2, green)
+                GET_ARG_INT(3, blue)
+                GET_OPTARG_INT(4, alpha, 255)
+                RET_INT(RGBA::Pack(red, green, blue, alpha))
+            }
+
+            //-----------------------------------------------------------------
+            // UnpackRed(color)
+            static SQInteger _graphics_UnpackRed(HSQUIRRELVM v)
+            {
+                CHECK_NARGS(1)
+                GET_ARG_INT(1, color)
+                RET_INT(RGBA::Unpack((u32)color).red)
+            }
+
+            //-----------------------------------------------------------------
+            // UnpackGreen(color)
+            static SQInteger _graphics_UnpackGreen(HSQUIRRELVM v)
+            {
+                CHECK_NARGS(1)
+                GET_ARG_INT(1, color)
+                RET_INT(RGBA::Unpack((u32)color).green)
+            }
+
+            //-----------------------------------------------------------------
+            // UnpackBlue(color)
+            static SQInteger _graphics_UnpackBlue(HSQUIRRELVM v)
+            {
+                CHECK_NARGS(1)
+                GET_ARG_INT(1, color)
+                RET_INT(RGBA::Unpack((u32)color).blue)
             }
 
             //-----------------------------------------------------------------
@@ -1340,6 +2048,101 @@ namespace sphere {
                 RET_CANVAS(canvas.get())
             }
 
+            //-----------------------------------------------------------------
+            // RequestFrameReadback([section])
+            static SQInteger _graphics_RequestFrameReadback(HSQUIRRELVM v)
+            {
+                GET_OPTARG_RECT(1, section)
+                int handle = video::RequestFrameReadback(section);
+                if (handle == 0) {
+                    THROW_ERROR("Could not request frame readback")
+                }
+                RET_INT(handle)
+            }
+
+            //-----------------------------------------------------------------
+            // PollFrameReadback(handle)
+            static SQInteger _graphics_PollFrameReadback(HSQUIRRELVM v)
+            {
+                CHECK_NARGS(1)
+                GET_ARG_INT(1, handle)
+                bool pending = false;
+                CanvasPtr canvas = video::PollFrameReadback(handle, &pending);
+                if (!canvas) {
+                    if (pending) {
+                        RET_NULL()
+                    }
+                    THROW_ERROR("Could not poll frame readback")
+                }
+                RET_CANVAS(canvas.get())
+            }
+
+            //-----------------------------------------------------------------
+            // CreateRenderTarget(width, height)
+            static SQInteger _graphics_CreateRenderTarget(HSQUIRRELVM v)
+            {
+                CHECK_NARGS(2)
+                GET_ARG_INT(1, width)
+                GET_ARG_INT(2, height)
+                if (width <= 0) {
+                    THROW_ERROR1("Invalid width: %d", width)
+                }
+                if (height <= 0) {
+                    THROW_ERROR1("Invalid height: %d", height)
+                }
+                TexturePtr target = video::CreateRenderTarget(width, height);
+                if (!target) {
+                    THROW_ERROR("Could not create render target")
+                }
+                RET_TEXTURE(target.get())
+            }
+
+            //-----------------------------------------------------------------
+            // SetRenderTarget([target = null])
+            static SQInteger _graphics_SetRenderTarget(HSQUIRRELVM v)
+            {
+                ITexture* target = 0;
+                if (sq_gettop(v) >= 2 && !ARG_IS_NULL(1)) {
+                    GET_ARG_TEXTURE(1, texture)
+                    target = texture;
+                }
+                if (!video::SetRenderTarget(target)) {
+                    THROW_ERROR("Invalid render target")
+                }
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // GetRenderTarget()
+            static SQInteger _graphics_GetRenderTarget(HSQUIRRELVM v)
+            {
+                ITexture* target = video::GetRenderTarget();
+                if (!target) {
+                    RET_NULL()
+                }
+                RET_TEXTURE(target)
+            }
+
+            //-----------------------------------------------------------------
+            // CreateStreamingTexture(width, height)
+            static SQInteger _graphics_CreateStreamingTexture(HSQUIRRELVM v)
+            {
+                CHECK_NARGS(2)
+                GET_ARG_INT(1, width)
+                GET_ARG_INT(2, height)
+                if (width <= 0) {
+                    THROW_ERROR1("Invalid width: %d", width)
+                }
+                if (height <= 0) {
+                    THROW_ERROR1("Invalid height: %d", height)
+                }
+                TexturePtr texture = video::CreateStreamingTexture(width, height);
+                if (!texture) {
+                    THROW_ERROR("Could not create streaming texture")
+                }
+                RET_TEXTURE(texture.get())
+            }
+
             //-----------------------------------------------------------------
             // GetBlendMode()
             static SQInteger _graphics_GetBlendMode(HSQUIRRELVM v)
@@ -1522,15 +2325,9 @@ namespace sphere {
 
             //-----------------------------------------------------------------
             // DrawImage(image, x, y [, mask = CreateColor(255, 255, 255)])
-            static SQInteger _graphics_DrawImage(HSQUIRRELVM v)
+            void _graphics_DrawImage(ITexture* image, int x, int y, binding::Optional<int> mask)
             {
-                CHECK_MIN_NARGS(3)
-                GET_ARG_TEXTURE(1, image)
-                GET_ARG_INT(2, x)
-                GET_ARG_INT(3, y)
-                GET_OPTARG_INT(4, mask, RGBA::Pack(255, 255, 255))
-                video::DrawImage(image, Vec2i(x, y), RGBA::Unpack((u32)mask));
-                RET_VOID()
+                video::DrawImage(image, Vec2i(x, y), RGBA::Unpack((u32)mask.get(RGBA::Pack(255, 255, 255))));
             }
 
             //-----------------------------------------------------------------
@@ -1637,6 +2434,76 @@ namespace sphere {
                 RET_VOID()
             }
 
+            //-----------------------------------------------------------------
+            // GetVideoStats()
+            static SQInteger _graphics_GetVideoStats(HSQUIRRELVM v)
+            {
+                const video::VideoStats& stats = video::GetVideoStats();
+
+                sq_newtable(v);
+
+                sq_pushstring(v, "drawCalls", -1);
+                sq_pushinteger(v, stats.drawCalls);
+                sq_newslot(v, -3, SQFalse);
+
+                sq_pushstring(v, "stateChanges", -1);
+                sq_pushinteger(v, stats.stateChanges);
+                sq_newslot(v, -3, SQFalse);
+
+                sq_pushstring(v, "redundantStateChanges", -1);
+                sq_pushinteger(v, stats.redundantStateChanges);
+                sq_newslot(v, -3, SQFalse);
+
+                return 1;
+            }
+
+            //-----------------------------------------------------------------
+            // GetTextureMemoryBudget()
+            static SQInteger _graphics_GetTextureMemoryBudget(HSQUIRRELVM v)
+            {
+                RET_INT(video::GetTextureMemoryBudget())
+            }
+
+            //-----------------------------------------------------------------
+            // SetTextureMemoryBudget(budget)
+            static SQInteger _graphics_SetTextureMemoryBudget(HSQUIRRELVM v)
+            {
+                CHECK_NARGS(1)
+                GET_ARG_INT(1, budget)
+                if (budget < 0) {
+                    THROW_ERROR1("Invalid budget: %d", budget)
+                }
+                video::SetTextureMemoryBudget(budget);
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // GetTextureMemoryStats()
+            static SQInteger _graphics_GetTextureMemoryStats(HSQUIRRELVM v)
+            {
+                const video::TextureMemoryStats& stats = video::GetTextureMemoryStats();
+
+                sq_newtable(v);
+
+                sq_pushstring(v, "usage", -1);
+                sq_pushinteger(v, stats.usage);
+                sq_newslot(v, -3, SQFalse);
+
+                sq_pushstring(v, "peakUsage", -1);
+                sq_pushinteger(v, stats.peakUsage);
+                sq_newslot(v, -3, SQFalse);
+
+                sq_pushstring(v, "evictedUsage", -1);
+                sq_pushinteger(v, stats.evictedUsage);
+                sq_newslot(v, -3, SQFalse);
+
+                sq_pushstring(v, "evictions", -1);
+                sq_pushinteger(v, stats.evictions);
+                sq_newslot(v, -3, SQFalse);
+
+                return 1;
+            }
+
             //-----------------------------------------------------------------
             static util::Function _graphics_functions[] = {
                 {"CreateColor",                 "CreateColor",              _graphics_CreateColor              },
@@ -1661,6 +2528,15 @@ namespace sphere {
                 {"GetFrameScissor",             "GetFrameScissor",          _graphics_GetFrameScissor          },
                 {"SetFrameScissor",             "SetFrameScissor",          _graphics_SetFrameScissor          },
                 {"CloneFrame",                  "CloneFrame",               _graphics_CloneFrame               },
+                {"RequestFrameReadback",        "RequestFrameReadback",     _graphics_RequestFrameReadback     },
+                {"PollFrameReadback",           "PollFrameReadback",        _graphics_PollFrameReadback        },
+                {"CreateRenderTarget",          "CreateRenderTarget",       _graphics_CreateRenderTarget       },
+                {"SetRenderTarget",             "SetRenderTarget",          _graphics_SetRenderTarget          },
+                {"GetRenderTarget",             "GetRenderTarget",          _graphics_GetRenderTarget          },
+                {"CreateStreamingTexture",      "CreateStreamingTexture",   _graphics_CreateStreamingTexture   },
+                {"GetTextureMemoryBudget",      "GetTextureMemoryBudget",   _graphics_GetTextureMemoryBudget   },
+                {"SetTextureMemoryBudget",      "SetTextureMemoryBudget",   _graphics_SetTextureMemoryBudget   },
+                {"GetTextureMemoryStats",       "GetTextureMemoryStats",    _graphics_GetTextureMemoryStats    },
                 {"GetBlendMode",                "GetBlendMode",             _graphics_GetBlendMode             },
                 {"SetBlendMode",                "SetBlendMode",             _graphics_SetBlendMode             },
                 {"CaptureFrame",                "CaptureFrame",             _graphics_CaptureFrame             },
@@ -1670,11 +2546,12 @@ namespace sphere {
                 {"DrawLine",                    "DrawLine",                 _graphics_DrawLine                 },
                 {"DrawTriangle",                "DrawTriangle",             _graphics_DrawTriangle             },
                 {"DrawRect",                    "DrawRect",                 _graphics_DrawRect                 },
-                {"DrawImage",                   "DrawImage",                _graphics_DrawImage                },
+                {"DrawImage",                   "DrawImage",                NATIVE_FUNCTION(_graphics_DrawImage) },
                 {"DrawSubImage",                "DrawSubImage",             _graphics_DrawSubImage             },
                 {"DrawImageQuad",               "DrawImageQuad",            _graphics_DrawImageQuad            },
                 {"DrawSubImageQuad",            "DrawSubImageQuad",         _graphics_DrawSubImageQuad         },
                 {"DrawTexturedTriangle",        "DrawTexturedTriangle",     _graphics_DrawTexturedTriangle     },
+                {"GetVideoStats",               "GetVideoStats",            _graphics_GetVideoStats            },
                 {0,0}
             };
 
@@ -1705,6 +2582,10 @@ namespace sphere {
                 {"BM_SUBTRACT",     video::BM_SUBTRACT  },
                 {"BM_MULTIPLY",     video::BM_MULTIPLY  },
 
+                // filter constants
+                {"FILTER_NEAREST",  Canvas::FILTER_NEAREST  },
+                {"FILTER_BILINEAR", Canvas::FILTER_BILINEAR },
+
                 {0}
             };
 
@@ -1728,6 +2609,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep canvas class for binding objects
+                util::KeepClass(v, -1, g_CanvasClass);
+
                 // register canvas class in root table
                 sq_pushroottable(v);
                 sq_pushstring(v, "Canvas", -1);
@@ -1755,6 +2639,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep texture class for binding objects
+                util::KeepClass(v, -1, g_TextureClass);
+
                 // register texture class in root table
                 sq_pushroottable(v);
                 sq_pushstring(v, "Texture", -1);
@@ -1765,6 +2652,25 @@ namespace sphere {
                 // pop texture class
                 sq_poptop(v);
 
+                /* DrawList */
+
+                // create draw list class
+                sq_newclass(v, SQFalse);
+
+                // set up draw list class
+                sq_settypetag(v, -1, TT_DRAWLIST);
+                util::RegisterFunctions(v, _drawlist_methods);
+
+                // register draw list class in root table
+                sq_pushroottable(v);
+                sq_pushstring(v, "DrawList", -1);
+                sq_push(v, -3); // push draw list class
+                sq_newslot(v, -3, SQFalse);
+                sq_poptop(v); // pop root table
+
+                // pop draw list class
+                sq_poptop(v);
+
                 /* Global Symbols */
 
                 sq_pushroottable(v);
@@ -4,10 +4,12 @@
 #include <squirrel.h>
 #include "../graphics/Canvas.hpp"
 #include "../graphics/video.hpp"
+#include "../graphics/DrawList.hpp"
 
 // type tags
-#define TT_CANVAS  ((SQUserPointer)400)
-#define TT_TEXTURE ((SQUserPointer)401)
+#define TT_CANVAS   ((SQUserPointer)400)
+#define TT_TEXTURE  ((SQUserPointer)401)
+#define TT_DRAWLIST ((SQUserPointer)402)
 
 
 namespace sphere {
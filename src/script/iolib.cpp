@@ -11,6 +11,11 @@
 namespace sphere {
     namespace script {
 
+        //-----------------------------------------------------------------
+        // globals
+        static HSQOBJECT g_StreamClass;
+        static HSQOBJECT g_FileClass;
+
         namespace internal {
 
             static SQInteger _stream_destructor(SQUserPointer p, SQInteger size);
@@ -23,26 +28,11 @@ namespace sphere {
         {
             assert(stream);
 
-            // get stream class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "Stream", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_STREAM) {
-                sq_poptop(v);
+            // create instance
+            if (!util::CreateInstance(v, g_StreamClass)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop stream class
-            sq_remove(v, -2);
-
             // set up instance
             sq_setreleasehook(v, -1, internal::_stream_destructor);
             sq_setinstanceup(v, -1, (SQUserPointer)stream);
@@ -68,26 +58,11 @@ namespace sphere {
         {
             assert(file);
 
-            // get file class
-            sq_pushregistrytable(v);
-            sq_pushstring(v, "File", -1);
-            if (!SQ_SUCCEEDED(sq_rawget(v, -2))) {
-                sq_poptop(v); // pop registry table
-                return false;
-            }
-            sq_remove(v, -2); // remove registry table
-            SQUserPointer tt = 0;
-            if (!SQ_SUCCEEDED(sq_gettypetag(v, -1, &tt)) || tt != TT_FILE) {
-                sq_poptop(v);
+            // create instance
+            if (!util::CreateInstance(v, g_FileClass)) {
                 return false;
             }
 
-            // create instance
-            sq_createinstance(v, -1);
-
-            // pop file class
-            sq_remove(v, -2);
-
             // set up instance
             sq_setreleasehook(v, -1, internal::_file_destructor);
             sq_setinstanceup(v, -1, (SQUserPointer)file);
@@ -647,6 +622,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep stream class for binding objects
+                util::KeepClass(v, -1, g_StreamClass);
+
                 // register stream class in root table
                 sq_pushroottable(v);
                 sq_pushstring(v, "Stream", -1);
@@ -690,6 +668,9 @@ namespace sphere {
                 sq_newslot(v, -3, SQFalse);
                 sq_poptop(v); // pop registry table
 
+                // keep file class for binding objects
+                util::KeepClass(v, -1, g_FileClass);
+
                 // register file class in root table
                 sq_pushroottable(v);
                 sq_pushstring(v, "File", -1);
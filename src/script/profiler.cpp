@@ -0,0 +1,405 @@
+#include <cassert>
+#include <map>
+#include <sstream>
+#include "../system/system.hpp"
+#include "util.hpp"
+#include "vm.hpp"
+#include "profiler.hpp"
+
+
+namespace sphere {
+    namespace script {
+
+        //-----------------------------------------------------------------
+        typedef std::pair<const void*, const void*> PROFILERKEY;
+
+        struct PROFILERNODE {
+            int function; // -1 in the root
+            int parent;
+            i64 selfTime;
+            std::map<int, int> children; // function -> node
+        };
+
+        struct PROFILERFRAME {
+            int node;
+            int function;
+            PROFILERKEY key;
+            i64 start;
+            i64 childTime;
+        };
+
+        //-----------------------------------------------------------------
+        // globals
+        static bool g_ProfileNatives = false;
+        static int g_ProfilerMode = 0;
+        static int g_ProfilerInterval = 0;
+        static i64 g_NextSample = 0;
+        static volatile int g_SampleDue = 0; // set by the ticker once per interval
+        static int g_SampleMark = 0;
+        static std::vector<ProfilerFunction> g_ProfilerFunctions;
+        static std::vector<int> g_FunctionDepths; // calls mode, to not count recursive calls twice
+        static std::vector<int> g_FunctionMarks;  // sampling mode, the last sample a function was on the stack
+        static std::map<PROFILERKEY, int> g_FunctionIndices;
+        static std::vector<PROFILERNODE> g_ProfilerNodes; // the call tree, node 0 is the root
+        static std::vector<PROFILERFRAME> g_ProfilerFrames;
+        static std::vector<int> g_SampleStack;
+
+        //-----------------------------------------------------------------
+        static int get_function(const PROFILERKEY& key, const SQChar* name, const SQChar* source, SQInteger line, bool native)
+        {
+            std::map<PROFILERKEY, int>::iterator it = g_FunctionIndices.find(key);
+            if (it != g_FunctionIndices.end()) {
+                return it->second;
+            }
+
+            ProfilerFunction function;
+            function.name   = (name ? name : "unknown");
+            function.source = (source ? source : "unknown");
+            function.line   = (line > 0 ? (int)line : 0);
+            function.native = native;
+            function.calls   = 0;
+            function.samples = 0;
+            function.inclusiveTime = 0;
+            function.exclusiveTime = 0;
+            function.nativeTime    = 0;
+
+            int index = (int)g_ProfilerFunctions.size();
+            g_ProfilerFunctions.push_back(function);
+            g_FunctionDepths.push_back(0);
+            g_FunctionMarks.push_back(0);
+            g_FunctionIndices[key] = index;
+            return index;
+        }
+
+        //-----------------------------------------------------------------
+        static int get_child_node(int parent, int function)
+        {
+            std::map<int, int>::iterator it = g_ProfilerNodes[parent].children.find(function);
+            if (it != g_ProfilerNodes[parent].children.end()) {
+                return it->second;
+            }
+
+            PROFILERNODE node;
+            node.function = function;
+            node.parent   = parent;
+            node.selfTime = 0;
+
+            int index = (int)g_ProfilerNodes.size();
+            g_ProfilerNodes.push_back(node);
+            g_ProfilerNodes[parent].children[function] = index;
+            return index;
+        }
+
+        //-----------------------------------------------------------------
+        static void enter_function(int function, const PROFILERKEY& key, i64 now)
+        {
+            PROFILERFRAME frame;
+            frame.node      = get_child_node((g_ProfilerFrames.empty() ? 0 : g_ProfilerFrames.back().node), function);
+            frame.function  = function;
+            frame.key       = key;
+            frame.start     = now;
+            frame.childTime = 0;
+            g_ProfilerFrames.push_back(frame);
+
+            g_ProfilerFunctions[function].calls++;
+            g_FunctionDepths[function]++;
+        }
+
+        //-----------------------------------------------------------------
+        static void leave_function(i64 now)
+        {
+            assert(!g_ProfilerFrames.empty());
+            PROFILERFRAME frame = g_ProfilerFrames.back();
+            g_ProfilerFrames.pop_back();
+
+            i64 elapsed = now - frame.start;
+            i64 self_time = elapsed - frame.childTime;
+
+            ProfilerFunction& function = g_ProfilerFunctions[frame.function];
+            g_ProfilerNodes[frame.node].selfTime += self_time;
+            function.exclusiveTime += self_time;
+            if (--g_FunctionDepths[frame.function] == 0) {
+                function.inclusiveTime += elapsed;
+            }
+
+            if (!g_ProfilerFrames.empty()) {
+                PROFILERFRAME& parent = g_ProfilerFrames.back();
+                parent.childTime += elapsed;
+                if (function.native) {
+                    g_ProfilerFunctions[parent.function].nativeTime += elapsed;
+                }
+            }
+        }
+
+        //-----------------------------------------------------------------
+        // Returns the function in the given level of the call stack of
+        // the VM, or -1 if there is no such level.
+        static int get_stack_function(HSQUIRRELVM v, SQInteger level)
+        {
+            SQStackInfos si;
+            if (!SQ_SUCCEEDED(sq_stackinfos(v, level, &si))) {
+                return -1;
+            }
+            // the line of native functions is -1
+            return get_function(PROFILERKEY(si.funcname, si.source), si.funcname, si.source, si.line, si.line == -1);
+        }
+
+        //-----------------------------------------------------------------
+        // Attributes the intervals passed since the last sample to the
+        // call stack, starting at level firstLevel.
+        static void take_sample(HSQUIRRELVM v, i64 now, SQInteger firstLevel)
+        {
+            i64 num_samples = 1 + (now - g_NextSample) / g_ProfilerInterval;
+            i64 weight = num_samples * g_ProfilerInterval;
+            g_NextSample += weight;
+
+            g_SampleStack.clear();
+            for (SQInteger level = firstLevel; ; ++level) {
+                int function = get_stack_function(v, level);
+                if (function == -1) {
+                    break;
+                }
+                g_SampleStack.push_back(function);
+            }
+            if (g_SampleStack.empty()) {
+                return;
+            }
+
+            // recursive functions are on the stack more than once
+            g_SampleMark++;
+
+            int node = 0;
+            for (int i = (int)g_SampleStack.size() - 1; i >= 0; --i) {
+                int function = g_SampleStack[i];
+                node = get_child_node(node, function);
+                if (g_FunctionMarks[function] != g_SampleMark) {
+                    g_FunctionMarks[function] = g_SampleMark;
+                    g_ProfilerFunctions[function].samples += (int)num_samples;
+                    g_ProfilerFunctions[function].inclusiveTime += weight;
+                }
+            }
+
+            ProfilerFunction& leaf = g_ProfilerFunctions[g_SampleStack[0]];
+            g_ProfilerNodes[node].selfTime += weight;
+            leaf.exclusiveTime += weight;
+            if (leaf.native && g_SampleStack.size() > 1) {
+                g_ProfilerFunctions[g_SampleStack[1]].nativeTime += weight;
+            }
+        }
+
+        //-----------------------------------------------------------------
+        static void sampling_hook(HSQUIRRELVM v, SQInteger type, const SQChar* source, SQInteger line, const SQChar* name)
+        {
+            if (!g_SampleDue) {
+                return;
+            }
+            g_SampleDue = 0;
+
+            // a called function has not run yet
+            take_sample(v, system::GetMicroseconds(), (type == 'c' ? 1 : 0));
+        }
+
+        //-----------------------------------------------------------------
+        static void calls_hook(HSQUIRRELVM v, SQInteger type, const SQChar* source, SQInteger line, const SQChar* name)
+        {
+            if (type != 'c' && type != 'r') {
+                return;
+            }
+            i64 now = system::GetMicroseconds();
+
+            PROFILERKEY key(name, source);
+            if (type == 'c') {
+                enter_function(get_function(key, name, source, line, false), key, now);
+            } else {
+                // functions left by an exception have no return event,
+                // they are left together with the function returning
+                for (int i = (int)g_ProfilerFrames.size() - 1; i >= 0; --i) {
+                    if (g_ProfilerFrames[i].key == key) {
+                        while ((int)g_ProfilerFrames.size() > i) {
+                            leave_function(now);
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+
+        //-----------------------------------------------------------------
+        bool StartProfiler(int mode, int interval)
+        {
+            HSQUIRRELVM v = GetVM();
+            if (!v || g_ProfilerMode != 0 || interval <= 0) {
+                return false;
+            }
+            if (mode != PROFILER_CALLS && mode != PROFILER_SAMPLING) {
+                return false;
+            }
+
+            g_ProfilerFunctions.clear();
+            g_FunctionDepths.clear();
+            g_FunctionMarks.clear();
+            g_FunctionIndices.clear();
+            g_ProfilerNodes.clear();
+            g_ProfilerFrames.clear();
+            g_SampleMark = 0;
+
+            PROFILERNODE root;
+            root.function = -1;
+            root.parent   = -1;
+            root.selfTime = 0;
+            g_ProfilerNodes.push_back(root);
+
+            i64 now = system::GetMicroseconds();
+            if (mode == PROFILER_CALLS) {
+                // enter the script functions that are already running,
+                // native functions are entered when they are called
+                std::vector<SQStackInfos> running;
+                SQStackInfos si;
+                for (SQInteger level = 0; SQ_SUCCEEDED(sq_stackinfos(v, level, &si)); ++level) {
+                    if (si.line != -1) {
+                        running.push_back(si);
+                    }
+                }
+                for (int i = (int)running.size() - 1; i >= 0; --i) {
+                    PROFILERKEY key(running[i].funcname, running[i].source);
+                    enter_function(get_function(key, running[i].funcname, running[i].source, running[i].line, false), key, now);
+                }
+            }
+
+            g_ProfilerInterval = interval;
+            g_NextSample = now + interval;
+            g_SampleDue = 0;
+            if (mode == PROFILER_SAMPLING && !system::StartTicker(interval, &g_SampleDue)) {
+                return false;
+            }
+            g_ProfilerMode = mode;
+            sq_setnativedebughook(v, (mode == PROFILER_SAMPLING ? sampling_hook : calls_hook));
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        void StopProfiler()
+        {
+            if (g_ProfilerMode == 0) {
+                return;
+            }
+            i64 now = system::GetMicroseconds();
+            while (!g_ProfilerFrames.empty()) {
+                leave_function(now);
+            }
+            if (GetVM()) {
+                sq_setnativedebughook(GetVM(), 0);
+            }
+            system::StopTicker();
+            g_ProfilerMode = 0;
+        }
+
+        //-----------------------------------------------------------------
+        bool IsProfilerRunning()
+        {
+            return g_ProfilerMode != 0;
+        }
+
+        //-----------------------------------------------------------------
+        const std::vector<ProfilerFunction>& GetProfilerFunctions()
+        {
+            return g_ProfilerFunctions;
+        }
+
+        //-----------------------------------------------------------------
+        bool WriteProfilerStacks(IStream* stream)
+        {
+            assert(stream);
+            std::vector<int> path;
+            for (int i = 1; i < (int)g_ProfilerNodes.size(); ++i) {
+                if (g_ProfilerNodes[i].selfTime <= 0) {
+                    continue;
+                }
+
+                path.clear();
+                for (int node = i; node > 0; node = g_ProfilerNodes[node].parent) {
+                    path.push_back(g_ProfilerNodes[node].function);
+                }
+
+                std::ostringstream oss;
+                for (int j = (int)path.size() - 1; j >= 0; --j) {
+                    const ProfilerFunction& function = g_ProfilerFunctions[path[j]];
+                    oss << function.name;
+                    if (!function.native) {
+                        oss << " (" << function.source << ":" << function.line << ")";
+                    }
+                    oss << (j > 0 ? ";" : " ");
+                }
+                oss << g_ProfilerNodes[i].selfTime << "\n";
+
+                std::string line = oss.str();
+                if (stream->write(line.c_str(), (int)line.size()) != (int)line.size()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        namespace internal {
+
+            //-----------------------------------------------------------------
+            void EnableNativeProfiling()
+            {
+                assert(!GetVM());
+                g_ProfileNatives = true;
+            }
+
+            //-----------------------------------------------------------------
+            bool IsNativeProfilingEnabled()
+            {
+                return g_ProfileNatives;
+            }
+
+            //-----------------------------------------------------------------
+            SQInteger CallNative(HSQUIRRELVM v)
+            {
+                SQUserPointer p = 0;
+                sq_getuserpointer(v, -1, &p);
+                sq_poptop(v); // the free variable is not an argument
+                const util::Function* native = (const util::Function*)p;
+                assert(native);
+
+                if (g_ProfilerMode == 0) {
+                    return native->function(v);
+                }
+
+                if (g_ProfilerMode == PROFILER_SAMPLING) {
+                    // the time before the call was spent in the caller,
+                    // the time of the call in the native function
+                    if (g_SampleDue) {
+                        g_SampleDue = 0;
+                        take_sample(v, system::GetMicroseconds(), 1);
+                    }
+                    SQInteger result = native->function(v);
+                    if (g_SampleDue && g_ProfilerMode == PROFILER_SAMPLING) {
+                        g_SampleDue = 0;
+                        take_sample(v, system::GetMicroseconds(), 0);
+                    }
+                    return result;
+                }
+
+                PROFILERKEY key(native, 0);
+                int num_frames = (int)g_ProfilerFrames.size();
+                enter_function(get_function(key, native->debugName, "native", 0, true), key, system::GetMicroseconds());
+                SQInteger result = native->function(v);
+
+                // the profiler may have been stopped or started again in
+                // the call, script functions left by an exception are
+                // left here
+                if (g_ProfilerMode == PROFILER_CALLS) {
+                    i64 now = system::GetMicroseconds();
+                    while ((int)g_ProfilerFrames.size() > num_frames) {
+                        leave_function(now);
+                    }
+                }
+                return result;
+            }
+
+        } // namespace internal
+    } // namespace script
+} // namespace sphere
@@ -0,0 +1,70 @@
+#ifndef SPHERE_SCRIPT_PROFILER_HPP
+#define SPHERE_SCRIPT_PROFILER_HPP
+
+#include <string>
+#include <vector>
+#include <squirrel.h>
+#include "../common/types.hpp"
+#include "../io/IStream.hpp"
+
+
+namespace sphere {
+    namespace script {
+
+        // profiler modes
+        enum {
+            PROFILER_CALLS = 1, // times every call
+            PROFILER_SAMPLING,  // records the call stack once per interval
+        };
+
+        struct ProfilerFunction {
+            std::string name;
+            std::string source;
+            int  line;           // where the function was first entered or sampled
+            bool native;
+            int  calls;          // calls mode only
+            int  samples;        // sampling mode only
+            i64  inclusiveTime;  // in microseconds, including called functions
+            i64  exclusiveTime;  // in microseconds, in the function itself
+            i64  nativeTime;     // in microseconds, in native functions it called
+        };
+
+        // In calls mode, script functions are timed through the debug
+        // hook of the VM and native functions when they are called, so
+        // the times are exact but every call is slowed down. In sampling
+        // mode, a timer thread flags each interval (in microseconds) and
+        // the call stack is recorded at the next call, return or line
+        // after that, so a call only costs testing the flag. Functions
+        // are told apart by name and source file. Starting the profiler
+        // clears the results of the previous run.
+        //
+        // Native functions are only timed and sampled on their own if
+        // native profiling was enabled before the VM was initialized,
+        // otherwise their time counts as time of the calling script
+        // function.
+        bool StartProfiler(int mode = PROFILER_SAMPLING, int interval = 1000);
+        void StopProfiler();
+        bool IsProfilerRunning();
+        const std::vector<ProfilerFunction>& GetProfilerFunctions();
+
+        // Writes one line per call stack, "outer;inner;leaf time", with
+        // the time spent in the leaf in microseconds. This is the
+        // collapsed format read by flame graph tools.
+        bool WriteProfilerStacks(IStream* stream);
+
+        namespace internal {
+
+            // If enabled, native functions registered by
+            // util::RegisterFunctions are called through CallNative,
+            // with their util::Function as free variable. Otherwise they
+            // are registered as they are and cost nothing extra.
+            void EnableNativeProfiling();
+            bool IsNativeProfilingEnabled();
+            SQInteger CallNative(HSQUIRRELVM v);
+
+        } // namespace internal
+    } // namespace script
+} // namespace sphere
+
+
+#endif
@@ -1,4 +1,5 @@
 #include <cassert>
+#include "profiler.hpp"
 #include "util.hpp"
 
 
@@ -12,7 +13,13 @@ namespace sphere {
                 assert(functions);
                 for (int i = 0; functions[i].name != 0; i++) {
                     sq_pushstring(v, functions[i].name, -1);
-                    sq_newclosure(v, functions[i].function, 0);
+                    if (internal::IsNativeProfilingEnabled()) {
+                        // called through the profiler
+                        sq_pushuserpointer(v, (SQUserPointer)&functions[i]);
+                        sq_newclosure(v, internal::CallNative, 1);
+                    } else {
+                        sq_newclosure(v, functions[i].function, 0);
+                    }
                     sq_setnativeclosurename(v, -1, functions[i].debugName);
                     if (!SQ_SUCCEEDED(sq_newslot(v, -3, (areStatic ? SQTrue : SQFalse)))) {
                         return false;
@@ -41,6 +48,29 @@ namespace sphere {
                 return true;
             }
 
+            //-----------------------------------------------------------------
+            void KeepClass(HSQUIRRELVM v, SQInteger idx, HSQOBJECT& handle)
+            {
+                assert(sq_gettype(v, idx) == OT_CLASS);
+                sq_getstackobj(v, idx, &handle);
+                sq_addref(v, &handle);
+            }
+
+            //-----------------------------------------------------------------
+            bool CreateInstance(HSQUIRRELVM v, const HSQOBJECT& handle)
+            {
+                if (!sq_isclass(handle)) {
+                    return false; // not registered yet
+                }
+                sq_pushobject(v, handle);
+                if (!SQ_SUCCEEDED(sq_createinstance(v, -1))) {
+                    sq_poptop(v);
+                    return false;
+                }
+                sq_remove(v, -2); // remove class
+                return true;
+            }
+
         } // namespace util
     } // namespace script
 } // namespace sphere
@@ -62,6 +62,11 @@ namespace sphere {
             bool RegisterFunctions(HSQUIRRELVM v, const Function* functions, bool areStatic = false);
             bool RegisterConstants(HSQUIRRELVM v, const Constant* constants, bool areStatic = false);
 
+            // Classes are kept in handles when they are registered, so
+            // binding an object does not look its class up by name.
+            void KeepClass(HSQUIRRELVM v, SQInteger idx, HSQOBJECT& handle);
+            bool CreateInstance(HSQUIRRELVM v, const HSQOBJECT& handle);
+
         } // namespace util
     } // namespace script
 } // namespace sphere
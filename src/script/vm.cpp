@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <cassert>
 #include <cstdarg>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -16,6 +20,7 @@
 #include "compressionlib.hpp"
 #include "mathlib.hpp"
 #include "baselib.hpp"
+#include "profiler.hpp"
 #include "vm.hpp"
 
 // marshal magic numbers
@@ -30,6 +35,19 @@
 #define MARSHAL_MAGIC_CLOSURE      ((u32)0x5908b2f8)
 #define MARSHAL_MAGIC_INSTANCE     ((u32)0xd89bf8b4)
 
+// size of the blocks the script compiler reads from streams
+#define LEXFEED_BUFFER_SIZE 4096
+
+// size of the blocks JSON is read and written in
+#define JSON_BUFFER_SIZE 4096
+
+// nesting limit, also stops stringifying tables that contain themselves
+#define JSON_MAX_DEPTH 512
+
+// script cache entry header
+#define SCRIPT_CACHE_MAGIC         ((u32)0x3ac1e5b7)
+#define SCRIPT_CACHE_VERSION       1
+
 
 namespace sphere {
     namespace script {
@@ -39,6 +57,8 @@ namespace sphere {
         static HSQUIRRELVM g_VM = 0;
         static std::string g_LastError;
         static std::vector<std::string> g_LoadedScripts;
+        static std::string g_ScriptCacheDirectory;
+        static int g_ScriptCacheSize = 0;
 
         //-----------------------------------------------------------------
         static char* get_scratch_pad(int& size)
@@ -150,46 +170,259 @@ namespace sphere {
         }
 
         //-----------------------------------------------------------------
+        // The lexer asks for one character at a time, the characters are
+        // read from the stream in blocks instead of one call per character.
+        struct LEXFEED {
+            IStream* stream;
+            int      remaining; // bytes left to read, -1 if unlimited
+            int      pos;
+            int      size;
+            char     buffer[LEXFEED_BUFFER_SIZE];
+        };
+
         static SQInteger lexfeed_callback(SQUserPointer p)
         {
-            char c;
-            IStream* stream = (IStream*)p;
-            if (stream->read(&c, sizeof(c)) == sizeof(c)) {
-                return c;
+            LEXFEED* lf = (LEXFEED*)p;
+            if (lf->pos == lf->size) {
+                int size = LEXFEED_BUFFER_SIZE;
+                if (lf->remaining >= 0 && lf->remaining < size) {
+                    size = lf->remaining;
+                }
+                lf->pos  = 0;
+                lf->size = (size > 0 ? lf->stream->read(lf->buffer, size) : 0);
+                if (lf->size <= 0) {
+                    lf->size = 0;
+                    return 0;
+                }
+                if (lf->remaining >= 0) {
+                    lf->remaining -= lf->size;
+                }
             }
-            return 0;
+            return lf->buffer[lf->pos++];
         }
 
         //-----------------------------------------------------------------
-        struct STREAMSOURCE {
-            IStream* stream;
-            int remaining;
+        bool CompileStream(IStream* stream, const std::string& scriptName, int count)
+        {
+            assert(stream);
+            if (stream) {
+                LEXFEED lf;
+                lf.stream    = stream;
+                lf.remaining = (count > 0 ? count : -1);
+                lf.pos       = 0;
+                lf.size      = 0;
+                return SQ_SUCCEEDED(sq_compile(g_VM, lexfeed_callback, &lf, scriptName.c_str(), SQTrue));
+            }
+            return false;
+        }
+
+        //-----------------------------------------------------------------
+        void SetScriptCache(const std::string& directory, int maxSize)
+        {
+            g_ScriptCacheDirectory = directory;
+            if (!g_ScriptCacheDirectory.empty() && g_ScriptCacheDirectory[g_ScriptCacheDirectory.size() - 1] == '/') {
+                g_ScriptCacheDirectory.erase(g_ScriptCacheDirectory.size() - 1);
+            }
+            g_ScriptCacheSize = maxSize;
+            if (!g_ScriptCacheDirectory.empty() && !io::filesystem::IsDirectory(g_ScriptCacheDirectory)) {
+                io::filesystem::CreateDirectory(g_ScriptCacheDirectory);
+            }
+        }
+
+        //-----------------------------------------------------------------
+        // FNV-1a
+        static u32 hash_bytes(const void* data, int size)
+        {
+            const u8* bytes = (const u8*)data;
+            u32 hash = 2166136261U;
+            for (int i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 16777619U;
+            }
+            return hash;
+        }
+
+        //-----------------------------------------------------------------
+        // Every script has one cache entry, named after the hash of its
+        // file name.
+        static std::string get_cache_filename(const std::string& filename)
+        {
+            std::ostringstream oss;
+            oss << g_ScriptCacheDirectory << "/";
+            oss << std::hex << std::setw(8) << std::setfill('0') << hash_bytes(filename.data(), filename.size());
+            oss << BYTECODE_FILE_EXT;
+            return oss.str();
+        }
+
+        //-----------------------------------------------------------------
+        // The entry header identifies the script and the source it was
+        // compiled from, any mismatch makes the entry stale.
+        struct SCRIPTCACHEKEY {
+            std::string filename;
+            i32 modTime;
+            i32 size;
+            u32 hash;
         };
 
-        static SQInteger lexfeed_callback_ex(SQUserPointer p)
+        static bool write_cache_key(IStream* stream, const SCRIPTCACHEKEY& key)
         {
-            char c;
-            STREAMSOURCE* ss = (STREAMSOURCE*)p;
-            if (ss->remaining > 0 && ss->stream->read(&c, sizeof(c)) == sizeof(c)) {
-                ss->remaining -= sizeof(c);
-                return c;
+            return writei32l(stream, (i32)SCRIPT_CACHE_MAGIC)   &&
+                   writei32l(stream, (i32)SCRIPT_CACHE_VERSION) &&
+                   writei32l(stream, (i32)key.filename.size())  &&
+                   stream->write(key.filename.data(), key.filename.size()) == (int)key.filename.size() &&
+                   writei32l(stream, key.modTime) &&
+                   writei32l(stream, key.size)    &&
+                   writei32l(stream, (i32)key.hash);
+        }
+
+        static bool check_cache_key(IStream* stream, const SCRIPTCACHEKEY& key)
+        {
+            i32 magic;
+            i32 version;
+            i32 length;
+            if (!readi32l(stream, magic)   || (u32)magic != SCRIPT_CACHE_MAGIC ||
+                !readi32l(stream, version) || version != SCRIPT_CACHE_VERSION  ||
+                !readi32l(stream, length)  || length != (i32)key.filename.size())
+            {
+                return false;
+            }
+            std::string filename(length, ' ');
+            if (length > 0 && stream->read(&filename[0], length) != length) {
+                return false;
             }
-            return 0;
+            i32 mod_time;
+            i32 size;
+            i32 hash;
+            return filename == key.filename &&
+                   readi32l(stream, mod_time) && mod_time == key.modTime &&
+                   readi32l(stream, size)     && size     == key.size    &&
+                   readi32l(stream, hash)     && (u32)hash == key.hash;
         }
 
         //-----------------------------------------------------------------
-        bool CompileStream(IStream* stream, const std::string& scriptName, int count)
+        // Pushes the cached closure if the cache has an entry that was
+        // compiled from the same source.
+        static bool load_cached_script(const SCRIPTCACHEKEY& key)
         {
-            assert(stream);
-            if (stream) {
-                if (count > 0) {
-                    STREAMSOURCE ss = {stream, count};
-                    return SQ_SUCCEEDED(sq_compile(g_VM, lexfeed_callback_ex, &ss, scriptName.c_str(), SQTrue));
-                } else {
-                    return SQ_SUCCEEDED(sq_compile(g_VM, lexfeed_callback, stream, scriptName.c_str(), SQTrue));
+            FilePtr file = io::filesystem::OpenFile(get_cache_filename(key.filename));
+            if (!file || !check_cache_key(file.get(), key)) {
+                return false;
+            }
+            int old_top = sq_gettop(g_VM);
+            if (!LoadObject(file.get()) || sq_gettype(g_VM, -1) != OT_CLOSURE) {
+                sq_settop(g_VM, old_top);
+                return false;
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        struct SCRIPTCACHEENTRY {
+            std::string filename;
+            int modTime;
+            int size;
+
+            bool operator<(const SCRIPTCACHEENTRY& rhs) const {
+                return modTime < rhs.modTime;
+            }
+        };
+
+        // Removes the entries written longest ago until the cache fits
+        // into its size.
+        static void trim_script_cache()
+        {
+            std::vector<std::string> file_list;
+            if (g_ScriptCacheSize <= 0 || !io::filesystem::EnumerateFiles(g_ScriptCacheDirectory, file_list)) {
+                return;
+            }
+
+            std::string ext = BYTECODE_FILE_EXT;
+            std::vector<SCRIPTCACHEENTRY> entries;
+            int total_size = 0;
+            for (int i = 0; i < (int)file_list.size(); ++i) {
+                const std::string& name = file_list[i];
+                if (name.size() <= ext.size() || name.compare(name.size() - ext.size(), ext.size(), ext) != 0) {
+                    continue;
+                }
+                SCRIPTCACHEENTRY entry;
+                entry.filename = g_ScriptCacheDirectory + "/" + name;
+                entry.modTime  = io::filesystem::GetFileModTime(entry.filename);
+                entry.size     = io::filesystem::GetFileSize(entry.filename);
+                if (entry.size > 0) {
+                    entries.push_back(entry);
+                    total_size += entry.size;
                 }
             }
-            return false;
+
+            std::sort(entries.begin(), entries.end());
+            for (int i = 0; i < (int)entries.size() && total_size > g_ScriptCacheSize; ++i) {
+                if (io::filesystem::RemoveFile(entries[i].filename)) {
+                    total_size -= entries[i].size;
+                }
+            }
+        }
+
+        //-----------------------------------------------------------------
+        // Writes the closure on top of the stack into the cache. The entry
+        // is written to a temporary file first, so a crash never leaves a
+        // truncated entry behind.
+        static void store_cached_script(const SCRIPTCACHEKEY& key)
+        {
+            std::string cache_filename = get_cache_filename(key.filename);
+            std::string temp_filename  = cache_filename + ".tmp";
+
+            FilePtr file = io::filesystem::OpenFile(temp_filename, IFile::FM_OUT);
+            if (!file) {
+                return;
+            }
+            bool succeeded = write_cache_key(file.get(), key) && DumpObject(-1, file.get());
+            file->close();
+            file = 0;
+
+            io::filesystem::RemoveFile(cache_filename);
+            if (!succeeded || !io::filesystem::RenameFile(temp_filename, cache_filename)) {
+                io::filesystem::RemoveFile(temp_filename);
+                return;
+            }
+
+            trim_script_cache();
+        }
+
+        //-----------------------------------------------------------------
+        bool CompileFile(const std::string& filename)
+        {
+            FilePtr file = io::filesystem::OpenFile(filename);
+            if (!file) {
+                return false;
+            }
+            if (g_ScriptCacheDirectory.empty()) {
+                return CompileStream(file.get(), file->getName());
+            }
+
+            // the source is needed for the hash anyway, so it is
+            // compiled from memory on a cache miss
+            int size = io::filesystem::GetFileSize(filename);
+            if (size <= 0) {
+                return CompileStream(file.get(), file->getName());
+            }
+            BlobPtr source = Blob::Create(size);
+            if (file->read(source->getBuffer(), size) != size) {
+                return false;
+            }
+
+            SCRIPTCACHEKEY key;
+            key.filename = filename;
+            key.modTime  = io::filesystem::GetFileModTime(filename);
+            key.size     = size;
+            key.hash     = hash_bytes(source->getBuffer(), size);
+
+            if (load_cached_script(key)) {
+                return true;
+            }
+            if (!CompileBuffer(source->getBuffer(), size, file->getName())) {
+                return false;
+            }
+            store_cached_script(key);
+            return true;
         }
 
         //-----------------------------------------------------------------
@@ -206,8 +439,7 @@ namespace sphere {
                         return false;
                     }
                 } else { // try compiling as plain text
-                    file->seek(0); // LoadObject changed the stream position, set it back to beginning
-                    if (!CompileStream(file.get(), file->getName())) {
+                    if (!CompileFile(filename)) {
                         sq_settop(g_VM, old_top); // restore stack top
                         return false;
                     }
@@ -228,150 +460,576 @@ namespace sphere {
         }
 
         //-----------------------------------------------------------------
-        bool JSONStringify(SQInteger idx)
+        // JSON output is collected in a buffer and written to the stream
+        // in blocks.
+        struct JSONWRITER {
+            IStream* stream;
+            int      size;
+            bool     failed;
+            char     buffer[JSON_BUFFER_SIZE];
+        };
+
+        static void json_flush(JSONWRITER& w)
         {
-            if (idx < 0) { // make any negative indices positive to reduce complexity
-                idx = (sq_gettop(g_VM) + 1) + idx;
+            if (w.size > 0 && !w.failed) {
+                w.failed = (w.stream->write(w.buffer, w.size) != w.size);
+            }
+            w.size = 0;
+        }
+
+        static void json_write(JSONWRITER& w, const char* s, int n)
+        {
+            if (w.size + n > JSON_BUFFER_SIZE) {
+                json_flush(w);
+                if (n > JSON_BUFFER_SIZE) {
+                    if (!w.failed) {
+                        w.failed = (w.stream->write(s, n) != n);
+                    }
+                    return;
+                }
+            }
+            memcpy(w.buffer + w.size, s, n);
+            w.size += n;
+        }
+
+        static inline void json_put(JSONWRITER& w, char c)
+        {
+            if (w.size == JSON_BUFFER_SIZE) {
+                json_flush(w);
+            }
+            w.buffer[w.size++] = c;
+        }
+
+        //-----------------------------------------------------------------
+        static void json_write_string(JSONWRITER& w, const SQChar* s, int length)
+        {
+            static const char hex[] = "0123456789abcdef";
+
+            json_put(w, '"');
+            int start = 0;
+            for (int i = 0; i < length; ++i) {
+                unsigned char c = (unsigned char)s[i];
+                if (c >= 0x20 && c != '"' && c != '\\') {
+                    continue;
+                }
+                json_write(w, s + start, i - start);
+                start = i + 1;
+                json_put(w, '\\');
+                switch (c) {
+                case '"':  json_put(w, '"');  break;
+                case '\\': json_put(w, '\\'); break;
+                case '\b': json_put(w, 'b');  break;
+                case '\f': json_put(w, 'f');  break;
+                case '\n': json_put(w, 'n');  break;
+                case '\r': json_put(w, 'r');  break;
+                case '\t': json_put(w, 't');  break;
+                default: {
+                    char esc[5] = {'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                    json_write(w, esc, 5);
+                }
+                }
+            }
+            json_write(w, s + start, length - start);
+            json_put(w, '"');
+        }
+
+        //-----------------------------------------------------------------
+        // Writes the shortest of the usual precisions that reads back as
+        // the same number, with a decimal point so it stays a float.
+        static void json_write_float(JSONWRITER& w, SQFloat f)
+        {
+            if (f != f || f - f != f - f) { // not a number or infinite
+                json_write(w, "null", 4);
+                return;
+            }
+            bool single = (sizeof(SQFloat) == sizeof(float));
+            char buf[40];
+            int n = sprintf(buf, "%.*g", (single ? 6 : 15), (double)f);
+            if ((SQFloat)strtod(buf, 0) != f) {
+                n = sprintf(buf, "%.*g", (single ? 9 : 17), (double)f);
+            }
+            if (!strpbrk(buf, ".e")) {
+                buf[n++] = '.';
+                buf[n++] = '0';
+            }
+            json_write(w, buf, n);
+        }
+
+        //-----------------------------------------------------------------
+        static bool json_write_value(JSONWRITER& w, SQInteger idx, int depth)
+        {
+            if (depth > JSON_MAX_DEPTH) {
+                return false;
             }
             switch (sq_gettype(g_VM, idx)) {
             case OT_NULL: {
-                sq_pushstring(g_VM, "null", -1);
+                json_write(w, "null", 4);
                 return true;
             }
             case OT_BOOL: {
                 SQBool b;
                 sq_getbool(g_VM, idx, &b);
-                sq_pushstring(g_VM, ((b == SQTrue) ? "true" : "false"), -1);
+                if (b == SQTrue) {
+                    json_write(w, "true", 4);
+                } else {
+                    json_write(w, "false", 5);
+                }
                 return true;
             }
             case OT_INTEGER: {
                 SQInteger i;
                 sq_getinteger(g_VM, idx, &i);
-                std::ostringstream oss;
-                oss << i;
-                sq_pushstring(g_VM, oss.str().c_str(), -1);
+                char buf[24];
+        #ifdef _SQ64
+                int n = sprintf(buf, "%lld", (long long)i);
+        #else
+                int n = sprintf(buf, "%d", (int)i);
+        #endif
+                json_write(w, buf, n);
                 return true;
             }
             case OT_FLOAT: {
                 SQFloat f;
                 sq_getfloat(g_VM, idx, &f);
-                std::ostringstream oss;
-                oss << f;
-                sq_pushstring(g_VM, oss.str().c_str(), -1);
+                json_write_float(w, f);
                 return true;
             }
             case OT_STRING: {
                 const SQChar* s = 0;
                 sq_getstring(g_VM, idx, &s);
-                std::ostringstream oss;
-                oss << "\"" << s << "\"";
-                sq_pushstring(g_VM, oss.str().c_str(), -1);
+                json_write_string(w, s, sq_getsize(g_VM, idx));
                 return true;
             }
-            case OT_TABLE: {
-                const SQChar* temp = 0;
+            case OT_TABLE:
+            case OT_ARRAY: {
+                bool is_table = (sq_gettype(g_VM, idx) == OT_TABLE);
                 int oldtop = sq_gettop(g_VM);
-                std::ostringstream oss;
-                oss << "{";
+                json_put(w, (is_table ? '{' : '['));
                 sq_pushnull(g_VM); // will be substituted with an iterator by squirrel
                 bool appendcomma = false;
                 while (SQ_SUCCEEDED(sq_next(g_VM, idx))) {
                     if (appendcomma) {
-                        oss << ",";
+                        json_put(w, ',');
                     } else {
                         appendcomma = true;
                     }
                     int top = sq_gettop(g_VM);
-                    if (sq_gettype(g_VM, top-1) != OT_STRING) { // key must be a string
-                        sq_settop(g_VM, oldtop);
-                        return false;
-                    }
-                    sq_getstring(g_VM, top-1, &temp);
-                    oss << "\"" << temp << "\":";
-                    if (sq_gettype(g_VM, top) == OT_STRING) {
-                        sq_getstring(g_VM, top, &temp);
-                        oss << "\"" << temp << "\"";
-                    } else {
-                        if (!JSONStringify(top)) { // stringify value
+                    if (is_table) {
+                        if (sq_gettype(g_VM, top-1) != OT_STRING) { // key must be a string
                             sq_settop(g_VM, oldtop);
                             return false;
                         }
-                        sq_getstring(g_VM, top+1, &temp);
-                        oss << temp;
-                        sq_poptop(g_VM); // pop json value
+                        const SQChar* key = 0;
+                        sq_getstring(g_VM, top-1, &key);
+                        json_write_string(w, key, sq_getsize(g_VM, top-1));
+                        json_put(w, ':');
+                    }
+                    if (!json_write_value(w, top, depth + 1)) {
+                        sq_settop(g_VM, oldtop);
+                        return false;
                     }
                     sq_pop(g_VM, 2); // pop key, value
                 }
                 sq_poptop(g_VM); // pop iterator
-                oss << "}";
-                sq_pushstring(g_VM, oss.str().c_str(), -1);
+                json_put(w, (is_table ? '}' : ']'));
                 return true;
             }
-            case OT_ARRAY: {
-                const SQChar* temp = 0;
-                int oldtop = sq_gettop(g_VM);
-                std::ostringstream oss;
-                oss << "[";
-                sq_pushnull(g_VM); // will be substituted with an iterator by squirrel
-                bool appendcomma = false;
-                while (SQ_SUCCEEDED(sq_next(g_VM, idx))) {
-                    if (appendcomma) {
-                        oss << ",";
-                    } else {
-                        appendcomma = true;
+            default:
+                return false;
+            }
+        }
+
+        //-----------------------------------------------------------------
+        bool JSONStringify(SQInteger idx, IStream* stream)
+        {
+            assert(stream);
+            if (!stream || !stream->isWriteable()) {
+                return false;
+            }
+            if (idx < 0) { // make any negative indices positive to reduce complexity
+                idx = (sq_gettop(g_VM) + 1) + idx;
+            }
+            JSONWRITER w;
+            w.stream = stream;
+            w.size   = 0;
+            w.failed = false;
+            if (!json_write_value(w, idx, 0)) {
+                return false;
+            }
+            json_flush(w);
+            return !w.failed;
+        }
+
+        //-----------------------------------------------------------------
+        bool JSONStringify(SQInteger idx)
+        {
+            if (idx < 0) { // make any negative indices positive to reduce complexity
+                idx = (sq_gettop(g_VM) + 1) + idx;
+            }
+            BlobPtr blob = Blob::Create();
+            if (!JSONStringify(idx, blob.get())) {
+                return false;
+            }
+            sq_pushstring(g_VM, (const SQChar*)blob->getBuffer(), blob->getSize());
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        // JSON input is read in one pass, from memory or from a stream in
+        // blocks. The values are pushed as they are read.
+        struct JSONREADER {
+            IStream*    stream;     // 0 if reading from memory
+            const char* start;      // of the current block
+            const char* pos;
+            const char* end;
+            int         offset;     // of the current block in the input
+            std::string string;     // the last string read
+            char        buffer[JSON_BUFFER_SIZE];
+        };
+
+        static bool json_fill(JSONREADER& r)
+        {
+            if (!r.stream) {
+                return false;
+            }
+            int n = r.stream->read(r.buffer, JSON_BUFFER_SIZE);
+            if (n <= 0) {
+                return false;
+            }
+            r.offset += (int)(r.end - r.start);
+            r.start = r.buffer;
+            r.pos   = r.buffer;
+            r.end   = r.buffer + n;
+            return true;
+        }
+
+        // returns -1 at the end of the input
+        static inline int json_peek(JSONREADER& r)
+        {
+            if (r.pos == r.end && !json_fill(r)) {
+                return -1;
+            }
+            return (unsigned char)*r.pos;
+        }
+
+        static inline int json_get(JSONREADER& r)
+        {
+            int c = json_peek(r);
+            if (c != -1) {
+                r.pos++;
+            }
+            return c;
+        }
+
+        static int json_skip_whitespace(JSONREADER& r)
+        {
+            int c = json_peek(r);
+            while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                r.pos++;
+                c = json_peek(r);
+            }
+            return c;
+        }
+
+        static bool json_expect(JSONREADER& r, const char* literal)
+        {
+            for (; *literal; ++literal) {
+                if (json_get(r) != (unsigned char)*literal) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        static bool json_read_hex4(JSONREADER& r, unsigned int& u)
+        {
+            u = 0;
+            for (int i = 0; i < 4; ++i) {
+                int c = json_get(r);
+                if (c >= '0' && c <= '9') {
+                    u = (u << 4) | (c - '0');
+                } else if (c >= 'a' && c <= 'f') {
+                    u = (u << 4) | (c - 'a' + 10);
+                } else if (c >= 'A' && c <= 'F') {
+                    u = (u << 4) | (c - 'A' + 10);
+                } else {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        static void json_append_utf8(std::string& s, unsigned int cp)
+        {
+            if (cp < 0x80) {
+                s += (char)cp;
+            } else if (cp < 0x800) {
+                s += (char)(0xC0 | (cp >> 6));
+                s += (char)(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                s += (char)(0xE0 | (cp >> 12));
+                s += (char)(0x80 | ((cp >> 6) & 0x3F));
+                s += (char)(0x80 | (cp & 0x3F));
+            } else {
+                s += (char)(0xF0 | (cp >> 18));
+                s += (char)(0x80 | ((cp >> 12) & 0x3F));
+                s += (char)(0x80 | ((cp >> 6) & 0x3F));
+                s += (char)(0x80 | (cp & 0x3F));
+            }
+        }
+
+        //-----------------------------------------------------------------
+        // Reads a string after its opening quote into r.string.
+        static bool json_read_string(JSONREADER& r)
+        {
+            r.string.clear();
+            for (;;) {
+                // copy runs of plain characters at once
+                const char* run = r.pos;
+                while (r.pos < r.end && *r.pos != '"' && *r.pos != '\\' && (unsigned char)*r.pos >= 0x20) {
+                    r.pos++;
+                }
+                r.string.append(run, r.pos - run);
+
+                int c = json_get(r);
+                if (c == '"') {
+                    return true;
+                }
+                if (c < 0x20) { // end of input or control character
+                    return false;
+                }
+                if (c != '\\') {
+                    r.string += (char)c;
+                    continue;
+                }
+                switch (json_get(r)) {
+                case '"':  r.string += '"';  break;
+                case '\\': r.string += '\\'; break;
+                case '/':  r.string += '/';  break;
+                case 'b':  r.string += '\b'; break;
+                case 'f':  r.string += '\f'; break;
+                case 'n':  r.string += '\n'; break;
+                case 'r':  r.string += '\r'; break;
+                case 't':  r.string += '\t'; break;
+                case 'u': {
+                    unsigned int cp;
+                    if (!json_read_hex4(r, cp)) {
+                        return false;
                     }
-                    if (sq_gettype(g_VM, idx+3) == OT_STRING) {
-                        sq_getstring(g_VM, idx+3, &temp);
-                        oss << "\"" << temp << "\"";
-                    } else {
-                        if (!JSONStringify(idx+3)) { // stringify value
-                            sq_settop(g_VM, oldtop);
+                    if (cp >= 0xD800 && cp < 0xDC00) { // high surrogate, the low one follows
+                        unsigned int low;
+                        if (json_get(r) != '\\' || json_get(r) != 'u' || !json_read_hex4(r, low) || low < 0xDC00 || low > 0xDFFF) {
                             return false;
                         }
-                        sq_getstring(g_VM, idx+4, &temp);
-                        oss << temp;
-                        sq_poptop(g_VM); // pop json value
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
                     }
-                    sq_pop(g_VM, 2); // pop key, value
+                    json_append_utf8(r.string, cp);
+                    break;
+                }
+                default:
+                    return false;
                 }
-                sq_poptop(g_VM); // pop iterator
-                oss << "]";
-                sq_pushstring(g_VM, oss.str().c_str(), -1);
-                return true;
-            }
-            default:
-                return false;
             }
         }
 
         //-----------------------------------------------------------------
-        bool JSONParse(const char* jsonstr)
+        // Numbers without fraction and exponent become integers if they
+        // fit, all others floats.
+        static bool json_read_number(JSONREADER& r)
         {
-            assert(jsonstr);
+            char buf[64];
+            int n = 0;
+            bool is_float = false;
+            int c = json_peek(r);
+            while ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                if (n == sizeof(buf) - 1) {
+                    return false;
+                }
+                if (c == '.' || c == 'e' || c == 'E') {
+                    is_float = true;
+                }
+                buf[n++] = (char)c;
+                r.pos++;
+                c = json_peek(r);
+            }
+            buf[n] = 0;
 
-            int oldtop = sq_gettop(g_VM);
+            char* end = 0;
+            double d = strtod(buf, &end);
+            if (n == 0 || end != buf + n) {
+                return false;
+            }
+
+        #ifdef _SQ64
+            bool fits = (d > -9.2e18 && d < 9.2e18);
+        #else
+            bool fits = (d >= -2147483648.0 && d <= 2147483647.0);
+        #endif
+            if (is_float || !fits) {
+                sq_pushfloat(g_VM, (SQFloat)d);
+                return true;
+            }
+
+            // convert the digits, a double can't hold every 64 bit integer
+            const char* p = buf;
+            bool negative = (*p == '-');
+            if (*p == '-' || *p == '+') {
+                p++;
+            }
+            SQInteger i = 0;
+            for (; *p; ++p) {
+                i = i * 10 + (*p - '0');
+            }
+            sq_pushinteger(g_VM, (negative ? -i : i));
+            return true;
+        }
 
-            // compile string
-            std::string src = std::string("return ") + jsonstr;
-            if (!CompileBuffer(src.c_str(), src.length())) {
+        //-----------------------------------------------------------------
+        static bool json_read_value(JSONREADER& r, int depth)
+        {
+            if (depth > JSON_MAX_DEPTH) {
                 return false;
             }
+            int c = json_skip_whitespace(r);
+            switch (c) {
+            case '{': {
+                r.pos++;
+                sq_newtable(g_VM);
+                c = json_skip_whitespace(r);
+                if (c == '}') {
+                    r.pos++;
+                    return true;
+                }
+                for (;;) {
+                    if (json_get(r) != '"' || !json_read_string(r)) {
+                        return false;
+                    }
+                    sq_pushstring(g_VM, r.string.data(), r.string.size());
+                    if (json_skip_whitespace(r) != ':') {
+                        return false;
+                    }
+                    r.pos++;
+                    if (!json_read_value(r, depth + 1)) {
+                        return false;
+                    }
+                    sq_newslot(g_VM, -3, SQFalse);
+                    c = json_skip_whitespace(r);
+                    if (c == '}') {
+                        r.pos++;
+                        return true;
+                    }
+                    if (c != ',') {
+                        return false;
+                    }
+                    r.pos++;
+                    json_skip_whitespace(r);
+                }
+            }
+            case '[': {
+                r.pos++;
+                sq_newarray(g_VM, 0);
+                c = json_skip_whitespace(r);
+                if (c == ']') {
+                    r.pos++;
+                    return true;
+                }
+                for (;;) {
+                    if (!json_read_value(r, depth + 1)) {
+                        return false;
+                    }
+                    sq_arrayappend(g_VM, -2);
+                    c = json_skip_whitespace(r);
+                    if (c == ']') {
+                        r.pos++;
+                        return true;
+                    }
+                    if (c != ',') {
+                        return false;
+                    }
+                    r.pos++;
+                }
+            }
+            case '"': {
+                r.pos++;
+                if (!json_read_string(r)) {
+                    return false;
+                }
+                sq_pushstring(g_VM, r.string.data(), r.string.size());
+                return true;
+            }
+            case 't': {
+                if (!json_expect(r, "true")) {
+                    return false;
+                }
+                sq_pushbool(g_VM, SQTrue);
+                return true;
+            }
+            case 'f': {
+                if (!json_expect(r, "false")) {
+                    return false;
+                }
+                sq_pushbool(g_VM, SQFalse);
+                return true;
+            }
+            case 'n': {
+                if (!json_expect(r, "null")) {
+                    return false;
+                }
+                sq_pushnull(g_VM);
+                return true;
+            }
+            default:
+                if (c == '-' || (c >= '0' && c <= '9')) {
+                    return json_read_number(r);
+                }
+                return false;
+            }
+        }
 
-            // execute closure
-            sq_pushroottable(g_VM); // this
-            if (!SQ_SUCCEEDED(sq_call(g_VM, 1, SQTrue, SQTrue))) {
+        //-----------------------------------------------------------------
+        // Pushes the value, the input must not contain anything else.
+        static bool json_parse(JSONREADER& r)
+        {
+            int oldtop = sq_gettop(g_VM);
+            if (!json_read_value(r, 0) || json_skip_whitespace(r) != -1) {
+                std::ostringstream oss;
+                oss << "Invalid JSON at offset " << (r.offset + (int)(r.pos - r.start));
+                g_LastError = oss.str();
                 sq_settop(g_VM, oldtop);
                 return false;
             }
+            return true;
+        }
 
-            // the object is now on top of the stack
-            int numtopop = (sq_gettop(g_VM) - oldtop) - 1;
-            while (numtopop > 0) {
-                sq_remove(g_VM, -2);
-                numtopop--;
-            }
+        //-----------------------------------------------------------------
+        bool JSONParse(const char* jsonstr)
+        {
+            assert(jsonstr);
+            JSONREADER r;
+            r.stream = 0;
+            r.start  = jsonstr;
+            r.pos    = jsonstr;
+            r.end    = jsonstr + strlen(jsonstr);
+            r.offset = 0;
+            return json_parse(r);
+        }
 
-            return true;
+        //-----------------------------------------------------------------
+        bool JSONParse(IStream* stream)
+        {
+            assert(stream);
+            if (!stream || !stream->isReadable()) {
+                return false;
+            }
+            JSONREADER r;
+            r.stream = stream;
+            r.start  = r.buffer;
+            r.pos    = r.buffer;
+            r.end    = r.buffer;
+            r.offset = 0;
+            return json_parse(r);
         }
 
         //-----------------------------------------------------------------
@@ -898,9 +1556,17 @@ namespace sphere {
             }
 
             //-----------------------------------------------------------------
-            // JSONStringify(object)
+            // JSONStringify(object [, stream])
             static SQInteger _script_JSONStringify(HSQUIRRELVM v)
             {
+                CHECK_MIN_NARGS(1)
+                GET_OPTARG_STREAM(2, stream)
+                if (stream) {
+                    if (!JSONStringify(2, stream)) {
+                        THROW_ERROR("Could not stringify object")
+                    }
+                    RET_VOID()
+                }
                 if (!JSONStringify(2)) {
                     THROW_ERROR("Could not stringify object")
                 }
@@ -909,15 +1575,26 @@ namespace sphere {
 
             //-----------------------------------------------------------------
             // JSONParse(jsonstr)
+            // JSONParse(stream)
             static SQInteger _script_JSONParse(HSQUIRRELVM v)
             {
                 CHECK_NARGS(1)
-                GET_ARG_STRING(1, jsonstr)
-                if (sq_getsize(v, 2) == 0) {
-                    THROW_ERROR("Empty JSON string")
-                }
-                if (!JSONParse(jsonstr)) {
-                    THROW_ERROR("Could not parse JSON string")
+                if (ARG_IS_STRING(1)) {
+                    GET_ARG_STRING(1, jsonstr)
+                    if (sq_getsize(v, 2) == 0) {
+                        THROW_ERROR("Empty JSON string")
+                    }
+                    if (!JSONParse(jsonstr)) {
+                        THROW_ERROR1("Could not parse JSON string: %s", g_LastError.c_str())
+                    }
+                } else {
+                    GET_ARG_STREAM(1, stream)
+                    if (!stream->isOpen() || !stream->isReadable()) {
+                        THROW_ERROR("Invalid input stream")
+                    }
+                    if (!JSONParse(stream)) {
+                        THROW_ERROR1("Could not parse JSON stream: %s", g_LastError.c_str())
+                    }
                 }
                 return 1;
             }
@@ -952,6 +1629,97 @@ namespace sphere {
                 return 1;
             }
 
+            //-----------------------------------------------------------------
+            // StartProfiler([mode [, interval]])
+            static SQInteger _script_StartProfiler(HSQUIRRELVM v)
+            {
+                GET_OPTARG_INT(1, mode, PROFILER_SAMPLING)
+                GET_OPTARG_INT(2, interval, 1000)
+                if (mode != PROFILER_CALLS && mode != PROFILER_SAMPLING) {
+                    THROW_ERROR("Invalid profiler mode")
+                }
+                if (interval <= 0) {
+                    THROW_ERROR("Invalid sampling interval")
+                }
+                if (IsProfilerRunning()) {
+                    THROW_ERROR("Profiler is already running")
+                }
+                if (!StartProfiler(mode, interval)) {
+                    THROW_ERROR("Could not start profiler")
+                }
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // StopProfiler([stream])
+            static SQInteger _script_StopProfiler(HSQUIRRELVM v)
+            {
+                GET_OPTARG_STREAM(1, stream)
+                StopProfiler();
+                if (stream) {
+                    if (!stream->isOpen() || !stream->isWriteable()) {
+                        THROW_ERROR("Invalid stream")
+                    }
+                    if (!WriteProfilerStacks(stream)) {
+                        THROW_ERROR("Could not write profiler stacks")
+                    }
+                }
+                RET_VOID()
+            }
+
+            //-----------------------------------------------------------------
+            // GetProfilerResults()
+            static SQInteger _script_GetProfilerResults(HSQUIRRELVM v)
+            {
+                const std::vector<ProfilerFunction>& functions = GetProfilerFunctions();
+                sq_newarray(v, functions.size());
+                for (int i = 0; i < (int)functions.size(); i++) {
+                    const ProfilerFunction& function = functions[i];
+                    sq_pushinteger(v, i);
+                    sq_newtable(v);
+
+                    sq_pushstring(v, "name", -1);
+                    sq_pushstring(v, function.name.c_str(), -1);
+                    sq_newslot(v, -3, SQFalse);
+
+                    sq_pushstring(v, "source", -1);
+                    sq_pushstring(v, function.source.c_str(), -1);
+                    sq_newslot(v, -3, SQFalse);
+
+                    sq_pushstring(v, "line", -1);
+                    sq_pushinteger(v, function.line);
+                    sq_newslot(v, -3, SQFalse);
+
+                    sq_pushstring(v, "native", -1);
+                    sq_pushbool(v, (function.native ? SQTrue : SQFalse));
+                    sq_newslot(v, -3, SQFalse);
+
+                    sq_pushstring(v, "calls", -1);
+                    sq_pushinteger(v, function.calls);
+                    sq_newslot(v, -3, SQFalse);
+
+                    sq_pushstring(v, "samples", -1);
+                    sq_pushinteger(v, function.samples);
+                    sq_newslot(v, -3, SQFalse);
+
+                    // times in milliseconds
+                    sq_pushstring(v, "inclusiveTime", -1);
+                    sq_pushfloat(v, (SQFloat)(function.inclusiveTime / 1000.0));
+                    sq_newslot(v, -3, SQFalse);
+
+                    sq_pushstring(v, "exclusiveTime", -1);
+                    sq_pushfloat(v, (SQFloat)(function.exclusiveTime / 1000.0));
+                    sq_newslot(v, -3, SQFalse);
+
+                    sq_pushstring(v, "nativeTime", -1);
+                    sq_pushfloat(v, (SQFloat)(function.nativeTime / 1000.0));
+                    sq_newslot(v, -3, SQFalse);
+
+                    sq_rawset(v, -3);
+                }
+                return 1;
+            }
+
             //-----------------------------------------------------------------
             static util::Function _script_functions[] = {
                 {"Assert",                  "Assert",               _script_Assert               },
@@ -966,6 +1734,16 @@ namespace sphere {
                 {"JSONParse",               "JSONParse",            _script_JSONParse            },
                 {"DumpObject",              "DumpObject",           _script_DumpObject           },
                 {"LoadObject",              "LoadObject",           _script_LoadObject           },
+                {"StartProfiler",           "StartProfiler",        _script_StartProfiler        },
+                {"StopProfiler",            "StopProfiler",         _script_StopProfiler         },
+                {"GetProfilerResults",      "GetProfilerResults",   _script_GetProfilerResults   },
+                {0,0}
+            };
+
+            //-----------------------------------------------------------------
+            static util::Constant _script_constants[] = {
+                {"PROFILER_CALLS",      PROFILER_CALLS      },
+                {"PROFILER_SAMPLING",   PROFILER_SAMPLING   },
                 {0,0}
             };
 
@@ -1068,6 +1846,7 @@ namespace sphere {
                 // register script functions
                 sq_pushroottable(g_VM);
                 util::RegisterFunctions(g_VM, _script_functions);
+                util::RegisterConstants(g_VM, _script_constants);
                 sq_poptop(g_VM); // pop root table
 
                 // register libs
@@ -1087,6 +1866,7 @@ namespace sphere {
             void DeinitVM()
             {
                 if (g_VM) {
+                    StopProfiler();
                     sq_close(g_VM);
                     g_VM = 0;
                 }
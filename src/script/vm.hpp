@@ -19,13 +19,23 @@ namespace sphere {
         HSQUIRRELVM GetVM();
         bool        CompileBuffer(const void* buffer, int size, const std::string& scriptName = "unknown");
         bool        CompileStream(IStream* stream, const std::string& scriptName = "unknown", int count = -1);
+        bool        CompileFile(const std::string& filename);
         bool        EvaluateScript(const std::string& filename);
         bool        JSONStringify(SQInteger idx);
+        bool        JSONStringify(SQInteger idx, IStream* stream);
         bool        JSONParse(const char* jsonstr);
+        bool        JSONParse(IStream* stream);
         bool        DumpObject(SQInteger idx, IStream* stream);
         bool        LoadObject(IStream* stream);
         SQRESULT    ThrowError(const char* format, ...);
 
+        // Scripts compiled by CompileFile are cached as bytecode in
+        // directory, keyed by the file name, modification time and a hash
+        // of the source, so unchanged scripts are not compiled again.
+        // The oldest entries are removed when the cache grows beyond
+        // maxSize bytes. An empty directory disables the cache.
+        void        SetScriptCache(const std::string& directory, int maxSize);
+
         namespace internal {
 
             bool InitVM(const Log& log);
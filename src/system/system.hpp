@@ -1,6 +1,7 @@
 #ifndef SPHERE_SYSTEM_HPP
 #define SPHERE_SYSTEM_HPP
 
+#include "../common/types.hpp"
 #include "../Log.hpp"
 
 
@@ -9,6 +10,22 @@ namespace sphere {
 
         // thread
         void Sleep(int ms);
+        int  GetNumProcessors();
+
+        // Calls func(data, i) for every i in [0, count) and returns when
+        // all calls have finished. The calls are distributed among the
+        // worker threads and the calling thread, so func must not depend
+        // on the order of execution. Nested calls and calls made before
+        // the system is initialized run serially on the calling thread.
+        typedef void (*PARALLELFUNC_T)(void* data, int index);
+        void RunParallel(PARALLELFUNC_T func, void* data, int count);
+
+        // Sets *flag to 1 on a timer thread every interval microseconds
+        // until StopTicker is called, the caller resets it. Only one
+        // ticker can run at a time. Intervals below the resolution of
+        // the system timer are rounded up to it.
+        bool StartTicker(int interval, volatile int* flag);
+        void StopTicker();
 
         // time
         struct TimeInfo {
@@ -23,6 +40,7 @@ namespace sphere {
         };
 
         int GetTicks();
+        i64 GetMicroseconds(); // monotonic, for measuring short intervals
         int GetTime();
         TimeInfo GetTimeInfo(int rawtime, bool utc = false);
 
@@ -2,8 +2,12 @@
 #include <ctime>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <algorithm>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/time.h>
+#include <time.h>
 #include "../../version.hpp"
 #include "../system.hpp"
 
@@ -14,6 +18,32 @@
 //-----------------------------------------------------------------
 // globals
 static unsigned int g_TicksAtSystemInit = 0;
+static sphere::i64 g_MicrosecondsAtSystemInit = 0;
+
+// worker pool used by RunParallel
+static std::vector<pthread_t> g_Workers;
+static pthread_mutex_t g_PoolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_WorkCond  = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  g_DoneCond  = PTHREAD_COND_INITIALIZER;
+static volatile int g_PoolBusy    = 0;
+static bool         g_PoolQuit    = false;
+static int          g_WorkPending = 0;
+
+// current job
+static sphere::system::PARALLELFUNC_T g_JobFunc = 0;
+static void*        g_JobData   = 0;
+static int          g_JobCount  = 0;
+static volatile int g_JobNext   = 0;
+static int          g_JobActive = 0;
+
+// ticker
+static pthread_t       g_Ticker;
+static pthread_mutex_t g_TickerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_TickerCond  = PTHREAD_COND_INITIALIZER;
+static bool            g_TickerRunning  = false;
+static bool            g_TickerQuit     = false;
+static int             g_TickerInterval = 0;
+static volatile int*   g_TickerFlag     = 0;
 
 namespace sphere {
     namespace system {
@@ -24,6 +54,141 @@ namespace sphere {
             usleep(ms * 1000);
         }
 
+        //-----------------------------------------------------------------
+        int GetNumProcessors()
+        {
+            long n = sysconf(_SC_NPROCESSORS_ONLN);
+            return (n > 0 ? (int)n : 1);
+        }
+
+        //-----------------------------------------------------------------
+        static void run_job()
+        {
+            int index;
+            while ((index = __sync_fetch_and_add(&g_JobNext, 1)) < g_JobCount) {
+                g_JobFunc(g_JobData, index);
+            }
+            // the last participant to run out of work wakes up the caller
+            pthread_mutex_lock(&g_PoolMutex);
+            if (--g_JobActive == 0) {
+                pthread_cond_signal(&g_DoneCond);
+            }
+            pthread_mutex_unlock(&g_PoolMutex);
+        }
+
+        //-----------------------------------------------------------------
+        static void* worker_thread(void*)
+        {
+            while (true) {
+                pthread_mutex_lock(&g_PoolMutex);
+                while (!g_PoolQuit && g_WorkPending == 0) {
+                    pthread_cond_wait(&g_WorkCond, &g_PoolMutex);
+                }
+                if (g_PoolQuit) {
+                    pthread_mutex_unlock(&g_PoolMutex);
+                    break;
+                }
+                g_WorkPending--;
+                pthread_mutex_unlock(&g_PoolMutex);
+                run_job();
+            }
+            return 0;
+        }
+
+        //-----------------------------------------------------------------
+        void RunParallel(PARALLELFUNC_T func, void* data, int count)
+        {
+            assert(func);
+            if (count <= 0) {
+                return;
+            }
+            if (count == 1 || g_Workers.empty() || !__sync_bool_compare_and_swap(&g_PoolBusy, 0, 1)) {
+                for (int i = 0; i < count; ++i) {
+                    func(data, i);
+                }
+                return;
+            }
+
+            // wake up only as many workers as there is work for, every
+            // woken worker must check out before the next job can start
+            int num_helpers = std::min((int)g_Workers.size(), count - 1);
+            pthread_mutex_lock(&g_PoolMutex);
+            g_JobFunc     = func;
+            g_JobData     = data;
+            g_JobCount    = count;
+            g_JobNext     = 0;
+            g_JobActive   = num_helpers + 1;
+            g_WorkPending = num_helpers;
+            pthread_cond_broadcast(&g_WorkCond);
+            pthread_mutex_unlock(&g_PoolMutex);
+
+            run_job();
+
+            pthread_mutex_lock(&g_PoolMutex);
+            while (g_JobActive > 0) {
+                pthread_cond_wait(&g_DoneCond, &g_PoolMutex);
+            }
+            pthread_mutex_unlock(&g_PoolMutex);
+
+            __sync_lock_release(&g_PoolBusy);
+        }
+
+        //-----------------------------------------------------------------
+        static void* ticker_thread(void*)
+        {
+            // the condition variable uses the realtime clock
+            timeval tv;
+            gettimeofday(&tv, 0);
+            timespec next;
+            next.tv_sec  = tv.tv_sec;
+            next.tv_nsec = tv.tv_usec * 1000;
+
+            pthread_mutex_lock(&g_TickerMutex);
+            while (!g_TickerQuit) {
+                next.tv_nsec += (long)(g_TickerInterval % 1000000) * 1000;
+                next.tv_sec  += g_TickerInterval / 1000000 + next.tv_nsec / 1000000000;
+                next.tv_nsec %= 1000000000;
+                while (!g_TickerQuit && pthread_cond_timedwait(&g_TickerCond, &g_TickerMutex, &next) == 0) {
+                }
+                if (!g_TickerQuit) {
+                    *g_TickerFlag = 1;
+                }
+            }
+            pthread_mutex_unlock(&g_TickerMutex);
+            return 0;
+        }
+
+        //-----------------------------------------------------------------
+        bool StartTicker(int interval, volatile int* flag)
+        {
+            assert(flag);
+            if (g_TickerRunning || interval <= 0) {
+                return false;
+            }
+            g_TickerQuit     = false;
+            g_TickerInterval = interval;
+            g_TickerFlag     = flag;
+            if (pthread_create(&g_Ticker, 0, ticker_thread, 0) != 0) {
+                return false;
+            }
+            g_TickerRunning = true;
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        void StopTicker()
+        {
+            if (!g_TickerRunning) {
+                return;
+            }
+            pthread_mutex_lock(&g_TickerMutex);
+            g_TickerQuit = true;
+            pthread_cond_signal(&g_TickerCond);
+            pthread_mutex_unlock(&g_TickerMutex);
+            pthread_join(g_Ticker, 0);
+            g_TickerRunning = false;
+        }
+
         //-----------------------------------------------------------------
         int GetTicks()
         {
@@ -34,6 +199,22 @@ namespace sphere {
             return (int)(((tv.tv_sec * 1000) + (tv.tv_usec / 1000)) - g_TicksAtSystemInit);
         }
 
+        //-----------------------------------------------------------------
+        static i64 get_monotonic_microseconds()
+        {
+            timespec ts;
+            if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+                return 0;
+            }
+            return (i64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        }
+
+        //-----------------------------------------------------------------
+        i64 GetMicroseconds()
+        {
+            return get_monotonic_microseconds() - g_MicrosecondsAtSystemInit;
+        }
+
         //-----------------------------------------------------------------
         int GetTime()
         {
@@ -73,6 +254,18 @@ namespace sphere {
                     return 0;
                 }
                 g_TicksAtSystemInit = (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+                g_MicrosecondsAtSystemInit = get_monotonic_microseconds();
+
+                // start worker pool, the calling thread is a worker too
+                int num_workers = GetNumProcessors() - 1;
+                for (int i = 0; i < num_workers; ++i) {
+                    pthread_t worker;
+                    if (pthread_create(&worker, 0, worker_thread, 0) != 0) {
+                        break;
+                    }
+                    g_Workers.push_back(worker);
+                }
+                log.info() << "Worker threads: " << (int)g_Workers.size();
 
                 return true;
             }
@@ -80,6 +273,17 @@ namespace sphere {
             //-----------------------------------------------------------------
             void DeinitSystem()
             {
+                StopTicker();
+
+                // stop worker pool
+                pthread_mutex_lock(&g_PoolMutex);
+                g_PoolQuit = true;
+                pthread_cond_broadcast(&g_WorkCond);
+                pthread_mutex_unlock(&g_PoolMutex);
+                for (int i = 0; i < (int)g_Workers.size(); ++i) {
+                    pthread_join(g_Workers[i], 0);
+                }
+                g_Workers.clear();
             }
 
         } // namespace internal
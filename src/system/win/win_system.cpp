@@ -1,6 +1,9 @@
 #include <cassert>
 #include <ctime>
+#include <vector>
+#include <algorithm>
 #include <windows.h>
+#include <process.h>
 #include "../system.hpp"
 
 
@@ -10,6 +13,28 @@ namespace sphere {
         //-----------------------------------------------------------------
         // globals
         unsigned int g_TicksAtSystemInit = 0;
+        LARGE_INTEGER g_CounterFrequency;
+        LARGE_INTEGER g_CounterAtSystemInit;
+
+        // worker pool used by RunParallel
+        std::vector<HANDLE> g_Workers;
+        HANDLE g_WorkSemaphore = 0;
+        HANDLE g_WorkDone      = 0;
+        volatile LONG g_PoolBusy = 0;
+        volatile LONG g_PoolQuit = 0;
+
+        // current job
+        PARALLELFUNC_T g_JobFunc   = 0;
+        void*          g_JobData   = 0;
+        LONG           g_JobCount  = 0;
+        volatile LONG  g_JobNext   = 0;
+        volatile LONG  g_JobActive = 0;
+
+        // ticker
+        HANDLE g_Ticker     = 0;
+        HANDLE g_TickerQuit = 0;
+        int    g_TickerInterval = 0;
+        volatile int* g_TickerFlag = 0;
 
         //-----------------------------------------------------------------
         void Sleep(int ms)
@@ -17,12 +42,136 @@ namespace sphere {
             ::Sleep(ms);
         }
 
+        //-----------------------------------------------------------------
+        int GetNumProcessors()
+        {
+            SYSTEM_INFO si;
+            GetSystemInfo(&si);
+            return std::max((int)si.dwNumberOfProcessors, 1);
+        }
+
+        //-----------------------------------------------------------------
+        static void run_job()
+        {
+            LONG index;
+            while ((index = InterlockedIncrement(&g_JobNext) - 1) < g_JobCount) {
+                g_JobFunc(g_JobData, (int)index);
+            }
+            // the last participant to run out of work wakes up the caller
+            if (InterlockedDecrement(&g_JobActive) == 0) {
+                SetEvent(g_WorkDone);
+            }
+        }
+
+        //-----------------------------------------------------------------
+        static unsigned int __stdcall worker_thread(void*)
+        {
+            while (true) {
+                WaitForSingleObject(g_WorkSemaphore, INFINITE);
+                if (g_PoolQuit) {
+                    break;
+                }
+                run_job();
+            }
+            return 0;
+        }
+
+        //-----------------------------------------------------------------
+        void RunParallel(PARALLELFUNC_T func, void* data, int count)
+        {
+            assert(func);
+            if (count <= 0) {
+                return;
+            }
+            if (count == 1 || g_Workers.empty() || InterlockedCompareExchange(&g_PoolBusy, 1, 0) != 0) {
+                for (int i = 0; i < count; ++i) {
+                    func(data, i);
+                }
+                return;
+            }
+
+            // wake up only as many workers as there is work for, every
+            // woken worker must check out before the next job can start
+            int num_helpers = std::min((int)g_Workers.size(), count - 1);
+            g_JobFunc   = func;
+            g_JobData   = data;
+            g_JobCount  = count;
+            g_JobActive = num_helpers + 1;
+            InterlockedExchange(&g_JobNext, 0);
+            ReleaseSemaphore(g_WorkSemaphore, num_helpers, 0);
+
+            run_job();
+            WaitForSingleObject(g_WorkDone, INFINITE);
+
+            InterlockedExchange(&g_PoolBusy, 0);
+        }
+
+        //-----------------------------------------------------------------
+        static unsigned int __stdcall ticker_thread(void*)
+        {
+            // the wait is only as fine as the system timer
+            DWORD ms = (DWORD)std::max(g_TickerInterval / 1000, 1);
+            while (WaitForSingleObject(g_TickerQuit, ms) == WAIT_TIMEOUT) {
+                *g_TickerFlag = 1;
+            }
+            return 0;
+        }
+
+        //-----------------------------------------------------------------
+        bool StartTicker(int interval, volatile int* flag)
+        {
+            assert(flag);
+            if (g_Ticker || interval <= 0) {
+                return false;
+            }
+            g_TickerQuit = CreateEvent(0, TRUE, FALSE, 0);
+            if (!g_TickerQuit) {
+                return false;
+            }
+            g_TickerInterval = interval;
+            g_TickerFlag     = flag;
+            g_Ticker = (HANDLE)_beginthreadex(0, 0, ticker_thread, 0, 0, 0);
+            if (!g_Ticker) {
+                CloseHandle(g_TickerQuit);
+                g_TickerQuit = 0;
+                return false;
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        void StopTicker()
+        {
+            if (!g_Ticker) {
+                return;
+            }
+            SetEvent(g_TickerQuit);
+            WaitForSingleObject(g_Ticker, INFINITE);
+            CloseHandle(g_Ticker);
+            CloseHandle(g_TickerQuit);
+            g_Ticker     = 0;
+            g_TickerQuit = 0;
+        }
+
         //-----------------------------------------------------------------
         int GetTicks()
         {
             return (int)(GetTickCount() - g_TicksAtSystemInit);
         }
 
+        //-----------------------------------------------------------------
+        i64 GetMicroseconds()
+        {
+            LARGE_INTEGER counter;
+            QueryPerformanceCounter(&counter);
+            i64 elapsed = counter.QuadPart - g_CounterAtSystemInit.QuadPart;
+
+            // split to not overflow when multiplying with one million
+            i64 seconds = elapsed / g_CounterFrequency.QuadPart;
+            i64 rest    = elapsed % g_CounterFrequency.QuadPart;
+            return seconds * 1000000 + (rest * 1000000) / g_CounterFrequency.QuadPart;
+        }
+
         //-----------------------------------------------------------------
         int GetTime()
         {
@@ -58,6 +207,25 @@ namespace sphere {
             {
                 // initialize tick count
                 g_TicksAtSystemInit = GetTickCount();
+                QueryPerformanceFrequency(&g_CounterFrequency);
+                QueryPerformanceCounter(&g_CounterAtSystemInit);
+
+                // start worker pool, the calling thread is a worker too
+                int num_workers = GetNumProcessors() - 1;
+                if (num_workers > 0) {
+                    g_WorkSemaphore = CreateSemaphore(0, 0, num_workers, 0);
+                    g_WorkDone      = CreateEvent(0, FALSE, FALSE, 0);
+                    if (g_WorkSemaphore && g_WorkDone) {
+                        for (int i = 0; i < num_workers; ++i) {
+                            HANDLE worker = (HANDLE)_beginthreadex(0, 0, worker_thread, 0, 0, 0);
+                            if (!worker) {
+                                break;
+                            }
+                            g_Workers.push_back(worker);
+                        }
+                    }
+                }
+                log.info() << "Worker threads: " << (int)g_Workers.size();
 
                 return true;
             }
@@ -65,7 +233,26 @@ namespace sphere {
             //-----------------------------------------------------------------
             void DeinitSystem()
             {
-                // NO-OP
+                StopTicker();
+
+                // stop worker pool
+                if (!g_Workers.empty()) {
+                    g_PoolQuit = 1;
+                    ReleaseSemaphore(g_WorkSemaphore, (LONG)g_Workers.size(), 0);
+                    for (int i = 0; i < (int)g_Workers.size(); ++i) {
+                        WaitForSingleObject(g_Workers[i], INFINITE);
+                        CloseHandle(g_Workers[i]);
+                    }
+                    g_Workers.clear();
+                }
+                if (g_WorkSemaphore) {
+                    CloseHandle(g_WorkSemaphore);
+                    g_WorkSemaphore = 0;
+                }
+                if (g_WorkDone) {
+                    CloseHandle(g_WorkDone);
+                    g_WorkDone = 0;
+                }
             }
 
         } // namespace internal